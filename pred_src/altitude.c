@@ -13,32 +13,53 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "pred.h"
 #include "altitude.h"
+#include "atmosphere.h"
 #include "run_model.h"
 
-// get density of atmosphere at a given altitude
-// uses NASA model from http://www.grc.nasa.gov/WWW/K-12/airplane/atmosmet.html
-// units of degrees celcius, metres, KPa and Kg/metre cubed
-static float get_density(float altitude);
-
 #define G 9.8
 
+// The descent is at terminal velocity, dz/dt = -drag_coeff/sqrt(rho(z)), so
+// the time taken to fall from z0 to z1 is (S(z0) - S(z1)) / drag_coeff where
+//
+//   S(z) = \int_0^z sqrt(rho(h)) dh.
+//
+// S does not depend on the drag coefficient so a single table of it, and a
+// guide to inverting it, serves every model. See atmosphere.h.
+
+static double _descent_integral(double altitude);
+static double _descent_altitude(double integral);
+static dual_t _descent_integral_dual(dual_t altitude);
+static dual_t _descent_altitude_dual(dual_t integral);
+
+static unsigned int _profile_segment(const altitude_model_t* self, 
+                                     unsigned int segment, double time_into_flight);
+static float _profile_altitude(const altitude_model_t* self, 
+                               unsigned int segment, double time_into_flight);
+static float _before_descent_altitude(const altitude_model_t* self, 
+                                      altitude_state_t* state, double time_into_flight);
+
 struct altitude_model_s
 {
     float   burst_altitude;
     float   ascent_rate;
     float   drag_coeff;
+    float   float_time;
     int     descent_mode;
 
-    float   initial_alt;
-    int     burst_time;
+    // The profile followed before descending, NULL for the analytic ascent.
+    float  *profile_time;       // s, strictly increasing
+    float  *profile_alt;        // m
+    unsigned int profile_length;
 };
 
 altitude_model_t*
-altitude_model_new(int dec_mode, float burst_alt, float asc_rate, float drag_co) 
+altitude_model_new(int dec_mode, float burst_alt, float asc_rate, float drag_co,
+                   float float_time) 
 {
     altitude_model_t* self = (altitude_model_t*)malloc(sizeof(altitude_model_t));
 
@@ -48,9 +69,86 @@ altitude_model_new(int dec_mode, float burst_alt, float asc_rate, float drag_co)
     self->burst_altitude = burst_alt;
     self->ascent_rate = asc_rate;
     self->drag_coeff = drag_co;
+    self->float_time = float_time;
     self->descent_mode = dec_mode;
 
+    self->profile_time = NULL;
+    self->profile_alt = NULL;
+    self->profile_length = 0;
+
+    return self;
+}
+
+altitude_model_t*
+altitude_model_new_from_file(const char* filename, float drag_co)
+{
+    altitude_model_t* self;
+    FILE* file;
+    char line[256];
+    unsigned int line_number = 0, capacity = 64;
+
+    file = fopen(filename, "r");
+    if(!file) {
+        fprintf(stderr, "ERROR: %s: could not open altitude profile.\n", filename);
+        return NULL;
+    }
+
+    self = altitude_model_new(DESCENT_MODE_NORMAL, 0.f, 0.f, drag_co, 0.f);
+    self->profile_time = (float*)malloc(sizeof(float) * capacity);
+    self->profile_alt = (float*)malloc(sizeof(float) * capacity);
+
+    while(fgets(line, sizeof(line), file)) {
+        char *record = line, *endptr;
+        float time, alt = 0.f;
+
+        ++line_number;
+
+        record += strspn(record, " \t");
+        if((*record == '#') || (*record == '\0') || (*record == '\n') || (*record == '\r'))
+            continue;
+
+        time = strtod(record, &endptr);
+        if(endptr != record) {
+            record = endptr + strspn(endptr, " \t,");
+            alt = strtod(record, &endptr);
+        }
+        if(endptr == record) {
+            fprintf(stderr, "ERROR: %s:%u: expected 'time, altitude'.\n", 
+                    filename, line_number);
+            goto fail;
+        }
+
+        if((self->profile_length > 0) && 
+           (time <= self->profile_time[self->profile_length-1])) {
+            fprintf(stderr, "ERROR: %s:%u: times must be increasing.\n", 
+                    filename, line_number);
+            goto fail;
+        }
+
+        if(self->profile_length == capacity) {
+            capacity *= 2;
+            self->profile_time = (float*)realloc(self->profile_time, sizeof(float) * capacity);
+            self->profile_alt = (float*)realloc(self->profile_alt, sizeof(float) * capacity);
+        }
+
+        self->profile_time[self->profile_length] = time;
+        self->profile_alt[self->profile_length] = alt;
+        ++self->profile_length;
+    }
+
+    if(self->profile_length < 2) {
+        fprintf(stderr, "ERROR: %s: an altitude profile needs at least two points.\n",
+                filename);
+        goto fail;
+    }
+
+    fclose(file);
     return self;
+
+fail:
+    fclose(file);
+    altitude_model_free(self);
+    return NULL;
 }
 
 void
@@ -59,68 +157,447 @@ altitude_model_free(altitude_model_t* self)
     if(!self)
         return;
 
+    free(self->profile_time);
+    free(self->profile_alt);
     free(self);
 }
 
-int 
-altitude_model_get_altitude(altitude_model_t* self, int time_into_flight, float* alt) {
-    // TODO: this section needs some work to make it more flexible
-    
-    // time == 0 so setup initial altitude stuff
-    if (time_into_flight == 0) {
-        self->initial_alt = *alt;
-        self->burst_time = (self->burst_altitude - self->initial_alt) / self->ascent_rate;
+void
+altitude_model_get_params(const altitude_model_t* self, altitude_params_t* params)
+{
+    params->burst_altitude = self->burst_altitude;
+    params->ascent_rate = self->ascent_rate;
+    params->drag_coeff = self->drag_coeff;
+    params->float_time = self->float_time;
+    params->launch_time = 0.f;
+}
+
+void
+altitude_model_start(const altitude_model_t* self, altitude_state_t* state,
+                     float initial_alt, const altitude_params_t* params)
+{
+    altitude_params_t model_params;
+    float descent_start_alt = initial_alt;
+
+    if (!params) {
+        altitude_model_get_params(self, &model_params);
+        params = &model_params;
     }
-    
-    // If we are not doing a descending mode sim then start going up
-    // at out ascent rate. The ascent rate is constant to a good approximation.
-    if (self->descent_mode == DESCENT_MODE_NORMAL) 
-        if (time_into_flight <= self->burst_time) {
-            *alt = self->initial_alt + time_into_flight*self->ascent_rate;
-            return 1;
-        }
-    
+
+    state->ascent_rate = params->ascent_rate;
+    state->drag_coeff = params->drag_coeff;
+    state->profile_segment = 0;
+    state->launch_time = 0;
+
+    // A profile is followed from launch and the descent starts from its end.
+    if (self->profile_length) {
+        state->initial_alt = 0.f;
+        state->burst_time = -1;
+        state->descent_start_time = self->profile_time[self->profile_length-1];
+        state->descent_start_integral = 
+            _descent_integral(self->profile_alt[self->profile_length-1]);
+        return;
+    }
+
+    state->initial_alt = initial_alt;
+
+    state->descent_start_time = 0.0;
+    if (self->descent_mode == DESCENT_MODE_NORMAL) {
+        state->launch_time = (int)floor(params->launch_time + 0.5);
+        state->burst_time = state->launch_time + 
+            (int)((params->burst_altitude - initial_alt) / params->ascent_rate);
+        state->descent_start_time = state->burst_time + params->float_time;
+        descent_start_alt = initial_alt + 
+            (state->burst_time - state->launch_time)*params->ascent_rate;
+    } else {
+        state->burst_time = -1;
+    }
+    state->descent_start_integral = _descent_integral(descent_start_alt);
+}
+
+double
+altitude_model_get_launch_time(const altitude_model_t* self, 
+                               const altitude_state_t* state)
+{
+    return state->launch_time;
+}
+
+double
+altitude_model_get_burst_time(const altitude_model_t* self, 
+                              const altitude_state_t* state)
+{
+    if (self->profile_length)
+        return state->descent_start_time;
+
+    return state->burst_time;
+}
+
+double
+altitude_model_get_descent_time(const altitude_model_t* self,
+                                const altitude_state_t* state)
+{
+    return state->descent_start_time;
+}
+
+double
+altitude_model_get_landing_time(const altitude_model_t* self,
+                                const altitude_state_t* state)
+{
+    return state->descent_start_time + 
+        state->descent_start_integral / state->drag_coeff;
+}
+
+int
+altitude_model_get_altitude(const altitude_model_t* self, 
+                            altitude_state_t* state,
+                            double time_into_flight, float* alt)
+{
+    double integral;
+
+    // The ascent rate is constant to a good approximation.
+    if (time_into_flight <= state->burst_time) {
+        if (time_into_flight < state->launch_time)
+            time_into_flight = state->launch_time;
+        *alt = state->initial_alt + 
+            (time_into_flight - state->launch_time)*state->ascent_rate;
+        return 1;
+    }
+
     // Descent - just assume its at terminal velocity (which varies with altitude)
     // this is a pretty darn good approximation for high-ish drag e.g. under parachute
     // still converges to T.V. quickly (i.e. less than a minute) for low drag.
-    // terminal velocity = -drag_coeff/sqrt(get_density(*alt));
-    *alt += TIMESTEP * -self->drag_coeff/sqrt(get_density(*alt));
-    
-    /*
-    // Rob's method - is this just freefall until we reach terminal velocity?
-	vertical_speed = -drag_coeff/sqrt(get_density(*alt));
-	// TODO: inaccurate if still accelerating
-	if (vertical_speed < previous_vertical_speed - G*TIMESTEP)    // still accelerating
-		vertical_speed = previous_vertical_speed - G*TIMESTEP;
-	if(vertical_speed > previous_vertical_speed + G*TIMESTEP)     // still accelerating
-		vertical_speed = previous_vertical_speed + G*TIMESTEP;
-	previous_vertical_speed = vertical_speed;
-	*alt += TIMESTEP * vertical_speed;
-	*/
-    
-    if (*alt <= 0)
+    if (time_into_flight >= altitude_model_get_landing_time(self, state)) {
+        *alt = 0.f;
         return 0;
+    }
+
+    if (time_into_flight < state->descent_start_time) {
+        *alt = _before_descent_altitude(self, state, time_into_flight);
+        return 1;
+    }
+
+    integral = state->descent_start_integral - 
+        state->drag_coeff * (time_into_flight - state->descent_start_time);
+
+    *alt = _descent_altitude(integral);
 
     return 1;
-    
 }
 
-float get_density(float altitude) {
-    
-    float temp = 0.f, pressure = 0.f;
-    
-    if (altitude > 25000) {
-        temp = -131.21 + 0.00299 * altitude;
-        pressure = 2.488*pow((temp+273.1)/216.6,-11.388);
+void
+altitude_model_advance(const altitude_model_t* self, unsigned int n,
+                       altitude_state_t* const* states,
+                       double time_into_flight, float* alt, int* flying)
+{
+    double integral[ALTITUDE_BATCH_SIZE];
+    unsigned int descending[ALTITUDE_BATCH_SIZE];
+    unsigned int before_descent[ALTITUDE_BATCH_SIZE];
+    unsigned int i, first, n_descending, n_before_descent;
+
+    for (first=0; first<n; first+=ALTITUDE_BATCH_SIZE) {
+        unsigned int last = first + ALTITUDE_BATCH_SIZE;
+
+        if (last > n)
+            last = n;
+
+        // The ascent and the descent's integral are simple arithmetic for
+        // every particle so do them all together...
+        n_descending = n_before_descent = 0;
+        for (i=first; i<last; ++i) {
+            const altitude_state_t* state = states[i];
+            double landing_time = state->descent_start_time + 
+                state->descent_start_integral / state->drag_coeff;
+
+            alt[i] = state->initial_alt + 
+                (time_into_flight - state->launch_time)*state->ascent_rate;
+            flying[i] = 1;
+
+            if (time_into_flight <= state->burst_time) {
+                if (time_into_flight < state->launch_time)
+                    alt[i] = state->initial_alt;
+                continue;
+            }
+
+            if (time_into_flight >= landing_time) {
+                alt[i] = 0.f;
+                flying[i] = 0;
+                continue;
+            }
+
+            if (time_into_flight < state->descent_start_time) {
+                before_descent[n_before_descent++] = i;
+                continue;
+            }
+
+            integral[n_descending] = state->descent_start_integral - 
+                state->drag_coeff * (time_into_flight - state->descent_start_time);
+            descending[n_descending++] = i;
+        }
+
+        // ...and then look up the altitude of those which are descending.
+        for (i=0; i<n_descending; ++i)
+            alt[descending[i]] = _descent_altitude(integral[i]);
+
+        // Those floating or following a profile are never ascending too so
+        // this costs the analytic ascent nothing.
+        for (i=0; i<n_before_descent; ++i) {
+            alt[before_descent[i]] = _before_descent_altitude(self, 
+                    states[before_descent[i]], time_into_flight);
+        }
     }
-    if (altitude <=25000 && altitude > 11000) {
-        temp = -56.46;
-        pressure = 22.65 * exp(1.73-0.000157*altitude);
+}
+
+float
+altitude_model_get_vertical_speed(const altitude_model_t* self, 
+                                  const altitude_state_t* state,
+                                  double time_into_flight, float alt)
+{
+    if (time_into_flight < state->launch_time)
+        return 0.f;
+
+    if (time_into_flight < state->burst_time)
+        return state->ascent_rate;
+
+    if (time_into_flight < state->descent_start_time) {
+        unsigned int i;
+
+        if (!self->profile_length)
+            return 0.f;
+
+        i = _profile_segment(self, state->profile_segment, time_into_flight);
+
+        return (self->profile_alt[i+1] - self->profile_alt[i]) / 
+            (self->profile_time[i+1] - self->profile_time[i]);
     }
-    if (altitude <=11000) {
-        temp = 15.04 - 0.00649 * altitude;
-        pressure = 101.29 * pow((temp + 273.1)/288.08,5.256);
+
+    // terminal velocity, see altitude_model_get_altitude()
+    return -state->drag_coeff/sqrt(atmosphere_get_density(alt));
+}
+
+// Where a particle started as for altitude_model_get_altitude_dual() starts
+// to descend: the end of its ascent, negative if it does not ascend at a
+// constant rate, the start of its descent, the altitude it descends from and
+// S() of that altitude. As in altitude_model_start().
+typedef struct descent_start_s descent_start_t;
+struct descent_start_s
+{
+    double  launch_time;
+    dual_t  burst_time;
+    dual_t  descent_time;
+    dual_t  alt;
+    dual_t  integral;
+};
+
+static void
+_descent_start_dual(const altitude_model_t* self, const altitude_dual_params_t* params,
+                    float initial_alt, descent_start_t* start)
+{
+    start->launch_time = 0.0;
+    start->burst_time = dual_constant(-1.0);
+
+    if (self->profile_length) {
+        start->descent_time = dual_constant(self->profile_time[self->profile_length-1]);
+        start->alt = dual_constant(self->profile_alt[self->profile_length-1]);
+    } else if (self->descent_mode == DESCENT_MODE_NORMAL) {
+        start->launch_time = floor(params->launch_time + 0.5);
+
+        // The ascent is cut short to a whole number of seconds, which is
+        // piecewise constant, so only its value is truncated.
+        start->burst_time = dual_offset(dual_div(dual_offset(params->burst_altitude, 
+                        -initial_alt), params->ascent_rate), start->launch_time);
+        start->burst_time.x = start->launch_time + 
+            (int)(((float)params->burst_altitude.x - initial_alt) / 
+                  (float)params->ascent_rate.x);
+
+        start->descent_time = dual_offset(start->burst_time, params->float_time);
+        start->alt = dual_offset(dual_mul(dual_offset(start->burst_time, 
+                        -start->launch_time), params->ascent_rate), initial_alt);
+    } else {
+        start->descent_time = dual_constant(0.0);
+        start->alt = dual_constant(initial_alt);
     }
-    
-    return pressure/(0.2869*(temp+273.1));
+
+    start->integral = _descent_integral_dual(start->alt);
+}
+
+int
+altitude_model_get_altitude_dual(const altitude_model_t* self, 
+                                 const altitude_dual_params_t* params,
+                                 float initial_alt, double time_into_flight, 
+                                 dual_t* alt)
+{
+    descent_start_t start;
+    dual_t integral;
+
+    _descent_start_dual(self, params, initial_alt, &start);
+
+    if (time_into_flight <= start.burst_time.x) {
+        if (time_into_flight < start.launch_time)
+            time_into_flight = start.launch_time;
+        *alt = dual_offset(dual_scale(params->ascent_rate, 
+                    time_into_flight - start.launch_time), initial_alt);
+        return 1;
+    }
+
+    if (time_into_flight >= altitude_model_get_landing_time_dual(self, params, 
+                initial_alt).x) {
+        *alt = dual_constant(0.0);
+        return 0;
+    }
+
+    if (time_into_flight < start.descent_time.x) {
+        if (self->profile_length)
+            *alt = dual_constant(_profile_altitude(self, 
+                        _profile_segment(self, 0, time_into_flight), time_into_flight));
+        else
+            *alt = start.alt;
+        return 1;
+    }
+
+    integral = dual_sub(start.integral, dual_mul(params->drag_coeff, 
+                dual_sub(dual_constant(time_into_flight), start.descent_time)));
+
+    *alt = _descent_altitude_dual(integral);
+
+    return 1;
+}
+
+dual_t
+altitude_model_get_landing_time_dual(const altitude_model_t* self,
+                                     const altitude_dual_params_t* params,
+                                     float initial_alt)
+{
+    descent_start_t start;
+
+    _descent_start_dual(self, params, initial_alt, &start);
+
+    return dual_add(start.descent_time, dual_div(start.integral, params->drag_coeff));
+}
+
+// The interval of the table in which S(altitude) is interpolated.
+static unsigned int
+_descent_integral_interval(double altitude)
+{
+    double idx = altitude / ATMOSPHERE_TABLE_STEP;
+
+    if (idx <= 0.0)
+        return 0;
+    else if (idx >= ATMOSPHERE_TABLE_SIZE-2)
+        return ATMOSPHERE_TABLE_SIZE-2;
+    return (unsigned int) idx;
+}
+
+// S(altitude), interpolated from the table.
+static double
+_descent_integral(double altitude)
+{
+    const double* table = atmosphere_sqrt_density_integral_table;
+    double idx = altitude / ATMOSPHERE_TABLE_STEP;
+    unsigned int i = _descent_integral_interval(altitude);
+
+    return table[i] + (idx - i) * (table[i+1] - table[i]);
+}
+
+// The interval of the table in which S() is integral.
+static unsigned int
+_descent_altitude_interval(double integral)
+{
+    const double* table = atmosphere_sqrt_density_integral_table;
+    double g = integral * atmosphere_sqrt_density_integral_guide_scale;
+    unsigned int i;
+
+    if (g <= 0.0)
+        i = 0;
+    else if (g >= ATMOSPHERE_GUIDE_SIZE)
+        i = ATMOSPHERE_TABLE_SIZE-2;
+    else
+        i = atmosphere_sqrt_density_integral_guide[(unsigned int) g];
+
+    while ((i < ATMOSPHERE_TABLE_SIZE-2) && (table[i+1] < integral))
+        ++i;
+
+    return i;
+}
+
+// The altitude at which S() is integral. This is the exact inverse of
+// _descent_integral().
+static double
+_descent_altitude(double integral)
+{
+    const double* table = atmosphere_sqrt_density_integral_table;
+    unsigned int i = _descent_altitude_interval(integral);
+
+    return ATMOSPHERE_TABLE_STEP * (i + (integral - table[i]) / 
+            (table[i+1] - table[i]));
+}
+
+// _descent_integral() and _descent_altitude() of dual numbers. Both are
+// linear within each interval of the table.
+static dual_t
+_descent_integral_dual(dual_t altitude)
+{
+    const double* table = atmosphere_sqrt_density_integral_table;
+    unsigned int i = _descent_integral_interval(altitude.x);
+
+    return dual_chain(altitude, _descent_integral(altitude.x),
+                      (table[i+1] - table[i]) / ATMOSPHERE_TABLE_STEP);
+}
+
+static dual_t
+_descent_altitude_dual(dual_t integral)
+{
+    const double* table = atmosphere_sqrt_density_integral_table;
+    unsigned int i = _descent_altitude_interval(integral.x);
+
+    return dual_chain(integral, _descent_altitude(integral.x),
+                      ATMOSPHERE_TABLE_STEP / (table[i+1] - table[i]));
+}
+
+// The altitude of a particle between the end of its ascent and the start of
+// its descent. It is either floating at its burst altitude or following the
+// profile. Successive times are usually close together so the search of the
+// profile starts from the segment we were last in.
+static float
+_before_descent_altitude(const altitude_model_t* self, altitude_state_t* state,
+                         double time_into_flight)
+{
+    if (!self->profile_length)
+        return state->initial_alt + 
+            (state->burst_time - state->launch_time)*state->ascent_rate;
+
+    state->profile_segment = _profile_segment(self, state->profile_segment, 
+                                              time_into_flight);
+    return _profile_altitude(self, state->profile_segment, time_into_flight);
+}
+
+// The segment of the profile, [time[i], time[i+1]), containing
+// time_into_flight, searching from segment. Times before the profile starts
+// are in the first segment.
+static unsigned int
+_profile_segment(const altitude_model_t* self, unsigned int segment, 
+                 double time_into_flight)
+{
+    const float* time = self->profile_time;
+
+    while ((segment+2 < self->profile_length) && (time[segment+1] <= time_into_flight))
+        ++segment;
+    while ((segment > 0) && (time[segment] > time_into_flight))
+        --segment;
+
+    return segment;
+}
+
+// The altitude of the profile at time_into_flight within segment.
+static float
+_profile_altitude(const altitude_model_t* self, unsigned int segment,
+                  double time_into_flight)
+{
+    const float* time = self->profile_time;
+    const float* alt = self->profile_alt;
+    double frac = (time_into_flight - time[segment]) / (time[segment+1] - time[segment]);
+
+    if (frac < 0.0)
+        frac = 0.0;
+
+    return alt[segment] + frac * (alt[segment+1] - alt[segment]);
 }
@@ -14,33 +14,171 @@
 #ifndef __ALTITUDE_H__
 #define __ALTITUDE_H__
 
+#include "util/dual.h"
+
+// The parameters of an altitude model. These never change once the model is
+// created so a single model may be shared by any number of particles on any
+// number of threads.
 typedef struct altitude_model_s altitude_model_t;
 
+// The flight parameters which may differ from particle to particle.
+typedef struct altitude_params_s altitude_params_t;
+struct altitude_params_s
+{
+    float   burst_altitude;     // m
+    float   ascent_rate;        // m/s
+    float   drag_coeff;
+    float   float_time;         // s
+    float   launch_time;        // s after the start of the run
+};
+
+// The flight parameters with the burst altitude, ascent rate and drag
+// coefficient as dual numbers, for differentiating a flight with respect to
+// them. See util/dual.h.
+typedef struct altitude_dual_params_s altitude_dual_params_t;
+struct altitude_dual_params_s
+{
+    dual_t  burst_altitude;     // m
+    dual_t  ascent_rate;        // m/s
+    dual_t  drag_coeff;
+    float   float_time;         // s
+    float   launch_time;        // s after the start of the run
+};
+
+// Where a single particle is in its flight. Each particle following a model
+// has one of these. The fields are private, initialise it with
+// altitude_model_start().
+typedef struct altitude_state_s altitude_state_t;
+struct altitude_state_s
+{
+    float   ascent_rate;
+    float   drag_coeff;
+    float   initial_alt;
+    int     launch_time;
+    int     burst_time;
+
+    double  descent_start_time;
+    double  descent_start_integral;
+
+    unsigned int profile_segment;
+};
+
+// The number of particles altitude_model_advance() works on at once.
+#define ALTITUDE_BATCH_SIZE 16
+
 // create an altitude/time model with given parameters, must be called before
 // calling run_model if descent_mode is DESCENT_MODE_DESCENDING then we start
-// off with the balloon descending i.e. after burst
+// off with the balloon descending i.e. after burst. Otherwise the balloon
+// floats at burst_alt for float_time seconds before it starts to descend.
 altitude_model_t    *altitude_model_new    (int                 descent_mode, 
                                             float               burst_alt, 
                                             float               ascent_rate,
+                                            float               drag_coeff,
+                                            float               float_time);
+
+// create an altitude model which follows the time/altitude profile in the
+// file filename and then descends from where the profile ends. Each line of
+// the file is a time into the flight (in seconds) and an altitude (in metres)
+// separated by a comma. Times must be increasing and lines starting with '#'
+// are ignored. The profile may describe a measured ascent, a float or a whole
+// flight. If it ends at zero altitude there is no descent. Only the drag
+// coefficient of any per-particle parameters is used. Returns NULL on failure.
+altitude_model_t    *altitude_model_new_from_file
+                                           (const char         *filename,
                                             float               drag_coeff);
 
 // free resources associated with the specified altitude model.
 void                 altitude_model_free   (altitude_model_t   *model);
 
+// fill params with the flight parameters the model was created with.
+void                 altitude_model_get_params
+                                           (const altitude_model_t *model,
+                                            altitude_params_t  *params);
+
+// start a particle's flight from initial_alt with the given parameters or, if
+// params is NULL, those of the model. initial_alt is ignored when following a profile.
+// The particle waits at initial_alt until the launch time, rounded to a whole
+// second, before ascending. The launch time is ignored when following a
+// profile or starting off descending.
+void                 altitude_model_start  (const altitude_model_t *model,
+                                            altitude_state_t   *state,
+                                            float               initial_alt,
+                                            const altitude_params_t *params);
+
 // returns the altitude corresponding to a certain time into the flight (in seconds)
-// the result it stored in the alt variable.
-// the contents of alt when the function is called with time_into_flight = 0
-// will be taken as the starting altitude returns 1 normally and 0 when the
-// flight has terminated
+// the result it stored in the alt variable. returns 1 normally and 0 when the
+// flight has terminated, in which case alt is set to zero. The time need not
+// be a whole number of seconds and the altitude may be found at any time in
+// any order. The descent is looked up in a table of the time taken to fall to
+// each altitude rather than stepped.
 int                  altitude_model_get_altitude
-                                           (altitude_model_t   *model,
-                                            int                 time_into_flight, 
+                                           (const altitude_model_t *model,
+                                            altitude_state_t   *state,
+                                            double              time_into_flight,
                                             float              *alt);
 
+// as altitude_model_get_altitude() for n particles at the same time into the
+// flight. The altitude of the i-th particle is stored in alt[i] and flying[i]
+// is set to the return value.
+void                 altitude_model_advance(const altitude_model_t *model,
+                                            unsigned int        n,
+                                            altitude_state_t   *const *states,
+                                            double              time_into_flight,
+                                            float              *alt,
+                                            int                *flying);
+
+// returns the time into the flight (in seconds) at which the particle lands.
+double               altitude_model_get_landing_time
+                                           (const altitude_model_t *model,
+                                            const altitude_state_t *state);
+
+// returns the time into the flight (in seconds) at which the particle is
+// launched. It is on the ground, and should not move, until then.
+double               altitude_model_get_launch_time
+                                           (const altitude_model_t *model,
+                                            const altitude_state_t *state);
+
+// returns the time into the flight (in seconds) at which the particle's ascent
+// or profile ends or a negative value if the flight starts off descending.
+double               altitude_model_get_burst_time
+                                           (const altitude_model_t *model,
+                                            const altitude_state_t *state);
+
+// returns the time into the flight (in seconds) at which the particle starts
+// to descend. This is the burst time plus any float.
+double               altitude_model_get_descent_time
+                                           (const altitude_model_t *model,
+                                            const altitude_state_t *state);
+
+// returns the rate of climb (in m/s, negative when descending) at a certain
+// time into the flight (in seconds) when at altitude alt. The balloon is
+// ascending before the burst time and descending from it onwards. This is
+// evaluated from the atmospheric density rather than from the descent tables
+// used by altitude_model_get_altitude().
+float                altitude_model_get_vertical_speed
+                                           (const altitude_model_t *model,
+                                            const altitude_state_t *state,
+                                            double              time_into_flight,
+                                            float               alt);
 
+// as altitude_model_get_altitude() for a particle started from initial_alt
+// with the parameters params. The altitude is differentiated with respect to
+// whatever the parameters are. The ascent lasts a whole number of seconds, as
+// for altitude_model_get_altitude(), but its derivatives are those of the
+// exact duration so that they are not zero almost everywhere.
+int                  altitude_model_get_altitude_dual
+                                           (const altitude_model_t *model,
+                                            const altitude_dual_params_t *params,
+                                            float               initial_alt,
+                                            double              time_into_flight,
+                                            dual_t             *alt);
 
-// it seems like overkill to do it this way but it is in preparation for being able to load in
-// arbitrary altitude/time profiles from a file
+// as altitude_model_get_landing_time() for a particle started as for
+// altitude_model_get_altitude_dual().
+dual_t               altitude_model_get_landing_time_dual
+                                           (const altitude_model_t *model,
+                                            const altitude_dual_params_t *params,
+                                            float               initial_alt);
 
 #define DESCENT_MODE_DESCENDING 1
 #define DESCENT_MODE_NORMAL 0
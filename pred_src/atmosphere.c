@@ -0,0 +1,36 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// Written by Rob Anderson 
+// Modified by Fergus Noble
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY 
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+#include <math.h>
+
+#include "atmosphere.h"
+
+float atmosphere_get_density_exact(float altitude) {
+    
+    float temp = 0.f, pressure = 0.f;
+    
+    if (altitude > 25000) {
+        temp = -131.21 + 0.00299 * altitude;
+        pressure = 2.488*pow((temp+273.1)/216.6,-11.388);
+    }
+    if (altitude <=25000 && altitude > 11000) {
+        temp = -56.46;
+        pressure = 22.65 * exp(1.73-0.000157*altitude);
+    }
+    if (altitude <=11000) {
+        temp = 15.04 - 0.00649 * altitude;
+        pressure = 101.29 * pow((temp + 273.1)/288.08,5.256);
+    }
+    
+    return pressure/(0.2869*(temp+273.1));
+}
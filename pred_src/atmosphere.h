@@ -0,0 +1,61 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// Written by Rob Anderson 
+// Modified by Fergus Noble
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY 
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+#ifndef __ATMOSPHERE_H__
+#define __ATMOSPHERE_H__
+
+// get density of atmosphere at a given altitude
+// uses NASA model from http://www.grc.nasa.gov/WWW/K-12/airplane/atmosmet.html
+// units of degrees celcius, metres, KPa and Kg/metre cubed
+float                atmosphere_get_density_exact
+                                           (float               altitude);
+
+// as atmosphere_get_density_exact() but interpolated from a table which is
+// generated when the predictor is built. The relative error is less than
+// 1e-5 from 0 to ATMOSPHERE_TABLE_TOP metres. Outside that the table is
+// extrapolated linearly.
+float                atmosphere_get_density(float               altitude);
+
+// as atmosphere_get_density() for n altitudes at once. The loop has no
+// branches so that the compiler can vectorise it.
+void                 atmosphere_get_density_batch
+                                           (unsigned int        n,
+                                            const float        *altitude,
+                                            float              *density);
+
+// The tables are sampled every ATMOSPHERE_TABLE_STEP metres from sea level.
+// They are exposed so that hand vectorised code can gather from them.
+#define ATMOSPHERE_TABLE_STEP 20.0
+#define ATMOSPHERE_TABLE_SIZE 4001
+#define ATMOSPHERE_TABLE_TOP ((ATMOSPHERE_TABLE_SIZE-1) * ATMOSPHERE_TABLE_STEP)
+
+// atmosphere_density_table[i] is the density at the start and end of the
+// interval (i, i+1] * ATMOSPHERE_TABLE_STEP. The model is discontinuous at
+// some interval boundaries so the start is the limit from above.
+extern const float   atmosphere_density_table[ATMOSPHERE_TABLE_SIZE-1][2];
+
+// atmosphere_sqrt_density_integral_table[i] is the integral of the square
+// root of the density from sea level to i * ATMOSPHERE_TABLE_STEP. This gives
+// the time taken to fall at terminal velocity.
+extern const double  atmosphere_sqrt_density_integral_table[ATMOSPHERE_TABLE_SIZE];
+
+// A guide to inverting atmosphere_sqrt_density_integral_table. For an
+// integral S, the interval of the table which contains it is no earlier than
+// atmosphere_sqrt_density_integral_guide[(int)(S * scale)] where scale is
+// atmosphere_sqrt_density_integral_guide_scale.
+#define ATMOSPHERE_GUIDE_SIZE 1024
+extern const double  atmosphere_sqrt_density_integral_guide_scale;
+extern const unsigned int
+                     atmosphere_sqrt_density_integral_guide[ATMOSPHERE_GUIDE_SIZE+1];
+
+#endif // __ATMOSPHERE_H__
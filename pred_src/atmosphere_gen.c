@@ -0,0 +1,106 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// Written by Rob Anderson 
+// Modified by Fergus Noble
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY 
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+// Generate the tables used by atmosphere_lookup.c and altitude.c from the
+// NASA atmosphere model. This is run when the predictor is built.
+//
+// Usage: atmosphere_gen <output file>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "atmosphere.h"
+
+static double _density_start[ATMOSPHERE_TABLE_SIZE-1];
+static double _density_end[ATMOSPHERE_TABLE_SIZE-1];
+static double _integral[ATMOSPHERE_TABLE_SIZE];
+static unsigned int _guide[ATMOSPHERE_GUIDE_SIZE+1];
+
+int main(int argc, const char *argv[]) {
+    FILE* output;
+    double guide_scale;
+    unsigned int i, j;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <output file>\n", argv[0]);
+        return 1;
+    }
+
+    // The model is discontinuous where it changes layer so sample the start
+    // of each interval just above it. The layer boundaries lie on the table's
+    // grid so each interval is then within a single layer.
+    for (i=0; i<ATMOSPHERE_TABLE_SIZE-1; ++i) {
+        float z0 = i * ATMOSPHERE_TABLE_STEP;
+        float z1 = (i+1) * ATMOSPHERE_TABLE_STEP;
+
+        _density_start[i] = atmosphere_get_density_exact(nextafterf(z0, z1));
+        _density_end[i] = atmosphere_get_density_exact(z1);
+    }
+
+    // Integrate the square root of the density over each interval with
+    // Simpson's rule.
+    _integral[0] = 0.0;
+    for (i=1; i<ATMOSPHERE_TABLE_SIZE; ++i) {
+        double z_mid = (i - 0.5) * ATMOSPHERE_TABLE_STEP;
+
+        _integral[i] = _integral[i-1] + (ATMOSPHERE_TABLE_STEP / 6.0) * 
+            (sqrt(_density_start[i-1]) + 
+             4.0*sqrt(atmosphere_get_density_exact(z_mid)) + 
+             sqrt(_density_end[i-1]));
+    }
+
+    // For each guide entry, the last interval which starts at or before it.
+    guide_scale = ATMOSPHERE_GUIDE_SIZE / _integral[ATMOSPHERE_TABLE_SIZE-1];
+    for (i=0, j=0; i<=ATMOSPHERE_GUIDE_SIZE; ++i) {
+        double integral = i / guide_scale;
+
+        while ((j < ATMOSPHERE_TABLE_SIZE-2) && (_integral[j+1] <= integral))
+            ++j;
+        _guide[i] = j;
+    }
+
+    output = fopen(argv[1], "w");
+    if (!output) {
+        fprintf(stderr, "ERROR: %s: could not open output file\n", argv[1]);
+        return 1;
+    }
+
+    fprintf(output, "// Generated by atmosphere_gen, do not edit.\n\n");
+    fprintf(output, "#include \"atmosphere.h\"\n\n");
+
+    fprintf(output, "const float atmosphere_density_table[ATMOSPHERE_TABLE_SIZE-1][2] = {\n");
+    for (i=0; i<ATMOSPHERE_TABLE_SIZE-1; ++i)
+        fprintf(output, "    { %.9ef, %.9ef },\n", _density_start[i], _density_end[i]);
+    fprintf(output, "};\n\n");
+
+    fprintf(output, "const double atmosphere_sqrt_density_integral_table[ATMOSPHERE_TABLE_SIZE] = {\n");
+    for (i=0; i<ATMOSPHERE_TABLE_SIZE; ++i)
+        fprintf(output, "    %.17e,\n", _integral[i]);
+    fprintf(output, "};\n\n");
+
+    fprintf(output, "const double atmosphere_sqrt_density_integral_guide_scale = %.17e;\n\n",
+            guide_scale);
+
+    fprintf(output, "const unsigned int atmosphere_sqrt_density_integral_guide[ATMOSPHERE_GUIDE_SIZE+1] = {\n");
+    for (i=0; i<=ATMOSPHERE_GUIDE_SIZE; ++i)
+        fprintf(output, "    %u,\n", _guide[i]);
+    fprintf(output, "};\n");
+
+    if (ferror(output) || fclose(output)) {
+        fprintf(stderr, "ERROR: %s: error writing output file\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// Written by Rob Anderson 
+// Modified by Fergus Noble
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY 
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+#include <math.h>
+
+#include "atmosphere.h"
+
+// Linearly interpolate the density table. Altitudes on the grid belong to
+// the interval below, as in the model. The interval is clamped to the first
+// or last rather than branching so that this vectorises.
+static inline float
+_lookup_density(float altitude)
+{
+    float idx = altitude * (float)(1.0 / ATMOSPHERE_TABLE_STEP);
+    float clamped = ceilf(idx) - 1.f;
+    int i;
+
+    if (clamped < 0.f)
+        clamped = 0.f;
+    if (clamped > ATMOSPHERE_TABLE_SIZE-2)
+        clamped = ATMOSPHERE_TABLE_SIZE-2;
+    i = (int) clamped;
+
+    return atmosphere_density_table[i][0] + (idx - i) * 
+        (atmosphere_density_table[i][1] - atmosphere_density_table[i][0]);
+}
+
+float atmosphere_get_density(float altitude) {
+    return _lookup_density(altitude);
+}
+
+void atmosphere_get_density_batch(unsigned int n, const float* altitude, float* density) {
+    unsigned int i;
+
+    for (i=0; i<n; ++i)
+        density[i] = _lookup_density(altitude[i]);
+}
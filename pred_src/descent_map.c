@@ -0,0 +1,390 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+#include "descent_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <glib.h>
+
+#include "altitude.h"
+
+extern int verbosity;
+
+struct descent_map_s
+{
+    descent_map_header_t header;
+    float          *altitudes;      // m
+    float          *cells;          // n_times slices of n_altitudes rasters
+};
+
+int
+descent_map_build(wind_file_cache_t* cache, const site_grid_t* grid,
+                  const float* altitudes, unsigned int n_altitudes,
+                  long int first_timestamp, long int interval, unsigned int n_times,
+                  float drag_coeff, float rmswinderror, 
+                  const run_model_config_t* config, const char* filename)
+{
+    descent_map_header_t header;
+    unsigned int i, j, k, n_sites = site_grid_get_n_sites(grid);
+    altitude_params_t* params;
+    run_model_landing_t* landings;
+    float* sites;
+    FILE* file;
+    int ok;
+
+    file = fopen(filename, "wb");
+    if(!file) {
+        fprintf(stderr, "ERROR: %s: could not open descent map for output\n", filename);
+        return 0;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DESCENT_MAP_MAGIC, sizeof(header.magic));
+    header.version = DESCENT_MAP_VERSION;
+    header.n_lat = grid->n_lat;
+    header.n_lng = grid->n_lng;
+    header.n_values = DESCENT_MAP_VALUES;
+    header.n_altitudes = n_altitudes;
+    header.n_times = n_times;
+    header.south = grid->south;
+    header.west = grid->west;
+    header.dlat = grid->dlat;
+    header.dlng = grid->dlng;
+    header.first_timestamp = first_timestamp;
+    header.interval = interval;
+    header.drag_coeff = drag_coeff;
+    header.wind_key = wind_file_cache_get_key(cache);
+
+    ok = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+        (fwrite(altitudes, sizeof(float), n_altitudes, file) == n_altitudes);
+
+    params = (altitude_params_t*)malloc(sizeof(altitude_params_t) * n_sites);
+    landings = (run_model_landing_t*)malloc(sizeof(run_model_landing_t) * n_sites);
+    sites = (float*)malloc(sizeof(float) * 2 * n_sites);
+    for(i=0; i<n_sites; ++i)
+        site_grid_get_site(grid, i, &sites[2*i], &sites[2*i+1]);
+
+    // Each slice of the map is a site grid whose flights start at burst.
+    for(k=0; ok && (k<n_times); ++k)
+    {
+        long int timestamp = first_timestamp + k * interval;
+
+        // The slices are in time order so no later one needs wind data
+        // superseded by this one's time.
+        wind_file_cache_release_before(cache, timestamp);
+
+        for(j=0; ok && (j<n_altitudes); ++j)
+        {
+            altitude_model_t* model;
+            run_model_config_t sweep;
+
+            model = altitude_model_new(DESCENT_MODE_DESCENDING, altitudes[j], 1.f, 
+                                       drag_coeff, 0.f);
+            for(i=0; i<n_sites; ++i) 
+            {
+                altitude_model_get_params(model, &params[i]);
+                params[i].launch_time = 0.f;
+            }
+
+            sweep = *config;
+            sweep.ascent_cache = NULL;
+            sweep.n_sweep = n_sites;
+            sweep.sweep_params = params;
+            sweep.sweep_landings = landings;
+            sweep.sweep_sites = sites;
+            sweep.sweep_track_file = NULL;
+            sweep.checkpoint_file = NULL;
+            sweep.resume_file = NULL;
+            sweep.keep_wind_data = 1;
+
+            ok = run_model(cache, model, sites[0], sites[1], altitudes[j], timestamp,
+                           rmswinderror, &sweep) &&
+                site_grid_write_cells(grid, landings, timestamp, file);
+            altitude_model_free(model);
+
+            if(ok && (verbosity > 0))
+                fprintf(stderr, "INFO: Mapped the descents from %.0fm at %li.\n", 
+                        altitudes[j], timestamp);
+        }
+    }
+
+    free(params);
+    free(landings);
+    free(sites);
+
+    if(fclose(file) != 0)
+        ok = 0;
+
+    if(!ok)
+        fprintf(stderr, "ERROR: %s: error writing descent map\n", filename);
+
+    return ok;
+}
+
+descent_map_t*
+descent_map_read(const char* filename, wind_file_cache_t* cache)
+{
+    descent_map_t* self;
+    descent_map_header_t* header;
+    size_t n_cells;
+    FILE* file;
+    int ok;
+
+    file = fopen(filename, "rb");
+    if(!file) {
+        fprintf(stderr, "ERROR: %s: could not open descent map\n", filename);
+        return NULL;
+    }
+
+    self = (descent_map_t*)malloc(sizeof(descent_map_t));
+    self->altitudes = NULL;
+    self->cells = NULL;
+    header = &(self->header);
+
+    ok = (fread(header, sizeof(descent_map_header_t), 1, file) == 1) &&
+        !memcmp(header->magic, DESCENT_MAP_MAGIC, sizeof(header->magic)) &&
+        (header->version == DESCENT_MAP_VERSION) &&
+        (header->n_values == DESCENT_MAP_VALUES) && 
+        (header->n_altitudes > 0) && (header->n_times > 0) && (header->interval > 0) &&
+        (header->n_lat > 0) && (header->n_lng > 0);
+
+    if(ok) 
+    {
+        n_cells = (size_t)header->n_times * header->n_altitudes * 
+            header->n_lat * header->n_lng * DESCENT_MAP_VALUES;
+        self->altitudes = (float*)malloc(sizeof(float) * header->n_altitudes);
+        self->cells = (float*)malloc(sizeof(float) * n_cells);
+        ok = (fread(self->altitudes, sizeof(float), header->n_altitudes, file) == 
+              header->n_altitudes) &&
+            (fread(self->cells, sizeof(float), n_cells, file) == n_cells);
+    }
+    fclose(file);
+
+    if(!ok) {
+        fprintf(stderr, "ERROR: %s: not a descent map or truncated\n", filename);
+        descent_map_free(self);
+        return NULL;
+    }
+
+    if(header->wind_key != wind_file_cache_get_key(cache)) {
+        fprintf(stderr, "ERROR: %s: descent map was flown in other wind data\n", filename);
+        descent_map_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+descent_map_free(descent_map_t* self)
+{
+    if(!self)
+        return;
+
+    free(self->altitudes);
+    free(self->cells);
+    free(self);
+}
+
+// Find where x lies along an axis of n points at first + i*step. Sets *i to
+// the point at or before it, or the last but one, and *w to how far x is from
+// it towards the next point, in steps. Points up to margin steps beyond
+// either end are taken to be at the end. Returns zero if x is further off.
+static int
+_locate(double x, double first, double step, unsigned int n, double margin,
+        unsigned int* i, double* w)
+{
+    double u = (x - first) / step;
+
+    if((u < -margin) || (u > (n - 1) + margin))
+        return 0;
+
+    if(u < 0.0)
+        u = 0.0;
+    if(u > n - 1)
+        u = n - 1;
+
+    *i = (n > 1) && (u >= n - 1) ? n - 2 : (unsigned int)u;
+    *w = u - *i;
+
+    return 1;
+}
+
+int
+descent_map_lookup(const descent_map_t* self, float lat, float lng, float alt,
+                   long int timestamp, float* landing_lat, float* landing_lng,
+                   long int* landing_timestamp)
+{
+    const descent_map_header_t* header = &(self->header);
+    unsigned int index[4], n[4], corner, d, v;
+    double weight[4], value[DESCENT_MAP_VALUES] = { 0.0 };
+
+    n[0] = header->n_times;
+    n[1] = header->n_altitudes;
+    n[2] = header->n_lat;
+    n[3] = header->n_lng;
+
+    // The sites are at the centres of the cells so bursts in the outer half
+    // of the edge cells take the values at the sites. 
+    if(!_locate(timestamp, header->first_timestamp, header->interval, n[0], 0.0,
+                &index[0], &weight[0]) ||
+       !_locate(lat, header->south + 0.5 * header->dlat, header->dlat, n[2], 0.5,
+                &index[2], &weight[2]) ||
+       !_locate(lng, header->west + 0.5 * header->dlng, header->dlng, n[3], 0.5,
+                &index[3], &weight[3]))
+        return 0;
+
+    if((alt < self->altitudes[0]) || (alt > self->altitudes[n[1] - 1]))
+        return 0;
+    index[1] = 0;
+    while((index[1] + 2 < n[1]) && (alt > self->altitudes[index[1] + 1]))
+        ++index[1];
+    weight[1] = (n[1] > 1) ? (alt - self->altitudes[index[1]]) / 
+        (self->altitudes[index[1] + 1] - self->altitudes[index[1]]) : 0.0;
+
+    // Interpolate between the 16 surrounding burst points. A burst next to one
+    // whose descents left the wind data is flown instead.
+    for(corner=0; corner<16; ++corner)
+    {
+        size_t cell = 0;
+        double w = 1.0;
+
+        for(d=0; d<4; ++d)
+        {
+            unsigned int upper = (corner >> d) & 1;
+
+            w *= upper ? weight[d] : 1.0 - weight[d];
+            cell = cell * n[d] + index[d] + upper;
+        }
+
+        if(w <= 0.0)
+            continue;
+
+        for(v=0; v<DESCENT_MAP_VALUES; ++v)
+        {
+            float x = self->cells[cell * DESCENT_MAP_VALUES + v];
+
+            if(isnan(x))
+                return 0;
+            value[v] += w * x;
+        }
+    }
+
+    *landing_lat = lat + value[0] * METRES_TO_DEGREES;
+    *landing_lng = lng + value[1] * METRES_TO_DEGREES / cos(lat * DEGREES_TO_RADIANS);
+    *landing_timestamp = timestamp + (long int)floor(value[2] + 0.5);
+
+    return 1;
+}
+
+int
+descent_map_predict(FILE* bursts, FILE* output, wind_file_cache_t* cache,
+                    const descent_map_t* map, float rmswinderror,
+                    const run_model_config_t* config)
+{
+    unsigned int line_number = 0;
+    char line[256];
+
+    while(fgets(line, sizeof(line), bursts)) 
+    {
+        const char* record = line + strspn(line, " \t");
+        gint64 start_time = g_get_monotonic_time();
+        long int timestamp, landing_timestamp;
+        float lat, lng, alt, landing_lat, landing_lng;
+        int looked_up;
+
+        ++line_number;
+        if((*record == '#') || (*record == '\0') || (*record == '\n') || (*record == '\r'))
+            continue;
+
+        if(sscanf(record, "%li , %f , %f , %f", &timestamp, &lat, &lng, &alt) != 4) 
+        {
+            fprintf(stderr, "WARN: %u: expected 'timestamp, latitude, longitude, "
+                    "altitude'.\n", line_number);
+            continue;
+        }
+
+        looked_up = descent_map_lookup(map, lat, lng, alt, timestamp, 
+                                       &landing_lat, &landing_lng, &landing_timestamp);
+
+        // Bursts off the map are flown down as a one point sweep.
+        if(!looked_up) 
+        {
+            altitude_model_t* model;
+            altitude_params_t params;
+            run_model_landing_t landing;
+            run_model_config_t sweep;
+            float wind_v, wind_u, wind_var;
+            wind_file_cursor_t cursor;
+            int ok;
+
+            wind_file_cursor_init(&cursor);
+            if(!get_wind(cache, &cursor, lat, lng, alt, timestamp, 
+                         &wind_v, &wind_u, &wind_var)) 
+            {
+                fprintf(stderr, "WARN: %u: no wind data for burst.\n", line_number);
+                continue;
+            }
+
+            model = altitude_model_new(DESCENT_MODE_DESCENDING, alt, 1.f, 
+                                       map->header.drag_coeff, 0.f);
+            altitude_model_get_params(model, &params);
+            params.launch_time = 0.f;
+
+            sweep = *config;
+            sweep.ascent_cache = NULL;
+            sweep.n_sweep = 1;
+            sweep.sweep_params = &params;
+            sweep.sweep_landings = &landing;
+            sweep.sweep_sites = NULL;
+            sweep.sweep_track_file = NULL;
+            sweep.initial_cursor = &cursor;
+            sweep.checkpoint_file = NULL;
+            sweep.resume_file = NULL;
+            sweep.keep_wind_data = 1;
+
+            ok = run_model(cache, model, lat, lng, alt, timestamp, rmswinderror, &sweep);
+            altitude_model_free(model);
+            if(!ok)
+                return 0;
+
+            if(landing.n_landed < landing.n_members) {
+                fprintf(stderr, "WARN: %u: descent left the wind data.\n", line_number);
+                continue;
+            }
+
+            landing_lat = landing.lat;
+            landing_lng = landing.lng;
+            landing_timestamp = landing.timestamp;
+        }
+
+        fprintf(output, "%li,%g,%g,%li,%i\n", timestamp, 
+                landing_lat, landing_lng, landing_timestamp, looked_up);
+        fflush(output);
+        if(ferror(output)) {
+            fprintf(stderr, "ERROR: error writing to CSV file\n");
+            return 0;
+        }
+
+        if(verbosity > 0)
+            fprintf(stderr, "INFO: %s the descent from line %u in %.1fus.\n", 
+                    looked_up ? "Looked up" : "Flew", line_number,
+                    (double)(g_get_monotonic_time() - start_time));
+    }
+
+    return 1;
+}
+
+// vim:sw=4:ts=4:et:cindent
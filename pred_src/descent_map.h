@@ -0,0 +1,99 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+#ifndef __DESCENT_MAP_H__
+#define __DESCENT_MAP_H__
+
+#include <stdio.h>
+
+#include "run_model.h"
+#include "site_grid.h"
+
+// Where descents from a grid of burst points land, flown in advance so that
+// the landing of a flight which has just burst can be looked up rather than
+// flown. The burst points are the sites of a site grid at each of a list of
+// altitudes and each of a series of times. An opaque type.
+typedef struct descent_map_s descent_map_t;
+
+// The binary file written by descent_map_build(). All values are in the
+// native byte order. The header is followed by the n_altitudes burst
+// altitudes (m) as floats, lowest first, and then by a slice for each of the
+// n_times times first_timestamp + k*interval, earliest first. Each slice is
+// a raster for each altitude, lowest first, laid out as the cells of a site
+// grid raster (see site_grid.h): the mean landing offset north and east (m)
+// and descent time (s) from the centre of each cell, or NANs if any member
+// flown from the cell left the wind data. The wind key is that of the wind
+// data the map was flown in (see wind_file_cache_get_key()).
+#define DESCENT_MAP_MAGIC "PREDDMAP"
+#define DESCENT_MAP_VERSION 2
+#define DESCENT_MAP_VALUES SITE_GRID_VALUES
+
+typedef struct descent_map_header_s descent_map_header_t;
+struct descent_map_header_s
+{
+    char            magic[8];       // DESCENT_MAP_MAGIC
+    unsigned int    version;        // DESCENT_MAP_VERSION
+    unsigned int    n_lat, n_lng;
+    unsigned int    n_values;       // DESCENT_MAP_VALUES
+    unsigned int    n_altitudes, n_times;
+    double          south, west;    // degrees
+    double          dlat, dlng;     // degrees
+    long int        first_timestamp;
+    long int        interval;       // s
+    float           drag_coeff;
+    float           reserved;
+    unsigned long long wind_key;
+};
+
+// Fly the ensemble described by config down from every site of grid at each
+// of the n_altitudes burst altitudes, which must be in increasing order, at
+// each of n_times times interval seconds apart from first_timestamp, with the
+// given drag coefficient, and write the map to filename. The points of each
+// slice are flown together as a site grid is. Returns non-zero on success.
+int descent_map_build(wind_file_cache_t* cache, const site_grid_t* grid,
+                      const float* altitudes, unsigned int n_altitudes,
+                      long int first_timestamp, long int interval, unsigned int n_times,
+                      float drag_coeff, float rmswinderror, 
+                      const run_model_config_t* config, const char* filename);
+
+// Read the map written to filename by descent_map_build(). Returns NULL if
+// it cannot be read or was flown in other wind data than that of cache.
+descent_map_t* descent_map_read(const char* filename, wind_file_cache_t* cache);
+
+// Free resources associated with map.
+void descent_map_free(descent_map_t* map);
+
+// Look up where a flight which bursts at lat, lng and alt at timestamp lands
+// by interpolating the landing offset and descent time linearly between the
+// nearest burst points of map in each of latitude, longitude, altitude and
+// time. Returns zero if the burst is outside the map or any of those burst
+// points is invalid.
+int descent_map_lookup(const descent_map_t* map, float lat, float lng, float alt,
+                       long int timestamp, float* landing_lat, float* landing_lng,
+                       long int* landing_timestamp);
+
+// Predict where each burst read from bursts until the end of the file lands.
+// Each line is a burst: the timestamp, latitude, longitude and altitude (m)
+// separated by commas. Blank lines, lines starting with '#' and malformed
+// lines are ignored. A burst which can be looked up in map is, any other is
+// flown down with the map's drag coefficient by the ensemble described by
+// config. After each a CSV line of the burst's timestamp, the landing
+// latitude, longitude and timestamp and 1 if it was looked up or 0 if it was
+// flown is written to output and flushed. Bursts whose descents leave the
+// wind data are warned of and skipped. Returns zero if a descent could not
+// be flown.
+int descent_map_predict(FILE* bursts, FILE* output, wind_file_cache_t* cache,
+                        const descent_map_t* map, float rmswinderror,
+                        const run_model_config_t* config);
+
+#endif // __DESCENT_MAP_H__
+
+// vim:sw=4:ts=4:et:cindent
@@ -0,0 +1,130 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+#include "ensemble_stats.h"
+
+#include <string.h>
+
+void
+ensemble_moments_reset(ensemble_moments_t* self)
+{
+    memset(self, 0, sizeof(ensemble_moments_t));
+}
+
+void
+ensemble_moments_add(ensemble_moments_t* self, const double* x)
+{
+    double delta[3];
+    unsigned int i, j;
+
+    self->n += 1.0;
+    for(i=0; i<3; ++i)
+    {
+        delta[i] = x[i] - self->mean[i];
+        self->mean[i] += delta[i] / self->n;
+    }
+
+    // The product of the deviations from the old and new means.
+    for(i=0; i<3; ++i)
+        for(j=0; j<3; ++j)
+            self->m2[i][j] += delta[i] * (x[j] - self->mean[j]);
+}
+
+void
+ensemble_moments_merge(ensemble_moments_t* self, const ensemble_moments_t* other)
+{
+    double n, delta[3];
+    unsigned int i, j;
+
+    if(other->n <= 0.0)
+        return;
+
+    if(self->n <= 0.0) {
+        *self = *other;
+        return;
+    }
+
+    n = self->n + other->n;
+    for(i=0; i<3; ++i)
+        delta[i] = other->mean[i] - self->mean[i];
+
+    for(i=0; i<3; ++i)
+        for(j=0; j<3; ++j)
+            self->m2[i][j] += other->m2[i][j] + 
+                delta[i] * delta[j] * self->n * other->n / n;
+
+    for(i=0; i<3; ++i)
+        self->mean[i] += delta[i] * other->n / n;
+
+    self->n = n;
+}
+
+double
+ensemble_moments_covariance(const ensemble_moments_t* self, 
+                            unsigned int i, unsigned int j)
+{
+    if(self->n <= 0.0)
+        return 0.0;
+
+    return self->m2[i][j] / self->n;
+}
+
+void
+altitude_histogram_reset(altitude_histogram_t* self)
+{
+    memset(self, 0, sizeof(altitude_histogram_t));
+}
+
+void
+altitude_histogram_add(altitude_histogram_t* self, float alt)
+{
+    double bin = alt / ALTITUDE_HISTOGRAM_BIN;
+
+    if(bin < 0.0)
+        bin = 0.0;
+    if(bin > ALTITUDE_HISTOGRAM_BINS - 1)
+        bin = ALTITUDE_HISTOGRAM_BINS - 1;
+
+    ++self->counts[(unsigned int)bin];
+    ++self->n;
+}
+
+void
+altitude_histogram_merge(altitude_histogram_t* self, const altitude_histogram_t* other)
+{
+    unsigned int i;
+
+    for(i=0; i<ALTITUDE_HISTOGRAM_BINS; ++i)
+        self->counts[i] += other->counts[i];
+    self->n += other->n;
+}
+
+float
+altitude_histogram_percentile(const altitude_histogram_t* self, double p)
+{
+    double target = p * self->n, cumulative = 0.0;
+    unsigned int i;
+
+    if(self->n == 0)
+        return 0.f;
+
+    for(i=0; i<ALTITUDE_HISTOGRAM_BINS; ++i)
+    {
+        if((self->counts[i] > 0) && (cumulative + self->counts[i] >= target))
+            return ALTITUDE_HISTOGRAM_BIN * 
+                (i + (target - cumulative) / self->counts[i]);
+        cumulative += self->counts[i];
+    }
+
+    return ALTITUDE_HISTOGRAM_BIN * ALTITUDE_HISTOGRAM_BINS;
+}
+
+// vim:sw=4:ts=4:et:cindent
@@ -0,0 +1,77 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+#ifndef __ENSEMBLE_STATS_H__
+#define __ENSEMBLE_STATS_H__
+
+// Summary statistics of an ensemble which are accumulated one member at a
+// time in constant memory, so that the members need not be stored. Partial
+// statistics of disjoint sets of members may be merged.
+
+// The count, mean and covariance of a set of three dimensional points, such
+// as latitude, longitude and altitude. Points are added with Welford's method
+// and sets merged with the method of Chan, Golub and LeVeque, both of which
+// avoid the cancellation of the textbook sum of squares formula. Merging in
+// a different order rounds differently so merge in a fixed order for
+// reproducible results.
+typedef struct ensemble_moments_s ensemble_moments_t;
+struct ensemble_moments_s
+{
+    double          n;
+    double          mean[3];
+    double          m2[3][3];       // sum of products of deviations from mean
+};
+
+// Empty moments of their points.
+void ensemble_moments_reset(ensemble_moments_t* moments);
+
+// Add the point x to moments.
+void ensemble_moments_add(ensemble_moments_t* moments, const double* x);
+
+// Add the points summarised by other to moments.
+void ensemble_moments_merge(ensemble_moments_t* moments, const ensemble_moments_t* other);
+
+// Return the (population) covariance of the i-th and j-th coordinates of the
+// points or zero if there are none.
+double ensemble_moments_covariance(const ensemble_moments_t* moments, 
+                                   unsigned int i, unsigned int j);
+
+// A histogram of altitudes in bins of ALTITUDE_HISTOGRAM_BIN metres from sea
+// level. Altitudes outside the range count in the first or last bin. The
+// counts are integers so histograms may be merged in any order.
+#define ALTITUDE_HISTOGRAM_BIN 25.0
+#define ALTITUDE_HISTOGRAM_BINS 2400    // up to 60km
+
+typedef struct altitude_histogram_s altitude_histogram_t;
+struct altitude_histogram_s
+{
+    unsigned long   n;
+    unsigned long   counts[ALTITUDE_HISTOGRAM_BINS];
+};
+
+// Empty histogram of its altitudes.
+void altitude_histogram_reset(altitude_histogram_t* histogram);
+
+// Count alt in histogram.
+void altitude_histogram_add(altitude_histogram_t* histogram, float alt);
+
+// Add the altitudes counted by other to histogram.
+void altitude_histogram_merge(altitude_histogram_t* histogram, 
+                              const altitude_histogram_t* other);
+
+// Return the altitude below which a fraction p of the altitudes lie,
+// interpolating linearly within a bin, or zero if there are none. Accurate to
+// within a bin.
+float altitude_histogram_percentile(const altitude_histogram_t* histogram, double p);
+
+#endif // __ENSEMBLE_STATS_H__
+
+// vim:sw=4:ts=4:et:cindent
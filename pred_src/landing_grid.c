@@ -0,0 +1,315 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+#include "landing_grid.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "run_model.h"
+
+// The kernel is cut off at this many standard deviations...
+#define KERNEL_CUTOFF 3.0
+
+// ...or this many cells from the landing, whichever is nearer.
+#define MAX_KERNEL_RADIUS 64
+
+struct landing_grid_s
+{
+    double          south, west;
+    double          dlat, dlng;
+    unsigned int    n_lat, n_lng;
+
+    // standard deviation of the kernel in cells, zero for none
+    double          sigma_lat, sigma_lng;
+
+    double          total;
+    double         *cells;
+};
+
+landing_grid_t*
+landing_grid_new(float south, float west, float north, float east,
+                 float resolution, float bandwidth)
+{
+    landing_grid_t* self;
+    double margin, lng_margin, centre_lat, n_cells;
+
+    if((north < south) || (east < west) || (resolution <= 0.f) || (bandwidth < 0.f))
+        return NULL;
+
+    self = (landing_grid_t*)malloc(sizeof(landing_grid_t));
+
+    // Cells are square at the centre of the grid.
+    centre_lat = 0.5 * (north + south);
+    self->dlat = resolution * METRES_TO_DEGREES;
+    self->dlng = self->dlat / cos(centre_lat * DEGREES_TO_RADIANS);
+
+    margin = KERNEL_CUTOFF * bandwidth * METRES_TO_DEGREES;
+    lng_margin = margin / cos(centre_lat * DEGREES_TO_RADIANS);
+    self->south = south - margin;
+    self->west = west - lng_margin;
+    self->n_lat = 1 + (unsigned int)((north + margin - self->south) / self->dlat);
+    self->n_lng = 1 + (unsigned int)((east + lng_margin - self->west) / self->dlng);
+
+    n_cells = (double)self->n_lat * self->n_lng;
+    if(n_cells > LANDING_GRID_MAX_CELLS) {
+        double scale = sqrt(n_cells / LANDING_GRID_MAX_CELLS);
+
+        fprintf(stderr, "WARN: Landing grid would have %.0f cells, "
+                "using a resolution of %.0fm.\n", n_cells, resolution * scale);
+
+        self->dlat *= scale;
+        self->dlng *= scale;
+        self->n_lat = 1 + (unsigned int)(self->n_lat / scale);
+        self->n_lng = 1 + (unsigned int)(self->n_lng / scale);
+    }
+
+    self->sigma_lat = bandwidth * METRES_TO_DEGREES / self->dlat;
+    self->sigma_lng = self->sigma_lat;
+
+    self->total = 0.0;
+    self->cells = (double*)calloc((size_t)self->n_lat * self->n_lng, sizeof(double));
+
+    return self;
+}
+
+landing_grid_t*
+landing_grid_new_like(const landing_grid_t* grid)
+{
+    landing_grid_t* self = (landing_grid_t*)malloc(sizeof(landing_grid_t));
+
+    *self = *grid;
+    self->total = 0.0;
+    self->cells = (double*)calloc((size_t)self->n_lat * self->n_lng, sizeof(double));
+
+    return self;
+}
+
+void
+landing_grid_free(landing_grid_t* self)
+{
+    if(!self)
+        return;
+
+    free(self->cells);
+    free(self);
+}
+
+// Fill weights with a Gaussian kernel of standard deviation sigma cells
+// centred x cells along an axis of n cells. Returns the number of weights
+// and sets *first to the cell of the first one. The weights sum to one.
+static unsigned int
+_kernel(double x, double sigma, unsigned int n, int* first, double* weights)
+{
+    int radius = (int)ceil(KERNEL_CUTOFF * sigma);
+    int centre = (int)floor(x), i, last;
+    unsigned int n_weights = 0, j;
+    double sum = 0.0;
+
+    if(radius > MAX_KERNEL_RADIUS)
+        radius = MAX_KERNEL_RADIUS;
+
+    *first = centre - radius;
+    last = centre + radius;
+    if(*first < 0)
+        *first = 0;
+    if(last > (int)n - 1)
+        last = (int)n - 1;
+
+    for(i=*first; i<=last; ++i) {
+        double d = (i + 0.5 - x) / sigma;
+
+        weights[n_weights] = exp(-0.5 * d * d);
+        sum += weights[n_weights++];
+    }
+
+    // Landings right on the edge of the grid lose the part of their kernel
+    // which is off it. The margin added by landing_grid_new() makes this
+    // rare.
+    for(j=0; j<n_weights; ++j)
+        weights[j] /= sum;
+
+    return n_weights;
+}
+
+void
+landing_grid_add(landing_grid_t* self, float lat, float lng, double weight)
+{
+    double x = (lat - self->south) / self->dlat;
+    double y = (lng - self->west) / self->dlng;
+    double lat_weights[2*MAX_KERNEL_RADIUS+1], lng_weights[2*MAX_KERNEL_RADIUS+1];
+    unsigned int n_lat_weights, n_lng_weights, i, j;
+    int first_lat, first_lng;
+
+    self->total += weight;
+
+    if((x < 0.0) || (y < 0.0) || (x >= self->n_lat) || (y >= self->n_lng))
+        return;
+
+    if(self->sigma_lat <= 0.0) {
+        self->cells[(size_t)x * self->n_lng + (size_t)y] += weight;
+        return;
+    }
+
+    // The kernel is separable.
+    n_lat_weights = _kernel(x, self->sigma_lat, self->n_lat, &first_lat, lat_weights);
+    n_lng_weights = _kernel(y, self->sigma_lng, self->n_lng, &first_lng, lng_weights);
+
+    for(i=0; i<n_lat_weights; ++i) {
+        double* row = &(self->cells[(size_t)(first_lat + i) * self->n_lng + first_lng]);
+        double row_weight = weight * lat_weights[i];
+
+        for(j=0; j<n_lng_weights; ++j)
+            row[j] += row_weight * lng_weights[j];
+    }
+}
+
+void
+landing_grid_merge(landing_grid_t* self, const landing_grid_t* other)
+{
+    size_t i, n = (size_t)self->n_lat * self->n_lng;
+
+    self->total += other->total;
+    for(i=0; i<n; ++i)
+        self->cells[i] += other->cells[i];
+}
+
+void
+landing_grid_get_size(const landing_grid_t* self,
+                      unsigned int* n_lat, unsigned int* n_lng)
+{
+    *n_lat = self->n_lat;
+    *n_lng = self->n_lng;
+}
+
+double
+landing_grid_get_probability(const landing_grid_t* self,
+                             unsigned int i_lat, unsigned int i_lng)
+{
+    if(self->total <= 0.0)
+        return 0.0;
+
+    return self->cells[(size_t)i_lat * self->n_lng + i_lng] / self->total;
+}
+
+static int
+_write_binary(const landing_grid_t* self, FILE* file)
+{
+    landing_grid_header_t header;
+    float* row;
+    unsigned int i, j;
+    int ok = 1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LANDING_GRID_MAGIC, sizeof(header.magic));
+    header.version = LANDING_GRID_VERSION;
+    header.n_lat = self->n_lat;
+    header.n_lng = self->n_lng;
+    header.south = self->south;
+    header.west = self->west;
+    header.dlat = self->dlat;
+    header.dlng = self->dlng;
+
+    if(fwrite(&header, sizeof(header), 1, file) != 1)
+        return 0;
+
+    row = (float*)malloc(sizeof(float) * self->n_lng);
+    for(i=0; ok && (i<self->n_lat); ++i) {
+        for(j=0; j<self->n_lng; ++j)
+            row[j] = landing_grid_get_probability(self, i, j);
+        ok = (fwrite(row, sizeof(float), self->n_lng, file) == self->n_lng);
+    }
+    free(row);
+
+    return ok;
+}
+
+// Order cell indices by decreasing value. Used to find the most likely
+// regions.
+static const double* _sort_cells;
+
+static int
+_cell_compare_rev(const void* a, const void* b)
+{
+    double va = _sort_cells[*(const size_t*)a];
+    double vb = _sort_cells[*(const size_t*)b];
+
+    return (va < vb) - (va > vb);
+}
+
+static int
+_write_geojson(const landing_grid_t* self, FILE* file)
+{
+    size_t i, n_cells = 0, n = (size_t)self->n_lat * self->n_lng;
+    size_t* order;
+    double cumulative = 0.0;
+
+    order = (size_t*)malloc(sizeof(size_t) * (n > 0 ? n : 1));
+    for(i=0; i<n; ++i) {
+        if(self->cells[i] > 0.0)
+            order[n_cells++] = i;
+    }
+
+    _sort_cells = self->cells;
+    qsort(order, n_cells, sizeof(size_t), _cell_compare_rev);
+
+    fprintf(file, "{\"type\":\"FeatureCollection\",\"features\":[");
+    for(i=0; i<n_cells; ++i) {
+        unsigned int i_lat = order[i] / self->n_lng, i_lng = order[i] % self->n_lng;
+        double probability = landing_grid_get_probability(self, i_lat, i_lng);
+        double s = self->south + i_lat * self->dlat, n_edge = s + self->dlat;
+        double w = self->west + i_lng * self->dlng, e = w + self->dlng;
+
+        cumulative += probability;
+
+        fprintf(file, "%s\n{\"type\":\"Feature\",\"properties\":"
+                "{\"probability\":%.6g,\"cumulative\":%.6g},"
+                "\"geometry\":{\"type\":\"Polygon\",\"coordinates\":"
+                "[[[%.6f,%.6f],[%.6f,%.6f],[%.6f,%.6f],[%.6f,%.6f],[%.6f,%.6f]]]}}",
+                (i > 0) ? "," : "", probability, cumulative,
+                w, s, e, s, e, n_edge, w, n_edge, w, s);
+    }
+    fprintf(file, "\n]}\n");
+
+    free(order);
+
+    return !ferror(file);
+}
+
+int
+landing_grid_write(const landing_grid_t* self, const char* filename)
+{
+    const char* extension = strrchr(filename, '.');
+    FILE* file;
+    int ok;
+
+    file = fopen(filename, "wb");
+    if(!file) {
+        fprintf(stderr, "ERROR: %s: could not open landing grid for output\n", filename);
+        return 0;
+    }
+
+    if(extension && (!strcmp(extension, ".json") || !strcmp(extension, ".geojson")))
+        ok = _write_geojson(self, file);
+    else
+        ok = _write_binary(self, file);
+
+    if(fclose(file) != 0)
+        ok = 0;
+
+    if(!ok)
+        fprintf(stderr, "ERROR: %s: error writing landing grid\n", filename);
+
+    return ok;
+}
+
+// vim:sw=4:ts=4:et:cindent
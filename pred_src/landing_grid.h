@@ -0,0 +1,84 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+#ifndef __LANDING_GRID_H__
+#define __LANDING_GRID_H__
+
+// A latitude/longitude grid over which the landing points of an ensemble are
+// accumulated to give the probability of landing in each cell. Each landing
+// is either counted in the cell it falls in or spread over nearby cells with
+// a Gaussian kernel. An opaque type.
+typedef struct landing_grid_s landing_grid_t;
+
+// The most cells a grid may have. Grids which would be larger are made
+// coarser.
+#define LANDING_GRID_MAX_CELLS (1 << 22)
+
+// The binary file format written by landing_grid_write(). All values are in
+// the native byte order. The header is followed by n_lat rows, south first,
+// of n_lng floats, west first, giving the probability of landing in each
+// cell. The cell (i, j) spans latitudes south + i*dlat to south + (i+1)*dlat
+// and similarly for longitude.
+#define LANDING_GRID_MAGIC "PREDGRID"
+#define LANDING_GRID_VERSION 1
+
+typedef struct landing_grid_header_s landing_grid_header_t;
+struct landing_grid_header_s
+{
+    char            magic[8];       // LANDING_GRID_MAGIC
+    unsigned int    version;        // LANDING_GRID_VERSION
+    unsigned int    n_lat, n_lng;
+    unsigned int    reserved;
+    double          south, west;    // degrees
+    double          dlat, dlng;     // degrees
+};
+
+// Create an empty grid of cells resolution metres across covering the
+// landings within the given bounds. If bandwidth is non-zero each landing is
+// spread with a Gaussian kernel of that standard deviation (in metres) and
+// the grid is widened to take it. Returns NULL if the bounds are invalid.
+landing_grid_t* landing_grid_new(float south, float west, float north, float east,
+                                 float resolution, float bandwidth);
+
+// Create an empty grid with the same cells and kernel as grid. Use this to
+// accumulate part of an ensemble on each thread.
+landing_grid_t* landing_grid_new_like(const landing_grid_t* grid);
+
+// Free resources associated with grid.
+void landing_grid_free(landing_grid_t* grid);
+
+// Add a landing at lat, lng with the given weight. Landings outside the grid
+// count towards the total weight but no cell.
+void landing_grid_add(landing_grid_t* grid, float lat, float lng, double weight);
+
+// Add the landings accumulated in other, which must have been created with
+// landing_grid_new_like(grid) or vice versa, to grid.
+void landing_grid_merge(landing_grid_t* grid, const landing_grid_t* other);
+
+// Fill in the number of rows (latitudes) and columns (longitudes) of grid.
+void landing_grid_get_size(const landing_grid_t* grid,
+                           unsigned int* n_lat, unsigned int* n_lng);
+
+// Return the probability of landing in cell (i_lat, i_lng) of grid.
+double landing_grid_get_probability(const landing_grid_t* grid,
+                                    unsigned int i_lat, unsigned int i_lng);
+
+// Write grid to filename. If the name ends in .json or .geojson it is written
+// as a GeoJSON FeatureCollection of a square polygon for each cell with a
+// non-zero probability, not contour lines. Each cell has a "probability"
+// property and a "cumulative" property giving the total probability of it
+// and every more likely cell, so that, for example, the cells with cumulative
+// <= 0.9 fill the smallest area where 90% of landings are expected. Otherwise
+// it is written in the binary format above. Returns non-zero on success.
+int landing_grid_write(const landing_grid_t* grid, const char* filename);
+
+#endif // __LANDING_GRID_H__
+
+// vim:sw=4:ts=4:et:cindent
@@ -0,0 +1,232 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+#include "live.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <glib.h>
+
+#include "atmosphere.h"
+
+extern int verbosity;
+
+// The most fixes kept for estimating the rates.
+#define MAX_FIXES 1024
+
+// The drag coefficient is the descent rate at sea level scaled by this, as
+// in the scenario.
+#define DESCENT_RATE_SCALE 1.1045
+
+typedef struct live_fix_s live_fix_t;
+struct live_fix_s
+{
+    long int        timestamp;
+    float           lat, lng;           // degrees
+    float           alt;                // m
+};
+
+void
+live_config_init(live_config_t* live)
+{
+    live->window = 0.f;
+    live->burst_drop = 100.f;
+    live->descending = 0;
+}
+
+// Estimate the ascent rate (m/s) or, if descending, the drag coefficient from
+// the n fixes, oldest first. Returns zero if they span no time or give a
+// rate which makes no sense.
+static int
+_estimate_rate(const live_fix_t* fixes, unsigned int n, int descending, float* rate)
+{
+    double span, sum = 0.0;
+    unsigned int i;
+
+    if(n < 2)
+        return 0;
+
+    span = fixes[n-1].timestamp - fixes[0].timestamp;
+    if(span <= 0.0)
+        return 0;
+
+    if(!descending) 
+    {
+        *rate = (fixes[n-1].alt - fixes[0].alt) / span;
+        return *rate > 0.f;
+    }
+
+    // The descent is at terminal velocity, dz/dt = -drag_coeff/sqrt(rho(z)),
+    // so the drag coefficient is the mean over time of -sqrt(rho(z)) dz/dt.
+    for(i=1; i<n; ++i) 
+    {
+        sum += (fixes[i-1].alt - fixes[i].alt) * 
+            sqrt(atmosphere_get_density(0.5f * (fixes[i-1].alt + fixes[i].alt)));
+    }
+    *rate = sum / span;
+    return *rate > 0.f;
+}
+
+int
+live_predict(FILE* fixes_file, FILE* output, wind_file_cache_t* cache,
+             const altitude_model_t* alt_model, float rmswinderror,
+             const run_model_config_t* config, const live_config_t* live)
+{
+    live_fix_t fixes[MAX_FIXES];
+    unsigned int n_fixes = 0, line_number = 0;
+    altitude_params_t nominal;
+    wind_file_cursor_t cursor;
+    float max_alt = 0.f;
+    int descending = live->descending;
+    char line[256];
+
+    altitude_model_get_params(alt_model, &nominal);
+    wind_file_cursor_init(&cursor);
+
+    while(fgets(line, sizeof(line), fixes_file)) 
+    {
+        const char* record = line + strspn(line, " \t");
+        gint64 start_time = g_get_monotonic_time();
+        altitude_model_t* model;
+        altitude_params_t params;
+        run_model_landing_t landing;
+        run_model_config_t sweep;
+        live_fix_t fix;
+        float wind_v, wind_u, wind_var, rate;
+        int bursting, ok;
+        unsigned int i, first;
+
+        ++line_number;
+        if((*record == '#') || (*record == '\0') || (*record == '\n') || (*record == '\r'))
+            continue;
+
+        if(sscanf(record, "%li , %f , %f , %f", 
+                  &fix.timestamp, &fix.lat, &fix.lng, &fix.alt) != 4) 
+        {
+            fprintf(stderr, "WARN: %u: expected 'timestamp, latitude, longitude, "
+                    "altitude'.\n", line_number);
+            continue;
+        }
+
+        if((n_fixes > 0) && (fix.timestamp <= fixes[n_fixes-1].timestamp)) 
+        {
+            fprintf(stderr, "WARN: %u: fix is not later than the last.\n", line_number);
+            continue;
+        }
+
+        // Only the fixes after the highest belong to the descent. The burst
+        // came somewhere between the highest and the next.
+        if(!descending && (n_fixes > 0) && (max_alt - fix.alt > live->burst_drop)) 
+        {
+            first = 0;
+            for(i=1; i<n_fixes; ++i) 
+            {
+                if(fixes[i].alt > fixes[first].alt)
+                    first = i;
+            }
+            ++first;
+            n_fixes -= first;
+            memmove(fixes, &fixes[first], sizeof(live_fix_t) * n_fixes);
+            descending = 1;
+
+            if(verbosity > 0)
+                fprintf(stderr, "INFO: Burst at %.0fm.\n", max_alt);
+        }
+        if((n_fixes == 0) || (fix.alt > max_alt))
+            max_alt = fix.alt;
+
+        // Keep the fixes of the last window seconds.
+        first = 0;
+        if(n_fixes == MAX_FIXES)
+            first = 1;
+        while((first < n_fixes) && 
+              (fixes[first].timestamp < fix.timestamp - live->window))
+            ++first;
+        n_fixes -= first;
+        memmove(fixes, &fixes[first], sizeof(live_fix_t) * n_fixes);
+        fixes[n_fixes++] = fix;
+
+        params = nominal;
+        params.launch_time = 0.f;
+        if((live->window > 0.f) && _estimate_rate(fixes, n_fixes, descending, &rate)) 
+        {
+            if(descending)
+                params.drag_coeff = rate;
+            else
+                params.ascent_rate = rate;
+        }
+
+        // A flight at or above its burst altitude is taken to burst now.
+        bursting = descending || (fix.alt >= params.burst_altitude);
+        if(bursting)
+            params.float_time = 0.f;
+
+        // The fixes are in time order so no later one needs wind data
+        // superseded by this one's time.
+        wind_file_cache_release_before(cache, fix.timestamp);
+
+        // Every member starts in the fix's cell of the wind grid, which also
+        // checks that we have wind data for it.
+        if(!get_wind(cache, &cursor, fix.lat, fix.lng, fix.alt, fix.timestamp,
+                     &wind_v, &wind_u, &wind_var)) 
+        {
+            fprintf(stderr, "WARN: %u: no wind data for fix.\n", line_number);
+            continue;
+        }
+
+        model = altitude_model_new(bursting ? DESCENT_MODE_DESCENDING : DESCENT_MODE_NORMAL,
+                                   params.burst_altitude, params.ascent_rate, 
+                                   params.drag_coeff, params.float_time);
+
+        sweep = *config;
+        sweep.ascent_cache = NULL;
+        sweep.n_sweep = 1;
+        sweep.sweep_params = &params;
+        sweep.sweep_landings = &landing;
+        sweep.sweep_sites = NULL;
+        sweep.sweep_track_file = NULL;
+        sweep.initial_cursor = &cursor;
+        sweep.checkpoint_file = NULL;
+        sweep.resume_file = NULL;
+        sweep.keep_wind_data = 1;
+
+        ok = run_model(cache, model, fix.lat, fix.lng, fix.alt, fix.timestamp, 
+                       rmswinderror, &sweep);
+        altitude_model_free(model);
+        if(!ok)
+            return 0;
+
+        fprintf(output, "%li,%g,%g,%u,%u", fix.timestamp,
+                bursting ? 0.f : params.ascent_rate, params.drag_coeff / DESCENT_RATE_SCALE,
+                landing.n_members, landing.n_landed);
+        if(landing.n_landed < landing.n_members)
+            fprintf(output, ",,,,,,\n");
+        else
+            fprintf(output, ",%g,%g,%li,%.0f,%.0f,%.0f\n", landing.lat, landing.lng,
+                    landing.timestamp, landing.sd_north, landing.sd_east, landing.sd_time);
+        fflush(output);
+        if(ferror(output)) 
+        {
+            fprintf(stderr, "ERROR: error writing to CSV file\n");
+            return 0;
+        }
+
+        if(verbosity > 0)
+            fprintf(stderr, "INFO: Predicted from the fix at %li in %.1fms.\n", 
+                    fix.timestamp, 1e-3 * (g_get_monotonic_time() - start_time));
+    }
+
+    return 1;
+}
+
+// vim:sw=4:ts=4:et:cindent
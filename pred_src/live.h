@@ -0,0 +1,54 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+#ifndef __LIVE_H__
+#define __LIVE_H__
+
+#include <stdio.h>
+
+#include "run_model.h"
+
+typedef struct live_config_s live_config_t;
+struct live_config_s
+{
+    // If non-zero the ascent or descent rate is re-estimated at each fix
+    // from the fixes of the current phase of the flight received in the
+    // last window seconds. Otherwise the altitude model's rates are used.
+    float           window;             // s
+
+    // The flight has burst once a fix is this far below the highest.
+    float           burst_drop;         // m
+
+    int             descending;         // non-zero if the flight has already burst
+};
+
+// set live to keep the altitude model's rates, to detect a burst 100m below
+// the highest fix and to start off ascending.
+void live_config_init(live_config_t* live);
+
+// Re-predict a flight from each telemetry fix read from fixes until the end
+// of the file. Each line is a fix: the timestamp, latitude, longitude and
+// altitude (m) separated by commas. Blank lines and lines starting with '#'
+// are ignored, as are fixes which are malformed or not later than the last.
+// The ensemble described by config is launched from the fix with the
+// altitude model's burst altitude and rates, or those estimated from recent
+// fixes, ascending until it bursts and then descending. The wind data loaded
+// for one fix stays loaded for the next and each ensemble starts from the
+// wind grid cell of the fix. After each fix a CSV line of the fix's
+// timestamp, the ascent and descent rates flown, zero for a phase which is
+// over, and where the ensemble landed, as in a sweep table, is written to
+// output and flushed. Returns zero if the model could not be run.
+int live_predict(FILE* fixes, FILE* output, wind_file_cache_t* cache,
+                 const altitude_model_t* alt_model, float rmswinderror,
+                 const run_model_config_t* config, const live_config_t* live);
+
+#endif // __LIVE_H__
+
+// vim:sw=4:ts=4:et:cindent
@@ -14,9 +14,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <time.h>
 #include <errno.h>
 
+#include <glib.h>
+
 #include "ini/iniparser.h"
 #include "util/gopt.h"
 #include "wind/wind_file_cache.h"
@@ -24,24 +27,676 @@
 #include "run_model.h"
 #include "pred.h"
 #include "altitude.h"
+#include "site_grid.h"
+#include "solve.h"
+#include "live.h"
+#include "descent_map.h"
+#include "surface.h"
 
 FILE* output;
 FILE* kml_file;
 const char* data_dir;
 int verbosity;
 
+// Flush the output after every position so that a reader sees each as soon
+// as it is written.
+static int flush_output = 0;
+
+// The step of the coarse pass of a progressive prediction.
+#define COARSE_STEP 60.f    // s
+
+// Read the uncertainty of a flight parameter from the [uncertainty] section of
+// scenario: a standard deviation under key or a range under key-min and
+// key-max. Values are multiplied by scale. Returns zero if they make no
+// sense.
+static int
+_read_uncertainty(dictionary* scenario, const char* key, float scale,
+                  float* sd, float* min, float* max)
+{
+    char name[64];
+
+    snprintf(name, sizeof(name), "uncertainty:%s", key);
+    *sd = iniparser_getdouble(scenario, name, 0.0) * scale;
+    snprintf(name, sizeof(name), "uncertainty:%s-min", key);
+    *min = iniparser_getdouble(scenario, name, 0.0) * scale;
+    snprintf(name, sizeof(name), "uncertainty:%s-max", key);
+    *max = iniparser_getdouble(scenario, name, 0.0) * scale;
+
+    if((*sd < 0.f) || (*min > *max)) {
+        fprintf(stderr, "ERROR: %s: invalid uncertainty\n", key);
+        return 0;
+    }
+
+    return 1;
+}
+
+// The flight parameters which may be swept, in the order they are varied
+// with the last fastest, and the most points a sweep may have.
+#define N_SWEEP_PARAMS 5
+#define MAX_SWEEP_POINTS 1000000
+
+static const char* _sweep_keys[N_SWEEP_PARAMS] = {
+    "ascent-rate", "burst-altitude", "descent-rate", "float-time", "launch-time"
+};
+
+// A response surface is a sweep written to a file.
+#if N_SWEEP_PARAMS != SURFACE_PARAMS
+#error "a response surface must have the parameters of a sweep"
+#endif
+
+// Read the values key takes in section, usually [sweep], of scenario into a
+// newly allocated array and return how many there are. The values are a
+// comma separated list of numbers and ranges first:last:step. If key is not
+// given its only value is nominal. Values are multiplied by scale. Returns
+// zero if they make no sense.
+static unsigned int
+_read_sweep(dictionary* scenario, const char* section, const char* key, 
+            float nominal, float scale, float** values)
+{
+    char name[64];
+    const char* p;
+    char* endptr;
+    unsigned int n = 0;
+
+    snprintf(name, sizeof(name), "%s:%s", section, key);
+    p = iniparser_getstring(scenario, name, NULL);
+
+    if(!p) {
+        *values = (float*)malloc(sizeof(float));
+        (*values)[0] = nominal;
+        return 1;
+    }
+
+    *values = NULL;
+    for(;;) {
+        double first, last, step = 1.0;
+        unsigned int i, n_range;
+
+        first = last = strtod(p, &endptr);
+        if(endptr == p)
+            break;
+        p = endptr;
+
+        if(*p == ':') {
+            last = strtod(p + 1, &endptr);
+            if((endptr == p + 1) || (*endptr != ':'))
+                break;
+            p = endptr + 1;
+            step = strtod(p, &endptr);
+            if((endptr == p) || (step <= 0.0) || (last < first))
+                break;
+            p = endptr;
+        }
+
+        // allow for the step not dividing the range exactly
+        n_range = 1 + (unsigned int)((last - first) / step + 1e-6);
+        if(n + n_range > MAX_SWEEP_POINTS)
+            break;
+
+        *values = (float*)realloc(*values, sizeof(float) * (n + n_range));
+        for(i=0; i<n_range; ++i)
+            (*values)[n++] = (first + i * step) * scale;
+
+        while(*p == ' ')
+            ++p;
+        if(*p == '\0')
+            return n;
+        if(*p != ',')
+            break;
+        ++p;
+    }
+
+    fprintf(stderr, "ERROR: %s: invalid sweep\n", key);
+    free(*values);
+    *values = NULL;
+    return 0;
+}
+
+// Returns zero if the points of a sweep cannot be flown as config says.
+static int
+_check_sweep(const run_model_config_t* config)
+{
+    if((config->resample_threshold > 0.f) || (config->sampling == SAMPLING_UNSCENTED) ||
+       config->summary_file || config->landing_grid_file) {
+        fprintf(stderr, "ERROR: a sweep cannot be resampled, use unscented "
+                "sampling or write a summary track or landing grid\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+// Read the points of a sweep into config from the [sweep] section of
+// scenario, or the [surface] section if surface_file is not NULL, about the
+// nominal flight parameters. A launch window, if window_interval is
+// non-zero, sweeps the launch time from initial_timestamp to window_end in
+// place of the section. The values of each parameter are allocated in
+// sweep_values and the points and their landings in sweep_params and
+// sweep_landings. Returns zero if the sweep makes no sense.
+static int
+_read_sweep_section(dictionary* scenario, const void* options, const char* surface_file,
+                    const float* nominal, long int initial_timestamp,
+                    long int window_end, long int window_interval,
+                    unsigned int* n_sweep_values, float** sweep_values,
+                    altitude_params_t** sweep_params, run_model_landing_t** sweep_landings,
+                    run_model_config_t* config)
+{
+    const float scale[N_SWEEP_PARAMS] = { 1.0, 1.0, 1.1045, 1.0, 1.0 };
+    const char* argument;
+    double n_sweep = 1.0;
+    unsigned int i, k;
+
+    if(iniparser_find_entry(scenario, "site-grid")) {
+        fprintf(stderr, "ERROR: a site grid cannot also be swept\n");
+        return 0;
+    }
+    if(iniparser_find_entry(scenario, "sweep") && surface_file) {
+        fprintf(stderr, "ERROR: a response surface is swept in place of [sweep]\n");
+        return 0;
+    }
+    if(!_check_sweep(config))
+        return 0;
+
+    for(k=0; k<N_SWEEP_PARAMS; ++k)
+        sweep_values[k] = NULL;
+
+    for(k=0; k<N_SWEEP_PARAMS; ++k) {
+        if((window_interval > 0) && (k == N_SWEEP_PARAMS - 1)) {
+            if((window_end < initial_timestamp) || ((window_end - initial_timestamp) / 
+                        window_interval >= MAX_SWEEP_POINTS)) {
+                fprintf(stderr, "ERROR: %li: launch window ends before the "
+                        "launch or is too long\n", window_end);
+                goto fail;
+            }
+            n_sweep_values[k] = 1 + (window_end - initial_timestamp) / window_interval;
+            sweep_values[k] = (float*)malloc(sizeof(float) * n_sweep_values[k]);
+            for(i=0; i<n_sweep_values[k]; ++i)
+                sweep_values[k][i] = i * window_interval;
+        } else {
+            n_sweep_values[k] = _read_sweep(scenario, surface_file ? "surface" : "sweep", 
+                                            _sweep_keys[k], nominal[k], scale[k], 
+                                            &sweep_values[k]);
+            if(n_sweep_values[k] == 0)
+                goto fail;
+        }
+        // The surface interpolates in the reciprocals of the rates.
+        if(surface_file && ((k == SURFACE_ASCENT_RATE) || (k == SURFACE_DRAG_COEFF)) &&
+           (sweep_values[k][0] <= 0.f)) {
+            fprintf(stderr, "ERROR: %s: the values of a response surface must be "
+                    "positive\n", _sweep_keys[k]);
+            goto fail;
+        }
+        for(i=1; surface_file && (i<n_sweep_values[k]); ++i) {
+            if(sweep_values[k][i] <= sweep_values[k][i-1]) {
+                fprintf(stderr, "ERROR: %s: the values of a response surface "
+                        "must increase\n", _sweep_keys[k]);
+                goto fail;
+            }
+        }
+        n_sweep *= n_sweep_values[k];
+        if(n_sweep > MAX_SWEEP_POINTS) {
+            fprintf(stderr, "ERROR: a sweep may have at most %i points\n", MAX_SWEEP_POINTS);
+            goto fail;
+        }
+    }
+
+    config->n_sweep = (unsigned int)n_sweep;
+    *sweep_params = (altitude_params_t*)malloc(sizeof(altitude_params_t) * config->n_sweep);
+    for(i=0; i<config->n_sweep; ++i) {
+        float value[N_SWEEP_PARAMS];
+        unsigned int rest = i;
+
+        for(k=N_SWEEP_PARAMS; k>0; --k) {
+            value[k-1] = sweep_values[k-1][rest % n_sweep_values[k-1]];
+            rest /= n_sweep_values[k-1];
+        }
+
+        (*sweep_params)[i].ascent_rate = value[0];
+        (*sweep_params)[i].burst_altitude = value[1];
+        (*sweep_params)[i].drag_coeff = value[2];
+        (*sweep_params)[i].float_time = value[3];
+        (*sweep_params)[i].launch_time = value[4];
+    }
+
+    *sweep_landings = (run_model_landing_t*)malloc(sizeof(run_model_landing_t) * 
+                                                   config->n_sweep);
+    config->sweep_params = *sweep_params;
+    config->sweep_landings = *sweep_landings;
+
+    config->sweep_track_file = iniparser_getstring(scenario, "sweep:tracks", NULL);
+    if(gopt_arg(options, 'T', &argument) && strcmp(argument, "-"))
+        config->sweep_track_file = argument;
+
+    return 1;
+
+fail:
+    for(k=0; k<N_SWEEP_PARAMS; ++k)
+        free(sweep_values[k]);
+    return 0;
+}
+
+// Read the site grid in the [site-grid] section of scenario, about the
+// launch site initial_lat, initial_lng, into grid and its filename, and
+// sweep config over its sites with the nominal flight parameters. The points,
+// their sites and their landings are allocated in sweep_params, sweep_sites
+// and sweep_landings. Returns zero if the grid makes no sense.
+static int
+_read_site_grid_section(dictionary* scenario, float initial_lat, float initial_lng,
+                        const altitude_params_t* nominal, site_grid_t* grid, 
+                        const char** filename, altitude_params_t** sweep_params, 
+                        float** sweep_sites, run_model_landing_t** sweep_landings,
+                        run_model_config_t* config)
+{
+    unsigned int i;
+
+    if(!site_grid_init(grid, 
+                iniparser_getdouble(scenario, "site-grid:south", initial_lat),
+                iniparser_getdouble(scenario, "site-grid:west", initial_lng),
+                iniparser_getdouble(scenario, "site-grid:north", initial_lat),
+                iniparser_getdouble(scenario, "site-grid:east", initial_lng),
+                iniparser_getdouble(scenario, "site-grid:resolution", 1000.0)) ||
+       ((double)grid->n_lat * grid->n_lng > MAX_SWEEP_POINTS)) {
+        fprintf(stderr, "ERROR: invalid site grid\n");
+        return 0;
+    }
+    if(!_check_sweep(config))
+        return 0;
+    *filename = iniparser_getstring(scenario, "site-grid:filename", "site-grid.bin");
+
+    config->n_sweep = site_grid_get_n_sites(grid);
+    *sweep_params = (altitude_params_t*)malloc(sizeof(altitude_params_t) * config->n_sweep);
+    *sweep_sites = (float*)malloc(sizeof(float) * 2 * config->n_sweep);
+    for(i=0; i<config->n_sweep; ++i) {
+        (*sweep_params)[i] = *nominal;
+        site_grid_get_site(grid, i, &(*sweep_sites)[2*i], &(*sweep_sites)[2*i+1]);
+    }
+
+    *sweep_landings = (run_model_landing_t*)malloc(sizeof(run_model_landing_t) * 
+                                                   config->n_sweep);
+    config->sweep_params = *sweep_params;
+    config->sweep_landings = *sweep_landings;
+    config->sweep_sites = *sweep_sites;
+
+    return 1;
+}
+
+// Read where the run is checkpointed and which checkpoint it resumes from
+// from the [checkpoint] section of scenario, or -c and -R, into config.
+// Returns zero if they make no sense.
+static int
+_read_checkpoint_section(dictionary* scenario, const void* options, 
+                         run_model_config_t* config)
+{
+    const char* argument;
+
+    config->checkpoint_file = iniparser_getstring(scenario, "checkpoint:filename", NULL);
+    if(gopt_arg(options, 'c', &argument) && strcmp(argument, "-"))
+        config->checkpoint_file = argument;
+    config->checkpoint_interval = iniparser_getdouble(scenario, "checkpoint:interval", 
+                                                      config->checkpoint_interval);
+    config->checkpoint_end = iniparser_getdouble(scenario, "checkpoint:end", 
+                                                 config->checkpoint_end);
+    if((config->checkpoint_interval <= 0.f) || (config->checkpoint_end < 0.f)) {
+        fprintf(stderr, "ERROR: checkpoint interval must be positive\n");
+        return 0;
+    }
+    config->resume_file = iniparser_getstring(scenario, "checkpoint:resume", NULL);
+    if(gopt_arg(options, 'R', &argument) && strcmp(argument, "-"))
+        config->resume_file = argument;
+
+    // Only the track and landings can be written again from a checkpoint.
+    if(config->resume_file && (config->summary_file || config->sweep_track_file)) {
+        fprintf(stderr, "ERROR: a resumed run cannot write a summary track or "
+                "sweep tracks\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+// Read the target and bounds of an inverse prediction from the [solve]
+// section of scenario, whose launch site is initial_lat, initial_lng, into
+// solve. Returns zero if they make no sense or config cannot be solved for.
+static int
+_read_solve_section(dictionary* scenario, const run_model_config_t* config,
+                    float initial_lat, float initial_lng, solve_config_t* solve)
+{
+    const char* unknowns_name;
+
+    if((config->n_sweep > 0) || (config->sampling == SAMPLING_UNSCENTED) ||
+       config->resume_file) {
+        fprintf(stderr, "ERROR: cannot solve for the launch of a sweep, a "
+                "resumed run or with unscented sampling\n");
+        return 0;
+    }
+
+    solve_config_init(solve, initial_lat, initial_lng);
+
+    unknowns_name = iniparser_getstring(scenario, "solve:vary", "site");
+    solve->unknowns = solve_unknowns_from_name(unknowns_name);
+    if(solve->unknowns < 0) {
+        fprintf(stderr, "ERROR: %s: can only vary the launch site or time\n", 
+                unknowns_name);
+        return 0;
+    }
+
+    solve->target_lat = iniparser_getdouble(scenario, "solve:latitude", solve->target_lat);
+    solve->target_lng = iniparser_getdouble(scenario, "solve:longitude", solve->target_lng);
+    solve->south = iniparser_getdouble(scenario, "solve:south", solve->south);
+    solve->west = iniparser_getdouble(scenario, "solve:west", solve->west);
+    solve->north = iniparser_getdouble(scenario, "solve:north", solve->north);
+    solve->east = iniparser_getdouble(scenario, "solve:east", solve->east);
+    solve->earliest = iniparser_getdouble(scenario, "solve:earliest", solve->earliest);
+    solve->latest = iniparser_getdouble(scenario, "solve:latest", solve->latest);
+    solve->tolerance = iniparser_getdouble(scenario, "solve:tolerance", solve->tolerance);
+    solve->max_iterations = iniparser_getint(scenario, "solve:iterations", 
+                                             solve->max_iterations);
+    if((solve->north < solve->south) || (solve->east < solve->west) || 
+       (solve->latest < solve->earliest) || (solve->tolerance < 0.f)) {
+        fprintf(stderr, "ERROR: invalid bounds on the launch\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+// Read how a live prediction follows its fixes from the [live] section of
+// scenario into live. other_mode is non-zero if the scenario also solves,
+// finds the sensitivity or follows a profile. Returns zero if they make no
+// sense or config cannot be predicted live.
+static int
+_read_live_section(dictionary* scenario, const run_model_config_t* config,
+                   int other_mode, int descending, live_config_t* live)
+{
+    if((config->n_sweep > 0) || other_mode || 
+       (config->resample_threshold > 0.f) || (config->sampling == SAMPLING_UNSCENTED) ||
+       config->summary_file || config->landing_grid_file ||
+       config->checkpoint_file || config->resume_file) {
+        fprintf(stderr, "ERROR: a live prediction cannot sweep, solve, follow a "
+                "profile, resample, use unscented sampling, checkpoint, resume "
+                "or write a summary track, landing grid or sensitivity\n");
+        return 0;
+    }
+
+    live_config_init(live);
+    live->window = iniparser_getdouble(scenario, "live:window", live->window);
+    live->burst_drop = iniparser_getdouble(scenario, "live:burst-drop", live->burst_drop);
+    live->descending = descending;
+    if((live->window < 0.f) || (live->burst_drop <= 0.f)) {
+        fprintf(stderr, "ERROR: invalid live prediction window or burst drop\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+// Read the descent map in the [descent-map] section of scenario, about the
+// launch site initial_lat, initial_lng at initial_timestamp with the burst
+// altitude burst_alt: its grid, its burst altitudes, allocated in altitudes,
+// its n_times times every interval seconds and the file it is written to.
+// other_mode is non-zero if the scenario also solves, predicts live, finds
+// the sensitivity or follows a profile. Returns zero if they make no sense
+// or config cannot be mapped.
+static int
+_read_descent_map_section(dictionary* scenario, const run_model_config_t* config,
+                          int other_mode, float initial_lat, float initial_lng,
+                          long int initial_timestamp, float burst_alt, site_grid_t* grid,
+                          float** altitudes, unsigned int* n_altitudes, 
+                          long int* interval, unsigned int* n_times, const char** filename)
+{
+    long int end;
+    unsigned int i;
+
+    if((config->n_sweep > 0) || other_mode || config->summary_file || 
+       config->landing_grid_file || config->checkpoint_file || config->resume_file ||
+       (config->resample_threshold > 0.f) || (config->sampling == SAMPLING_UNSCENTED)) {
+        fprintf(stderr, "ERROR: a descent map cannot be combined with a sweep, "
+                "site grid, solve, live prediction, profile, summary track, "
+                "landing grid, sensitivity, checkpoint, resampling or unscented "
+                "sampling\n");
+        return 0;
+    }
+
+    if(!site_grid_init(grid, 
+                iniparser_getdouble(scenario, "descent-map:south", initial_lat),
+                iniparser_getdouble(scenario, "descent-map:west", initial_lng),
+                iniparser_getdouble(scenario, "descent-map:north", initial_lat),
+                iniparser_getdouble(scenario, "descent-map:east", initial_lng),
+                iniparser_getdouble(scenario, "descent-map:resolution", 5000.0)) ||
+       ((double)grid->n_lat * grid->n_lng > MAX_SWEEP_POINTS)) {
+        fprintf(stderr, "ERROR: invalid descent map grid\n");
+        return 0;
+    }
+
+    *n_altitudes = _read_sweep(scenario, "descent-map", "altitudes", 
+                               burst_alt, 1.0, altitudes);
+    if(*n_altitudes == 0)
+        return 0;
+    for(i=1; i<*n_altitudes; ++i) {
+        if((*altitudes)[i] <= (*altitudes)[i-1])
+            break;
+    }
+
+    end = iniparser_getint(scenario, "descent-map:end", initial_timestamp + 10800);
+    *interval = iniparser_getint(scenario, "descent-map:interval", 3600);
+    if((*n_altitudes < 2) || (i < *n_altitudes) || (*interval <= 0) || 
+       (end <= initial_timestamp)) {
+        fprintf(stderr, "ERROR: a descent map needs at least two burst altitudes, "
+                "in increasing order, and two times\n");
+        free(*altitudes);
+        *altitudes = NULL;
+        return 0;
+    }
+    *n_times = 1 + (end - initial_timestamp) / *interval;
+
+    *filename = iniparser_getstring(scenario, "descent-map:filename", "descent-map.bin");
+
+    return 1;
+}
+
+// Read the budget (s) of the coarse pass of a progressive prediction from
+// the [progressive] section of scenario, or -P, into budget. Zero predicts
+// the flight only once. single_flight is non-zero if the scenario predicts a
+// single flight. Returns zero if the budget makes no sense.
+static int
+_read_progressive_section(dictionary* scenario, const void* options, int single_flight,
+                          float* budget)
+{
+    const char* argument;
+    char* endptr;
+
+    *budget = iniparser_getdouble(scenario, "progressive:budget", 0.0);
+    if(gopt_arg(options, 'P', &argument) && strcmp(argument, "-")) {
+        *budget = strtod(argument, &endptr);
+        if (endptr == argument) {
+            fprintf(stderr, "ERROR: %s: invalid progressive budget\n", argument);
+            return 0;
+        }
+    }
+    if(*budget < 0.f) {
+        fprintf(stderr, "ERROR: progressive budget must not be negative\n");
+        return 0;
+    }
+    if((*budget > 0.f) && !single_flight) {
+        fprintf(stderr, "ERROR: only a single flight can be predicted progressively\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+// Write where and when a flight landed to filename, as a line of "landing",
+// latitude, longitude and timestamp, followed by how far north and east (m)
+// and how much later (s) it lands per unit of each flight parameter, one line
+// for each named as in the [sweep] section. Returns non-zero on success.
+static int
+_write_sensitivity(const char* filename, const run_model_sensitivity_t* sensitivity)
+{
+    // The descent rate is the drag coefficient scaled as in the scenario.
+    static const char* names[SENSITIVITY_PARAMS] = { 
+        "ascent-rate", "burst-altitude", "descent-rate" 
+    };
+    static const float scale[SENSITIVITY_PARAMS] = { 1.0, 1.0, 1.1045 };
+    FILE* file;
+    unsigned int k;
+    int ok;
+
+    file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "ERROR: %s: could not open sensitivity file for output\n", filename);
+        return 0;
+    }
+
+    fprintf(file, "landing,%g,%g,%li\n", 
+            sensitivity->lat, sensitivity->lng, sensitivity->timestamp);
+    for(k=0; k<SENSITIVITY_PARAMS; ++k) {
+        fprintf(file, "%s,%g,%g,%g\n", names[k], sensitivity->d_north[k] * scale[k],
+                sensitivity->d_east[k] * scale[k], sensitivity->d_time[k] * scale[k]);
+    }
+
+    ok = !ferror(file);
+    if (fclose(file) != 0)
+        ok = 0;
+    if (!ok)
+        fprintf(stderr, "ERROR: %s: error writing sensitivity\n", filename);
+
+    return ok;
+}
+
+// Write the launch and where the flight from it lands, looked up in surface,
+// as the track. Returns zero if the flight cannot be looked up in surface or
+// the estimated error of the lookup is more than max_error (m).
+static int
+_write_from_surface(const surface_t* surface, const altitude_model_t* alt_model,
+                    float lat, float lng, float alt, long int timestamp, float rmserror,
+                    float max_error)
+{
+    altitude_params_t params;
+    run_model_landing_t landing;
+    float error;
+
+    altitude_model_get_params(alt_model, &params);
+    if(!surface_lookup(surface, lat, lng, alt, timestamp, rmserror, &params, 
+                       &landing, &error)) {
+        fprintf(stderr, "INFO: The flight cannot be looked up in the response surface.\n");
+        return 0;
+    }
+
+    if(error > max_error) {
+        fprintf(stderr, "INFO: The estimated error of the response surface, %.0fm, is "
+                "too large, flying the flight.\n", error);
+        return 0;
+    }
+
+    write_position(lat, lng, alt, timestamp);
+    write_position(landing.lat, landing.lng, 0.f, landing.timestamp);
+
+    fprintf(stderr, "INFO: Looked up the landing in the response surface, estimated "
+            "error %.0fm, spread %.0fm north and %.0fm east.\n", 
+            error, landing.sd_north, landing.sd_east);
+
+    return 1;
+}
+
+// Write the track of a coarse prediction of the flight, a single unperturbed
+// member integrated with large Runge-Kutta steps, followed by a blank line.
+// The track is held back until the prediction is complete, so nothing but
+// the blank line is written if it fails or takes longer than budget seconds.
+// The wind data it loads stays loaded for the full prediction which follows.
+static void
+_write_coarse(wind_file_cache_t* cache, const altitude_model_t* alt_model,
+              float lat, float lng, float alt, long int timestamp, 
+              float budget, const run_model_config_t* config)
+{
+    run_model_config_t coarse;
+    FILE* kml = kml_file;
+    FILE* full = output;
+    FILE* track;
+    char buffer[4096];
+    size_t n;
+    int ok;
+
+    run_model_config_init(&coarse);
+    coarse.seed = config->seed;
+    coarse.integrator = INTEGRATOR_RK4;
+    coarse.step = COARSE_STEP;
+    coarse.time_limit = budget;
+    coarse.keep_wind_data = 1;
+
+    track = tmpfile();
+    if (!track) {
+        fprintf(stderr, "ERROR: could not open a temporary file for the coarse track\n");
+        exit(1);
+    }
+
+    // Only the full prediction goes in the KML file.
+    kml_file = NULL;
+    output = track;
+    ok = run_model(cache, alt_model, lat, lng, alt, timestamp, 0.f, &coarse);
+    output = full;
+    kml_file = kml;
+
+    if (ok) {
+        rewind(track);
+        while ((n = fread(buffer, 1, sizeof(buffer), track)) > 0)
+            fwrite(buffer, 1, n, output);
+    } else {
+        fprintf(stderr, "WARN: The coarse prediction failed or ran out of time, "
+                "writing no coarse track.\n");
+    }
+    fclose(track);
+
+    fprintf(output, "\n");
+    fflush(output);
+    if (ferror(output)) {
+      fprintf(stderr, "ERROR: error writing to CSV file\n");
+      exit(1);
+    }
+}
+
 int main(int argc, const char *argv[]) {
     
     const char* argument;
     
     long int initial_timestamp;
     float initial_lat, initial_lng, initial_alt;
-    float burst_alt, ascent_rate, drag_coeff, rmswinderror;
+    float burst_alt, ascent_rate, drag_coeff, float_time, rmswinderror;
     int descent_mode;
     int scenario_idx, n_scenarios;
+    int n_members, n_threads;
+    unsigned long seed;
+    int have_seed;
+    long int window_end = 0, window_interval = 0;
+    const char* integrator_name;
+    const char* sampling_name;
+    const char* profile_file;
+    run_model_config_t config;
+    float* sweep_values[N_SWEEP_PARAMS];
+    unsigned int n_sweep_values[N_SWEEP_PARAMS];
+    altitude_params_t* sweep_params = NULL;
+    run_model_landing_t* sweep_landings = NULL;
+    float* sweep_sites = NULL;
+    site_grid_t site_grid;
+    const char* site_grid_file;
+    const char* sensitivity_file;
+    const char* descent_map_file;
+    site_grid_t descent_map_grid;
+    float* descent_map_altitudes = NULL;
+    unsigned int n_descent_map_altitudes = 0, n_descent_map_times = 0;
+    long int descent_map_interval = 0;
+    const char* surface_file;
+    surface_t* surface = NULL;
+    int use_surface;
+    float surface_max_error = HUGE_VALF;
+    float progressive_budget;
+    solve_config_t solve;
+    int solving;
+    live_config_t live;
+    int live_mode;
     char* endptr;       // used to check for errors on strtod calls 
     
     wind_file_cache_t* file_cache;
+    run_model_ascent_cache_t* ascent_cache = NULL;
     dictionary*        scenario = NULL;
     
     // configure command-line options parsing
@@ -54,7 +709,26 @@ int main(int argc, const char *argv[]) {
         gopt_option('t', GOPT_ARG, gopt_shorts('t'), gopt_longs("start_time")),
         gopt_option('i', GOPT_ARG, gopt_shorts('i'), gopt_longs("data_dir")),
         gopt_option('d', 0, gopt_shorts('d'), gopt_longs("descending")),
-        gopt_option('e', GOPT_ARG, gopt_shorts('e'), gopt_longs("wind_error"))
+        gopt_option('e', GOPT_ARG, gopt_shorts('e'), gopt_longs("wind_error")),
+        gopt_option('n', GOPT_ARG, gopt_shorts('n'), gopt_longs("members")),
+        gopt_option('j', GOPT_ARG, gopt_shorts('j'), gopt_longs("threads")),
+        gopt_option('s', GOPT_ARG, gopt_shorts('s'), gopt_longs("seed")),
+        gopt_option('m', GOPT_ARG, gopt_shorts('m'), gopt_longs("integrator")),
+        gopt_option('p', GOPT_ARG, gopt_shorts('p'), gopt_longs("profile")),
+        gopt_option('g', GOPT_ARG, gopt_shorts('g'), gopt_longs("landing_grid")),
+        gopt_option('r', GOPT_ARG, gopt_shorts('r'), gopt_longs("resample")),
+        gopt_option('S', GOPT_ARG, gopt_shorts('S'), gopt_longs("sampling")),
+        gopt_option('u', GOPT_ARG, gopt_shorts('u'), gopt_longs("summary")),
+        gopt_option('w', GOPT_ARG, gopt_shorts('w'), gopt_longs("window")),
+        gopt_option('T', GOPT_ARG, gopt_shorts('T'), gopt_longs("tracks")),
+        gopt_option('J', GOPT_ARG, gopt_shorts('J'), gopt_longs("sensitivity")),
+        gopt_option('l', 0, gopt_shorts('l'), gopt_longs("live")),
+        gopt_option('c', GOPT_ARG, gopt_shorts('c'), gopt_longs("checkpoint")),
+        gopt_option('R', GOPT_ARG, gopt_shorts('R'), gopt_longs("resume")),
+        gopt_option('Q', GOPT_ARG, gopt_shorts('Q'), gopt_longs("descent_map")),
+        gopt_option('A', GOPT_ARG, gopt_shorts('A'), gopt_longs("surface")),
+        gopt_option('E', GOPT_ARG, gopt_shorts('E'), gopt_longs("surface_error")),
+        gopt_option('P', GOPT_ARG, gopt_shorts('P'), gopt_longs("progressive"))
     ));
 
     if (gopt(options, 'h')) {
@@ -74,6 +748,60 @@ int main(int argc, const char *argv[]) {
         printf("                           burst or cutdown. burst_alt and ascent_rate ignored.\n");
         printf(" -i --data_dir <dir>     Input directory for wind data, defaults to current dir.\n\n");
         printf(" -e --wind_error <err>   RMS windspeed error (m/s).\n");
+        printf(" -n --members <int>      Number of ensemble members. Overrides scenario.\n");
+        printf(" -j --threads <int>      Number of worker threads, defaults to the number of CPUs.\n");
+        printf(" -s --seed <int>         Seed for the random wind perturbations. Runs with the\n");
+        printf("                           same seed give the same result. Overrides scenario,\n");
+        printf("                           defaults to random.\n");
+        printf(" -r --resample <frac>    Resample the ensemble by likelihood whenever its\n");
+        printf("                           effective size falls below this fraction of the\n");
+        printf("                           live members. Overrides scenario, defaults to 0 (never).\n");
+        printf(" -S --sampling <name>    Perturb the ensemble with random or sobol (scrambled\n");
+        printf("                           quasi-random) wind errors, or fly the sigma points of\n");
+        printf("                           the unscented transform of the flight and wind\n");
+        printf("                           uncertainties. Overrides scenario, defaults to random.\n");
+        printf(" -u --summary <file>     Write the mean, spread and altitude percentiles of the\n");
+        printf("                           flying members to file every %i timesteps and\n", LOG_DECIMATE);
+        printf("                           report where and when they landed. Overrides scenario.\n");
+        printf(" -m --integrator <name>  Integrate trajectories with euler, rk4 or rk45 (adaptive).\n");
+        printf("                           Overrides scenario, defaults to euler.\n");
+        printf(" -p --profile <file>     Follow the time, altitude profile in file before\n");
+        printf("                           descending. Overrides scenario.\n");
+        printf(" -g --landing_grid <file> Write the probability of landing in each cell of a\n");
+        printf("                           grid to file, as GeoJSON cell polygons if it ends in\n");
+        printf("                           .json or .geojson. Overrides scenario.\n");
+        printf(" -w --window <end>:<int> Sweep the launch time from the start time to the\n");
+        printf("                           timestamp end every int seconds, flying every launch\n");
+        printf("                           together. Writes a table of where each landed.\n");
+        printf(" -T --tracks <file>      Write the track of each point of a sweep to file.\n");
+        printf("                           Overrides scenario.\n");
+        printf(" -J --sensitivity <file> Write how far the unperturbed flight's landing moves\n");
+        printf("                           per unit of ascent rate, burst altitude and descent\n");
+        printf("                           rate to file. Overrides scenario.\n");
+        printf(" -l --live               Read telemetry fixes of timestamp, latitude, longitude\n");
+        printf("                           and altitude from standard input and write where the\n");
+        printf("                           flight will land after each. The wind data stays\n");
+        printf("                           loaded between fixes. Needs a scenario file.\n");
+        printf(" -c --checkpoint <file>  Save the state of the run to file every hour of the\n");
+        printf("                           flight or as often as the scenario says. Overrides\n");
+        printf("                           scenario.\n");
+        printf(" -R --resume <file>      Carry on from the run saved in file, for example with\n");
+        printf("                           newer wind data. Overrides scenario.\n");
+        printf(" -Q --descent_map <file> Read bursts of timestamp, latitude, longitude and\n");
+        printf("                           altitude from standard input and write where each\n");
+        printf("                           lands, looked up in the descent map in file or, off\n");
+        printf("                           the map, flown. The map must have been flown\n");
+        printf("                           in the same wind data. Needs no scenario.\n");
+        printf(" -A --surface <file>     Look the landing up in the response surface in file\n");
+        printf("                           and write the launch and landing as the track. Flights\n");
+        printf("                           outside it are flown as usual. A surface which cannot\n");
+        printf("                           be read or was flown in other wind data is ignored.\n");
+        printf(" -E --surface_error <m>  Fly flights whose landing looked up with -A has an\n");
+        printf("                           estimated error of more than m metres in full.\n");
+        printf(" -P --progressive <s>    Write a coarse track of a single member, or none if\n");
+        printf("                           it takes more than about s seconds, and a blank line\n");
+        printf("                           before the full prediction, flushing each line as it\n");
+        printf("                           is written. Overrides scenario.\n");
         printf("The scenario file is an INI-like file giving the launch scenario. If it is\n");
         printf("omitted, the scenario is read from standard input.\n");
       exit(0);
@@ -115,10 +843,106 @@ int main(int argc, const char *argv[]) {
     if (!(gopt_arg(options, 'i', &data_dir) && strcmp(data_dir, "-")))
       data_dir = "./";
 
+    if (gopt_arg(options, 'j', &argument) && strcmp(argument, "-")) {
+      n_threads = strtol(argument, &endptr, 0);
+      if (endptr == argument || n_threads < 1) {
+        fprintf(stderr, "ERROR: %s: invalid number of threads\n", argument);
+        exit(1);
+      }
+    } else {
+      n_threads = g_get_num_processors();
+    }
+
+    seed = 0;
+    have_seed = 0;
+    if (gopt_arg(options, 's', &argument) && strcmp(argument, "-")) {
+      seed = strtoul(argument, &endptr, 0);
+      if (endptr == argument) {
+        fprintf(stderr, "ERROR: %s: invalid random seed\n", argument);
+        exit(1);
+      }
+      have_seed = 1;
+    }
+
+    if (gopt_arg(options, 'w', &argument) && strcmp(argument, "-")) {
+      window_end = strtol(argument, &endptr, 0);
+      if (endptr != argument && *endptr == ':')
+        window_interval = strtol(endptr + 1, &endptr, 0);
+      if (*endptr != '\0' || window_interval <= 0) {
+        fprintf(stderr, "ERROR: %s: invalid launch window\n", argument);
+        exit(1);
+      }
+    }
+
+
+    // pick the fastest way of interpolating the wind this CPU has
+    argument = wind_file_batch_init();
+    if(verbosity > 0)
+      fprintf(stderr, "INFO: Using %s wind interpolation.\n", argument);
 
     // populate wind data file cache
     file_cache = wind_file_cache_new(data_dir);
 
+    // A live prediction reads its fixes from standard input.
+    live_mode = gopt(options, 'l');
+    if(live_mode && (argc != 2)) {
+        fprintf(stderr, "ERROR: a live prediction needs exactly one scenario file\n");
+        exit(1);
+    }
+
+    // A descent map answers the bursts read from standard input by itself.
+    // Bursts off the map are flown by a single unperturbed member.
+    if (gopt_arg(options, 'Q', &argument) && strcmp(argument, "-")) {
+        descent_map_t* map = descent_map_read(argument, file_cache);
+
+        if (!map)
+            exit(1);
+
+        output = stdout;
+        if (gopt_arg(options, 'o', &argument) && strcmp(argument, "-")) {
+            output = fopen(argument, "wb");
+            if (!output) {
+                fprintf(stderr, "ERROR: %s: could not open CSV file for output\n", argument);
+                exit(1);
+            }
+        }
+
+        run_model_config_init(&config);
+        config.n_threads = n_threads;
+        if (!descent_map_predict(stdin, output, file_cache, map, 0.f, &config)) {
+            fprintf(stderr, "ERROR: error during descent map prediction!\n");
+            exit(1);
+        }
+
+        if (output != stdout)
+            fclose(output);
+        descent_map_free(map);
+        gopt_free(options);
+        wind_file_cache_free(file_cache);
+
+        return 0;
+    }
+
+    if (gopt_arg(options, 'A', &argument) && strcmp(argument, "-")) {
+        // A stale surface is no reason not to answer: fly in full instead.
+        surface = surface_read(argument, file_cache);
+        if (!surface)
+            fprintf(stderr, "WARN: %s: flights will be flown in full\n", argument);
+    }
+
+    if (gopt_arg(options, 'E', &argument) && strcmp(argument, "-")) {
+        surface_max_error = strtod(argument, &endptr);
+        if (endptr == argument || *endptr != '\0') {
+            fprintf(stderr, "ERROR: %s: invalid surface error\n", argument);
+            exit(1);
+        }
+        if (surface_max_error < 0.f) {
+            fprintf(stderr, "ERROR: %s: the error of a surface lookup cannot be "
+                    "negative\n", argument);
+            exit(1);
+        }
+    }
+
     // read in flight parameters
     n_scenarios = argc - 1;
     if(n_scenarios == 0) {
@@ -126,6 +950,23 @@ int main(int argc, const char *argv[]) {
         n_scenarios = 1;
     }
 
+    // Scenarios which share a launch and ascent share its integration. Ask
+    // for a checkpoint before each burst altitude so that whichever order
+    // they come in each can start from the latest one before its own burst.
+    if(n_scenarios > 1) {
+        ascent_cache = run_model_ascent_cache_new();
+
+        for(scenario_idx = 0; scenario_idx < n_scenarios; ++scenario_idx) {
+            scenario = iniparser_load(argv[scenario_idx+1]);
+            if(!scenario)
+                continue;
+
+            run_model_ascent_cache_request(ascent_cache, iniparser_getdouble(scenario, 
+                        "altitude-model:burst-altitude", 1.0));
+            iniparser_freedict(scenario);
+        }
+    }
+
     for(scenario_idx = 0; scenario_idx < n_scenarios; ++scenario_idx) {
         char* scenario_output = NULL;
 
@@ -192,6 +1033,12 @@ int main(int argc, const char *argv[]) {
 
         burst_alt = iniparser_getdouble(scenario, "altitude-model:burst-altitude", 1.0);
 
+        float_time = iniparser_getdouble(scenario, "altitude-model:float-time", 0.0);
+
+        profile_file = iniparser_getstring(scenario, "altitude-model:profile", NULL);
+        if(gopt_arg(options, 'p', &argument) && strcmp(argument, "-"))
+            profile_file = argument;
+
         rmswinderror = iniparser_getdouble(scenario, "atmosphere:wind-error", 0.0);
         if(gopt_arg(options, 'e', &argument) && strcmp(argument, "-")) {
             rmswinderror = strtod(argument, &endptr);
@@ -201,6 +1048,126 @@ int main(int argc, const char *argv[]) {
             }
         }
 
+        n_members = iniparser_getint(scenario, "ensemble:members", 1);
+        if(gopt_arg(options, 'n', &argument) && strcmp(argument, "-")) {
+            n_members = strtol(argument, &endptr, 0);
+            if (endptr == argument) {
+                fprintf(stderr, "ERROR: %s: invalid number of ensemble members\n", argument);
+                exit(1);
+            }
+        }
+        if(n_members < 1) {
+            fprintf(stderr, "ERROR: %i: ensemble must have at least one member\n", n_members);
+            exit(1);
+        }
+
+        // a seed given on the command line wins over one in the scenario. If
+        // neither gives one, pick one at random.
+        if(!have_seed) {
+            const char* seed_str = iniparser_getstring(scenario, "ensemble:seed", NULL);
+            if(seed_str) {
+                seed = strtoul(seed_str, &endptr, 0);
+                if (endptr == seed_str) {
+                    fprintf(stderr, "ERROR: %s: invalid random seed\n", seed_str);
+                    exit(1);
+                }
+            } else {
+                seed = g_random_int();
+            }
+        }
+
+        run_model_config_init(&config);
+        config.n_members = n_members;
+        config.n_threads = n_threads;
+        config.seed = seed;
+
+        integrator_name = iniparser_getstring(scenario, "integrator:method", "euler");
+        if(gopt_arg(options, 'm', &argument) && strcmp(argument, "-"))
+            integrator_name = argument;
+        config.integrator = run_model_integrator_from_name(integrator_name);
+        if(config.integrator < 0) {
+            fprintf(stderr, "ERROR: %s: unknown integrator\n", integrator_name);
+            exit(1);
+        }
+
+        config.step = iniparser_getdouble(scenario, "integrator:step", config.step);
+        config.tolerance = iniparser_getdouble(scenario, "integrator:tolerance", config.tolerance);
+        if((config.step <= 0.f) || (config.tolerance <= 0.f)) {
+            fprintf(stderr, "ERROR: integrator step and tolerance must be positive\n");
+            exit(1);
+        }
+
+        config.resample_threshold = iniparser_getdouble(scenario, 
+                "ensemble:resample-threshold", config.resample_threshold);
+        if(gopt_arg(options, 'r', &argument) && strcmp(argument, "-")) {
+            config.resample_threshold = strtod(argument, &endptr);
+            if (endptr == argument) {
+                fprintf(stderr, "ERROR: %s: invalid resampling threshold\n", argument);
+                exit(1);
+            }
+        }
+        if((config.resample_threshold < 0.f) || (config.resample_threshold > 1.f)) {
+            fprintf(stderr, "ERROR: resampling threshold must be between 0 and 1\n");
+            exit(1);
+        }
+
+        sampling_name = iniparser_getstring(scenario, "ensemble:sampling", "random");
+        if(gopt_arg(options, 'S', &argument) && strcmp(argument, "-"))
+            sampling_name = argument;
+        config.sampling = run_model_sampling_from_name(sampling_name);
+        if(config.sampling < 0) {
+            fprintf(stderr, "ERROR: %s: unknown sampling method\n", sampling_name);
+            exit(1);
+        }
+
+        // The uncertainties of the flight parameters from which each member
+        // draws its own.
+        if(!_read_uncertainty(scenario, "ascent-rate", 1.0, &config.params_sd.ascent_rate,
+                              &config.params_min.ascent_rate, 
+                              &config.params_max.ascent_rate) ||
+           !_read_uncertainty(scenario, "burst-altitude", 1.0, 
+                              &config.params_sd.burst_altitude,
+                              &config.params_min.burst_altitude, 
+                              &config.params_max.burst_altitude) ||
+           !_read_uncertainty(scenario, "descent-rate", 1.1045, &config.params_sd.drag_coeff,
+                              &config.params_min.drag_coeff, 
+                              &config.params_max.drag_coeff) ||
+           !_read_uncertainty(scenario, "float-time", 1.0, &config.params_sd.float_time,
+                              &config.params_min.float_time, 
+                              &config.params_max.float_time) ||
+           !_read_uncertainty(scenario, "launch-time", 1.0, &config.params_sd.launch_time,
+                              &config.params_min.launch_time, 
+                              &config.params_max.launch_time))
+            exit(1);
+        if((profile_file || descent_mode) && ((config.params_sd.launch_time > 0.f) ||
+                    (config.params_max.launch_time > config.params_min.launch_time))) {
+            fprintf(stderr, "WARN: Launch time uncertainty is ignored when following a "
+                    "profile or descending.\n");
+        }
+
+        if(!profile_file && !descent_mode)
+            config.ascent_cache = ascent_cache;
+
+        // The scenarios may launch in any order so a later one may need the
+        // wind data an earlier one has passed.
+        config.keep_wind_data = (n_scenarios > 1);
+
+        config.summary_file = iniparser_getstring(scenario, "ensemble:summary", NULL);
+        if(gopt_arg(options, 'u', &argument) && strcmp(argument, "-"))
+            config.summary_file = argument;
+
+        config.landing_grid_file = iniparser_getstring(scenario, "landing-grid:filename", NULL);
+        if(gopt_arg(options, 'g', &argument) && strcmp(argument, "-"))
+            config.landing_grid_file = argument;
+        config.landing_grid_resolution = iniparser_getdouble(scenario, 
+                "landing-grid:resolution", config.landing_grid_resolution);
+        config.landing_grid_bandwidth = iniparser_getdouble(scenario, 
+                "landing-grid:bandwidth", config.landing_grid_bandwidth);
+        if((config.landing_grid_resolution <= 0.f) || (config.landing_grid_bandwidth < 0.f)) {
+            fprintf(stderr, "ERROR: landing grid resolution must be positive\n");
+            exit(1);
+        }
+
         {
             int year, month, day, hour, minute, second;
             year = iniparser_getint(scenario, "launch-time:year", -1);
@@ -245,6 +1212,100 @@ int main(int argc, const char *argv[]) {
             }
         }
 
+        // A sweep flies the ensemble at every combination of the swept
+        // parameters and writes a table of where each landed in place of the
+        // track. A launch window sweeps the launch time. A response surface
+        // is a sweep which is also written to a file for looking flights up
+        // in with -A.
+        surface_file = NULL;
+        if(iniparser_find_entry(scenario, "surface"))
+            surface_file = iniparser_getstring(scenario, "surface:filename", "surface.bin");
+        if(iniparser_find_entry(scenario, "sweep") || surface_file || (window_interval > 0)) {
+            const float nominal[N_SWEEP_PARAMS] = { 
+                ascent_rate, burst_alt, drag_coeff, float_time, 0.f 
+            };
+
+            if(!_read_sweep_section(scenario, options, surface_file, nominal, 
+                                    initial_timestamp, window_end, window_interval,
+                                    n_sweep_values, sweep_values, &sweep_params, 
+                                    &sweep_landings, &config))
+                exit(1);
+        }
+
+        // A site grid is a sweep of the launch site over the centres of the
+        // cells of a grid. A raster of where each landed is written as well
+        // as the table.
+        site_grid_file = NULL;
+        if(iniparser_find_entry(scenario, "site-grid")) {
+            altitude_params_t nominal;
+
+            nominal.ascent_rate = ascent_rate;
+            nominal.burst_altitude = burst_alt;
+            nominal.drag_coeff = drag_coeff;
+            nominal.float_time = float_time;
+            nominal.launch_time = 0.f;
+            if(!_read_site_grid_section(scenario, initial_lat, initial_lng, &nominal,
+                                        &site_grid, &site_grid_file, &sweep_params,
+                                        &sweep_sites, &sweep_landings, &config))
+                exit(1);
+        }
+
+        // A run may be saved as it goes and carried on from where a saved
+        // one had got to.
+        if(!_read_checkpoint_section(scenario, options, &config))
+            exit(1);
+
+        // The sensitivity of the landing to the flight parameters is found
+        // alongside a single flight.
+        sensitivity_file = iniparser_getstring(scenario, "output:sensitivity", NULL);
+        if(gopt_arg(options, 'J', &argument) && strcmp(argument, "-"))
+            sensitivity_file = argument;
+        if(sensitivity_file && (config.n_sweep > 0)) {
+            fprintf(stderr, "ERROR: cannot find the sensitivity of a sweep\n");
+            exit(1);
+        }
+
+        // An inverse prediction searches for the launch site or time which
+        // lands nearest a target and then predicts the flight from it.
+        solving = iniparser_find_entry(scenario, "solve");
+        if(solving && 
+           !_read_solve_section(scenario, &config, initial_lat, initial_lng, &solve))
+            exit(1);
+
+        // A live prediction re-predicts the flight from each telemetry fix
+        // in place of the launch.
+        if(live_mode && 
+           !_read_live_section(scenario, &config, solving || sensitivity_file || profile_file,
+                               descent_mode == DESCENT_MODE_DESCENDING, &live))
+            exit(1);
+
+        // A descent map flies down from every cell of a site grid at each of
+        // a list of burst altitudes and a series of times in place of the
+        // flight, and is written to a file for looking bursts up in with -Q.
+        descent_map_file = NULL;
+        if(iniparser_find_entry(scenario, "descent-map") &&
+           !_read_descent_map_section(scenario, &config, 
+                                      solving || live_mode || sensitivity_file || profile_file,
+                                      initial_lat, initial_lng, initial_timestamp, burst_alt,
+                                      &descent_map_grid, &descent_map_altitudes, 
+                                      &n_descent_map_altitudes, &descent_map_interval,
+                                      &n_descent_map_times, &descent_map_file))
+            exit(1);
+
+        // Only a single flight from the launch may be looked up.
+        use_surface = surface && (config.n_sweep == 0) && !solving && !sensitivity_file &&
+            !profile_file && (descent_mode == DESCENT_MODE_NORMAL) && !live_mode && 
+            !descent_map_file && !config.summary_file && !config.landing_grid_file && 
+            !config.checkpoint_file && !config.resume_file;
+
+        // A progressive prediction writes a coarse track before the full
+        // one, reusing its wind data.
+        if(!_read_progressive_section(scenario, options, 
+                                      (config.n_sweep == 0) && !live_mode && !descent_map_file,
+                                      &progressive_budget))
+            exit(1);
+        flush_output = (progressive_budget > 0.f);
+
         if(verbosity > 0) {
             fprintf(stderr, "INFO: Scenario loaded:\n");
             fprintf(stderr, "    - Initial latitude  : %lf deg N\n", initial_lat);
@@ -252,32 +1313,177 @@ int main(int argc, const char *argv[]) {
             fprintf(stderr, "    - Initial altitude  : %lf m above sea level\n", initial_alt);
             fprintf(stderr, "    - Initial timestamp : %li\n", initial_timestamp);
             fprintf(stderr, "    - Drag coeff.       : %lf\n", drag_coeff);
-            if(!descent_mode) {
+            if(profile_file) {
+                fprintf(stderr, "    - Altitude profile  : %s\n", profile_file);
+            } else if(!descent_mode) {
                 fprintf(stderr, "    - Ascent rate       : %lf m/s\n", ascent_rate);
                 fprintf(stderr, "    - Burst alt.        : %lf m\n", burst_alt);
+                fprintf(stderr, "    - Float time        : %lf s\n", float_time);
             }
             fprintf(stderr, "    - Windspeed err.    : %f m/s\n", rmswinderror);
+            fprintf(stderr, "    - Ensemble members  : %i\n", n_members);
+            fprintf(stderr, "    - Random seed       : %lu\n", seed);
+            fprintf(stderr, "    - Integrator        : %s\n", integrator_name);
+            fprintf(stderr, "    - Sampling          : %s\n", sampling_name);
+            if(config.resample_threshold > 0.f)
+                fprintf(stderr, "    - Resample below    : %.2f\n", config.resample_threshold);
+            if(config.summary_file)
+                fprintf(stderr, "    - Summary track     : %s\n", config.summary_file);
+            if(config.landing_grid_file)
+                fprintf(stderr, "    - Landing grid      : %s (%.0fm cells)\n", 
+                        config.landing_grid_file, config.landing_grid_resolution);
+            if(config.n_sweep > 0)
+                fprintf(stderr, "    - Sweep points      : %u\n", config.n_sweep);
+            if(sensitivity_file)
+                fprintf(stderr, "    - Sensitivity       : %s\n", sensitivity_file);
+            if(progressive_budget > 0.f)
+                fprintf(stderr, "    - Coarse budget     : %gs\n", progressive_budget);
+            if(config.checkpoint_file)
+                fprintf(stderr, "    - Checkpoint        : %s (every %.0fs)\n", 
+                        config.checkpoint_file, config.checkpoint_interval);
+            if(config.resume_file)
+                fprintf(stderr, "    - Resume from       : %s\n", config.resume_file);
+            if(site_grid_file)
+                fprintf(stderr, "    - Site grid         : %s (%ux%u sites)\n", 
+                        site_grid_file, site_grid.n_lat, site_grid.n_lng);
+            if(descent_map_file)
+                fprintf(stderr, "    - Descent map       : %s (%ux%u sites, %u altitudes, "
+                        "%u times)\n", descent_map_file, descent_map_grid.n_lat, 
+                        descent_map_grid.n_lng, n_descent_map_altitudes, 
+                        n_descent_map_times);
         }
         
         {
             // do the actual stuff!!
-            altitude_model_t* alt_model = altitude_model_new(descent_mode, burst_alt, 
-                                                             ascent_rate, drag_coeff);
+            altitude_model_t* alt_model;
+            
+            if(profile_file)
+                alt_model = altitude_model_new_from_file(profile_file, drag_coeff);
+            else
+                alt_model = altitude_model_new(descent_mode, burst_alt, 
+                                               ascent_rate, drag_coeff, float_time);
             if(!alt_model) {
                     fprintf(stderr, "ERROR: error initialising altitude profile\n");
                     exit(1);
             }
 
-            if (!run_model(file_cache, alt_model, 
-                           initial_lat, initial_lng, initial_alt, initial_timestamp,
-                           rmswinderror)) {
+            if(solving) {
+                float miss;
+
+                if(!solve_launch(file_cache, alt_model, initial_alt, rmswinderror, &config,
+                                 &solve, &initial_lat, &initial_lng, &initial_timestamp, 
+                                 &miss)) {
+                    fprintf(stderr, "ERROR: error solving for the launch\n");
+                    exit(1);
+                }
+
+                fprintf(stderr, "INFO: Launching from %f, %f at %li.\n", 
+                        initial_lat, initial_lng, initial_timestamp);
+            }
+
+            if(sensitivity_file) {
+                run_model_sensitivity_t sensitivity;
+
+                if(!run_model_sensitivity(file_cache, alt_model, initial_lat, initial_lng,
+                                          initial_alt, initial_timestamp, &sensitivity) ||
+                   !_write_sensitivity(sensitivity_file, &sensitivity)) {
+                    fprintf(stderr, "ERROR: error finding the sensitivity\n");
+                    exit(1);
+                }
+            }
+
+            if (descent_map_file) {
+                if (!descent_map_build(file_cache, &descent_map_grid, descent_map_altitudes,
+                                       n_descent_map_altitudes, initial_timestamp, 
+                                       descent_map_interval, n_descent_map_times, 
+                                       drag_coeff, rmswinderror, &config, 
+                                       descent_map_file)) {
+                    fprintf(stderr, "ERROR: error building the descent map!\n");
+                    exit(1);
+                }
+                free(descent_map_altitudes);
+                descent_map_altitudes = NULL;
+            } else if (live_mode) {
+                if (!live_predict(stdin, output, file_cache, alt_model, rmswinderror,
+                                  &config, &live)) {
+                    fprintf(stderr, "ERROR: error during live prediction!\n");
+                    exit(1);
+                }
+            } else if (use_surface && 
+                       _write_from_surface(surface, alt_model, initial_lat, initial_lng,
+                                           initial_alt, initial_timestamp, rmswinderror,
+                                           surface_max_error)) {
+                // The track is the launch and landing.
+            } else {
+                if (progressive_budget > 0.f)
+                    _write_coarse(file_cache, alt_model, initial_lat, initial_lng,
+                                  initial_alt, initial_timestamp, progressive_budget,
+                                  &config);
+
+                if (!run_model(file_cache, alt_model, 
+                               initial_lat, initial_lng, initial_alt, initial_timestamp,
+                               rmswinderror, &config)) {
                     fprintf(stderr, "ERROR: error during model run!\n");
                     exit(1);
+                }
             }
 
             altitude_model_free(alt_model);
         }
 
+        // write the sweep table, one line per point
+        if(config.n_sweep > 0) {
+            unsigned int i;
+
+            for(i=0; i<config.n_sweep; ++i) {
+                const altitude_params_t* params = &(sweep_params[i]);
+                const run_model_landing_t* landing = &(sweep_landings[i]);
+
+                fprintf(output, "%u,%g,%g,%g,%g,%g,%u,%u", i,
+                        params->ascent_rate, params->burst_altitude, 
+                        params->drag_coeff / 1.1045, params->float_time, 
+                        params->launch_time, landing->n_members, landing->n_landed);
+
+                // A point some of whose members left the wind data has no
+                // landing.
+                if(landing->n_landed < landing->n_members)
+                    fprintf(output, ",,,,,,\n");
+                else
+                    fprintf(output, ",%g,%g,%li,%.0f,%.0f,%.0f\n",
+                            landing->lat, landing->lng, landing->timestamp,
+                            landing->sd_north, landing->sd_east, landing->sd_time);
+            }
+            if (ferror(output)) {
+              fprintf(stderr, "ERROR: error writing to CSV file\n");
+              exit(1);
+            }
+
+            if(site_grid_file && 
+               !site_grid_write(&site_grid, sweep_landings, initial_timestamp, site_grid_file))
+                exit(1);
+
+            if(surface_file && 
+               !surface_write(surface_file, file_cache, initial_lat, initial_lng, initial_alt, 
+                              initial_timestamp, rmswinderror, n_members, 
+                              n_sweep_values, sweep_values, sweep_landings))
+                exit(1);
+
+            // A site grid sweeps only the sites.
+            if(!site_grid_file) {
+                unsigned int k;
+
+                for(k=0; k<N_SWEEP_PARAMS; ++k)
+                    free(sweep_values[k]);
+            }
+
+            free(sweep_params);
+            free(sweep_landings);
+            free(sweep_sites);
+            sweep_params = NULL;
+            sweep_landings = NULL;
+            sweep_sites = NULL;
+        }
+
         // release the scenario
         iniparser_freedict(scenario);
         
@@ -297,6 +1503,8 @@ int main(int argc, const char *argv[]) {
 
     // release the file cache resources.
     wind_file_cache_free(file_cache);
+    run_model_ascent_cache_free(ascent_cache);
+    surface_free(surface);
 
     return 0;
 }
@@ -311,6 +1519,8 @@ void write_position(float lat, float lng, float alt, int timestamp) {
     }
         
     fprintf(output, "%d,%g,%g,%g\n", timestamp, lat, lng, alt);
+    if (flush_output)
+        fflush(output);
     if (ferror(output)) {
       fprintf(stderr, "ERROR: error writing to CSV file\n");
       exit(1);
@@ -14,13 +14,19 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
+#include <glib.h>
+
 #include "wind/wind_file.h"
+#include "wind/wind_file_dual.h"
 #include "util/random.h"
 #include "run_model.h"
 #include "pred.h"
 #include "altitude.h"
+#include "landing_grid.h"
+#include "ensemble_stats.h"
 
 extern int verbosity;
 
@@ -32,105 +38,1897 @@ struct model_state_s
     float               lat;
     float               lng;
     float               alt;
-    altitude_model_t   *alt_model;
+    altitude_params_t   params;
+    altitude_state_t    alt_state;
     double              loglik;
+
+    // Each member owns everything it mutates as it is advanced so that the
+    // result does not depend on which worker thread advances it.
+    random_stream_t     rng;
+    unsigned long       rng_position;   // next position in rng (rk4 and rk45)
+    wind_file_cursor_t  cursor;
+
+    // The Runge-Kutta integrators may step past the end of a block. The
+    // member's position is then interpolated from the step which spans it.
+    // The Euler method accumulates the position in rk_y[1] since a float
+    // latitude only resolves about 0.4m, so rounding after every one second
+    // step would drift by hundreds of metres over a flight.
+    double              rk_t[2];        // s - start and end of the last step
+    double              rk_y[2][3];     // lat, lng and alt at rk_t
+    int                 landed;         // if non-zero, rk_y[1] is the landing
+    float               step;           // s - next step to try (rk45)
+
+    int                 alive;          // zero once the member has landed
+    long int            final_timestamp;
+
+    float               wind_bias[2];   // m/s - added to the u and v wind
+
+    int                 summarised;     // non-zero once its landing is summarised
+};
+
+// A contiguous range of ensemble members advanced by one worker thread.
+typedef struct model_worker_s model_worker_t;
+struct model_worker_s
+{
+    wind_file_cache_t  *cache;
+    const altitude_model_t* alt_model;
+    model_state_t      *states;
+    unsigned int        n_states;
+    long int            first_timestamp;
+    long int            last_timestamp;
+    long int            initial_timestamp;
+    float               rmserror;
+    const run_model_config_t* config;
+
+    unsigned long       n_steps;        // member timesteps taken in last call
+    unsigned long       n_wind_evals;   // member wind evaluations in last call
+
+    // If non-zero, Runge-Kutta steps end exactly at the end of the call so
+    // that the members may be checkpointed there.
+    int                 end_on_block;
+
+    // If positions is not NULL then after each call the live members of the
+    // i-th packet of this worker are summarised in positions[i] and those
+    // which have landed since the last call in landings[i]. The altitudes of
+    // the live members are counted in altitudes.
+    ensemble_moments_t *positions;
+    ensemble_moments_t *landings;
+    altitude_histogram_t *altitudes;
+};
+
+// The statistics gathered for the summary track. Only the statistics of the
+// current block are kept so the memory used does not grow with the flight.
+typedef struct summary_s summary_t;
+struct summary_s
+{
+    FILE               *file;
+    ensemble_moments_t *positions;      // one for each packet
+    ensemble_moments_t *landings;       // one for each packet
+    altitude_histogram_t *altitudes;    // one for each worker
+
+    ensemble_moments_t  all_landings;   // lat, lng and time of every landing
+};
+
+// Butcher tableau of an explicit Runge-Kutta method. See
+// http://en.wikipedia.org/wiki/List_of_Runge%E2%80%93Kutta_methods
+#define MAX_RK_STAGES 6
+
+typedef struct rk_tableau_s rk_tableau_t;
+struct rk_tableau_s
+{
+    unsigned int        n_stages;
+    double              c[MAX_RK_STAGES];
+    double              a[MAX_RK_STAGES][MAX_RK_STAGES];
+    double              b[MAX_RK_STAGES];       // weights of the solution
+    double              e[MAX_RK_STAGES];       // weights of the error estimate
+    int                 adaptive;               // non-zero if e is valid
+};
+
+static const rk_tableau_t _rk4_tableau = {
+    4,
+    { 0.0, 0.5, 0.5, 1.0 },
+    { { 0.0 }, 
+      { 0.5 }, 
+      { 0.0, 0.5 }, 
+      { 0.0, 0.0, 1.0 } },
+    { 1.0/6.0, 1.0/3.0, 1.0/3.0, 1.0/6.0 },
+    { 0.0 },
+    0
+};
+
+// Cash-Karp. Unlike Dormand-Prince this does not reuse the last evaluation of
+// one step as the first of the next, which we could not do anyway since each
+// step is followed by a random perturbation.
+static const rk_tableau_t _rk45_tableau = {
+    6,
+    { 0.0, 1.0/5.0, 3.0/10.0, 3.0/5.0, 1.0, 7.0/8.0 },
+    { { 0.0 },
+      { 1.0/5.0 },
+      { 3.0/40.0, 9.0/40.0 },
+      { 3.0/10.0, -9.0/10.0, 6.0/5.0 },
+      { -11.0/54.0, 5.0/2.0, -70.0/27.0, 35.0/27.0 },
+      { 1631.0/55296.0, 175.0/512.0, 575.0/13824.0, 44275.0/110592.0, 253.0/4096.0 } },
+    { 37.0/378.0, 0.0, 250.0/621.0, 125.0/594.0, 0.0, 512.0/1771.0 },
+    // 5th order weights less the embedded 4th order weights
+    { 37.0/378.0 - 2825.0/27648.0, 0.0, 250.0/621.0 - 18575.0/48384.0,
+      125.0/594.0 - 13525.0/55296.0, -277.0/14336.0, 512.0/1771.0 - 0.25 },
+    1
+};
+
+// Step size control for adaptive methods.
+#define STEP_SAFETY 0.9         // aim for a little less than the tolerance
+#define STEP_MIN_SCALE 0.2      // never shrink the step by more than this...
+#define STEP_MAX_SCALE 5.0      // ...or grow it by more than this at once
+#define MAX_RK_STEP (10 * LOG_DECIMATE * TIMESTEP)
+
+// The random stream used to resample the ensemble. Members use the streams
+// numbered from zero.
+#define RESAMPLE_STREAM 0xffffffffu
+
+// The unscented transform's sigma points span the ascent rate, burst
+// altitude, drag coefficient and a constant error in the u and v wind. The
+// scaling is Julier's, kappa = 3 - d, so that lambda = 3 - d, with alpha = 1
+// and beta = 2 for Gaussian uncertainties.
+#define UNSCENTED_DIMENSIONS 5
+#define UNSCENTED_POINTS (2 * UNSCENTED_DIMENSIONS + 1)
+#define UNSCENTED_LAMBDA (3.0 - UNSCENTED_DIMENSIONS)
+
+// While floating the altitude is constant and the wind only changes as the
+// balloon drifts so much longer steps are allowed.
+#define MAX_FLOAT_STEP (3600 * TIMESTEP)
+
+// Get the distance (in metres) of one degree of latitude and one degree of
+// longitude. This varys with height (not much grant you).
+static void
+_get_frame(float lat, float lng, float alt, 
+        float *d_dlat, float *d_dlng)
+{
+    float theta, r;
+
+    theta = 2.f * M_PI * (90.f - lat) / 360.f;
+    r = RADIUS_OF_EARTH + alt;
+
+    // See the differentiation section of
+    // http://en.wikipedia.org/wiki/Spherical_coordinate_system
+
+    // d/dv = d/dlat = -d/dtheta
+    *d_dlat = (2.f * M_PI) * r / 360.f;
+
+    // d/du = d/dlong = d/dphi
+    *d_dlng = (2.f * M_PI) * r * sinf(theta) / 360.f;
+}
+
+// As _get_frame() for a position whose co-ordinates are dual numbers.
+static void
+_get_frame_dual(const dual_t* lat, const dual_t* alt, dual_t* d_dlat, dual_t* d_dlng)
+{
+    dual_t theta = dual_scale(dual_offset(dual_scale(*lat, -1.0), 90.0), 2.0 * M_PI / 360.0);
+    dual_t r = dual_offset(*alt, RADIUS_OF_EARTH);
+
+    *d_dlat = dual_scale(r, 2.0 * M_PI / 360.0);
+    *d_dlng = dual_mul(*d_dlat, dual_sin(theta));
+}
+
+// Fill out with n_pairs pairs of unit normal samples from position onwards in
+// a member's stream as the configured sampling method requires.
+static void
+_draw_normal_pairs(const run_model_config_t* config, const random_stream_t* rng,
+                   uint64_t position, unsigned int n_pairs, float* out)
+{
+    switch(config->sampling)
+    {
+        case SAMPLING_SOBOL:
+            random_stream_sobol_normal_pairs(rng, position, n_pairs, out);
+            break;
+        case SAMPLING_UNSCENTED:
+            memset(out, 0, sizeof(float) * 2 * n_pairs);
+            break;
+        default:
+            random_stream_normal_pairs(rng, position, n_pairs, out);
+            break;
+    }
+}
+
+// The most timesteps advanced between two writes of the output.
+#define MAX_BLOCK_STEPS (LOG_DECIMATE + 1)
+
+// Advance a packet of at most WIND_FILE_BATCH_SIZE live members by one
+// timestep. The wind for the whole packet is interpolated in one go. Members
+// which land (or leave our wind data) are marked as no longer alive. noise[i]
+// points to the pair of unit normal samples which perturb the i-th member's
+// wind for this timestep.
+static void
+_advance_one_timestep(wind_file_cache_t* cache, 
+                      const altitude_model_t* alt_model,
+                      unsigned long delta_t,
+                      unsigned long timestamp, unsigned long initial_timestamp,
+                      unsigned int n_states, model_state_t** states,
+                      const float* const* noise, float rmserror)
+{
+    unsigned int i, n_flying;
+    model_state_t* flying[WIND_FILE_BATCH_SIZE];
+    const float* flying_noise[WIND_FILE_BATCH_SIZE];
+    wind_file_cursor_t* cursors[WIND_FILE_BATCH_SIZE];
+    float lat[WIND_FILE_BATCH_SIZE], lng[WIND_FILE_BATCH_SIZE], alt[WIND_FILE_BATCH_SIZE];
+    float wind_v[WIND_FILE_BATCH_SIZE], wind_u[WIND_FILE_BATCH_SIZE];
+    float wind_var[WIND_FILE_BATCH_SIZE];
+    int wind_ok[WIND_FILE_BATCH_SIZE];
+    altitude_state_t* alt_states[WIND_FILE_BATCH_SIZE];
+    float new_alt[WIND_FILE_BATCH_SIZE];
+    int alt_ok[WIND_FILE_BATCH_SIZE];
+
+    assert(n_states <= WIND_FILE_BATCH_SIZE);
+
+    for(i=0; i<n_states; ++i)
+        alt_states[i] = &(states[i]->alt_state);
+
+    altitude_model_advance(alt_model, n_states, alt_states, 
+                           timestamp - initial_timestamp, new_alt, alt_ok);
+
+    n_flying = 0;
+    for(i=0; i<n_states; ++i)
+    {
+        model_state_t* state = states[i];
+
+        state->alt = new_alt[i];
+        if(!alt_ok[i])
+        {
+            state->alive = 0;
+            state->final_timestamp = timestamp;
+            continue;
+        }
+
+        flying[n_flying] = state;
+        flying_noise[n_flying] = noise[i];
+        cursors[n_flying] = &state->cursor;
+        lat[n_flying] = state->lat;
+        lng[n_flying] = state->lng;
+        alt[n_flying] = state->alt;
+        ++n_flying;
+    }
+
+    get_wind_batch(cache, n_flying, cursors, lat, lng, alt, timestamp,
+                   wind_v, wind_u, wind_var, wind_ok);
+
+    for(i=0; i<n_flying; ++i)
+    {
+        float ddlat, ddlng;
+        float u_samp, v_samp, sigma;
+        model_state_t* state = flying[i];
+        const float* z = flying_noise[i];
+
+        if(!wind_ok[i]) {
+            fprintf(stderr, "ERROR: error getting wind data\n");
+            state->alive = 0;
+            state->final_timestamp = timestamp;
+            continue;
+        }
+
+        _get_frame(state->lat, state->lng, state->alt, &ddlat, &ddlng);
+
+        // NOTE: it this really the right thing to be doing? - think about what
+        // happens near the poles
+
+        wind_var[i] += rmserror * rmserror;
+
+        assert(wind_var[i] >= 0.f);
+
+        sigma = sqrtf(wind_var[i]);
+        u_samp = wind_u[i] + state->wind_bias[0] + sigma * z[0];
+        v_samp = wind_v[i] + state->wind_bias[1] + sigma * z[1];
+
+        // Members waiting to launch stay put but still draw their perturbation
+        // so that their likelihood remains comparable with the others.
+        if(timestamp - initial_timestamp >= 
+           altitude_model_get_launch_time(alt_model, &(state->alt_state))) {
+            state->rk_y[1][0] += v_samp * delta_t / ddlat;
+            state->rk_y[1][1] += u_samp * delta_t / ddlng;
+            state->lat = state->rk_y[1][0];
+            state->lng = state->rk_y[1][1];
+        }
+
+        state->loglik += (double)(random_normal_loglik(z[0]) + 
+                                  random_normal_loglik(z[1]));
+    }
+}
+
+// Evaluate the rate of change of the horizontal position, y[i] = { lat, lng },
+// of each of a packet of members at t seconds into the flight. The altitude
+// is not integrated, it is given by the altitude model. If the wind for a
+// member cannot be found, ok[i] is cleared.
+static void
+_rk_derivative(model_worker_t* worker,
+               unsigned int n_states, model_state_t** states, 
+               double t, double y[][2], double dy[][2], float* wind_var, int* ok)
+{
+    unsigned int i;
+    wind_file_cursor_t* cursors[WIND_FILE_BATCH_SIZE];
+    altitude_state_t* alt_states[WIND_FILE_BATCH_SIZE];
+    float lat[WIND_FILE_BATCH_SIZE], lng[WIND_FILE_BATCH_SIZE], alt[WIND_FILE_BATCH_SIZE];
+    float wind_v[WIND_FILE_BATCH_SIZE], wind_u[WIND_FILE_BATCH_SIZE];
+    int wind_ok[WIND_FILE_BATCH_SIZE], alt_ok[WIND_FILE_BATCH_SIZE];
+
+    for(i=0; i<n_states; ++i)
+    {
+        cursors[i] = &(states[i]->cursor);
+        alt_states[i] = &(states[i]->alt_state);
+        lat[i] = y[i][0];
+        lng[i] = y[i][1];
+    }
+
+    altitude_model_advance(worker->alt_model, n_states, alt_states, t, alt, alt_ok);
+
+    get_wind_batch(worker->cache, n_states, cursors, lat, lng, alt, 
+                   worker->initial_timestamp + t, wind_v, wind_u, wind_var, wind_ok);
+
+    for(i=0; i<n_states; ++i)
+    {
+        float ddlat, ddlng;
+
+        if(!wind_ok[i]) {
+            ok[i] = 0;
+            dy[i][0] = dy[i][1] = 0.0;
+            continue;
+        }
+
+        if(t < altitude_model_get_launch_time(worker->alt_model, alt_states[i])) {
+            dy[i][0] = dy[i][1] = 0.0;
+            continue;
+        }
+
+        _get_frame(lat[i], lng[i], alt[i], &ddlat, &ddlng);
+
+        dy[i][0] = (wind_v[i] + states[i]->wind_bias[1]) / ddlat;
+        dy[i][1] = (wind_u[i] + states[i]->wind_bias[0]) / ddlng;
+    }
+}
+
+// Take Runge-Kutta steps with the method in tableau for a packet of at most
+// WIND_FILE_BATCH_SIZE live members until they have all reached or passed t
+// seconds into the flight and set their positions at t. Every member of the
+// packet takes the same steps so that the wind at each stage can be
+// interpolated as a batch. Adaptive methods choose the step so that the
+// estimated error of the worst member is within the configured tolerance.
+// Steps are not cut short at t, the position at t is interpolated from the
+// step which spans it, but they never straddle a launch, a burst, the end of
+// a float or the time of a wind data tile since the vertical speed or the
+// rate of change of the wind is discontinuous there, and they end exactly on
+// landing. Steps may be longer when every member is floating.
+//
+// Each step of h seconds is followed by a random perturbation with the same
+// variance as h/TIMESTEP Euler steps would accumulate. The log-likelihood of
+// the perturbation is weighted by h/TIMESTEP too so that it remains
+// comparable with the other integrators.
+static void
+_integrate_packet(model_worker_t* worker, const rk_tableau_t* tableau,
+                  unsigned int n_states, model_state_t** states, double t)
+{
+    const run_model_config_t* config = worker->config;
+    model_state_t* stepping[WIND_FILE_BATCH_SIZE];
+    double y0[WIND_FILE_BATCH_SIZE][2], yi[WIND_FILE_BATCH_SIZE][2];
+    double k[MAX_RK_STAGES][WIND_FILE_BATCH_SIZE][2];
+    float wind_var[MAX_RK_STAGES][WIND_FILE_BATCH_SIZE];
+    int ok[WIND_FILE_BATCH_SIZE];
+    double t_step = 0.0, h_next = -1.0;
+    unsigned int i, j, s, d, n_stepping = 0;
+
+    assert(n_states <= WIND_FILE_BATCH_SIZE);
+
+    // members which have landed are waiting for t to catch up with them, the
+    // rest are all at the same point in the flight.
+    for(i=0; i<n_states; ++i)
+    {
+        if(states[i]->landed)
+            continue;
+
+        stepping[n_stepping++] = states[i];
+        t_step = states[i]->rk_t[1];
+        if((h_next < 0.0) || (states[i]->step < h_next))
+            h_next = states[i]->step;
+    }
+
+    while((n_stepping > 0) && (t_step < t))
+    {
+        double t_end, tile_t, h, max_step = MAX_FLOAT_STEP, err = 0.0;
+        unsigned long tile_timestamp;
+        unsigned int n_alive;
+
+        // choose where this step ends
+        for(i=0; i<n_stepping; ++i)
+        {
+            double burst_t = altitude_model_get_burst_time(worker->alt_model,
+                                                           &(stepping[i]->alt_state));
+            double descent_t = altitude_model_get_descent_time(worker->alt_model,
+                                                               &(stepping[i]->alt_state));
+
+            if((t_step < burst_t) || (t_step >= descent_t))
+                max_step = MAX_RK_STEP;
+        }
+        if(h_next > max_step)
+            h_next = max_step;
+        t_end = t_step + h_next;
+        for(i=0; i<n_stepping; ++i)
+        {
+            double launch_t = altitude_model_get_launch_time(worker->alt_model,
+                                                             &(stepping[i]->alt_state));
+            double burst_t = altitude_model_get_burst_time(worker->alt_model,
+                                                           &(stepping[i]->alt_state));
+            double descent_t = altitude_model_get_descent_time(worker->alt_model,
+                                                               &(stepping[i]->alt_state));
+            double landing_t = altitude_model_get_landing_time(worker->alt_model,
+                                                               &(stepping[i]->alt_state));
+
+            if((launch_t > t_step) && (t_end > launch_t))
+                t_end = launch_t;
+            if((burst_t > t_step) && (t_end > burst_t))
+                t_end = burst_t;
+            if((descent_t > t_step) && (t_end > descent_t))
+                t_end = descent_t;
+            if((landing_t > t_step) && (t_end > landing_t))
+                t_end = landing_t;
+        }
+        if(worker->end_on_block && (t_end > t))
+            t_end = t;
+        tile_timestamp = wind_file_cache_next_timestamp(worker->cache, 
+                (unsigned long)(worker->initial_timestamp + t_step));
+        tile_t = (double)tile_timestamp - worker->initial_timestamp;
+        if(tile_timestamp && (tile_t > t_step) && (t_end > tile_t))
+            t_end = tile_t;
+        h = t_end - t_step;
+
+        for(i=0; i<n_stepping; ++i)
+        {
+            for(d=0; d<2; ++d)
+                y0[i][d] = stepping[i]->rk_y[1][d];
+            ok[i] = 1;
+        }
+
+        for(s=0; s<tableau->n_stages; ++s)
+        {
+            for(i=0; i<n_stepping; ++i)
+            {
+                for(d=0; d<2; ++d)
+                {
+                    yi[i][d] = y0[i][d];
+                    for(j=0; j<s; ++j)
+                        yi[i][d] += h * tableau->a[s][j] * k[j][i][d];
+                }
+            }
+
+            _rk_derivative(worker, n_stepping, stepping, t_step + tableau->c[s] * h,
+                           yi, k[s], wind_var[s], ok);
+        }
+        worker->n_wind_evals += tableau->n_stages * n_stepping;
+
+        // Members which have left our wind data stop where they are. Take
+        // the step again without them.
+        n_alive = 0;
+        for(i=0; i<n_stepping; ++i)
+        {
+            model_state_t* state = stepping[i];
+
+            if(!ok[i]) {
+                fprintf(stderr, "ERROR: error getting wind data\n");
+                state->lat = state->rk_y[1][0];
+                state->lng = state->rk_y[1][1];
+                state->alt = state->rk_y[1][2];
+                state->alive = 0;
+                state->final_timestamp = worker->initial_timestamp + (long int)t_step;
+                continue;
+            }
+            stepping[n_alive++] = state;
+        }
+        if(n_alive < n_stepping) {
+            n_stepping = n_alive;
+            continue;
+        }
+
+        if(tableau->adaptive) 
+        {
+            double scale;
+
+            // the largest error in metres relative to the tolerance
+            for(i=0; i<n_stepping; ++i)
+            {
+                double e[2], err_i;
+                float ddlat, ddlng;
+
+                for(d=0; d<2; ++d)
+                {
+                    e[d] = 0.0;
+                    for(s=0; s<tableau->n_stages; ++s)
+                        e[d] += h * tableau->e[s] * k[s][i][d];
+                }
+
+                _get_frame(y0[i][0], y0[i][1], stepping[i]->rk_y[1][2], &ddlat, &ddlng);
+                e[0] *= ddlat;
+                e[1] *= ddlng;
+
+                err_i = sqrt(e[0]*e[0] + e[1]*e[1]) / config->tolerance;
+                if(err_i > err)
+                    err = err_i;
+            }
+
+            // Reject the step if the error is too large. There is little point
+            // in taking steps shorter than an Euler step so accept those anyway.
+            if((err > 1.0) && (h > TIMESTEP)) {
+                scale = STEP_SAFETY * pow(err, -0.25);
+                if(scale < STEP_MIN_SCALE)
+                    scale = STEP_MIN_SCALE;
+                h_next = h * scale;
+                if(h_next < TIMESTEP)
+                    h_next = TIMESTEP;
+                continue;
+            }
+
+            scale = (err > 0.0) ? STEP_SAFETY * pow(err, -0.2) : STEP_MAX_SCALE;
+            if(scale > STEP_MAX_SCALE)
+                scale = STEP_MAX_SCALE;
+            if(scale < STEP_MIN_SCALE)
+                scale = STEP_MIN_SCALE;
+
+            // a step cut short by burst says nothing about how much shorter
+            // the next step should be
+            if((h >= h_next) || (h * scale > h_next))
+                h_next = h * scale;
+        }
+
+        n_alive = 0;
+        for(i=0; i<n_stepping; ++i)
+        {
+            model_state_t* state = stepping[i];
+            double y1[2];
+            float alt1, ddlat, ddlng, sigma, z[2];
+            int flying;
+
+            for(d=0; d<2; ++d)
+            {
+                y1[d] = y0[i][d];
+                for(s=0; s<tableau->n_stages; ++s)
+                    y1[d] += h * tableau->b[s] * k[s][i][d];
+            }
+
+            // the wind variance at the start of the step
+            wind_var[0][i] += worker->rmserror * worker->rmserror;
+            assert(wind_var[0][i] >= 0.f);
+
+            sigma = sqrtf(wind_var[0][i] * h * TIMESTEP);
+            _draw_normal_pairs(config, &state->rng, state->rng_position++, 1, z);
+
+            flying = altitude_model_get_altitude(worker->alt_model, &(state->alt_state),
+                                                 t_end, &alt1);
+
+            // as in the Euler method, members waiting to launch stay put
+            if(t_end > altitude_model_get_launch_time(worker->alt_model, &(state->alt_state))) {
+                _get_frame(y1[0], y1[1], alt1, &ddlat, &ddlng);
+                y1[0] += sigma * z[1] / ddlat;
+                y1[1] += sigma * z[0] / ddlng;
+            }
+
+            state->loglik += (h / TIMESTEP) * (double)(random_normal_loglik(z[0]) + 
+                                                       random_normal_loglik(z[1]));
+
+            state->rk_t[0] = t_step;
+            state->rk_t[1] = t_end;
+            state->rk_y[0][2] = state->rk_y[1][2];
+            state->rk_y[1][2] = alt1;
+            for(d=0; d<2; ++d)
+            {
+                state->rk_y[0][d] = y0[i][d];
+                state->rk_y[1][d] = y1[d];
+            }
+
+            if(!flying) {
+                state->landed = 1;
+                continue;
+            }
+
+            stepping[n_alive++] = state;
+        }
+        worker->n_steps += n_stepping;
+        n_stepping = n_alive;
+
+        t_step = t_end;
+    }
+
+    for(i=0; i<n_stepping; ++i)
+        stepping[i]->step = h_next;
+
+    // find where everyone is at t
+    for(i=0; i<n_states; ++i)
+    {
+        model_state_t* state = states[i];
+        double lambda = 1.0;
+
+        if(!state->alive)
+            continue;
+
+        if(state->landed && (state->rk_t[1] <= t)) {
+            state->alive = 0;
+            state->final_timestamp = worker->initial_timestamp + (long int)ceil(state->rk_t[1]);
+        } else if(state->rk_t[1] > state->rk_t[0]) {
+            lambda = (t - state->rk_t[0]) / (state->rk_t[1] - state->rk_t[0]);
+        }
+
+        state->lat = state->rk_y[0][0] + lambda * (state->rk_y[1][0] - state->rk_y[0][0]);
+        state->lng = state->rk_y[0][1] + lambda * (state->rk_y[1][1] - state->rk_y[0][1]);
+        state->alt = state->rk_y[0][2] + lambda * (state->rk_y[1][2] - state->rk_y[0][2]);
+    }
+}
+
+// Advance each live member of the worker's range through every timestep
+// from first_timestamp to last_timestamp inclusive with the Euler method.
+// Members are taken in packets which are stepped together so that their wind
+// can be interpolated as a batch.
+//
+// The wind perturbations for the whole block are drawn up front, one pair of
+// samples per member per timestep. The samples for a timestep depend only on
+// the seed, the member and the timestep so this gives the same result as
+// drawing them as we go.
+static void
+_advance_worker_euler(model_worker_t* worker)
+{
+    unsigned int first, i;
+    unsigned int n_block_steps;
+    unsigned long first_step;
+    float noise[WIND_FILE_BATCH_SIZE][2 * MAX_BLOCK_STEPS];
+
+    n_block_steps = (worker->last_timestamp - worker->first_timestamp) / TIMESTEP + 1;
+    first_step = (worker->first_timestamp - worker->initial_timestamp) / TIMESTEP;
+    assert(n_block_steps <= MAX_BLOCK_STEPS);
+
+    for(first=0; first<worker->n_states; first+=WIND_FILE_BATCH_SIZE)
+    {
+        long int timestamp;
+        unsigned int step;
+
+        for(i=first; (i<worker->n_states) && (i<first+WIND_FILE_BATCH_SIZE); ++i)
+        {
+            if(worker->states[i].alive)
+                _draw_normal_pairs(worker->config, &(worker->states[i].rng), first_step,
+                                   n_block_steps, noise[i-first]);
+        }
+
+        for(timestamp = worker->first_timestamp, step = 0; 
+            timestamp <= worker->last_timestamp;
+            timestamp += TIMESTEP, ++step)
+        {
+            model_state_t* packet[WIND_FILE_BATCH_SIZE];
+            const float* packet_noise[WIND_FILE_BATCH_SIZE];
+            unsigned int n_alive = 0;
+
+            for(i=first; (i<worker->n_states) && (i<first+WIND_FILE_BATCH_SIZE); ++i)
+            {
+                if(!worker->states[i].alive)
+                    continue;
+
+                packet[n_alive] = &(worker->states[i]);
+                packet_noise[n_alive] = &(noise[i-first][2*step]);
+                ++n_alive;
+            }
+
+            if(n_alive == 0)
+                break;
+
+            _advance_one_timestep(worker->cache, worker->alt_model, TIMESTEP, 
+                    timestamp, worker->initial_timestamp, 
+                    n_alive, packet, packet_noise, worker->rmserror);
+            worker->n_steps += n_alive;
+            worker->n_wind_evals += n_alive;
+        }
+    }
+}
+
+// As _advance_worker_euler() but with a Runge-Kutta method. The members end
+// up where the Euler method would leave them after the timestep at
+// last_timestamp.
+static void
+_advance_worker_rk(model_worker_t* worker, const rk_tableau_t* tableau)
+{
+    unsigned int first, i;
+    double t = worker->last_timestamp + TIMESTEP - worker->initial_timestamp;
+
+    for(first=0; first<worker->n_states; first+=WIND_FILE_BATCH_SIZE)
+    {
+        model_state_t* packet[WIND_FILE_BATCH_SIZE];
+        unsigned int n_alive = 0;
+
+        for(i=first; (i<worker->n_states) && (i<first+WIND_FILE_BATCH_SIZE); ++i)
+        {
+            if(worker->states[i].alive)
+                packet[n_alive++] = &(worker->states[i]);
+        }
+
+        if(n_alive > 0)
+            _integrate_packet(worker, tableau, n_alive, packet, t);
+    }
+}
+
+// Gather the statistics of the worker's members for the summary track.
+static void
+_summarise_worker(model_worker_t* worker)
+{
+    unsigned int i, n_packets;
+
+    n_packets = (worker->n_states + WIND_FILE_BATCH_SIZE - 1) / WIND_FILE_BATCH_SIZE;
+    for(i=0; i<n_packets; ++i)
+    {
+        ensemble_moments_reset(&(worker->positions[i]));
+        ensemble_moments_reset(&(worker->landings[i]));
+    }
+    altitude_histogram_reset(worker->altitudes);
+
+    for(i=0; i<worker->n_states; ++i)
+    {
+        model_state_t* state = &(worker->states[i]);
+        unsigned int packet = i / WIND_FILE_BATCH_SIZE;
+        double x[3] = { state->lat, state->lng, state->alt };
+
+        if(state->alive) {
+            ensemble_moments_add(&(worker->positions[packet]), x);
+            altitude_histogram_add(worker->altitudes, state->alt);
+        } else if(!state->summarised) {
+            x[2] = state->final_timestamp - worker->initial_timestamp;
+            ensemble_moments_add(&(worker->landings[packet]), x);
+            state->summarised = 1;
+        }
+    }
+}
+
+// Advance the members of a worker's range from first_timestamp to
+// last_timestamp with the configured integrator. Members are independent so
+// this is safe to run concurrently with other workers.
+static gpointer
+_advance_worker(gpointer data)
+{
+    model_worker_t* worker = (model_worker_t*)data;
+
+    worker->n_steps = 0;
+    worker->n_wind_evals = 0;
+
+    switch(worker->config->integrator) 
+    {
+        case INTEGRATOR_RK4:
+            _advance_worker_rk(worker, &_rk4_tableau);
+            break;
+        case INTEGRATOR_RK45:
+            _advance_worker_rk(worker, &_rk45_tableau);
+            break;
+        default:
+            _advance_worker_euler(worker);
+            break;
+    }
+
+    if(worker->positions)
+        _summarise_worker(worker);
+
+    return NULL;
+}
+
+// Call func for each of n_workers workers, each on its own thread.
+static void
+_run_workers(model_worker_t* workers, unsigned int n_workers, GThreadFunc func)
+{
+    GThread* threads[MAX_WORKER_THREADS];
+    unsigned int i;
+
+    // Don't pay for a thread if there is only one worker.
+    if(n_workers == 1) {
+        func(&(workers[0]));
+        return;
+    }
+
+    for(i=0; i<n_workers; ++i) 
+        threads[i] = g_thread_new("pred-worker", func, &(workers[i]));
+
+    for(i=0; i<n_workers; ++i) 
+        g_thread_join(threads[i]);
+}
+
+// Advance all members from first_timestamp to last_timestamp splitting them
+// between n_workers threads.
+static void
+_advance_timesteps(model_worker_t* workers, unsigned int n_workers,
+                   long int first_timestamp, long int last_timestamp)
+{
+    unsigned int i;
+
+    for(i=0; i<n_workers; ++i) 
+    {
+        workers[i].first_timestamp = first_timestamp;
+        workers[i].last_timestamp = last_timestamp;
+    }
+
+    _run_workers(workers, n_workers, _advance_worker);
+}
+
+// Write the probability of landing in each cell of a grid covering every
+// member's landing. The grid's bounds are only known once every member has
+// landed and adding a landing is cheap next to flying it, so the members are
+// added in order on this thread.
+static int
+_write_landing_grid(const model_state_t* states, unsigned int n_states,
+                    const run_model_config_t* config)
+{
+    landing_grid_t* grid;
+    float south = states[0].lat, north = states[0].lat;
+    float west = states[0].lng, east = states[0].lng;
+    unsigned int i;
+    int ok;
+
+    for(i=1; i<n_states; ++i)
+    {
+        if(states[i].lat < south) south = states[i].lat;
+        if(states[i].lat > north) north = states[i].lat;
+        if(states[i].lng < west) west = states[i].lng;
+        if(states[i].lng > east) east = states[i].lng;
+    }
+
+    grid = landing_grid_new(south, west, north, east, 
+                            config->landing_grid_resolution,
+                            config->landing_grid_bandwidth);
+    if(!grid) {
+        fprintf(stderr, "ERROR: invalid landing grid\n");
+        return 0;
+    }
+
+    for(i=0; i<n_states; ++i)
+        landing_grid_add(grid, states[i].lat, states[i].lng, 1.0);
+
+    ok = landing_grid_write(grid, config->landing_grid_file);
+    landing_grid_free(grid);
+
+    return ok;
+}
+
+// Open the summary track and allot each worker its share of the statistics.
+// Returns zero if the file could not be opened.
+static int
+_summary_open(summary_t* summary, const char* filename,
+              model_worker_t* workers, unsigned int n_workers, 
+              const model_state_t* states, unsigned int n_packets)
+{
+    unsigned int i;
+
+    summary->file = fopen(filename, "wb");
+    if(!summary->file) {
+        fprintf(stderr, "ERROR: %s: could not open summary track for output\n", filename);
+        return 0;
+    }
+
+    summary->positions = (ensemble_moments_t*)malloc(sizeof(ensemble_moments_t) * n_packets);
+    summary->landings = (ensemble_moments_t*)malloc(sizeof(ensemble_moments_t) * n_packets);
+    summary->altitudes = (altitude_histogram_t*)malloc(sizeof(altitude_histogram_t) * n_workers);
+    ensemble_moments_reset(&(summary->all_landings));
+
+    for(i=0; i<n_workers; ++i)
+    {
+        unsigned int first_packet = (workers[i].states - states) / WIND_FILE_BATCH_SIZE;
+
+        workers[i].positions = &(summary->positions[first_packet]);
+        workers[i].landings = &(summary->landings[first_packet]);
+        workers[i].altitudes = &(summary->altitudes[i]);
+    }
+
+    return 1;
+}
+
+// Combine the statistics gathered by the workers for the block ending at
+// timestamp and write a line of the summary track. The moments are merged in
+// packet order so that the result does not depend on the number of threads.
+static int
+_summary_write(summary_t* summary, unsigned int n_workers, unsigned int n_packets, 
+               long int timestamp)
+{
+    ensemble_moments_t positions;
+    altitude_histogram_t altitudes;
+    double sd_north, sd_east, correlation = 0.0, dlng_metres;
+    unsigned int i;
+
+    ensemble_moments_reset(&positions);
+    altitude_histogram_reset(&altitudes);
+    for(i=0; i<n_packets; ++i)
+    {
+        ensemble_moments_merge(&positions, &(summary->positions[i]));
+        ensemble_moments_merge(&(summary->all_landings), &(summary->landings[i]));
+    }
+    for(i=0; i<n_workers; ++i)
+        altitude_histogram_merge(&altitudes, &(summary->altitudes[i]));
+
+    if(positions.n <= 0.0)
+        return 1;
+
+    dlng_metres = DEGREES_TO_METRES * cos(positions.mean[0] * DEGREES_TO_RADIANS);
+    sd_north = sqrt(ensemble_moments_covariance(&positions, 0, 0)) * DEGREES_TO_METRES;
+    sd_east = sqrt(ensemble_moments_covariance(&positions, 1, 1)) * dlng_metres;
+    if((sd_north > 0.0) && (sd_east > 0.0))
+        correlation = ensemble_moments_covariance(&positions, 0, 1) * 
+            DEGREES_TO_METRES * dlng_metres / (sd_north * sd_east);
+
+    fprintf(summary->file, "%li,%.0f,%.0f,%g,%g,%g,%.0f,%.0f,%.3f,%.0f,%.0f,%.0f,%.0f\n",
+            timestamp, positions.n, summary->all_landings.n,
+            positions.mean[0], positions.mean[1], positions.mean[2],
+            sd_north, sd_east, correlation,
+            sqrt(ensemble_moments_covariance(&positions, 2, 2)),
+            altitude_histogram_percentile(&altitudes, 0.05),
+            altitude_histogram_percentile(&altitudes, 0.5),
+            altitude_histogram_percentile(&altitudes, 0.95));
+
+    if(ferror(summary->file)) {
+        fprintf(stderr, "ERROR: error writing summary track\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+static int
+_compare_long(const void* a, const void* b)
+{
+    long int la = *(const long int*)a, lb = *(const long int*)b;
+
+    return (la > lb) - (la < lb);
+}
+
+// Report where and when the members landed, close the summary track and free
+// the statistics. Returns zero if the track could not be written. The
+// landing times are kept with the members anyway so their percentiles are
+// found exactly.
+static int
+_summary_close(summary_t* summary, const model_state_t* states, unsigned int n_states,
+               long int initial_timestamp)
+{
+    const ensemble_moments_t* landings = &(summary->all_landings);
+    double dlng_metres = DEGREES_TO_METRES * cos(landings->mean[0] * DEGREES_TO_RADIANS);
+    long int* times;
+    unsigned int i;
+    int ok = 1;
+
+    times = (long int*)malloc(sizeof(long int) * n_states);
+    for(i=0; i<n_states; ++i)
+        times[i] = states[i].final_timestamp - initial_timestamp;
+    qsort(times, n_states, sizeof(long int), _compare_long);
+
+    fprintf(stderr, "INFO: %.0f members landed at %f, %f (standard deviations "
+            "%.0fm north, %.0fm east).\n", 
+            landings->n, landings->mean[0], landings->mean[1],
+            sqrt(ensemble_moments_covariance(landings, 0, 0)) * DEGREES_TO_METRES,
+            sqrt(ensemble_moments_covariance(landings, 1, 1)) * dlng_metres);
+    fprintf(stderr, "INFO: Landing time %.0fs into the run (standard deviation %.0fs, "
+            "5%%/50%%/95%% landed by %lis/%lis/%lis).\n",
+            landings->mean[2], sqrt(ensemble_moments_covariance(landings, 2, 2)),
+            times[(n_states - 1) / 20], times[(n_states - 1) / 2], 
+            times[(19 * (n_states - 1)) / 20]);
+    free(times);
+
+    if(fclose(summary->file) != 0) {
+        fprintf(stderr, "ERROR: error writing summary track\n");
+        ok = 0;
+    }
+
+    free(summary->positions);
+    free(summary->landings);
+    free(summary->altitudes);
+
+    return ok;
+}
+
+// A position on the maximum likelihood track.
+typedef struct track_row_s track_row_t;
+struct track_row_s
+{
+    float               lat, lng, alt;
+    long int            timestamp;
+};
+
+// Everything which the ascent of an ensemble depends on. Keys are compared
+// bytewise so clear them before filling them in.
+typedef struct ascent_key_s ascent_key_t;
+struct ascent_key_s
+{
+    float               lat, lng, alt;
+    long int            timestamp;
+    float               rmserror;
+    float               ascent_rate;
+    unsigned long       seed;
+    unsigned int        n_states;
+    int                 integrator;
+    int                 sampling;
+    float               step;
+    float               tolerance;
+    float               resample_threshold;
+    altitude_params_t   params_sd, params_min, params_max;
+};
+
+// An ensemble checkpointed before any member reached burst together with the
+// track written on the way.
+typedef struct ascent_checkpoint_s ascent_checkpoint_t;
+struct ascent_checkpoint_s
+{
+    ascent_key_t        key;
+    long int            time;           // s into the run
+    model_state_t      *states;
+    track_row_t        *track;
+    unsigned int        n_track;
+    unsigned long       n_blocks;
+    unsigned int        n_resamples;
+};
+
+struct run_model_ascent_cache_s
+{
+    ascent_checkpoint_t *checkpoints;
+    unsigned int        n_checkpoints;
+    float              *altitudes;      // m - requested burst altitudes
+    unsigned int        n_altitudes;
+};
+
+run_model_ascent_cache_t*
+run_model_ascent_cache_new(void)
+{
+    run_model_ascent_cache_t* self;
+
+    self = (run_model_ascent_cache_t*)malloc(sizeof(run_model_ascent_cache_t));
+    self->checkpoints = NULL;
+    self->n_checkpoints = 0;
+    self->altitudes = NULL;
+    self->n_altitudes = 0;
+
+    return self;
+}
+
+void
+run_model_ascent_cache_free(run_model_ascent_cache_t* self)
+{
+    unsigned int i;
+
+    if(!self)
+        return;
+
+    for(i=0; i<self->n_checkpoints; ++i)
+    {
+        free(self->checkpoints[i].states);
+        free(self->checkpoints[i].track);
+    }
+    free(self->checkpoints);
+    free(self->altitudes);
+    free(self);
+}
+
+void
+run_model_ascent_cache_request(run_model_ascent_cache_t* self, float burst_altitude)
+{
+    unsigned int i;
+
+    for(i=0; i<self->n_altitudes; ++i)
+    {
+        if(self->altitudes[i] == burst_altitude)
+            return;
+    }
+
+    self->altitudes = (float*)realloc(self->altitudes, 
+                                      sizeof(float) * (self->n_altitudes + 1));
+    self->altitudes[self->n_altitudes++] = burst_altitude;
+}
+
+// Returns non-zero if the ensemble should be checkpointed at the start of the
+// block from t to t_next seconds into the run, which is if it is the last
+// block to start before the first burst at any of the n requested altitudes,
+// at burst_times, or our own at burst_time.
+static int
+_is_checkpoint(double t, double t_next, const double* burst_times, unsigned int n,
+               double burst_time)
+{
+    unsigned int i;
+
+    if((t <= 0.0) || (t > burst_time))
+        return 0;
+
+    if(t_next > burst_time)
+        return 1;
+
+    for(i=0; i<n; ++i)
+    {
+        if((t <= burst_times[i]) && (t_next > burst_times[i]))
+            return 1;
+    }
+
+    return 0;
+}
+
+// Returns non-zero if every member of a run with config takes the altitude
+// model's burst altitude, descent rate and float time, so that members which
+// have not yet burst may be restarted with another model's. Sweeps fly their
+// own points together.
+static int
+_fixed_descent(const run_model_config_t* config)
+{
+    const altitude_params_t *sd = &(config->params_sd);
+    const altitude_params_t *min = &(config->params_min), *max = &(config->params_max);
+
+    return (config->n_sweep == 0) && (config->sampling != SAMPLING_UNSCENTED) &&
+        (sd->burst_altitude <= 0.f) && (max->burst_altitude <= min->burst_altitude) &&
+        (sd->drag_coeff <= 0.f) && (max->drag_coeff <= min->drag_coeff) &&
+        (sd->float_time <= 0.f) && (max->float_time <= min->float_time);
+}
+
+// Returns non-zero if the ascent of a run with config may be shared with
+// others. Only runs whose members differ in nothing but their ascent rate and
+// launch time before burst qualify and the summary track, which would have
+// to be replayed, is not kept. A resumed run starts from its own checkpoint.
+static int
+_can_share_ascent(const run_model_config_t* config)
+{
+    return config->ascent_cache && !config->summary_file && !config->resume_file &&
+        _fixed_descent(config);
+}
+
+// Restart members which have not yet burst with the altitude model's burst
+// altitude, descent rate and float time.
+static void
+_restart_descent(model_state_t* states, unsigned int n_states, 
+                 const altitude_model_t* alt_model, float initial_alt)
+{
+    altitude_params_t model_params;
+    unsigned int i;
+
+    altitude_model_get_params(alt_model, &model_params);
+    for(i=0; i<n_states; ++i)
+    {
+        model_state_t* state = &(states[i]);
+
+        state->params.burst_altitude = model_params.burst_altitude;
+        state->params.drag_coeff = model_params.drag_coeff;
+        state->params.float_time = model_params.float_time;
+        altitude_model_start(alt_model, &(state->alt_state), initial_alt, 
+                             &(state->params));
+    }
+}
+
+static void
+_ascent_key(ascent_key_t* key, const altitude_model_t* alt_model, 
+            const run_model_config_t* config, unsigned int n_states,
+            float lat, float lng, float alt, long int timestamp, float rmserror)
+{
+    altitude_params_t params;
+
+    memset(key, 0, sizeof(ascent_key_t));
+    altitude_model_get_params(alt_model, &params);
+
+    key->lat = lat;
+    key->lng = lng;
+    key->alt = alt;
+    key->timestamp = timestamp;
+    key->rmserror = rmserror;
+    key->ascent_rate = params.ascent_rate;
+    key->seed = config->seed;
+    key->n_states = n_states;
+    key->integrator = config->integrator;
+    key->sampling = config->sampling;
+    key->step = config->step;
+    key->tolerance = config->tolerance;
+    key->resample_threshold = config->resample_threshold;
+    key->params_sd = config->params_sd;
+    key->params_min = config->params_min;
+    key->params_max = config->params_max;
+}
+
+// The time into the run at which the first member would burst if the burst
+// altitude were burst_altitude, or the members' own if it is negative.
+static double
+_first_burst_time(const altitude_model_t* alt_model, const model_state_t* states,
+                  unsigned int n_states, float initial_alt, float burst_altitude)
+{
+    double first = 0.0;
+    unsigned int i;
+
+    for(i=0; i<n_states; ++i)
+    {
+        altitude_state_t alt_state = states[i].alt_state;
+        double burst_t;
+
+        if(burst_altitude >= 0.f) {
+            altitude_params_t params = states[i].params;
+
+            params.burst_altitude = burst_altitude;
+            altitude_model_start(alt_model, &alt_state, initial_alt, &params);
+        }
+
+        burst_t = altitude_model_get_burst_time(alt_model, &alt_state);
+        if((i == 0) || (burst_t < first))
+            first = burst_t;
+    }
+
+    return first;
+}
+
+// Return the latest checkpoint of an ensemble with key taken at or before
+// max_time seconds into the run or NULL if there is none.
+static const ascent_checkpoint_t*
+_find_checkpoint(const run_model_ascent_cache_t* cache, const ascent_key_t* key,
+                 double max_time)
+{
+    const ascent_checkpoint_t* found = NULL;
+    unsigned int i;
+
+    for(i=0; i<cache->n_checkpoints; ++i)
+    {
+        const ascent_checkpoint_t* checkpoint = &(cache->checkpoints[i]);
+
+        if(memcmp(&(checkpoint->key), key, sizeof(ascent_key_t)) || 
+           (checkpoint->time > max_time))
+            continue;
+
+        if(!found || (checkpoint->time > found->time))
+            found = checkpoint;
+    }
+
+    return found;
+}
+
+// Add a copy of the ensemble time seconds into the run to cache unless it
+// already has one.
+static void
+_save_checkpoint(run_model_ascent_cache_t* cache, const ascent_key_t* key, long int time,
+                 const model_state_t* states, unsigned int n_states,
+                 const track_row_t* track, unsigned int n_track,
+                 unsigned long n_blocks, unsigned int n_resamples)
+{
+    ascent_checkpoint_t* checkpoint;
+    unsigned int i;
+
+    for(i=0; i<cache->n_checkpoints; ++i)
+    {
+        if((cache->checkpoints[i].time == time) &&
+           !memcmp(&(cache->checkpoints[i].key), key, sizeof(ascent_key_t)))
+            return;
+    }
+
+    cache->checkpoints = (ascent_checkpoint_t*)realloc(cache->checkpoints, 
+            sizeof(ascent_checkpoint_t) * (cache->n_checkpoints + 1));
+    checkpoint = &(cache->checkpoints[cache->n_checkpoints++]);
+
+    memcpy(&(checkpoint->key), key, sizeof(ascent_key_t));
+    checkpoint->time = time;
+    checkpoint->states = (model_state_t*)malloc(sizeof(model_state_t) * n_states);
+    memcpy(checkpoint->states, states, sizeof(model_state_t) * n_states);
+    checkpoint->track = (track_row_t*)malloc(sizeof(track_row_t) * (n_track ? n_track : 1));
+    memcpy(checkpoint->track, track, sizeof(track_row_t) * n_track);
+    checkpoint->n_track = n_track;
+    checkpoint->n_blocks = n_blocks;
+    checkpoint->n_resamples = n_resamples;
+}
+
+// A checkpoint file is this header followed by the n_states member states
+// and the n_track rows of the track written so far. Everything is written as
+// it is laid out in memory so only the same build of pred can read it back.
+#define CHECKPOINT_MAGIC "PREDCKPT"
+#define CHECKPOINT_VERSION 1
+
+typedef struct checkpoint_header_s checkpoint_header_t;
+struct checkpoint_header_s
+{
+    char                magic[8];       // CHECKPOINT_MAGIC
+    unsigned int        version;        // CHECKPOINT_VERSION
+    unsigned int        state_size;     // sizeof(model_state_t)
+    ascent_key_t        key;
+    altitude_params_t   params;         // the altitude model's
+    long int            time;           // s into the run
+    unsigned long       n_blocks;
+    unsigned int        n_resamples;
+    unsigned int        n_track;
 };
 
-// Get the distance (in metres) of one degree of latitude and one degree of
-// longitude. This varys with height (not much grant you).
+// Write the run time seconds in to filename. The checkpoint is written
+// alongside and renamed over any earlier one once it is complete, so there is
+// always a whole checkpoint to resume from. Returns non-zero on success.
+static int
+_write_checkpoint(const char* filename, const ascent_key_t* key,
+                  const altitude_model_t* alt_model, long int time,
+                  const model_state_t* states, unsigned int n_states,
+                  const track_row_t* track, unsigned int n_track,
+                  unsigned long n_blocks, unsigned int n_resamples)
+{
+    checkpoint_header_t header;
+    char* partial;
+    FILE* file;
+    int ok;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.state_size = sizeof(model_state_t);
+    memcpy(&(header.key), key, sizeof(ascent_key_t));
+    altitude_model_get_params(alt_model, &(header.params));
+    header.time = time;
+    header.n_blocks = n_blocks;
+    header.n_resamples = n_resamples;
+    header.n_track = n_track;
+
+    partial = (char*)malloc(strlen(filename) + 6);
+    strcpy(partial, filename);
+    strcat(partial, ".part");
+
+    file = fopen(partial, "wb");
+    if(!file) {
+        fprintf(stderr, "ERROR: %s: could not open checkpoint for output\n", partial);
+        free(partial);
+        return 0;
+    }
+
+    ok = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+        (fwrite(states, sizeof(model_state_t), n_states, file) == n_states) &&
+        (fwrite(track, sizeof(track_row_t), n_track, file) == n_track);
+    if(fclose(file) != 0)
+        ok = 0;
+    ok = ok && (rename(partial, filename) == 0);
+
+    if(!ok)
+        fprintf(stderr, "ERROR: %s: error writing checkpoint\n", filename);
+    else if(verbosity > 0)
+        fprintf(stderr, "INFO: Checkpointed the run %lis into the flight.\n", time);
+
+    free(partial);
+
+    return ok;
+}
+
+// Replace states, started for this run, with those checkpointed in filename
+// and set the track, time into the run and counts of blocks and resamples to
+// the checkpoint's. Returns non-zero on success.
+static int
+_read_checkpoint(const char* filename, const ascent_key_t* key,
+                 const altitude_model_t* alt_model, const run_model_config_t* config,
+                 model_state_t* states, unsigned int n_states, float initial_alt,
+                 track_row_t** track, unsigned int* n_track, long int* time,
+                 unsigned long* n_blocks, unsigned int* n_resamples)
+{
+    checkpoint_header_t header;
+    altitude_params_t params;
+    model_state_t* saved;
+    unsigned int i;
+    int restart, ok;
+    FILE* file;
+
+    file = fopen(filename, "rb");
+    if(!file) {
+        fprintf(stderr, "ERROR: %s: could not open checkpoint\n", filename);
+        return 0;
+    }
+
+    if((fread(&header, sizeof(header), 1, file) != 1) ||
+       memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) ||
+       (header.version != CHECKPOINT_VERSION) ||
+       (header.state_size != sizeof(model_state_t))) {
+        fprintf(stderr, "ERROR: %s: not a checkpoint written by this build\n", filename);
+        fclose(file);
+        return 0;
+    }
+
+    if(memcmp(&(header.key), key, sizeof(ascent_key_t))) {
+        fprintf(stderr, "ERROR: %s: checkpoint is of another launch or ensemble\n", 
+                filename);
+        fclose(file);
+        return 0;
+    }
+
+    saved = (model_state_t*)malloc(sizeof(model_state_t) * n_states);
+    *track = (track_row_t*)malloc(sizeof(track_row_t) * (header.n_track + 1));
+    ok = (fread(saved, sizeof(model_state_t), n_states, file) == n_states) &&
+        (fread(*track, sizeof(track_row_t), header.n_track, file) == header.n_track);
+    fclose(file);
+    if(!ok)
+        fprintf(stderr, "ERROR: %s: checkpoint is truncated\n", filename);
+
+    // Members which have not yet burst may take this run's descent in place
+    // of the checkpointed one, as they do from an ascent checkpoint.
+    altitude_model_get_params(alt_model, &params);
+    restart = memcmp(&(header.params), &params, sizeof(altitude_params_t));
+    if(ok && restart && 
+       (!_fixed_descent(config) ||
+        (header.time > _first_burst_time(alt_model, states, n_states, initial_alt, -1.f)) ||
+        (header.time > _first_burst_time(alt_model, saved, n_states, initial_alt, -1.f)))) {
+        fprintf(stderr, "ERROR: %s: checkpoint was taken with other flight parameters\n", 
+                filename);
+        ok = 0;
+    }
+
+    if(!ok) {
+        free(saved);
+        free(*track);
+        *track = NULL;
+        return 0;
+    }
+
+    // The wind data may have changed since so every member finds its cell
+    // afresh.
+    memcpy(states, saved, sizeof(model_state_t) * n_states);
+    free(saved);
+    for(i=0; i<n_states; ++i)
+    {
+        if(config->initial_cursor)
+            states[i].cursor = *(config->initial_cursor);
+        else
+            wind_file_cursor_init(&states[i].cursor);
+    }
+
+    if(restart)
+        _restart_descent(states, n_states, alt_model, initial_alt);
+
+    *n_track = header.n_track;
+    *time = header.time;
+    *n_blocks = header.n_blocks;
+    *n_resamples = header.n_resamples;
+
+    return 1;
+}
+
+static int _state_compare_rev(const void* a, const void *b)
+{
+    model_state_t* sa = (model_state_t*)a;
+    model_state_t* sb = (model_state_t*)b;
+
+    // this returns a value s.t. the states will be sorted so that
+    // the maximum likelihood state is at position 0.
+    return (sa->loglik < sb->loglik) - (sa->loglik > sb->loglik);
+}
+
+// If the effective sample size of the live members has fallen below
+// threshold times their number, replace them with a systematic resample
+// drawn in proportion to exp(loglik) and return non-zero. u, in (0, 1],
+// offsets the resample. Both the selection and the copying are O(n).
+//
+// Each copy keeps its own random stream so copies of the same member go
+// their separate ways. Each is given the mean weight of the members it
+// replaces so that it remains comparable with those which have already
+// landed. Every live member is restarted at t, their common time into the
+// flight, so that the members of a packet are still all at the same point
+// for the Runge-Kutta integrators.
+static int
+_resample(model_state_t* states, unsigned int n_states, float threshold, 
+          float u, double t)
+{
+    model_state_t* copies;
+    unsigned int* alive;
+    double* weights;
+    double max_loglik = 0.0, sum = 0.0, sum_sq = 0.0, target, cumulative;
+    unsigned int i, j, n_alive = 0;
+
+    alive = (unsigned int*)malloc(sizeof(unsigned int) * n_states);
+    for(i=0; i<n_states; ++i) 
+    {
+        if(!states[i].alive)
+            continue;
+
+        if((n_alive == 0) || (states[i].loglik > max_loglik))
+            max_loglik = states[i].loglik;
+        alive[n_alive++] = i;
+    }
+
+    weights = (double*)malloc(sizeof(double) * (n_alive ? n_alive : 1));
+    for(i=0; i<n_alive; ++i)
+    {
+        weights[i] = exp(states[alive[i]].loglik - max_loglik);
+        sum += weights[i];
+        sum_sq += weights[i] * weights[i];
+    }
+
+    if((n_alive < 2) || (sum * sum >= threshold * n_alive * sum_sq)) {
+        free(weights);
+        free(alive);
+        return 0;
+    }
+
+    copies = (model_state_t*)malloc(sizeof(model_state_t) * n_alive);
+    for(i=0; i<n_alive; ++i)
+        copies[i] = states[alive[i]];
+
+    for(i=0, j=0, cumulative=weights[0]; i<n_alive; ++i)
+    {
+        model_state_t* state = &(states[alive[i]]);
+        random_stream_t rng = state->rng;
+        unsigned long rng_position = state->rng_position;
+
+        target = (i + 1.0 - u) * sum / n_alive;
+        while((j < n_alive-1) && (cumulative < target))
+            cumulative += weights[++j];
+
+        *state = copies[j];
+        state->rng = rng;
+        state->rng_position = rng_position;
+        state->loglik = max_loglik + log(sum / n_alive);
+
+        state->landed = 0;
+        state->rk_t[0] = state->rk_t[1] = t;
+        state->rk_y[0][0] = state->rk_y[1][0] = state->lat;
+        state->rk_y[0][1] = state->rk_y[1][1] = state->lng;
+        state->rk_y[0][2] = state->rk_y[1][2] = state->alt;
+    }
+
+    free(copies);
+    free(weights);
+    free(alive);
+
+    return 1;
+}
+
+void run_model_config_init(run_model_config_t* config)
+{
+    config->n_members = 1;
+    config->n_threads = 1;
+    config->seed = 0;
+
+    config->integrator = INTEGRATOR_EULER;
+    config->step = 10.f;
+    config->tolerance = 1.f;
+
+    config->resample_threshold = 0.f;
+
+    config->sampling = SAMPLING_RANDOM;
+    memset(&(config->params_sd), 0, sizeof(altitude_params_t));
+    memset(&(config->params_min), 0, sizeof(altitude_params_t));
+    memset(&(config->params_max), 0, sizeof(altitude_params_t));
+
+    config->summary_file = NULL;
+    config->ascent_cache = NULL;
+
+    config->landing_grid_file = NULL;
+    config->landing_grid_resolution = 1000.f;
+    config->landing_grid_bandwidth = 0.f;
+
+    config->n_sweep = 0;
+    config->sweep_params = NULL;
+    config->sweep_landings = NULL;
+    config->sweep_track_file = NULL;
+    config->sweep_sites = NULL;
+
+    config->initial_cursor = NULL;
+
+    config->checkpoint_file = NULL;
+    config->checkpoint_interval = 3600.f;
+    config->checkpoint_end = 0.f;
+    config->resume_file = NULL;
+
+    config->time_limit = 0.f;
+    config->keep_wind_data = 0;
+}
+
+int run_model_integrator_from_name(const char* name)
+{
+    if(!strcmp(name, "euler"))
+        return INTEGRATOR_EULER;
+    if(!strcmp(name, "rk4"))
+        return INTEGRATOR_RK4;
+    if(!strcmp(name, "rk45"))
+        return INTEGRATOR_RK45;
+
+    return -1;
+}
+
+int run_model_sampling_from_name(const char* name)
+{
+    if(!strcmp(name, "random"))
+        return SAMPLING_RANDOM;
+    if(!strcmp(name, "sobol"))
+        return SAMPLING_SOBOL;
+    if(!strcmp(name, "unscented"))
+        return SAMPLING_UNSCENTED;
+
+    return -1;
+}
+
+// Set the flight parameters and wind error of the i-th sigma point. Point 0
+// is the mean and points 2k-1 and 2k lie either side of it along the k-th
+// dimension.
+static void
+_unscented_point(const altitude_model_t* alt_model, const run_model_config_t* config,
+                 float rmserror, unsigned int i,
+                 altitude_params_t* params, float* wind_bias)
+{
+    double offset = sqrt(UNSCENTED_DIMENSIONS + UNSCENTED_LAMBDA);
+
+    altitude_model_get_params(alt_model, params);
+    wind_bias[0] = wind_bias[1] = 0.f;
+
+    if(i == 0)
+        return;
+
+    if((i % 2) == 0)
+        offset = -offset;
+
+    switch((i - 1) / 2)
+    {
+        case 0:
+            params->ascent_rate += offset * config->params_sd.ascent_rate;
+            break;
+        case 1:
+            params->burst_altitude += offset * config->params_sd.burst_altitude;
+            break;
+        case 2:
+            params->drag_coeff += offset * config->params_sd.drag_coeff;
+            break;
+        case 3:
+            wind_bias[0] = offset * rmserror;
+            break;
+        default:
+            wind_bias[1] = offset * rmserror;
+            break;
+    }
+
+    if((params->ascent_rate <= 0.f) || (params->drag_coeff <= 0.f))
+        fprintf(stderr, "WARN: Sigma point %u has a non-positive ascent rate or "
+                "drag coefficient. Reduce their uncertainty.\n", i);
+}
+
+// The weight of the i-th sigma point in the mean or, if covariance is
+// non-zero, in the covariance.
+static double
+_unscented_weight(unsigned int i, int covariance)
+{
+    double scale = UNSCENTED_DIMENSIONS + UNSCENTED_LAMBDA;
+
+    if(i > 0)
+        return 0.5 / scale;
+
+    return UNSCENTED_LAMBDA / scale + (covariance ? 2.0 : 0.0);
+}
+
+// Report the mean and covariance of the landings of the sigma points.
 static void
-_get_frame(float lat, float lng, float alt, 
-        float *d_dlat, float *d_dlng)
+_report_unscented(const model_state_t* states)
 {
-    float theta, r;
+    double lat = 0.0, lng = 0.0, timestamp = 0.0;
+    double nn = 0.0, ee = 0.0, ne = 0.0, dlng_metres;
+    unsigned int i;
 
-    theta = 2.f * M_PI * (90.f - lat) / 360.f;
-    r = RADIUS_OF_EARTH + alt;
+    for(i=0; i<UNSCENTED_POINTS; ++i)
+    {
+        double w = _unscented_weight(i, 0);
 
-    // See the differentiation section of
-    // http://en.wikipedia.org/wiki/Spherical_coordinate_system
+        lat += w * states[i].lat;
+        lng += w * states[i].lng;
+        timestamp += w * states[i].final_timestamp;
+    }
 
-    // d/dv = d/dlat = -d/dtheta
-    *d_dlat = (2.f * M_PI) * r / 360.f;
+    dlng_metres = DEGREES_TO_METRES * cos(lat * DEGREES_TO_RADIANS);
+    for(i=0; i<UNSCENTED_POINTS; ++i)
+    {
+        double w = _unscented_weight(i, 1);
+        double n = (states[i].lat - lat) * DEGREES_TO_METRES;
+        double e = (states[i].lng - lng) * dlng_metres;
 
-    // d/du = d/dlong = d/dphi
-    *d_dlng = (2.f * M_PI) * r * sinf(theta) / 360.f;
+        nn += w * n * n;
+        ee += w * e * e;
+        ne += w * n * e;
+    }
+
+    fprintf(stderr, "INFO: Unscented landing mean: %f, %f at %.0f\n", lat, lng, timestamp);
+    fprintf(stderr, "INFO: Unscented landing covariance: north %.0f, east %.0f, "
+            "north-east %.0f m^2 (standard deviations %.0fm, %.0fm)\n", 
+            nn, ee, ne, sqrt(nn > 0.0 ? nn : 0.0), sqrt(ee > 0.0 ? ee : 0.0));
 }
 
-static int 
-_advance_one_timestep(wind_file_cache_t* cache, 
-                      unsigned long delta_t,
-                      unsigned long timestamp, unsigned long initial_timestamp,
-                      unsigned int n_states, model_state_t* states,
-                      float rmserror)
+// The number of flight parameters a member draws and the most draws made for
+// one before giving up on finding one in range.
+#define N_PARAMS 5
+#define MAX_PARAM_DRAWS 16
+
+// Draw the k-th flight parameter of a member uniformly between min and max
+// if max > min and else from a normal distribution about mean with standard
+// deviation sd. Draws at or below lower are drawn again.
+static float
+_sample_param(const random_stream_t* rng, unsigned int k, float mean, float sd,
+              float min, float max, float lower)
 {
     unsigned int i;
 
-    for(i=0; i<n_states; ++i)
+    if((max <= min) && (sd <= 0.f))
+        return mean;
+
+    for(i=0; i<MAX_PARAM_DRAWS; ++i)
     {
-        float ddlat, ddlng;
-        float wind_v, wind_u, wind_var;
-        float u_samp, v_samp, u_lik, v_lik;
-        model_state_t* state = &(states[i]);
+        float u[2], x;
 
-        if(!altitude_model_get_altitude(state->alt_model, 
-                                        timestamp - initial_timestamp, &state->alt))
-            return 0;
+        random_stream_uniform(rng, 2 * (N_PARAMS * i + k), 2, u);
+        if(max > min)
+            x = min + (max - min) * u[0];
+        else
+            x = mean + sd * sqrtf(-2.f * logf(u[0])) * cosf(2.f * M_PI * u[1]);
 
-        if(!get_wind(cache, state->lat, state->lng, state->alt, timestamp, 
-                    &wind_v, &wind_u, &wind_var)) {
-                fprintf(stderr, "ERROR: error getting wind data\n");
-                return 0;
-        }
+        if(x > lower)
+            return x;
+    }
 
-        _get_frame(state->lat, state->lng, state->alt, &ddlat, &ddlng);
+    fprintf(stderr, "WARN: Could not draw a flight parameter above %f, "
+            "using %f.\n", lower, mean);
+    return mean;
+}
 
-        // NOTE: it this really the right thing to be doing? - think about what
-        // happens near the poles
+// Draw a member's flight parameters from the configured distributions about
+// nominal. The member's random stream is otherwise only used for normal
+// samples so the uniform samples used here are independent of its wind
+// perturbations.
+static void
+_sample_params(const altitude_params_t* nominal, const run_model_config_t* config,
+               const random_stream_t* rng, float initial_alt, altitude_params_t* params)
+{
+    const altitude_params_t* sd = &(config->params_sd);
+    const altitude_params_t* min = &(config->params_min);
+    const altitude_params_t* max = &(config->params_max);
 
-        wind_var += rmserror * rmserror;
+    *params = *nominal;
 
-        assert(wind_var >= 0.f);
+    params->ascent_rate = _sample_param(rng, 0, params->ascent_rate, 
+            sd->ascent_rate, min->ascent_rate, max->ascent_rate, 0.f);
+    params->burst_altitude = _sample_param(rng, 1, params->burst_altitude, 
+            sd->burst_altitude, min->burst_altitude, max->burst_altitude, initial_alt);
+    params->drag_coeff = _sample_param(rng, 2, params->drag_coeff, 
+            sd->drag_coeff, min->drag_coeff, max->drag_coeff, 0.f);
+    params->float_time = _sample_param(rng, 3, params->float_time, 
+            sd->float_time, min->float_time, max->float_time, -HUGE_VALF);
+    params->launch_time = _sample_param(rng, 4, params->launch_time, 
+            sd->launch_time, min->launch_time, max->launch_time, -HUGE_VALF);
 
-        //fprintf(stderr, "U: %f +/- %f, V: %f +/- %f\n",
-        //        wind_u, sqrtf(wind_u_var),
-        //        wind_v, sqrtf(wind_v_var));
+    if(params->float_time < 0.f)
+        params->float_time = 0.f;
+}
 
-        u_samp = random_sample_normal(wind_u, wind_var, &u_lik);
-        v_samp = random_sample_normal(wind_v, wind_var, &v_lik);
+// Summarise where the n_members members flying each point of a sweep
+// landed, relative to initial_timestamp, in config->sweep_landings. The
+// members of a point are states[i*n_members] onwards. Members which left
+// the wind data are still in the air and the point gets no landing.
+static void
+_summarise_sweep(const model_state_t* states, unsigned int n_members,
+                 const run_model_config_t* config, long int initial_timestamp)
+{
+    unsigned int i, j;
 
-        //u_samp = wind_u;
-        //v_samp = wind_v;
+    for(i=0; i<config->n_sweep; ++i)
+    {
+        run_model_landing_t* landing = &(config->sweep_landings[i]);
+        ensemble_moments_t moments;
+        unsigned int n_landed = 0;
+        double dlng_metres;
 
-        state->lat += v_samp * delta_t / ddlat;
-        state->lng += u_samp * delta_t / ddlng;
+        ensemble_moments_reset(&moments);
+        for(j=0; j<n_members; ++j)
+        {
+            const model_state_t* state = &(states[i * n_members + j]);
+            double x[3] = { state->lat, state->lng, 
+                state->final_timestamp - initial_timestamp };
 
-        state->loglik += (double)(u_lik + v_lik);
-    }
+            if(state->alt <= 0.f)
+                ++n_landed;
+            ensemble_moments_add(&moments, x);
+        }
 
-    return 1;
+        landing->n_members = n_members;
+        landing->n_landed = n_landed;
+        if(n_landed < n_members) {
+            landing->lat = landing->lng = NAN;
+            landing->sd_north = landing->sd_east = NAN;
+            landing->timestamp = 0;
+            landing->sd_time = NAN;
+            continue;
+        }
+
+        dlng_metres = DEGREES_TO_METRES * cos(moments.mean[0] * DEGREES_TO_RADIANS);
+
+        landing->lat = moments.mean[0];
+        landing->lng = moments.mean[1];
+        landing->sd_north = sqrt(ensemble_moments_covariance(&moments, 0, 0)) * 
+            DEGREES_TO_METRES;
+        landing->sd_east = sqrt(ensemble_moments_covariance(&moments, 1, 1)) * dlng_metres;
+        landing->timestamp = initial_timestamp + (long int)floor(moments.mean[2] + 0.5);
+        landing->sd_time = sqrt(ensemble_moments_covariance(&moments, 2, 2));
+    }
 }
 
-static int _state_compare_rev(const void* a, const void *b)
+// Write the position at timestamp, t seconds into the run, of the maximum
+// likelihood member of each point of a sweep which has launched and is
+// still flying to file.
+static void
+_write_sweep_track(FILE* file, const model_state_t* states, unsigned int n_members,
+                   unsigned int n_sweep, double t, long int timestamp)
 {
-    model_state_t* sa = (model_state_t*)a;
-    model_state_t* sb = (model_state_t*)b;
+    unsigned int i, j;
 
-    // this returns a value s.t. the states will be sorted so that
-    // the maximum likelihood state is at position 0.
-    return sb->loglik - sa->loglik;
+    for(i=0; i<n_sweep; ++i)
+    {
+        const model_state_t* best = NULL;
+
+        for(j=0; j<n_members; ++j)
+        {
+            const model_state_t* state = &(states[i * n_members + j]);
+
+            if(!state->alive || (state->params.launch_time >= t))
+                continue;
+
+            if(!best || (state->loglik > best->loglik))
+                best = state;
+        }
+
+        if(best)
+            fprintf(file, "%u,%li,%g,%g,%g\n", i, timestamp, 
+                    best->lat, best->lng, best->alt);
+    }
 }
 
-int run_model(wind_file_cache_t* cache, altitude_model_t* alt_model,
+int run_model(wind_file_cache_t* cache, const altitude_model_t* alt_model,
               float initial_lat, float initial_lng, float initial_alt,
-              long int initial_timestamp, float rmswinderror) 
+              long int initial_timestamp, float rmswinderror,
+              const run_model_config_t* config) 
 {
     model_state_t* states;
-    const unsigned int n_states = 1;
-    unsigned int i;
+    altitude_params_t nominal;
+    float earliest_launch = 0.f;
+    long int launch_offset;
+    model_worker_t workers[MAX_WORKER_THREADS];
+    unsigned int i, n_alive, n_packets;
+    unsigned int n_states = config->n_members;
+    unsigned int n_members;
+    unsigned int n_threads = config->n_threads;
+    unsigned long n_steps = 0, n_wind_evals = 0, n_blocks = 0;
+    unsigned int n_resamples = 0;
+    random_stream_t resample_rng;
+    summary_t summary;
+    FILE* sweep_tracks = NULL;
+    int share_ascent = _can_share_ascent(config);
+    int keep_track = share_ascent || config->checkpoint_file;
+    ascent_key_t ascent_key;
+    double next_checkpoint = config->checkpoint_interval;
+    double burst_time = 0.0, *checkpoint_times = NULL;
+    track_row_t* track = NULL;
+    unsigned int n_track = 0;
+    long int timestamp;
+    gint64 start_time = g_get_monotonic_time();
+
+    if(n_states < 1)
+        n_states = 1;
+    if(config->sampling == SAMPLING_UNSCENTED)
+        n_states = UNSCENTED_POINTS;
+    n_members = n_states;
+    if(config->n_sweep > 0)
+        n_states *= config->n_sweep;
+    n_packets = (n_states + WIND_FILE_BATCH_SIZE - 1) / WIND_FILE_BATCH_SIZE;
+
+    if(n_threads < 1)
+        n_threads = 1;
+    if(n_threads > MAX_WORKER_THREADS)
+        n_threads = MAX_WORKER_THREADS;
+    if(n_threads > n_packets)
+        n_threads = n_packets;
 
     states = (model_state_t*) malloc( sizeof(model_state_t) * n_states );
 
+    // Draw every member's flight parameters up front. If any member launches
+    // early the run starts when it does.
+    altitude_model_get_params(alt_model, &nominal);
+    for(i=0; i<n_states; ++i) 
+    {
+        random_stream_init(&states[i].rng, config->seed, i % n_members);
+        states[i].wind_bias[0] = states[i].wind_bias[1] = 0.f;
+
+        if(config->sampling == SAMPLING_UNSCENTED)
+            _unscented_point(alt_model, config, rmswinderror, i, 
+                             &states[i].params, states[i].wind_bias);
+        else if(config->n_sweep > 0)
+            _sample_params(&(config->sweep_params[i / n_members]), config, 
+                           &states[i].rng, initial_alt, &states[i].params);
+        else
+            _sample_params(&nominal, config, &states[i].rng, initial_alt, 
+                           &states[i].params);
+
+        if((i == 0) || (states[i].params.launch_time < earliest_launch))
+            earliest_launch = states[i].params.launch_time;
+    }
+
+    launch_offset = (long int)floor(earliest_launch + 0.5);
+    if(launch_offset > 0)
+        launch_offset = 0;
+    initial_timestamp += launch_offset;
+    for(i=0; i<n_states; ++i) 
+        states[i].params.launch_time -= launch_offset;
+
     for(i=0; i<n_states; ++i) 
     {
         model_state_t* state = &(states[i]);
@@ -138,45 +1936,441 @@ int run_model(wind_file_cache_t* cache, altitude_model_t* alt_model,
         state->alt = initial_alt;
         state->lat = initial_lat;
         state->lng = initial_lng;
-        state->alt_model = alt_model;
+        if(config->sweep_sites) 
+        {
+            state->lat = config->sweep_sites[2 * (i / n_members)];
+            state->lng = config->sweep_sites[2 * (i / n_members) + 1];
+        }
         state->loglik = 0.f;
+        altitude_model_start(alt_model, &(state->alt_state), initial_alt, &(state->params));
+
+        state->rng_position = 0;
+        if(config->initial_cursor)
+            state->cursor = *(config->initial_cursor);
+        else
+            wind_file_cursor_init(&state->cursor);
+
+        state->rk_t[0] = state->rk_t[1] = 0.0;
+        state->rk_y[0][0] = state->rk_y[1][0] = state->lat;
+        state->rk_y[0][1] = state->rk_y[1][1] = state->lng;
+        state->rk_y[0][2] = state->rk_y[1][2] = initial_alt;
+        state->landed = 0;
+        state->step = config->step;
+
+        state->alive = 1;
+        state->final_timestamp = initial_timestamp;
+        state->summarised = 0;
     }
 
-    long int timestamp = initial_timestamp;
-    
-    int log_counter = 0; // only write position to output files every LOG_DECIMATE timesteps
+    // Hand each worker a contiguous block of whole packets of members. The
+    // Runge-Kutta integrators step the members of a packet together so
+    // splitting on packet boundaries means that the split only affects which
+    // thread does the work, never the result.
+    for(i=0; i<n_threads; ++i) 
+    {
+        unsigned int first = ((n_packets * i) / n_threads) * WIND_FILE_BATCH_SIZE;
+        unsigned int last = ((n_packets * (i+1)) / n_threads) * WIND_FILE_BATCH_SIZE;
+
+        if(last > n_states)
+            last = n_states;
+
+        workers[i].cache = cache;
+        workers[i].states = &(states[first]);
+        workers[i].n_states = last - first;
+        workers[i].initial_timestamp = initial_timestamp;
+        workers[i].rmserror = rmswinderror;
+        workers[i].config = config;
+        workers[i].alt_model = alt_model;
+        workers[i].end_on_block = 0;
+        workers[i].positions = NULL;
+        workers[i].landings = NULL;
+        workers[i].altitudes = NULL;
+    }
+
+    if(config->summary_file && 
+       !_summary_open(&summary, config->summary_file, workers, n_threads, 
+                      states, n_packets)) {
+        free(states);
+        return 0;
+    }
+
+    if((config->n_sweep > 0) && config->sweep_track_file) 
+    {
+        sweep_tracks = fopen(config->sweep_track_file, "wb");
+        if(!sweep_tracks) {
+            fprintf(stderr, "ERROR: %s: could not open sweep tracks for output\n", 
+                    config->sweep_track_file);
+            if(config->summary_file)
+                _summary_close(&summary, states, n_states, initial_timestamp);
+            free(states);
+            return 0;
+        }
+    }
+
+    random_stream_init(&resample_rng, config->seed, RESAMPLE_STREAM);
+
+    timestamp = initial_timestamp;
+
+    if(share_ascent || config->checkpoint_file || config->resume_file)
+        _ascent_key(&ascent_key, alt_model, config, n_states, 
+                    initial_lat, initial_lng, initial_alt, initial_timestamp, rmswinderror);
+
+    // Carry on from where the checkpointed run left off, writing out the
+    // track it had written.
+    if(config->resume_file)
+    {
+        long int time;
+        
+        if(!_read_checkpoint(config->resume_file, &ascent_key, alt_model, config, 
+                             states, n_states, initial_alt, &track, &n_track, &time, 
+                             &n_blocks, &n_resamples)) {
+            if(config->summary_file)
+                _summary_close(&summary, states, n_states, initial_timestamp);
+            if(sweep_tracks)
+                fclose(sweep_tracks);
+            free(states);
+            return 0;
+        }
+
+        for(i=0; i<n_track; ++i)
+            write_position(track[i].lat, track[i].lng, track[i].alt, track[i].timestamp);
+
+        timestamp = initial_timestamp + time;
+        next_checkpoint = time + config->checkpoint_interval;
+
+        if(verbosity > 0)
+            fprintf(stderr, "INFO: Resuming the run %lis into the flight.\n", time);
+    }
+
+    // Start from the latest checkpoint of the same ascent taken before any
+    // member bursts. The members are restarted with this run's burst and
+    // descent.
+    if(share_ascent)
+    {
+        const ascent_checkpoint_t* checkpoint;
+
+        burst_time = _first_burst_time(alt_model, states, n_states, initial_alt, -1.f);
+
+        checkpoint_times = (double*)malloc(sizeof(double) * 
+                                           (config->ascent_cache->n_altitudes + 1));
+        for(i=0; i<config->ascent_cache->n_altitudes; ++i)
+            checkpoint_times[i] = _first_burst_time(alt_model, states, n_states, initial_alt,
+                                                    config->ascent_cache->altitudes[i]);
+
+        checkpoint = _find_checkpoint(config->ascent_cache, &ascent_key, burst_time);
+        if(checkpoint) 
+        {
+            memcpy(states, checkpoint->states, sizeof(model_state_t) * n_states);
+            _restart_descent(states, n_states, alt_model, initial_alt);
+
+            track = (track_row_t*)malloc(sizeof(track_row_t) * (checkpoint->n_track + 1));
+            for(n_track=0; n_track<checkpoint->n_track; ++n_track)
+            {
+                track[n_track] = checkpoint->track[n_track];
+                write_position(track[n_track].lat, track[n_track].lng, 
+                               track[n_track].alt, track[n_track].timestamp);
+            }
+
+            timestamp = initial_timestamp + checkpoint->time;
+            n_blocks = checkpoint->n_blocks;
+            n_resamples = checkpoint->n_resamples;
+
+            if(verbosity > 0)
+                fprintf(stderr, "INFO: Starting from the ascent checkpoint %lis into "
+                        "the flight.\n", checkpoint->time);
+        }
+    }
     
-    while(_advance_one_timestep(cache, TIMESTEP, timestamp, initial_timestamp, 
-                n_states, states, rmswinderror))
+    // Members are advanced in parallel up to each timestep which is written
+    // to the output (every LOG_DECIMATE timesteps). Only then do we need to
+    // look across the whole ensemble.
+    n_alive = n_states;
+    while(n_alive > 0)
     {
-        // Sort the array of models in order of log likelihood. 
-        qsort(states, n_states, sizeof(model_state_t), _state_compare_rev);
+        long int log_timestamp = timestamp + (LOG_DECIMATE - 1) * TIMESTEP;
+        model_state_t* best = NULL;
+
+        if(timestamp == initial_timestamp)
+            log_timestamp += TIMESTEP;
+
+        // Save the run at the start of the first block due a checkpoint.
+        if(config->checkpoint_file && 
+           (timestamp - initial_timestamp >= next_checkpoint) &&
+           ((config->checkpoint_end <= 0.f) || 
+            (timestamp - initial_timestamp <= config->checkpoint_end))) 
+        {
+            if(!_write_checkpoint(config->checkpoint_file, &ascent_key, alt_model, 
+                                  timestamp - initial_timestamp, states, n_states, 
+                                  track, n_track, n_blocks, n_resamples)) {
+                if(config->summary_file)
+                    _summary_close(&summary, states, n_states, initial_timestamp);
+                if(sweep_tracks)
+                    fclose(sweep_tracks);
+                free(track);
+                free(checkpoint_times);
+                free(states);
+                return 0;
+            }
+
+            while(next_checkpoint <= timestamp - initial_timestamp)
+                next_checkpoint += config->checkpoint_interval;
+        }
+
+        // Checkpoint the ensemble if this block would take the first member
+        // past burst at any requested altitude or our own. The Runge-Kutta
+        // methods end a step at each checkpoint so that the members are in
+        // the same state whichever run took it.
+        if(share_ascent) 
+        {
+            double t = timestamp - initial_timestamp;
+            double t_next = log_timestamp + TIMESTEP - initial_timestamp;
+            unsigned int n_altitudes = config->ascent_cache->n_altitudes;
+
+            if(_is_checkpoint(t, t_next, checkpoint_times, n_altitudes, burst_time))
+                _save_checkpoint(config->ascent_cache, &ascent_key, (long int)t, 
+                                 states, n_states, track, n_track, n_blocks, n_resamples);
+
+            for(i=0; i<n_threads; ++i)
+                workers[i].end_on_block = _is_checkpoint(t_next, 
+                        t_next + LOG_DECIMATE * TIMESTEP, checkpoint_times, 
+                        n_altitudes, burst_time);
+        }
+
+        // Every member is at or after timestamp so any wind data from before
+        // it which has been superseded will not be used again. Long flights
+        // would otherwise end up with every tile they crossed in memory.
+        if(!config->keep_wind_data)
+            wind_file_cache_release_before(cache, timestamp);
+
+        _advance_timesteps(workers, n_threads, timestamp, log_timestamp);
+        for(i=0; i<n_threads; ++i) 
+        {
+            n_steps += workers[i].n_steps;
+            n_wind_evals += workers[i].n_wind_evals;
+        }
 
         // write the maximum likelihood state out.
-        if (log_counter == LOG_DECIMATE) {
-            write_position(states[0].lat, states[0].lng, states[0].alt, timestamp);
-            log_counter = 0;
+        n_alive = 0;
+        for(i=0; i<n_states; ++i) 
+        {
+            if(!states[i].alive)
+                continue;
+
+            ++n_alive;
+            if(!best || (states[i].loglik > best->loglik))
+                best = &(states[i]);
+        }
+
+        if(best && (config->n_sweep == 0)) {
+            write_position(best->lat, best->lng, best->alt, log_timestamp);
+
+            if(keep_track) {
+                track = (track_row_t*)realloc(track, sizeof(track_row_t) * (n_track + 1));
+                track[n_track].lat = best->lat;
+                track[n_track].lng = best->lng;
+                track[n_track].alt = best->alt;
+                track[n_track].timestamp = log_timestamp;
+                ++n_track;
+            }
+        }
+
+        if(sweep_tracks)
+            _write_sweep_track(sweep_tracks, states, n_members, config->n_sweep, 
+                               log_timestamp - initial_timestamp, log_timestamp);
+
+        if(config->summary_file &&
+           !_summary_write(&summary, n_threads, n_packets, log_timestamp)) {
+            _summary_close(&summary, states, n_states, initial_timestamp);
+            if(sweep_tracks)
+                fclose(sweep_tracks);
+            free(states);
+            return 0;
+        }
+
+        timestamp = log_timestamp + TIMESTEP;
+
+        if(config->resample_threshold > 0.f) 
+        {
+            float u;
+
+            random_stream_uniform(&resample_rng, n_blocks, 1, &u);
+            n_resamples += _resample(states, n_states, config->resample_threshold, u,
+                                     timestamp - initial_timestamp);
         }
+        ++n_blocks;
 
-        log_counter++;
-        timestamp += TIMESTEP;
+        if((n_alive > 0) && (config->time_limit > 0.f) && 
+           (1e-6 * (g_get_monotonic_time() - start_time) > config->time_limit)) 
+        {
+            fprintf(stderr, "WARN: Gave up the run after its time limit of %gs.\n", 
+                    config->time_limit);
+            if(config->summary_file)
+                _summary_close(&summary, states, n_states, initial_timestamp);
+            if(sweep_tracks)
+                fclose(sweep_tracks);
+            free(track);
+            free(checkpoint_times);
+            free(states);
+            return 0;
+        }
     }
+    free(track);
+    free(checkpoint_times);
 
-    for(i=0; i<n_states; ++i) 
+    if(config->sampling == SAMPLING_UNSCENTED)
+        _report_unscented(states);
+
+    // A sweep's table takes the place of its track and landings.
+    if(config->n_sweep > 0) 
     {
-        model_state_t* state = &(states[i]);
-        write_position(state->lat, state->lng, state->alt, timestamp);
+        _summarise_sweep(states, n_members, config, initial_timestamp - launch_offset);
+
+        if(sweep_tracks) 
+        {
+            int ok;
+
+            for(i=0; i<n_states; ++i)
+                fprintf(sweep_tracks, "%u,%li,%g,%g,%g\n", i / n_members, 
+                        states[i].final_timestamp, states[i].lat, states[i].lng, 
+                        states[i].alt);
+
+            ok = !ferror(sweep_tracks);
+            if((fclose(sweep_tracks) != 0) || !ok) {
+                fprintf(stderr, "ERROR: error writing sweep tracks\n");
+                free(states);
+                return 0;
+            }
+        }
+    }
+    else
+    {
+        // Sort the array of models in order of log likelihood. 
+        qsort(states, n_states, sizeof(model_state_t), _state_compare_rev);
+
+        for(i=0; i<n_states; ++i) 
+        {
+            model_state_t* state = &(states[i]);
+            write_position(state->lat, state->lng, state->alt, state->final_timestamp);
+        }
+
+        fprintf(stderr, "INFO: Final maximum log lik: %f (=%f)\n", 
+                states[0].loglik, exp(states[0].loglik));
+    }
+
+    if(verbosity > 0) {
+        double elapsed = 1e-6 * (g_get_monotonic_time() - start_time);
+        fprintf(stderr, "INFO: Advanced %lu member timesteps with %lu wind "
+                "evaluations in %.3fs (%.0f per second).\n", 
+                n_steps, n_wind_evals, elapsed,
+                (elapsed > 0.0) ? n_steps / elapsed : 0.0);
+        if(config->resample_threshold > 0.f)
+            fprintf(stderr, "INFO: Resampled the ensemble %u times.\n", n_resamples);
+    }
+
+    if(config->landing_grid_file &&
+       !_write_landing_grid(states, n_states, config)) {
+        if(config->summary_file)
+            _summary_close(&summary, states, n_states, initial_timestamp);
+        free(states);
+        return 0;
     }
 
-    fprintf(stderr, "INFO: Final maximum log lik: %f (=%f)\n", 
-            states[0].loglik, exp(states[0].loglik));
+    if(config->summary_file && 
+       !_summary_close(&summary, states, n_states, initial_timestamp)) {
+        free(states);
+        return 0;
+    }
 
     free(states);
 
     return 1;
 }
 
-int get_wind(wind_file_cache_t* cache, float lat, float lng, float alt, long int timestamp,
+#if SENSITIVITY_PARAMS > DUAL_N
+#error "dual numbers carry too few derivatives for the sensitivity"
+#endif
+
+int run_model_sensitivity(wind_file_cache_t* cache, const altitude_model_t* alt_model,
+                          float initial_lat, float initial_lng, float initial_alt,
+                          long int initial_timestamp, run_model_sensitivity_t* sensitivity)
+{
+    altitude_params_t nominal;
+    altitude_dual_params_t params;
+    altitude_state_t alt_state;
+    wind_file_cursor_t cursor;
+    dual_t lat, lng, alt, landing_time;
+    dual_t lat_rate = dual_constant(0.0), lng_rate = dual_constant(0.0);
+    double dlng_metres;
+    long int timestamp;
+    unsigned int k;
+
+    altitude_model_get_params(alt_model, &nominal);
+    params.ascent_rate = dual_variable(nominal.ascent_rate, SENSITIVITY_ASCENT_RATE);
+    params.burst_altitude = dual_variable(nominal.burst_altitude, SENSITIVITY_BURST_ALTITUDE);
+    params.drag_coeff = dual_variable(nominal.drag_coeff, SENSITIVITY_DRAG_COEFF);
+    params.float_time = nominal.float_time;
+    params.launch_time = nominal.launch_time;
+
+    altitude_model_start(alt_model, &alt_state, initial_alt, &nominal);
+
+    lat = dual_constant(initial_lat);
+    lng = dual_constant(initial_lng);
+    wind_file_cursor_init(&cursor);
+
+    // The flight is advanced exactly as a member of run_model() is by
+    // _advance_one_timestep() with the Euler method, without the wind
+    // perturbations.
+    for(timestamp = initial_timestamp; ; timestamp += TIMESTEP)
+    {
+        dual_t wind_v, wind_u, ddlat, ddlng;
+        double t = timestamp - initial_timestamp;
+
+        if(!altitude_model_get_altitude_dual(alt_model, &params, initial_alt, t, &alt))
+            break;
+
+        if(!get_wind_dual(cache, &cursor, &lat, &lng, &alt, timestamp, &wind_v, &wind_u)) {
+            fprintf(stderr, "ERROR: error getting wind data\n");
+            return 0;
+        }
+
+        if(t < altitude_model_get_launch_time(alt_model, &alt_state))
+            continue;
+
+        _get_frame_dual(&lat, &alt, &ddlat, &ddlng);
+
+        lat_rate = dual_div(wind_v, ddlat);
+        lng_rate = dual_div(wind_u, ddlng);
+        lat = dual_add(lat, dual_scale(lat_rate, TIMESTEP));
+        lng = dual_add(lng, dual_scale(lng_rate, TIMESTEP));
+    }
+
+    // The flight stops at the first step after it lands so its landing only
+    // moves when the landing time crosses a step. Between steps it would
+    // have drifted on at the rate of its last step.
+    landing_time = altitude_model_get_landing_time_dual(alt_model, &params, initial_alt);
+    for(k=0; k<SENSITIVITY_PARAMS; ++k)
+    {
+        lat.dx[k] += lat_rate.x * landing_time.dx[k];
+        lng.dx[k] += lng_rate.x * landing_time.dx[k];
+    }
+
+    dlng_metres = DEGREES_TO_METRES * cos(lat.x * DEGREES_TO_RADIANS);
+
+    sensitivity->lat = lat.x;
+    sensitivity->lng = lng.x;
+    sensitivity->timestamp = timestamp;
+    for(k=0; k<SENSITIVITY_PARAMS; ++k)
+    {
+        sensitivity->d_north[k] = lat.dx[k] * DEGREES_TO_METRES;
+        sensitivity->d_east[k] = lng.dx[k] * dlng_metres;
+        sensitivity->d_time[k] = landing_time.dx[k];
+    }
+
+    return 1;
+}
+
+int get_wind(wind_file_cache_t* cache, wind_file_cursor_t* cursor,
+        float lat, float lng, float alt, long int timestamp,
         float* wind_v, float* wind_u, float *wind_var) {
     int i;
     float lambda, wu_l, wv_l, wu_h, wv_h;
@@ -218,13 +2412,12 @@ int get_wind(wind_file_cache_t* cache, float lat, float lng, float alt, long int
     }
 
     if(earlier_ts != later_ts)
-        lambda = ((float)timestamp - (float)earlier_ts) /
-            ((float)later_ts - (float)earlier_ts);
+        lambda = (double)(timestamp - earlier_ts) / (double)(later_ts - earlier_ts);
     else
         lambda = 0.5f;
 
-    wind_file_get_wind(found_files[0], lat, lng, alt, &wu_l, &wv_l, &wuvar_l, &wvvar_l);
-    wind_file_get_wind(found_files[1], lat, lng, alt, &wu_h, &wv_h, &wuvar_h, &wvvar_h);
+    wind_file_get_wind(found_files[0], cursor, lat, lng, alt, &wu_l, &wv_l, &wuvar_l, &wvvar_l);
+    wind_file_get_wind(found_files[1], cursor, lat, lng, alt, &wu_h, &wv_h, &wuvar_h, &wvvar_h);
 
     *wind_u = lambda * wu_h + (1.f-lambda) * wu_l;
     *wind_v = lambda * wv_h + (1.f-lambda) * wv_l;
@@ -236,4 +2429,169 @@ int get_wind(wind_file_cache_t* cache, float lat, float lng, float alt, long int
     return 1;
 }
 
+int get_wind_dual(wind_file_cache_t* cache, wind_file_cursor_t* cursor,
+        const dual_t* lat, const dual_t* lng, const dual_t* alt, long int timestamp,
+        dual_t* wind_v, dual_t* wind_u) {
+    int i;
+    double lambda;
+    dual_t wu[2], wv[2];
+    wind_file_cache_entry_t* found_entries[] = { NULL, NULL };
+    unsigned int earlier_ts, later_ts;
+
+    wind_file_cache_find_entry(cache, lat->x, lng->x, timestamp, 
+            &(found_entries[0]), &(found_entries[1]));
+
+    if(!found_entries[0] || !found_entries[1]) {
+        fprintf(stderr, "ERROR: Could not locate appropriate wind data tile for time.\n");
+        return 0;
+    }
+
+    if(!wind_file_cache_entry_contains_point(found_entries[0], lat->x, lng->x) || 
+            !wind_file_cache_entry_contains_point(found_entries[1], lat->x, lng->x))
+    {
+        fprintf(stderr, "ERROR: Could not locate appropriate wind data tile for location "
+                "lat=%f, lon=%f.\n", lat->x, lng->x);
+        return 0;
+    }
+
+    earlier_ts = wind_file_cache_entry_timestamp(found_entries[0]);
+    later_ts = wind_file_cache_entry_timestamp(found_entries[1]);
+
+    // The time is not differentiated so the interpolation in time is as in
+    // get_wind().
+    if(earlier_ts != later_ts)
+        lambda = (double)(timestamp - earlier_ts) / (double)(later_ts - earlier_ts);
+    else
+        lambda = 0.5f;
+
+    for(i=0; i<2; ++i)
+    {
+        wind_file_get_wind_dual(wind_file_cache_entry_file(found_entries[i]), cursor,
+                lat, lng, alt, &wu[i], &wv[i]);
+    }
+
+    *wind_u = dual_add(dual_scale(wu[1], lambda), dual_scale(wu[0], 1.0 - lambda));
+    *wind_v = dual_add(dual_scale(wv[1], lambda), dual_scale(wv[0], 1.0 - lambda));
+
+    return 1;
+}
+
+int get_wind_batch(wind_file_cache_t* cache, unsigned int n,
+        wind_file_cursor_t* const* cursors,
+        const float* lat, const float* lng, const float* alt, double timestamp,
+        float* wind_v, float* wind_u, float *wind_var, int* ok) {
+    unsigned int i, j;
+    wind_file_cache_entry_t* found_entries[WIND_FILE_BATCH_SIZE][2];
+    int done[WIND_FILE_BATCH_SIZE];
+    int n_ok = 0;
+
+    assert(n <= WIND_FILE_BATCH_SIZE);
+
+    // look for the wind files which match each member's latitude and longitude...
+    for(i=0; i<n; ++i)
+    {
+        wind_file_cache_find_entry(cache, lat[i], lng[i], (unsigned long)timestamp, 
+                &(found_entries[i][0]), &(found_entries[i][1]));
+
+        ok[i] = 0;
+        done[i] = 1;
+
+        if(!found_entries[i][0] || !found_entries[i][1]) {
+            fprintf(stderr, "ERROR: Could not locate appropriate wind data tile for time.\n");
+            continue;
+        }
+
+        if(!wind_file_cache_entry_contains_point(found_entries[i][0], lat[i], lng[i]) || 
+                !wind_file_cache_entry_contains_point(found_entries[i][1], lat[i], lng[i]))
+        {
+            fprintf(stderr, "ERROR: Could not locate appropriate wind data tile for location "
+                    "lat=%f, lon=%f.\n", lat[i], lng[i]);
+            continue;
+        }
+
+        done[i] = 0;
+    }
+
+    // ...and interpolate all the members which share the same pair of files
+    // together. Usually this is all of them.
+    for(i=0; i<n; ++i)
+    {
+        wind_file_cursor_t* group_cursors[WIND_FILE_BATCH_SIZE];
+        float group_lat[WIND_FILE_BATCH_SIZE], group_lng[WIND_FILE_BATCH_SIZE];
+        float group_alt[WIND_FILE_BATCH_SIZE];
+        float wu[2][WIND_FILE_BATCH_SIZE], wv[2][WIND_FILE_BATCH_SIZE];
+        float wuvar[2][WIND_FILE_BATCH_SIZE], wvvar[2][WIND_FILE_BATCH_SIZE];
+        unsigned int group[WIND_FILE_BATCH_SIZE];
+        unsigned int n_group = 0;
+        wind_file_t* found_files[2];
+        unsigned int earlier_ts, later_ts;
+        float lambda;
+        int k;
+
+        if(done[i])
+            continue;
+
+        for(j=i; j<n; ++j)
+        {
+            if(done[j] || (found_entries[j][0] != found_entries[i][0]) ||
+                    (found_entries[j][1] != found_entries[i][1]))
+                continue;
+
+            group[n_group] = j;
+            group_cursors[n_group] = cursors[j];
+            group_lat[n_group] = lat[j];
+            group_lng[n_group] = lng[j];
+            group_alt[n_group] = alt[j];
+            ++n_group;
+            done[j] = 1;
+        }
+
+        // Look in the cache for the files we need.
+        for(k=0; k<2; ++k)
+        {
+            found_files[k] = wind_file_cache_entry_file(found_entries[i][k]);
+        }
+
+        earlier_ts = wind_file_cache_entry_timestamp(found_entries[i][0]);
+        later_ts = wind_file_cache_entry_timestamp(found_entries[i][1]);
+
+        if(earlier_ts == later_ts)
+        {
+            fprintf(stderr, "WARN: Do not have two data files around current time. "
+                            "Expect the results to be wrong!\n");
+        }
+
+        // The time is taken from the earlier tile in double precision. A
+        // float holds a timestamp only to the nearest 128 seconds.
+        if(earlier_ts != later_ts)
+            lambda = (timestamp - earlier_ts) / (double)(later_ts - earlier_ts);
+        else
+            lambda = 0.5f;
+
+        for(k=0; k<2; ++k)
+        {
+            wind_file_get_wind_batch(found_files[k], group_cursors, n_group,
+                    group_lat, group_lng, group_alt, 
+                    wu[k], wv[k], wuvar[k], wvvar[k]);
+        }
+
+        for(j=0; j<n_group; ++j)
+        {
+            unsigned int member = group[j];
+
+            wind_u[member] = lambda * wu[1][j] + (1.f-lambda) * wu[0][j];
+            wind_v[member] = lambda * wv[1][j] + (1.f-lambda) * wv[0][j];
+
+            // flatten the u and v variances into a single mean variance for the
+            // magnitude.
+            wind_var[member] = 0.5f * (wuvar[1][j] + wuvar[0][j] + wvvar[1][j] + wvvar[0][j]);
+
+            ok[member] = 1;
+            ++n_ok;
+        }
+    }
+
+    return n_ok;
+}
+
 // vim:sw=4:ts=4:et:cindent
@@ -17,13 +17,233 @@
 #include "wind/wind_file_cache.h"
 #include "altitude.h"
 
-// run the model
-int run_model(wind_file_cache_t* cache, altitude_model_t* alt_model,
+// The ways in which each member's trajectory can be integrated.
+#define INTEGRATOR_EULER 0  // explicit Euler with a fixed step of TIMESTEP
+#define INTEGRATOR_RK4 1    // classic 4th order Runge-Kutta with a fixed step
+#define INTEGRATOR_RK45 2   // embedded 4th/5th order Runge-Kutta with adaptive steps
+
+// The ways in which the ensemble samples the uncertainty of the flight.
+#define SAMPLING_RANDOM 0       // independent random wind perturbations
+#define SAMPLING_SOBOL 1        // wind perturbations from a scrambled Sobol' sequence
+#define SAMPLING_UNSCENTED 2    // sigma points of the flight parameters, no perturbations
+
+// A store of ensembles checkpointed during their ascent which is shared
+// between runs so that runs which differ only from burst onwards, in their
+// burst altitude, descent rate or float, integrate their common ascent once.
+typedef struct run_model_ascent_cache_s run_model_ascent_cache_t;
+
+// Where and when the members flying one point of a sweep landed. A member
+// which leaves the wind data stops in mid-air, so unless every member landed
+// the position, time and standard deviations are NAN and timestamp is zero.
+typedef struct run_model_landing_s run_model_landing_t;
+struct run_model_landing_s
+{
+    unsigned int    n_members;
+    unsigned int    n_landed;           // members which did not leave the wind data
+    float           lat, lng;           // degrees - mean landing position
+    float           sd_north, sd_east;  // m - standard deviations of the landings
+    long int        timestamp;          // mean landing time
+    float           sd_time;            // s - standard deviation of the landing time
+};
+
+// The flight parameters with respect to which run_model_sensitivity()
+// differentiates the landing. They index the derivatives below.
+#define SENSITIVITY_ASCENT_RATE 0
+#define SENSITIVITY_BURST_ALTITUDE 1
+#define SENSITIVITY_DRAG_COEFF 2
+#define SENSITIVITY_PARAMS 3
+
+// Where and when a flight landed and how that changes with its parameters.
+typedef struct run_model_sensitivity_s run_model_sensitivity_t;
+struct run_model_sensitivity_s
+{
+    float           lat, lng;           // degrees - where it landed
+    long int        timestamp;          // when it landed
+
+    // The derivatives of the distance north and east (m) and of the time (s)
+    // at which it landed with respect to each parameter.
+    float           d_north[SENSITIVITY_PARAMS];
+    float           d_east[SENSITIVITY_PARAMS];
+    float           d_time[SENSITIVITY_PARAMS];
+};
+
+typedef struct run_model_config_s run_model_config_t;
+struct run_model_config_s
+{
+    unsigned int    n_members;      // number of ensemble members
+    unsigned int    n_threads;      // number of worker threads
+    unsigned long   seed;           // seed for the random wind perturbations
+
+    int             integrator;     // one of INTEGRATOR_*
+    float           step;           // s - step for rk4, initial step for rk45
+    float           tolerance;      // m - largest local error per step for rk45
+
+    // How the members are chosen. With SAMPLING_UNSCENTED there is one
+    // member for each sigma point of the ascent rate, burst altitude and
+    // drag coefficient, with the standard deviations in params_sd, and of a
+    // constant error in each component of the wind, with a standard deviation
+    // of the RMS wind error. n_members is ignored and the landing mean and
+    // covariance are reported.
+    int             sampling;       // one of SAMPLING_*
+
+    // The uncertainty of the flight parameters. Otherwise each member draws
+    // its own parameters, each uniformly between params_min and params_max if
+    // max > min and else from a normal distribution about the altitude
+    // model's value with standard deviation params_sd. The launch time is an
+    // offset (s) from the launch; if any member launches early the run starts
+    // with it.
+    altitude_params_t params_sd;
+    altitude_params_t params_min;
+    altitude_params_t params_max;
+
+    // Resample the live members in proportion to their likelihood whenever
+    // their effective sample size falls below this fraction of their number.
+    // Zero never resamples.
+    float           resample_threshold;
+
+    // If summary_file is not NULL a summary track of the live members is
+    // written to it every LOG_DECIMATE timesteps, one CSV line of timestamp,
+    // number flying, number landed, mean latitude, longitude and altitude,
+    // standard deviations north and east (m), their correlation, standard
+    // deviation of altitude and the 5th, 50th and 95th percentile altitudes.
+    // Where and when the members landed is reported when they all have. The
+    // statistics are accumulated as the members are advanced so the memory
+    // used does not grow with the flight.
+    const char*     summary_file;
+
+    // If ascent_cache is not NULL the ensemble is checkpointed in it before
+    // the first member reaches its burst altitude or any altitude requested
+    // of the cache, and the run starts from the latest checkpoint of the same
+    // ascent taken before its own first burst. With the Euler method the
+    // result is exactly that of a run without the cache. The Runge-Kutta
+    // methods end a step at each checkpoint, so they agree with a run without
+    // the cache to within their tolerance but never depend on which run took
+    // the checkpoint. Ignored for runs with a summary track, unscented sampling or
+    // uncertain burst altitudes, descent rates or floats, and must be NULL
+    // unless the altitude model ascends at a constant rate.
+    run_model_ascent_cache_t* ascent_cache;
+
+    // If landing_grid_file is not NULL the probability of landing in each
+    // cell of a grid is written to it. See landing_grid.h.
+    const char*     landing_grid_file;
+    float           landing_grid_resolution;    // m - size of each cell
+    float           landing_grid_bandwidth;     // m - kernel width, 0 to count
+
+    // If n_sweep is non-zero the run is a sweep of n_sweep points. Each point
+    // is flown by n_members members which take the flight parameters in
+    // sweep_params[i] in place of the altitude model's, drawing their own
+    // about them as above, and where they landed is summarised in
+    // sweep_landings[i] in place of the track. The points are flown as one
+    // ensemble so they share the worker threads and the wind data. The j-th
+    // member of every point draws the same wind perturbations, so the
+    // differences between points are due to their parameters alone. Must not
+    // be used with resampling, unscented sampling, a summary track or a
+    // landing grid.
+    unsigned int    n_sweep;
+    const altitude_params_t* sweep_params;
+    run_model_landing_t* sweep_landings;
+
+    // If sweep_sites is not NULL each point of a sweep is launched from its
+    // own site, the i-th at latitude sweep_sites[2*i] and longitude
+    // sweep_sites[2*i+1], in place of the initial latitude and longitude.
+    const float*    sweep_sites;
+
+    // If sweep_track_file is not NULL the track of each point of a sweep is
+    // written to it: every LOG_DECIMATE timesteps the position of the
+    // maximum likelihood member of each point which has launched and is still
+    // flying and, once all have landed, where each member landed. Each line
+    // is the index of the point followed by the timestamp, latitude,
+    // longitude and altitude as in the track of a run without a sweep.
+    const char*     sweep_track_file;
+
+    // If initial_cursor is not NULL every member starts from a copy of it
+    // rather than searching the wind grid for its first cell. It is checked
+    // before it is used so this only saves time when it was left near the
+    // launch, for example by a previous run from the same place.
+    const wind_file_cursor_t* initial_cursor;
+
+    // If checkpoint_file is not NULL the whole state of the run, every
+    // member with its random stream and altitude model state together with
+    // the track written so far, is saved to it in a compact binary form at
+    // the end of the first block which is checkpoint_interval seconds or more
+    // into the run and every checkpoint_interval seconds after, up to
+    // checkpoint_end seconds into the run if that is non-zero. Each
+    // checkpoint replaces the last, so ending them before burst keeps the
+    // ascent for runs which differ only after it.
+    const char*     checkpoint_file;
+    float           checkpoint_interval;    // s
+    float           checkpoint_end;         // s
+
+    // If resume_file is not NULL the run continues from the checkpoint in it,
+    // which must have been saved by the same build of a run from the same
+    // launch with the same ensemble. The track up to the checkpoint is
+    // written again so the output is that of the whole run. The wind data
+    // may have changed, for example to a newer forecast. If no member had
+    // burst by the checkpoint and the burst altitude, descent rate and float
+    // time are certain, the members are restarted with this run's; otherwise
+    // they must be those of the checkpointed run. Must not be used with a
+    // summary track or sweep tracks.
+    const char*     resume_file;
+
+    // If time_limit is non-zero the run gives up, returning zero, at the end
+    // of the first block after it has taken longer than time_limit seconds.
+    // The track written up to then stands. It is a soft limit: the time is
+    // only checked between blocks of LOG_DECIMATE timesteps, so a run of a
+    // large ensemble may overrun it by the time a block takes.
+    float           time_limit;     // s
+
+    // If keep_wind_data is non-zero the wind data which the run has loaded
+    // is not released once the run has passed it, so that a following run
+    // over the same flight, for example a finer one, need not load it again.
+    // Callers which run the model more than once over the same cache should
+    // set it, and may call wind_file_cache_release_before() between runs
+    // with the earliest launch time of the runs still to come.
+    int             keep_wind_data;
+};
+
+// set config to the defaults: a single member on a single thread integrated
+// with the Euler method, no resampling, no summary track, no landing grid, no
+// sweep, no initial cursor, no checkpoints and no time limit.
+void run_model_config_init(run_model_config_t* config);
+
+// create and free an empty ascent cache.
+run_model_ascent_cache_t* run_model_ascent_cache_new(void);
+void run_model_ascent_cache_free(run_model_ascent_cache_t* cache);
+
+// ask runs using cache to also checkpoint their ensemble before it would
+// reach burst_altitude (m), so that runs which burst there can start from it.
+void run_model_ascent_cache_request(run_model_ascent_cache_t* cache, float burst_altitude);
+
+// returns the INTEGRATOR_* value for an integrator called name ("euler",
+// "rk4" or "rk45") or -1 if there is no such integrator.
+int run_model_integrator_from_name(const char* name);
+
+// returns the SAMPLING_* value for a sampling method called name ("random",
+// "sobol" or "unscented") or -1 if there is no such method.
+int run_model_sampling_from_name(const char* name);
+
+// run the model for an ensemble of config->n_members flights split between
+// config->n_threads worker threads. Each member draws its wind perturbations
+// from its own random stream derived from config->seed so, for a given seed,
+// the output does not depend on the number of threads.
+int run_model(wind_file_cache_t* cache, const altitude_model_t* alt_model,
               float initial_lat, float initial_lng, float initial_alt, 
-	      long int initial_timestamp, float rmswinderror);
+	      long int initial_timestamp, float rmswinderror,
+	      const run_model_config_t* config);
+
+// fly a single unperturbed flight with the parameters of alt_model, with the
+// Euler method, and fill in where and when it landed along with the
+// derivatives of its landing with respect to the ascent rate, burst altitude
+// and drag coefficient. The derivatives are found exactly, by carrying them
+// through the integration as dual numbers (see util/dual.h), rather than by
+// flying perturbed flights. Returns zero if the wind could not be found.
+int run_model_sensitivity(wind_file_cache_t* cache, const altitude_model_t* alt_model,
+                          float initial_lat, float initial_lng, float initial_alt,
+                          long int initial_timestamp, run_model_sensitivity_t* sensitivity);
 
 #define TIMESTEP 1          // in seconds
 #define LOG_DECIMATE 50     // write entry to output files every x timesteps
+#define MAX_WORKER_THREADS 64
 
 #define METRES_TO_DEGREES  0.00000899289281755   // one metre corresponds to this many degrees latitude
 #define DEGREES_TO_METRES  111198.92345          // one degree latitude corresponds to this many metres
@@ -32,9 +252,25 @@ int run_model(wind_file_cache_t* cache, altitude_model_t* alt_model,
 // get the wind values in the u and v directions at a point in space and time from the dataset data
 // we interpolate lat, lng, alt and time. The GRIB data only contains pressure levels so we first
 // determine which pressure levels straddle to our desired altitude and then interpolate between them
-int get_wind(wind_file_cache_t* cache, float lat, float lng, float alt, long int timestamp, float* wind_v, float* wind_u, float *wind_var);
+// cursor caches the grid cell between calls for one particle and may be NULL.
+int get_wind(wind_file_cache_t* cache, wind_file_cursor_t* cursor, float lat, float lng, float alt, long int timestamp, float* wind_v, float* wind_u, float *wind_var);
+// As get_wind() without the variance for a point whose co-ordinates are dual
+// numbers. The wind is differentiated with respect to whatever they are.
+int get_wind_dual(wind_file_cache_t* cache, wind_file_cursor_t* cursor,
+                  const dual_t* lat, const dual_t* lng, const dual_t* alt, long int timestamp,
+                  dual_t* wind_v, dual_t* wind_u);
 // note: get_wind will likely call load_data and load a different tile into data, so just be careful that data could be pointing
 // somewhere else after running get_wind
 
+// As get_wind() for n <= WIND_FILE_BATCH_SIZE particles at the same time,
+// which need not be a whole number of seconds. The i-th particle uses
+// cursors[i], which must not be NULL, and ok[i] is set to non-zero if its
+// wind could be found. Returns the number of particles for which the wind
+// was found.
+int get_wind_batch(wind_file_cache_t* cache, unsigned int n,
+                   wind_file_cursor_t* const* cursors,
+                   const float* lat, const float* lng, const float* alt, double timestamp,
+                   float* wind_v, float* wind_u, float *wind_var, int* ok);
+
 #endif // __RUN_MODEL_H__
 
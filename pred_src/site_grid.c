@@ -0,0 +1,124 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+#include "site_grid.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+int
+site_grid_init(site_grid_t* grid, float south, float west, float north, float east,
+               float resolution)
+{
+    double centre_lat = 0.5 * (north + south);
+
+    if((north < south) || (east < west) || (resolution <= 0.f))
+        return 0;
+
+    grid->dlat = resolution * METRES_TO_DEGREES;
+    grid->dlng = grid->dlat / cos(centre_lat * DEGREES_TO_RADIANS);
+    grid->south = south;
+    grid->west = west;
+    grid->n_lat = 1 + (unsigned int)((north - south) / grid->dlat);
+    grid->n_lng = 1 + (unsigned int)((east - west) / grid->dlng);
+
+    return 1;
+}
+
+unsigned int
+site_grid_get_n_sites(const site_grid_t* grid)
+{
+    return grid->n_lat * grid->n_lng;
+}
+
+void
+site_grid_get_site(const site_grid_t* grid, unsigned int i, float* lat, float* lng)
+{
+    *lat = grid->south + ((i / grid->n_lng) + 0.5) * grid->dlat;
+    *lng = grid->west + ((i % grid->n_lng) + 0.5) * grid->dlng;
+}
+
+int
+site_grid_write_cells(const site_grid_t* grid, const run_model_landing_t* landings,
+                      long int initial_timestamp, FILE* file)
+{
+    float* row;
+    unsigned int i, j;
+    int ok = 1;
+
+    row = (float*)malloc(sizeof(float) * SITE_GRID_VALUES * grid->n_lng);
+    for(i=0; ok && (i<grid->n_lat); ++i) {
+        for(j=0; j<grid->n_lng; ++j) {
+            const run_model_landing_t* landing = &(landings[i * grid->n_lng + j]);
+            float lat, lng;
+
+            site_grid_get_site(grid, i * grid->n_lng + j, &lat, &lng);
+
+            if(landing->n_landed < landing->n_members) {
+                row[SITE_GRID_VALUES*j] = NAN;
+                row[SITE_GRID_VALUES*j + 1] = NAN;
+                row[SITE_GRID_VALUES*j + 2] = NAN;
+                continue;
+            }
+
+            row[SITE_GRID_VALUES*j] = (landing->lat - lat) * DEGREES_TO_METRES;
+            row[SITE_GRID_VALUES*j + 1] = (landing->lng - lng) * DEGREES_TO_METRES *
+                cos(lat * DEGREES_TO_RADIANS);
+            row[SITE_GRID_VALUES*j + 2] = landing->timestamp - initial_timestamp;
+        }
+        ok = (fwrite(row, sizeof(float), SITE_GRID_VALUES * grid->n_lng, file) == 
+              SITE_GRID_VALUES * grid->n_lng);
+    }
+    free(row);
+
+    return ok;
+}
+
+int
+site_grid_write(const site_grid_t* grid, const run_model_landing_t* landings,
+                long int initial_timestamp, const char* filename)
+{
+    site_grid_header_t header;
+    FILE* file;
+    int ok;
+
+    file = fopen(filename, "wb");
+    if(!file) {
+        fprintf(stderr, "ERROR: %s: could not open site grid for output\n", filename);
+        return 0;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SITE_GRID_MAGIC, sizeof(header.magic));
+    header.version = SITE_GRID_VERSION;
+    header.n_lat = grid->n_lat;
+    header.n_lng = grid->n_lng;
+    header.n_values = SITE_GRID_VALUES;
+    header.south = grid->south;
+    header.west = grid->west;
+    header.dlat = grid->dlat;
+    header.dlng = grid->dlng;
+
+    ok = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+        site_grid_write_cells(grid, landings, initial_timestamp, file);
+
+    if(fclose(file) != 0)
+        ok = 0;
+
+    if(!ok)
+        fprintf(stderr, "ERROR: %s: error writing site grid\n", filename);
+
+    return ok;
+}
+
+// vim:sw=4:ts=4:et:cindent
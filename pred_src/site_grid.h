@@ -0,0 +1,79 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+#ifndef __SITE_GRID_H__
+#define __SITE_GRID_H__
+
+#include <stdio.h>
+
+#include "run_model.h"
+
+// A latitude/longitude grid of launch sites, one at the centre of each cell,
+// and the raster of where flights from each site land. Cells are square at
+// the centre of the grid. The sites are numbered row by row, south first and
+// west first within a row, so that neighbouring sites are flown together and
+// share wind data.
+typedef struct site_grid_s site_grid_t;
+struct site_grid_s
+{
+    double          south, west;    // degrees - south west corner
+    double          dlat, dlng;     // degrees - size of each cell
+    unsigned int    n_lat, n_lng;
+};
+
+// The binary raster written by site_grid_write(). All values are in the
+// native byte order. The header is followed by n_lat rows, south first, of
+// n_lng cells, west first, each of SITE_GRID_VALUES floats: the mean landing
+// offset north and east (m) of flights launched from the centre of the cell
+// and their mean flight time (s). The cell (i, j) spans latitudes south +
+// i*dlat to south + (i+1)*dlat and similarly for longitude. A cell from
+// which any flight left the wind data before landing has no landing and its
+// values are NAN.
+#define SITE_GRID_MAGIC "PREDSITE"
+#define SITE_GRID_VERSION 1
+#define SITE_GRID_VALUES 3
+
+typedef struct site_grid_header_s site_grid_header_t;
+struct site_grid_header_s
+{
+    char            magic[8];       // SITE_GRID_MAGIC
+    unsigned int    version;        // SITE_GRID_VERSION
+    unsigned int    n_lat, n_lng;
+    unsigned int    n_values;       // SITE_GRID_VALUES
+    double          south, west;    // degrees
+    double          dlat, dlng;     // degrees
+};
+
+// Set grid to cells resolution metres across covering the given bounds.
+// Returns zero if the bounds are invalid.
+int site_grid_init(site_grid_t* grid, float south, float west, float north, float east,
+                   float resolution);
+
+// Return the number of sites in grid.
+unsigned int site_grid_get_n_sites(const site_grid_t* grid);
+
+// Fill in the latitude and longitude of the i-th site of grid.
+void site_grid_get_site(const site_grid_t* grid, unsigned int i, float* lat, float* lng);
+
+// Write the raster of where flights launched at initial_timestamp from each
+// site of grid landed, landings[i] being those from the i-th site, to
+// filename. Returns non-zero on success.
+int site_grid_write(const site_grid_t* grid, const run_model_landing_t* landings,
+                    long int initial_timestamp, const char* filename);
+
+// Write the cells of the raster written by site_grid_write(), without its
+// header, to file. Returns non-zero on success.
+int site_grid_write_cells(const site_grid_t* grid, const run_model_landing_t* landings,
+                          long int initial_timestamp, FILE* file);
+
+#endif // __SITE_GRID_H__
+
+// vim:sw=4:ts=4:et:cindent
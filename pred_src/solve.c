@@ -0,0 +1,339 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+#include "solve.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+extern int verbosity;
+
+// The steps in each unknown used to find the Jacobian by forward
+// differences. Steps much smaller than these are lost in the one second
+// resolution of the launch time and the wind perturbations.
+#define SITE_STEP 500.0     // m
+#define TIME_STEP 300.0     // s
+
+// Steps in the unknowns smaller than these make no useful difference.
+#define MIN_SITE_STEP 1.0   // m
+#define MIN_TIME_STEP 1.0   // s
+
+#define MAX_UNKNOWNS 2
+
+// The position of the current guess at the launch. The unknowns are offsets
+// north and east (m) of the initial site or (s) from the initial timestamp.
+typedef struct solve_state_s solve_state_t;
+struct solve_state_s
+{
+    wind_file_cache_t*          cache;
+    const altitude_model_t*     alt_model;
+    const run_model_config_t*   config;
+    const solve_config_t*       solve;
+    float                       initial_lat, initial_lng, initial_alt;
+    long int                    initial_timestamp;
+    float                       rmserror;
+    unsigned int                n_unknowns;
+    unsigned int                n_flown;        // trajectories flown so far
+};
+
+void 
+solve_config_init(solve_config_t* solve, float initial_lat, float initial_lng)
+{
+    solve->unknowns = SOLVE_SITE;
+    solve->target_lat = initial_lat;
+    solve->target_lng = initial_lng;
+
+    solve->south = initial_lat - 1.f;
+    solve->west = initial_lng - 1.f;
+    solve->north = initial_lat + 1.f;
+    solve->east = initial_lng + 1.f;
+    solve->earliest = -43200.f;
+    solve->latest = 43200.f;
+
+    solve->tolerance = 100.f;
+    solve->max_iterations = 20;
+}
+
+int 
+solve_unknowns_from_name(const char* name)
+{
+    if(!strcmp(name, "site"))
+        return SOLVE_SITE;
+    if(!strcmp(name, "time"))
+        return SOLVE_TIME;
+    return -1;
+}
+
+// Keep the unknowns x within the bounds of the search.
+static void
+_clamp(const solve_state_t* state, double* x)
+{
+    const solve_config_t* solve = state->solve;
+
+    if(solve->unknowns == SOLVE_SITE) 
+    {
+        double cos_lat = cos(state->initial_lat * DEGREES_TO_RADIANS);
+        double lat = state->initial_lat + x[0] * METRES_TO_DEGREES;
+        double lng = state->initial_lng + x[1] * METRES_TO_DEGREES / cos_lat;
+
+        if(lat < solve->south) lat = solve->south;
+        if(lat > solve->north) lat = solve->north;
+        if(lng < solve->west) lng = solve->west;
+        if(lng > solve->east) lng = solve->east;
+
+        x[0] = (lat - state->initial_lat) * DEGREES_TO_METRES;
+        x[1] = (lng - state->initial_lng) * DEGREES_TO_METRES * cos_lat;
+    }
+    else
+    {
+        if(x[0] < solve->earliest) x[0] = solve->earliest;
+        if(x[0] > solve->latest) x[0] = solve->latest;
+    }
+}
+
+// Fly the launches given by the unknowns x and, for each unknown, x with a
+// step in it together as one sweep. Fills r[0] with the offset north and
+// east (m) of the mean landing from the target of x and jacobian[k][0] with
+// the derivative of that offset with respect to the k-th unknown. A step
+// which would leave the bounds is taken the other way. If any launch leaves
+// the wind data before landing r is HUGE_VAL so that x is never the best.
+static int
+_fly(solve_state_t* state, const double* x, double* r, 
+     double jacobian[MAX_UNKNOWNS][2])
+{
+    const solve_config_t* solve = state->solve;
+    unsigned int n_points = state->n_unknowns + 1;
+    altitude_params_t params[MAX_UNKNOWNS + 1];
+    run_model_landing_t landings[MAX_UNKNOWNS + 1];
+    float sites[2 * (MAX_UNKNOWNS + 1)];
+    double cos_lat = cos(state->initial_lat * DEGREES_TO_RADIANS);
+    double cos_target = cos(solve->target_lat * DEGREES_TO_RADIANS);
+    double offsets[MAX_UNKNOWNS + 1][2], steps[MAX_UNKNOWNS];
+    double step = (solve->unknowns == SOLVE_SITE) ? SITE_STEP : TIME_STEP;
+    run_model_config_t sweep;
+    unsigned int i, k;
+
+    for(i=0; i<n_points; ++i) 
+    {
+        double point[MAX_UNKNOWNS];
+
+        for(k=0; k<state->n_unknowns; ++k)
+            point[k] = x[k];
+        if(i > 0)
+        {
+            point[i-1] += step;
+            _clamp(state, point);
+            if(point[i-1] - x[i-1] < 0.5 * step) 
+            {
+                point[i-1] = x[i-1] - step;
+                _clamp(state, point);
+            }
+            steps[i-1] = point[i-1] - x[i-1];
+        }
+
+        altitude_model_get_params(state->alt_model, &params[i]);
+        sites[2*i] = state->initial_lat;
+        sites[2*i+1] = state->initial_lng;
+
+        if(solve->unknowns == SOLVE_SITE) 
+        {
+            sites[2*i] += point[0] * METRES_TO_DEGREES;
+            sites[2*i+1] += point[1] * METRES_TO_DEGREES / cos_lat;
+        }
+        else
+        {
+            params[i].launch_time = point[0];
+        }
+    }
+
+    // The points are independent flights so must not be resampled together.
+    sweep = *(state->config);
+    sweep.resample_threshold = 0.f;
+    sweep.summary_file = NULL;
+    sweep.landing_grid_file = NULL;
+    sweep.ascent_cache = NULL;
+    sweep.n_sweep = n_points;
+    sweep.sweep_params = params;
+    sweep.sweep_landings = landings;
+    sweep.sweep_sites = sites;
+    sweep.sweep_track_file = NULL;
+    sweep.checkpoint_file = NULL;
+    sweep.resume_file = NULL;
+    sweep.keep_wind_data = 1;
+
+    if(!run_model(state->cache, state->alt_model, state->initial_lat, state->initial_lng, 
+                  state->initial_alt, state->initial_timestamp, state->rmserror, &sweep))
+        return 0;
+
+    for(i=0; i<n_points; ++i) 
+    {
+        state->n_flown += landings[i].n_members;
+        if(landings[i].n_landed < landings[i].n_members) 
+        {
+            if(verbosity > 0)
+                fprintf(stderr, "INFO: A launch the solver tried left the wind data.\n");
+            r[0] = r[1] = HUGE_VAL;
+            return 1;
+        }
+    }
+
+    for(i=0; i<n_points; ++i) 
+    {
+        offsets[i][0] = (landings[i].lat - solve->target_lat) * DEGREES_TO_METRES;
+        offsets[i][1] = (landings[i].lng - solve->target_lng) * DEGREES_TO_METRES * cos_target;
+    }
+
+    r[0] = offsets[0][0];
+    r[1] = offsets[0][1];
+    // An unknown whose bounds leave no room for a step has no derivative,
+    // which makes the Gauss-Newton step singular.
+    for(k=0; k<state->n_unknowns; ++k) 
+    {
+        if(steps[k] == 0.0) 
+        {
+            jacobian[k][0] = jacobian[k][1] = 0.0;
+            continue;
+        }
+        jacobian[k][0] = (offsets[k+1][0] - offsets[0][0]) / steps[k];
+        jacobian[k][1] = (offsets[k+1][1] - offsets[0][1]) / steps[k];
+    }
+
+    return 1;
+}
+
+// Set dx to the Gauss-Newton step which minimises |r + J dx|. Returns zero if
+// the Jacobian is singular.
+static int
+_gauss_newton_step(unsigned int n_unknowns, const double* r, 
+                   double jacobian[MAX_UNKNOWNS][2], double* dx)
+{
+    double a[MAX_UNKNOWNS][MAX_UNKNOWNS], g[MAX_UNKNOWNS], det;
+    unsigned int i, j;
+
+    // the normal equations J^T J dx = -J^T r
+    for(i=0; i<n_unknowns; ++i) 
+    {
+        g[i] = -(jacobian[i][0] * r[0] + jacobian[i][1] * r[1]);
+        for(j=0; j<n_unknowns; ++j)
+            a[i][j] = jacobian[i][0] * jacobian[j][0] + jacobian[i][1] * jacobian[j][1];
+    }
+
+    if(n_unknowns == 1) 
+    {
+        if(a[0][0] <= 0.0)
+            return 0;
+        dx[0] = g[0] / a[0][0];
+        return 1;
+    }
+
+    det = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+    if(fabs(det) <= 1e-12 * (a[0][0] * a[1][1] + a[0][1] * a[1][0]))
+        return 0;
+
+    dx[0] = (a[1][1] * g[0] - a[0][1] * g[1]) / det;
+    dx[1] = (a[0][0] * g[1] - a[1][0] * g[0]) / det;
+    return 1;
+}
+
+int
+solve_launch(wind_file_cache_t* cache, const altitude_model_t* alt_model,
+             float initial_alt, float rmswinderror, const run_model_config_t* config,
+             const solve_config_t* solve, 
+             float* lat, float* lng, long int* timestamp, float* miss)
+{
+    solve_state_t state;
+    double x[MAX_UNKNOWNS] = { 0.0, 0.0 }, best_x[MAX_UNKNOWNS] = { 0.0, 0.0 };
+    double r[2], jacobian[MAX_UNKNOWNS][2], best_jacobian[MAX_UNKNOWNS][2];
+    double best_miss = HUGE_VAL, min_step;
+    unsigned int iteration, k;
+
+    state.cache = cache;
+    state.alt_model = alt_model;
+    state.config = config;
+    state.solve = solve;
+    state.initial_lat = *lat;
+    state.initial_lng = *lng;
+    state.initial_alt = initial_alt;
+    state.initial_timestamp = *timestamp;
+    state.rmserror = rmswinderror;
+    state.n_unknowns = (solve->unknowns == SOLVE_SITE) ? 2 : 1;
+    state.n_flown = 0;
+    min_step = (solve->unknowns == SOLVE_SITE) ? MIN_SITE_STEP : MIN_TIME_STEP;
+
+    _clamp(&state, x);
+    for(iteration=0; iteration<solve->max_iterations; ++iteration) 
+    {
+        double dx[MAX_UNKNOWNS], step = 0.0, distance;
+
+        if(!_fly(&state, x, r, jacobian))
+            return 0;
+
+        distance = sqrt(r[0] * r[0] + r[1] * r[1]);
+        if(verbosity > 0)
+            fprintf(stderr, "INFO: Solver iteration %u: %.0fm from the target.\n", 
+                    iteration, distance);
+
+        if(distance < best_miss) 
+        {
+            // Take a Gauss-Newton step from the best launch so far.
+            best_miss = distance;
+            memcpy(best_x, x, sizeof(x));
+            memcpy(best_jacobian, jacobian, sizeof(jacobian));
+
+            if((best_miss <= solve->tolerance) || 
+               !_gauss_newton_step(state.n_unknowns, r, best_jacobian, dx))
+                break;
+        }
+        else
+        {
+            // The step went too far so try half of it.
+            for(k=0; k<state.n_unknowns; ++k)
+                dx[k] = 0.5 * (x[k] - best_x[k]);
+        }
+
+        for(k=0; k<state.n_unknowns; ++k) 
+        {
+            x[k] = best_x[k] + dx[k];
+        }
+        _clamp(&state, x);
+
+        for(k=0; k<state.n_unknowns; ++k)
+            step += (x[k] - best_x[k]) * (x[k] - best_x[k]);
+        if(sqrt(step) < min_step)
+            break;
+    }
+
+    if(solve->unknowns == SOLVE_SITE) 
+    {
+        *lat = state.initial_lat + best_x[0] * METRES_TO_DEGREES;
+        *lng = state.initial_lng + best_x[1] * METRES_TO_DEGREES / 
+            cos(state.initial_lat * DEGREES_TO_RADIANS);
+    }
+    else
+    {
+        *timestamp = state.initial_timestamp + (long int)floor(best_x[0] + 0.5);
+    }
+    *miss = best_miss;
+
+    if(best_miss == HUGE_VAL) {
+        fprintf(stderr, "ERROR: every launch the solver tried left the wind data\n");
+        return 0;
+    }
+
+    fprintf(stderr, "INFO: Solved for the launch with %u trajectories, landing %.0fm "
+            "from the target.\n", state.n_flown, best_miss);
+
+    return 1;
+}
+
+// vim:sw=4:ts=4:et:cindent
@@ -0,0 +1,63 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+#ifndef __SOLVE_H__
+#define __SOLVE_H__
+
+#include "run_model.h"
+
+// What an inverse prediction may vary to land on its target.
+#define SOLVE_SITE 0    // the latitude and longitude of the launch site
+#define SOLVE_TIME 1    // the launch time
+
+typedef struct solve_config_s solve_config_t;
+struct solve_config_s
+{
+    int             unknowns;           // one of SOLVE_*
+    float           target_lat;         // degrees
+    float           target_lng;         // degrees
+
+    // Bounds on the launch site (degrees) and on the launch time (s from
+    // the initial timestamp).
+    float           south, west, north, east;
+    float           earliest, latest;
+
+    float           tolerance;          // m - stop once this close to the target
+    unsigned int    max_iterations;
+};
+
+// set solve to search within a degree and within twelve hours of the given
+// launch site for up to 20 iterations, stopping within 100m of the target.
+void solve_config_init(solve_config_t* solve, float initial_lat, float initial_lng);
+
+// returns the SOLVE_* value for unknowns called name ("site" or "time") or
+// -1 if there are no such unknowns.
+int solve_unknowns_from_name(const char* name);
+
+// Search for the launch site or launch time, starting from *lat, *lng and
+// *timestamp, from which the mean landing of the ensemble described by
+// config lands nearest the target. Each iteration flies the current guess
+// and a small step in each unknown together as one sweep, which gives the
+// Jacobian of the landing position by forward differences, and takes a
+// Gauss-Newton step, halving it whenever it lands further from the target.
+// The members of every point share their wind perturbations so the
+// differences are smooth. On return *lat, *lng and *timestamp are the best
+// launch found and *miss its distance (m) from the target. The steps which
+// give the Jacobian stay within the bounds. Returns zero if the model could
+// not be run or every launch tried left the wind data.
+int solve_launch(wind_file_cache_t* cache, const altitude_model_t* alt_model,
+                 float initial_alt, float rmswinderror, const run_model_config_t* config,
+                 const solve_config_t* solve, 
+                 float* lat, float* lng, long int* timestamp, float* miss);
+
+#endif // __SOLVE_H__
+
+// vim:sw=4:ts=4:et:cindent
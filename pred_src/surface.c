@@ -0,0 +1,421 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+#include "surface.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Flights whose parameters are within this fraction of a value, or of one,
+// are taken to have that value.
+#define PARAM_TOLERANCE 1e-4
+
+// The value of each point which is 1 if it is valid.
+#define VALID_VALUE (SURFACE_VALUES - 1)
+
+struct surface_s
+{
+    surface_header_t header;
+    float          *values[SURFACE_PARAMS];     // of each parameter
+    float          *points;                     // SURFACE_VALUES for each point
+};
+
+// Return the number of points of a grid with n[k] values of each parameter.
+static size_t
+_n_points(const unsigned int* n)
+{
+    size_t n_points = 1;
+    unsigned int k;
+
+    for(k=0; k<SURFACE_PARAMS; ++k)
+        n_points *= n[k];
+
+    return n_points;
+}
+
+int
+surface_write(const char* filename, wind_file_cache_t* cache, 
+              float lat, float lng, float alt,
+              long int initial_timestamp, float rmserror, unsigned int n_members,
+              const unsigned int* n_values, float* const* values,
+              const run_model_landing_t* landings)
+{
+    surface_header_t header;
+    size_t i, n_points = _n_points(n_values);
+    float* points;
+    unsigned int k;
+    FILE* file;
+    int ok;
+
+    file = fopen(filename, "wb");
+    if(!file) {
+        fprintf(stderr, "ERROR: %s: could not open response surface for output\n", filename);
+        return 0;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SURFACE_MAGIC, sizeof(header.magic));
+    header.version = SURFACE_VERSION;
+    header.n_params = SURFACE_PARAMS;
+    header.n_values = SURFACE_VALUES;
+    header.n_members = n_members;
+    for(k=0; k<SURFACE_PARAMS; ++k)
+        header.n[k] = n_values[k];
+    header.lat = lat;
+    header.lng = lng;
+    header.alt = alt;
+    header.rmserror = rmserror;
+    header.initial_timestamp = initial_timestamp;
+    header.wind_key = wind_file_cache_get_key(cache);
+
+    ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+    for(k=0; ok && (k<SURFACE_PARAMS); ++k)
+        ok = (fwrite(values[k], sizeof(float), n_values[k], file) == n_values[k]);
+
+    points = (float*)malloc(sizeof(float) * SURFACE_VALUES * n_points);
+    for(i=0; i<n_points; ++i) 
+    {
+        const run_model_landing_t* landing = &(landings[i]);
+        float* point = &(points[SURFACE_VALUES * i]);
+        size_t launch_index = i % n_values[SURFACE_LAUNCH_TIME];
+
+        // A point some of whose members left the wind data has no landing.
+        if(landing->n_landed < landing->n_members) {
+            for(k=0; k<SURFACE_VALUES - 1; ++k)
+                point[k] = NAN;
+            point[SURFACE_VALUES - 1] = 0.f;
+            continue;
+        }
+
+        point[0] = (landing->lat - lat) * DEGREES_TO_METRES;
+        point[1] = (landing->lng - lng) * DEGREES_TO_METRES * cos(lat * DEGREES_TO_RADIANS);
+        point[2] = landing->timestamp - initial_timestamp - 
+            values[SURFACE_LAUNCH_TIME][launch_index];
+        point[3] = landing->sd_north;
+        point[4] = landing->sd_east;
+        point[5] = landing->sd_time;
+        point[6] = 1.f;
+    }
+    ok = ok && (fwrite(points, sizeof(float), SURFACE_VALUES * n_points, file) == 
+                SURFACE_VALUES * n_points);
+    free(points);
+
+    if(fclose(file) != 0)
+        ok = 0;
+
+    if(!ok)
+        fprintf(stderr, "ERROR: %s: error writing response surface\n", filename);
+
+    return ok;
+}
+
+surface_t*
+surface_read(const char* filename, wind_file_cache_t* cache)
+{
+    surface_t* self;
+    surface_header_t* header;
+    size_t n_points = 0;
+    unsigned int k;
+    FILE* file;
+    int ok;
+
+    file = fopen(filename, "rb");
+    if(!file) {
+        fprintf(stderr, "WARN: %s: could not open response surface\n", filename);
+        return NULL;
+    }
+
+    self = (surface_t*)malloc(sizeof(surface_t));
+    for(k=0; k<SURFACE_PARAMS; ++k)
+        self->values[k] = NULL;
+    self->points = NULL;
+    header = &(self->header);
+
+    ok = (fread(header, sizeof(surface_header_t), 1, file) == 1) &&
+        !memcmp(header->magic, SURFACE_MAGIC, sizeof(header->magic)) &&
+        (header->version == SURFACE_VERSION) &&
+        (header->n_params == SURFACE_PARAMS) && (header->n_values == SURFACE_VALUES);
+
+    if(ok)
+        n_points = _n_points(header->n);
+    for(k=0; ok && (k<SURFACE_PARAMS); ++k) 
+    {
+        self->values[k] = (float*)malloc(sizeof(float) * (header->n[k] + 1));
+        ok = (header->n[k] > 0) &&
+            (fread(self->values[k], sizeof(float), header->n[k], file) == header->n[k]) &&
+            ((self->values[k][0] > 0.f) ||
+             ((k != SURFACE_ASCENT_RATE) && (k != SURFACE_DRAG_COEFF)));
+    }
+    if(ok) 
+    {
+        self->points = (float*)malloc(sizeof(float) * SURFACE_VALUES * n_points);
+        ok = (fread(self->points, sizeof(float), SURFACE_VALUES * n_points, file) ==
+              SURFACE_VALUES * n_points);
+    }
+    fclose(file);
+
+    if(!ok) {
+        fprintf(stderr, "WARN: %s: not a response surface or truncated\n", filename);
+        surface_free(self);
+        return NULL;
+    }
+
+    if(header->wind_key != wind_file_cache_get_key(cache)) {
+        fprintf(stderr, "WARN: %s: response surface was flown in other wind data\n", 
+                filename);
+        surface_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+surface_free(surface_t* self)
+{
+    unsigned int k;
+
+    if(!self)
+        return;
+
+    for(k=0; k<SURFACE_PARAMS; ++k)
+        free(self->values[k]);
+    free(self->points);
+    free(self);
+}
+
+// Returns non-zero if x and y are the same to within PARAM_TOLERANCE.
+static int
+_same(double x, double y)
+{
+    return fabs(x - y) <= PARAM_TOLERANCE * (1.0 + fabs(y));
+}
+
+// The coordinate along parameter k in which the surface is interpolated.
+// The ascent and descent take times which go as the reciprocals of the
+// ascent rate and drag coefficient, so the landing is much closer to linear
+// in those than in the rates themselves.
+static double
+_coordinate(unsigned int k, double x)
+{
+    if((k == SURFACE_ASCENT_RATE) || (k == SURFACE_DRAG_COEFF))
+        return 1.0 / x;
+
+    return x;
+}
+
+// Find where x lies among the n increasing values of parameter k. Sets *i to
+// the value at or before it, or the last but one, and *w to how far x is
+// from it towards the next value as a fraction of the gap in the parameter's
+// coordinate. Returns zero if x is outside the values.
+static int
+_locate(const float* values, unsigned int n, unsigned int k, double x, 
+        unsigned int* i, double* w)
+{
+    if(_same(x, values[0]))
+        x = values[0];
+    if(_same(x, values[n-1]))
+        x = values[n-1];
+
+    *i = 0;
+    *w = 0.0;
+    if((x < values[0]) || (x > values[n-1]))
+        return 0;
+    if(n == 1)
+        return 1;
+
+    while((*i + 2 < n) && (x > values[*i + 1]))
+        ++*i;
+    *w = (_coordinate(k, x) - _coordinate(k, values[*i])) / 
+        (_coordinate(k, values[*i + 1]) - _coordinate(k, values[*i]));
+
+    return 1;
+}
+
+// Return the values of the point of surface at index[k] along each parameter
+// k.
+static const float*
+_point(const surface_t* self, const unsigned int* index)
+{
+    size_t point = 0;
+    unsigned int k;
+
+    for(k=0; k<SURFACE_PARAMS; ++k)
+        point = point * self->header.n[k] + index[k];
+
+    return &(self->points[SURFACE_VALUES * point]);
+}
+
+// Interpolate the values of surface at index[k] + weight[k] along each
+// parameter k into value. Returns zero if any point needed is invalid.
+static int
+_interpolate(const surface_t* self, const unsigned int* index, const double* weight,
+             double* value)
+{
+    unsigned int corner, k, v;
+
+    for(v=0; v<VALID_VALUE; ++v)
+        value[v] = 0.0;
+
+    for(corner=0; corner<(1 << SURFACE_PARAMS); ++corner)
+    {
+        size_t point = 0;
+        double w = 1.0;
+
+        for(k=0; k<SURFACE_PARAMS; ++k)
+        {
+            unsigned int upper = (corner >> (SURFACE_PARAMS - 1 - k)) & 1;
+
+            w *= upper ? weight[k] : 1.0 - weight[k];
+            point = point * self->header.n[k] + index[k] + upper;
+        }
+
+        if(w <= 0.0)
+            continue;
+        if(self->points[SURFACE_VALUES * point + VALID_VALUE] != 1.f)
+            return 0;
+
+        for(v=0; v<VALID_VALUE; ++v)
+            value[v] += w * self->points[SURFACE_VALUES * point + v];
+    }
+
+    return 1;
+}
+
+// The largest curvature (m per unit squared) of the landing along parameter
+// k about either end of the interval between index[k] and index[k] + 1, at
+// any of the corners along the other parameters which weight leaves in play.
+// Each curvature is the second difference of three neighbouring points.
+// Returns a negative curvature if any of the points is invalid.
+static double
+_max_curvature(const surface_t* self, const unsigned int* index, const double* weight,
+               unsigned int k)
+{
+    const unsigned int* n = self->header.n;
+    const float* v = self->values[k];
+    double max = 0.0;
+    unsigned int corner, end, d, m;
+
+    for(end=0; end<2; ++end)
+    {
+        unsigned int j = index[k] + end;
+
+        if(j < 1)
+            j = 1;
+        if(j > n[k] - 2)
+            j = n[k] - 2;
+
+        for(corner=0; corner<(1 << SURFACE_PARAMS); ++corner)
+        {
+            const float* f[3];
+            unsigned int i[SURFACE_PARAMS];
+            double c[3], second[2];
+
+            if((corner >> (SURFACE_PARAMS - 1 - k)) & 1)
+                continue;
+
+            for(m=0; m<SURFACE_PARAMS; ++m) 
+            {
+                unsigned int upper = (corner >> (SURFACE_PARAMS - 1 - m)) & 1;
+
+                if(upper && (weight[m] <= 0.0))
+                    break;
+                i[m] = index[m] + upper;
+            }
+            if(m < SURFACE_PARAMS)
+                continue;
+
+            for(d=0; d<3; ++d)
+            {
+                i[k] = j - 1 + d;
+                f[d] = _point(self, i);
+                c[d] = _coordinate(k, v[j - 1 + d]);
+                if(f[d][VALID_VALUE] != 1.f)
+                    return -1.0;
+            }
+
+            for(d=0; d<2; ++d) 
+            {
+                second[d] = 2.0 * ((f[2][d] - f[1][d]) / (c[2] - c[1]) - 
+                                   (f[1][d] - f[0][d]) / (c[1] - c[0])) / 
+                    (c[2] - c[0]);
+            }
+            if(hypot(second[0], second[1]) > max)
+                max = hypot(second[0], second[1]);
+        }
+    }
+
+    return max;
+}
+
+int
+surface_lookup(const surface_t* self, float lat, float lng, float alt,
+               long int timestamp, float rmserror, const altitude_params_t* params,
+               run_model_landing_t* landing, float* error)
+{
+    const surface_header_t* header = &(self->header);
+    double x[SURFACE_PARAMS], weight[SURFACE_PARAMS], value[SURFACE_VALUES];
+    unsigned int index[SURFACE_PARAMS], k;
+
+    if(!_same(lat, header->lat) || !_same(lng, header->lng) || 
+       !_same(alt, header->alt) || !_same(rmserror, header->rmserror))
+        return 0;
+
+    x[SURFACE_ASCENT_RATE] = params->ascent_rate;
+    x[SURFACE_BURST_ALTITUDE] = params->burst_altitude;
+    x[SURFACE_DRAG_COEFF] = params->drag_coeff;
+    x[SURFACE_FLOAT_TIME] = params->float_time;
+    x[SURFACE_LAUNCH_TIME] = timestamp - header->initial_timestamp;
+    for(k=0; k<SURFACE_PARAMS; ++k)
+    {
+        if(!_locate(self->values[k], header->n[k], k, x[k], &index[k], &weight[k]))
+            return 0;
+    }
+
+    if(!_interpolate(self, index, weight, value))
+        return 0;
+
+    // Linear interpolation between a and b misses a quadratic by f''/2 times
+    // (x - a)(b - x), in the parameter's coordinate. The errors along each
+    // parameter may add up.
+    *error = 0.0;
+    for(k=0; k<SURFACE_PARAMS; ++k)
+    {
+        double gap, curvature;
+
+        if((header->n[k] < 3) || (weight[k] <= 0.0))
+            continue;
+
+        curvature = _max_curvature(self, index, weight, k);
+        if(curvature < 0.0)
+            return 0;
+
+        gap = _coordinate(k, self->values[k][index[k] + 1]) - 
+            _coordinate(k, self->values[k][index[k]]);
+        *error += 0.5 * curvature * weight[k] * (1.0 - weight[k]) * gap * gap;
+    }
+
+    landing->n_members = header->n_members;
+    landing->n_landed = header->n_members;
+    landing->lat = header->lat + value[0] * METRES_TO_DEGREES;
+    landing->lng = header->lng + value[1] * METRES_TO_DEGREES / 
+        cos(header->lat * DEGREES_TO_RADIANS);
+    landing->timestamp = timestamp + (long int)floor(value[2] + 0.5);
+    landing->sd_north = value[3];
+    landing->sd_east = value[4];
+    landing->sd_time = value[5];
+
+    return 1;
+}
+
+// vim:sw=4:ts=4:et:cindent
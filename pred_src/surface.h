@@ -0,0 +1,102 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+#ifndef __SURFACE_H__
+#define __SURFACE_H__
+
+#include "run_model.h"
+
+// A response surface: where the flights from one launch site land over a
+// grid of flight parameters, flown in advance as a sweep so that the landing
+// of a flight with any parameters inside the grid can be interpolated rather
+// than flown. An opaque type.
+typedef struct surface_s surface_t;
+
+// The flight parameters which are the axes of the grid, in the order in
+// which they are varied with the last fastest, as in a sweep. The drag
+// coefficient is stored as such, not as a descent rate, and the launch time
+// as seconds after the initial timestamp.
+#define SURFACE_ASCENT_RATE 0
+#define SURFACE_BURST_ALTITUDE 1
+#define SURFACE_DRAG_COEFF 2
+#define SURFACE_FLOAT_TIME 3
+#define SURFACE_LAUNCH_TIME 4
+#define SURFACE_PARAMS 5
+
+// The binary file written by surface_write(). All values are in the native
+// byte order. The header is followed by the n[k] values of each parameter k
+// in turn as floats, each in increasing order, and then by SURFACE_VALUES
+// floats for each point of the grid in the order of a sweep: the mean
+// landing offset north and east (m) from the launch site, the mean flight
+// time (s), the standard deviations of the landing north and east (m) and
+// of the landing time (s) and 1 if the point is valid or 0 if any of its
+// members left the wind data, when the rest are NANs. The wind key is that
+// of the wind data the surface was flown in (see wind_file_cache_get_key()).
+#define SURFACE_MAGIC "PREDSURF"
+#define SURFACE_VERSION 2
+#define SURFACE_VALUES 7
+
+typedef struct surface_header_s surface_header_t;
+struct surface_header_s
+{
+    char            magic[8];       // SURFACE_MAGIC
+    unsigned int    version;        // SURFACE_VERSION
+    unsigned int    n_params;       // SURFACE_PARAMS
+    unsigned int    n_values;       // SURFACE_VALUES
+    unsigned int    n_members;      // ensemble members flown at each point
+    unsigned int    n[SURFACE_PARAMS];
+    unsigned int    reserved;
+    double          lat, lng;       // degrees - the launch site
+    float           alt;            // m
+    float           rmserror;       // m/s
+    long int        initial_timestamp;
+    unsigned long long wind_key;
+};
+
+// Write the surface of the sweep of n_values[k] values, values[k], of each
+// parameter k flown in the wind data of cache from lat, lng and alt at
+// initial_timestamp, with rms wind error rmserror and n_members members at
+// each point, which landed at landings, to filename. The values of each
+// parameter must be in increasing order, and positive for the ascent rate
+// and drag coefficient. Returns non-zero on success.
+int surface_write(const char* filename, wind_file_cache_t* cache, 
+                  float lat, float lng, float alt,
+                  long int initial_timestamp, float rmserror, unsigned int n_members,
+                  const unsigned int* n_values, float* const* values,
+                  const run_model_landing_t* landings);
+
+// Read the surface written to filename by surface_write(). Returns NULL, with
+// a warning, if it cannot be read or was flown in other wind data than that
+// of cache, and flights are then to be flown in full.
+surface_t* surface_read(const char* filename, wind_file_cache_t* cache);
+
+// Free resources associated with surface.
+void surface_free(surface_t* surface);
+
+// Interpolate where a flight launched from lat, lng and alt at timestamp with
+// rms wind error rmserror and the ascent rate, burst altitude, drag
+// coefficient and float time of params lands, linearly between the nearest
+// points of surface in each parameter, into landing. The ascent rate and
+// drag coefficient are interpolated in their reciprocals. *error is set to
+// an estimate (m) of how far the interpolated landing is from where the
+// flight would land with the surface's wind perturbations: the sum, over the
+// parameters with at least three values, of the error of linear
+// interpolation in a quadratic with the largest curvature found about the
+// flight's interval along that parameter. Returns zero if the flight is not
+// from the surface's launch site and wind error, its parameters are outside
+// it or any point the lookup needs is invalid.
+int surface_lookup(const surface_t* surface, float lat, float lng, float alt,
+                   long int timestamp, float rmserror, const altitude_params_t* params,
+                   run_model_landing_t* landing, float* error);
+
+#endif // __SURFACE_H__
+
+// vim:sw=4:ts=4:et:cindent
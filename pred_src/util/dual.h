@@ -0,0 +1,145 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY 
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+#ifndef __DUAL_H__
+#define __DUAL_H__
+
+#include <math.h>
+
+// The number of derivatives carried by a dual number.
+#define DUAL_N 3
+
+// A dual number for forward mode automatic differentiation: a value, x, and
+// its derivatives, dx[k], with respect to DUAL_N independent variables. Code
+// written in terms of the operations below computes the derivatives of its
+// result alongside the result itself, exactly and in a single pass.
+typedef struct dual_s dual_t;
+struct dual_s
+{
+    double      x;
+    double      dx[DUAL_N];
+};
+
+// A constant, whose derivatives are all zero.
+static inline dual_t
+dual_constant(double x)
+{
+    dual_t r;
+    unsigned int k;
+
+    r.x = x;
+    for (k=0; k<DUAL_N; ++k)
+        r.dx[k] = 0.0;
+    return r;
+}
+
+// The k-th independent variable, with value x.
+static inline dual_t
+dual_variable(double x, unsigned int k)
+{
+    dual_t r = dual_constant(x);
+
+    r.dx[k] = 1.0;
+    return r;
+}
+
+static inline dual_t
+dual_add(dual_t a, dual_t b)
+{
+    unsigned int k;
+
+    a.x += b.x;
+    for (k=0; k<DUAL_N; ++k)
+        a.dx[k] += b.dx[k];
+    return a;
+}
+
+static inline dual_t
+dual_sub(dual_t a, dual_t b)
+{
+    unsigned int k;
+
+    a.x -= b.x;
+    for (k=0; k<DUAL_N; ++k)
+        a.dx[k] -= b.dx[k];
+    return a;
+}
+
+static inline dual_t
+dual_mul(dual_t a, dual_t b)
+{
+    dual_t r;
+    unsigned int k;
+
+    r.x = a.x * b.x;
+    for (k=0; k<DUAL_N; ++k)
+        r.dx[k] = a.dx[k] * b.x + a.x * b.dx[k];
+    return r;
+}
+
+static inline dual_t
+dual_div(dual_t a, dual_t b)
+{
+    dual_t r;
+    unsigned int k;
+
+    r.x = a.x / b.x;
+    for (k=0; k<DUAL_N; ++k)
+        r.dx[k] = (a.dx[k] - r.x * b.dx[k]) / b.x;
+    return r;
+}
+
+// a + s and a * s for a constant s.
+static inline dual_t
+dual_offset(dual_t a, double s)
+{
+    a.x += s;
+    return a;
+}
+
+static inline dual_t
+dual_scale(dual_t a, double s)
+{
+    unsigned int k;
+
+    a.x *= s;
+    for (k=0; k<DUAL_N; ++k)
+        a.dx[k] *= s;
+    return a;
+}
+
+// f(a) given the value, f(a.x), and the derivative, f'(a.x), of f at a.
+static inline dual_t
+dual_chain(dual_t a, double value, double derivative)
+{
+    unsigned int k;
+
+    a.x = value;
+    for (k=0; k<DUAL_N; ++k)
+        a.dx[k] *= derivative;
+    return a;
+}
+
+static inline dual_t
+dual_sin(dual_t a)
+{
+    return dual_chain(a, sin(a.x), cos(a.x));
+}
+
+// a * (1 - lambda) + b * lambda
+static inline dual_t
+dual_lerp(dual_t a, dual_t b, dual_t lambda)
+{
+    return dual_add(a, dual_mul(dual_sub(b, a), lambda));
+}
+
+#endif // __DUAL_H__
+
+// vim:sw=4:ts=4:et:cindent
@@ -12,41 +12,230 @@
 
 #include "random.h"
 
-#include <glib.h>
 #include <math.h>
 
+// Philox4x32 constants.
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+// Counters are processed this many at a time. The inner loops over lanes
+// have no dependencies between iterations so the compiler can vectorise
+// them.
+#define LANES 8
+
+// The last word of the counter separates the different kinds of sample
+// drawn from a stream so that they never overlap.
+#define DOMAIN_NORMAL   0u
+#define DOMAIN_UNIFORM  1u
+#define DOMAIN_SOBOL    2u
+
+// Encrypt LANES counters, c[word][lane], in place with the key of 'stream'.
+static void
+_philox4x32_10(const random_stream_t *stream, uint32_t c[4][LANES])
+{
+    uint32_t k0 = stream->key[0], k1 = stream->key[1];
+    int round, lane;
+
+    for(round=0; round<PHILOX_ROUNDS; ++round)
+    {
+        for(lane=0; lane<LANES; ++lane)
+        {
+            uint64_t p0 = (uint64_t)PHILOX_M0 * c[0][lane];
+            uint64_t p1 = (uint64_t)PHILOX_M1 * c[2][lane];
+            uint32_t c1 = c[1][lane], c3 = c[3][lane];
+
+            c[0][lane] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+            c[1][lane] = (uint32_t)p1;
+            c[2][lane] = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+            c[3][lane] = (uint32_t)p0;
+        }
+
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+}
+
+// Set up the counters for LANES consecutive positions starting at position.
+static void
+_set_counters(const random_stream_t *stream, uint64_t position, uint32_t domain,
+              uint32_t c[4][LANES])
+{
+    int lane;
+
+    for(lane=0; lane<LANES; ++lane)
+    {
+        uint64_t p = position + lane;
+        c[0][lane] = (uint32_t)p;
+        c[1][lane] = (uint32_t)(p >> 32);
+        c[2][lane] = stream->stream_id;
+        c[3][lane] = domain;
+    }
+}
+
+// Convert a random 32-bit word into a float in (0, 1]. Only the top 24 bits
+// are used so that the result is exact.
+static float
+_to_uniform(uint32_t x)
+{
+    return (float)((x >> 8) + 1) * (1.f / 16777216.f);
+}
+
+void random_stream_init(random_stream_t *stream, 
+                        unsigned long seed, unsigned int stream_id)
+{
+    uint64_t seed64 = (uint64_t)seed;
+
+    stream->key[0] = (uint32_t)seed64;
+    stream->key[1] = (uint32_t)(seed64 >> 32);
+    stream->stream_id = stream_id;
+}
+
 // Sample from a normal distribution with zero mean and unit variance.
 // See http://en.wikipedia.org/wiki/Normal_distribution
 //                              #Generating_values_for_normal_random_variables
-static float _random_sample_normal_intl(float* loglik)
+//
+// Each position gives a block of four random words. The first two are used
+// for a Box-Muller transform which gives both samples of the pair from one
+// logarithm, one square root and one sine/cosine.
+void random_stream_normal_pairs(const random_stream_t *stream, uint64_t position,
+                                unsigned int n_pairs, float *out)
 {
-    double u, v = 0.0;
-    static const double k = 0.918938533204673; // = 0.5 * (log(2) + log(pi)), see below.
+    uint32_t c[4][LANES];
+    unsigned int i;
+    int lane;
 
-    u = g_random_double();
-    v = g_random_double();
-    v = sqrt(-2.0 * log(u)) * cos(2.0 * G_PI * v);
+    for(i=0; i<n_pairs; i+=LANES)
+    {
+        _set_counters(stream, position + i, DOMAIN_NORMAL, c);
+        _philox4x32_10(stream, c);
 
-    // actual likelihood is 1/sqrt(2*pi) exp(-(x^2)) since mu = 0 and sigma^2 = 1.
-    // log-likelihood is therefore:
-    //   \ell(x) = - (x^2) - 0.5 * (log(2) + log(pi)) = - (x^2) - k 
+        for(lane=0; (lane<LANES) && (i+lane<n_pairs); ++lane)
+        {
+            float u = _to_uniform(c[0][lane]);
+            float v = _to_uniform(c[1][lane]);
+            float r = sqrtf(-2.f * logf(u));
+            float theta = (float)(2.0 * M_PI) * v;
+
+            out[2*(i+lane)] = r * cosf(theta);
+            out[2*(i+lane)+1] = r * sinf(theta);
+        }
+    }
+}
+
+// Sobol' points and their scrambling. See Burley, "Practical Hash-based Owen
+// Scrambling", Journal of Computer Graphics Techniques 9(4), 2020.
+
+static uint32_t
+_reverse_bits(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// A random permutation of the 32-bit fractions in which each bit depends only
+// on the bits above it, i.e. a nested uniform (Owen) scramble.
+static uint32_t
+_owen_scramble(uint32_t x, uint32_t seed)
+{
+    x = _reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return _reverse_bits(x);
+}
+
+// The first two dimensions of the index-th Sobol' point as 32-bit fractions.
+// The first is the van der Corput sequence and the second has the direction
+// numbers v[k+1] = v[k] ^ (v[k] >> 1).
+static void
+_sobol_2d(uint32_t index, uint32_t *x, uint32_t *y)
+{
+    uint32_t v = 0x80000000u;
+
+    *x = _reverse_bits(index);
+    *y = 0;
+    for(; index; index >>= 1, v ^= v >> 1)
+    {
+        if(index & 1)
+            *y ^= v;
+    }
+}
+
+// The scrambles for a position are drawn from a counter shared by every
+// stream with the same key so that the streams see the same scrambled
+// sequence.
+void random_stream_sobol_normal_pairs(const random_stream_t *stream, uint64_t position,
+                                      unsigned int n_pairs, float *out)
+{
+    uint32_t c[4][LANES];
+    unsigned int i;
+    int lane;
+
+    for(i=0; i<n_pairs; i+=LANES)
+    {
+        for(lane=0; lane<LANES; ++lane)
+        {
+            uint64_t p = position + i + lane;
+            c[0][lane] = (uint32_t)p;
+            c[1][lane] = (uint32_t)(p >> 32);
+            c[2][lane] = 0;
+            c[3][lane] = DOMAIN_SOBOL;
+        }
+        _philox4x32_10(stream, c);
+
+        for(lane=0; (lane<LANES) && (i+lane<n_pairs); ++lane)
+        {
+            uint32_t index = _owen_scramble(stream->stream_id, c[0][lane]);
+            uint32_t x, y;
+            float u, v, r, theta;
+
+            _sobol_2d(index, &x, &y);
+            u = _to_uniform(_owen_scramble(x, c[1][lane]));
+            v = _to_uniform(_owen_scramble(y, c[2][lane]));
 
-    if(loglik)
-        *loglik = (float) ( - (v*v) - k );
+            r = sqrtf(-2.f * logf(u));
+            theta = (float)(2.0 * M_PI) * v;
 
-    return v;
+            out[2*(i+lane)] = r * cosf(theta);
+            out[2*(i+lane)+1] = r * sinf(theta);
+        }
+    }
 }
 
-float random_sample_normal(float mu, float sigma2, float *loglik)
+void random_stream_uniform(const random_stream_t *stream, uint64_t position,
+                           unsigned int n, float *out)
 {
-    // Sample from our base case.
-    float v = _random_sample_normal_intl(loglik);
+    uint32_t c[4][LANES];
+    unsigned int i;
+    int lane;
+
+    for(i=0; i<n; i+=LANES)
+    {
+        _set_counters(stream, position + i, DOMAIN_UNIFORM, c);
+        _philox4x32_10(stream, c);
+
+        for(lane=0; (lane<LANES) && (i+lane<n); ++lane)
+            out[i+lane] = _to_uniform(c[0][lane]);
+    }
+}
 
-    // Transform into appropriate range.
-    v *= sqrt(sigma2);
-    v += mu;
+float random_normal_loglik(float z)
+{
+    static const double k = 0.918938533204673; // = 0.5 * (log(2) + log(pi)), see below.
+
+    // actual likelihood is 1/sqrt(2*pi) exp(-(x^2)) since mu = 0 and sigma^2 = 1.
+    // log-likelihood is therefore:
+    //   \ell(x) = - (x^2) - 0.5 * (log(2) + log(pi)) = - (x^2) - k 
 
-    return v;
+    return (float) ( - (z*z) - k );
 }
 
 // vim:sw=4:ts=4:et:cindent
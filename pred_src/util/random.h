@@ -13,10 +13,51 @@
 #ifndef __RANDOM_H__
 #define __RANDOM_H__
 
-// Return a random sample drawn from the normal distribution with mean mu and
-// variance sigma2. If loglik is non-NULL, *loglik is set to the log-likelihood
-// of drawing that sample.
-float random_sample_normal(float mu, float sigma2, float *loglik);
+#include <stdint.h>
+
+// A stream of random numbers from a counter-based generator (Philox4x32-10,
+// see Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC11).
+// Each sample is a pure function of the seed, the stream id and the position
+// within the stream so there is no generator state to share or lock, streams
+// may be used from any thread and any position can be drawn at any time.
+// The fields are private, initialise it with random_stream_init().
+typedef struct random_stream_s random_stream_t;
+struct random_stream_s
+{
+    uint32_t    key[2];
+    uint32_t    stream_id;
+};
+
+// Initialise a stream. Streams with the same seed and stream_id always produce
+// the same samples.
+void random_stream_init(random_stream_t *stream, 
+                        unsigned long seed, unsigned int stream_id);
+
+// Fill out[0], out[1], ..., out[2*n_pairs-1] with samples drawn from the
+// normal distribution with zero mean and unit variance. The pair out[2*i],
+// out[2*i+1] is always the same for a given position + i. Positions are
+// typically timesteps.
+void random_stream_normal_pairs(const random_stream_t *stream, uint64_t position,
+                                unsigned int n_pairs, float *out);
+
+// As random_stream_normal_pairs() but the pairs drawn at each position by
+// streams with the same seed and stream ids 0, 1, 2, ... are the successive
+// points of a two dimensional Sobol' sequence rather than independent. The
+// points are shuffled and Owen scrambled afresh at each position so each
+// stream on its own still looks random but together the streams cover the
+// distribution far more evenly. This works best for a power of two streams.
+void random_stream_sobol_normal_pairs(const random_stream_t *stream, uint64_t position,
+                                      unsigned int n_pairs, float *out);
+
+// Fill out[0], ..., out[n-1] with samples drawn uniformly from (0, 1]. The
+// samples for a given position are independent of those returned by
+// random_stream_normal_pairs() for the same position.
+void random_stream_uniform(const random_stream_t *stream, uint64_t position,
+                           unsigned int n, float *out);
+
+// Return the log-likelihood of drawing the sample z from the normal
+// distribution with zero mean and unit variance.
+float random_normal_loglik(float z);
 
 #endif /* __RANDOM_H__ */
 
@@ -11,6 +11,7 @@
 // --------------------------------------------------------------
 
 #include "wind_file.h"
+#include "wind_file_private.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,42 +22,19 @@
 
 extern int verbosity;
 
-typedef struct wind_file_axis_s wind_file_axis_t;
-struct wind_file_axis_s 
-{
-        unsigned int            n_values;
-
-        //                      in actual fact, enough space is allocated for all values.
-        float                   values[1];
-};
-
-struct wind_file_s
-{
-        //                      This is from the file header.
-        float                   lat, latrad;
-        float                   lon, lonrad;
-        unsigned long           timestamp;
-
-        //                      This describes the axes.
-        unsigned int            n_axes;
-        wind_file_axis_t      **axes;
-
-        unsigned int            n_components;
-
-        //                      A pointer to the actual data.
-        float                  *data;
-};
-
 // These exciting functions are all to do with the fact that 'left' and 'right'
 // is an interesting thing to talk about on a sphere.
 
 // Canonicalise a longitude into the range (0, 360].
-static float
-_canonicalise_longitude(float lon)
+float
+wind_file_canonicalise_longitude(float lon)
 {
         lon = fmodf(lon, 360.f);
         if(lon < 0.f) 
                 lon += 360.f;
+        // a tiny negative longitude rounds up to 360 above
+        if(lon >= 360.f)
+                lon -= 360.f;
         assert((lon >= 0.f) && (lon < 360.f));
         return lon;
 }
@@ -79,8 +57,8 @@ _longitude_is_left_of(float lon_a, float lon_b)
 {
         float deg_east;
 
-        lon_a = _canonicalise_longitude(lon_a);
-        lon_b = _canonicalise_longitude(lon_b);
+        lon_a = wind_file_canonicalise_longitude(lon_a);
+        lon_b = wind_file_canonicalise_longitude(lon_b);
 
         deg_east = lon_b - lon_a;
         if(deg_east < 0.f) 
@@ -429,8 +407,8 @@ wind_file_free(wind_file_t* file)
         free(file);
 }
 
-static float*
-_wind_file_get_record(wind_file_t* file, 
+float*
+wind_file_get_record(wind_file_t* file, 
                 unsigned int lat_idx, unsigned int lon_idx,
                 unsigned int pressure_idx)
 {
@@ -446,7 +424,7 @@ _wind_file_get_height(wind_file_t* file,
                 unsigned int lat_idx, unsigned int lon_idx,
                 unsigned int pressure_idx)
 {
-        return _wind_file_get_record(file, lat_idx, lon_idx, pressure_idx)[0];
+        return wind_file_get_record(file, lat_idx, lon_idx, pressure_idx)[0];
 }
 
 static void
@@ -455,7 +433,7 @@ _wind_file_get_wind_raw(wind_file_t* file,
                 unsigned int pressure_idx,
                 float *u, float* v)
 {
-        float* record = _wind_file_get_record(file, lat_idx, lon_idx, pressure_idx);
+        float* record = wind_file_get_record(file, lat_idx, lon_idx, pressure_idx);
         *u = record[1]; *v = record[2];
 }
 
@@ -474,143 +452,119 @@ _bilinear_interpolate(float ll, float lr, float rl, float rr, float lambda1, flo
 }
 
 void
-wind_file_get_wind(wind_file_t* file, float lat, float lon, float height, 
-                float* windu, float *windv, float *uvar, float *vvar)
+wind_file_cursor_init(wind_file_cursor_t* cursor)
 {
-        // we use static variables to 'cache' the last left and right lat/longs
-        // and heights so that we can avoid searching the axes if necessary
-        static int have_valid_latlon_cache = 0;
-        static int have_valid_pressure_cache = 0;
-
-        static unsigned int left_lat_idx, right_lat_idx;
-        static unsigned int left_lon_idx, right_lon_idx;
-        static unsigned int left_pr_idx, right_pr_idx;
-
-        static float left_lat, right_lat;
-        static float left_lon, right_lon;
-
-        int i;
-        float left_height, right_height;
-        float lat_lambda, lon_lambda, pr_lambda;
-
-        assert(file);
-        assert(windu && windv);
-
-        // canonicalise the longitude
-        lon = _canonicalise_longitude(lon);
+        assert(cursor);
 
-        // by default, return nothing in case of error.
-        *windu = *windv = 0.f;
+        cursor->have_valid_latlon = 0;
+        cursor->have_valid_pressure = 0;
+}
 
+int
+wind_file_cursor_find_cell(wind_file_t* file, wind_file_cursor_t* cursor,
+                float lat, float lon)
+{
         // see if the cache is indeed valid
-        if(have_valid_latlon_cache)
+        if(cursor->have_valid_latlon)
         {
-                if((left_lat > lat) || 
-                   (right_lat < lat) ||
-                   !_longitude_is_left_of(left_lon, lon) || 
-                   !_longitude_is_left_of(lon, right_lon))
+                if((cursor->left_lat > lat) || 
+                   (cursor->right_lat < lat) ||
+                   !_longitude_is_left_of(cursor->left_lon, lon) || 
+                   !_longitude_is_left_of(lon, cursor->right_lon))
                 {
-                        have_valid_latlon_cache = 0;
+                        cursor->have_valid_latlon = 0;
                 }
         }
 
         // if we have no cached grid locations, look for them.
-        if(!have_valid_latlon_cache)
+        if(!cursor->have_valid_latlon)
         {
                 // look for latitude along second axis 
                 if(!_wind_file_axis_find_value(file->axes[1], lat,
-                                        _float_is_left_of, &left_lat_idx, &right_lat_idx))
+                                        _float_is_left_of, &cursor->left_lat_idx, &cursor->right_lat_idx))
                 {
                         if(verbosity > 0)
                                 fprintf(stderr, "WARN: Latitude %f is not covered by file.\n", lat);
-                        return;
+                        return 0;
                 }
-                left_lat = file->axes[1]->values[left_lat_idx];
-                right_lat = file->axes[1]->values[right_lat_idx];
+                cursor->left_lat = file->axes[1]->values[cursor->left_lat_idx];
+                cursor->right_lat = file->axes[1]->values[cursor->right_lat_idx];
 
                 // look for longitude along third axis
                 if(!_wind_file_axis_find_value(file->axes[2], lon,
-                                        _longitude_is_left_of, &left_lon_idx, &right_lon_idx))
+                                        _longitude_is_left_of, &cursor->left_lon_idx, &cursor->right_lon_idx))
                 {
                         if(verbosity > 0)
                                 fprintf(stderr, "WARN: Longitude %f is not covered by file.\n", lon);
-                        return;
+                        return 0;
                 }
-                left_lon = file->axes[2]->values[left_lon_idx];
-                right_lon = file->axes[2]->values[right_lon_idx];
+                cursor->left_lon = file->axes[2]->values[cursor->left_lon_idx];
+                cursor->right_lon = file->axes[2]->values[cursor->right_lon_idx];
 
                 if(verbosity > 1)
                         fprintf(stderr, "INFO: Moved to latitude/longitude "
                                         "cell (%f,%f)-(%f,%f)\n",
-                                        left_lat, left_lon, right_lat, right_lon);
+                                        cursor->left_lat, cursor->left_lon, cursor->right_lat, cursor->right_lon);
 
-                have_valid_latlon_cache = 1;
+                cursor->have_valid_latlon = 1;
         }
 
-        // compute the normalised lat/lon co-ordinate within the cell we're in.
-        if(left_lat_idx != right_lat_idx)
-                lat_lambda = (lat - left_lat) / (right_lat - left_lat);
-        else
-                lat_lambda = 0.5f;
-
-        if(left_lon_idx != right_lon_idx)
-                lon_lambda = _longitude_distance(lon, left_lon) 
-                        / _longitude_distance(right_lon, left_lon);
-        else
-                lon_lambda = 0.5f;
+        return 1;
+}
 
-        // munge the lambdas into the right range. Numerical approximations can nudge them
-        // ~1e-08 either side sometimes.
-        lat_lambda = (lat_lambda < 0.f) ? 0.f : lat_lambda;
-        lat_lambda = (lat_lambda > 1.f) ? 1.f : lat_lambda;
-        lon_lambda = (lon_lambda < 0.f) ? 0.f : lon_lambda;
-        lon_lambda = (lon_lambda > 1.f) ? 1.f : lon_lambda;
+int
+wind_file_cursor_find_level(wind_file_t* file, wind_file_cursor_t* cursor,
+                float lat_lambda, float lon_lambda, float height,
+                float* left_height_out, float* right_height_out)
+{
+        int i;
+        float left_height = 0.f, right_height = 0.f;
 
         // use this normalised co-ordinate to check the left and right heights
-        if(have_valid_pressure_cache)
+        if(cursor->have_valid_pressure)
         {
                 float ll_height, lr_height, rl_height, rr_height;
 
                 // left
-                ll_height = _wind_file_get_height(file, left_lat_idx, left_lon_idx, left_pr_idx);
-                lr_height = _wind_file_get_height(file, left_lat_idx, right_lon_idx, left_pr_idx);
-                rl_height = _wind_file_get_height(file, right_lat_idx, left_lon_idx, left_pr_idx);
-                rr_height = _wind_file_get_height(file, right_lat_idx, right_lon_idx, left_pr_idx);
+                ll_height = _wind_file_get_height(file, cursor->left_lat_idx, cursor->left_lon_idx, cursor->left_pr_idx);
+                lr_height = _wind_file_get_height(file, cursor->left_lat_idx, cursor->right_lon_idx, cursor->left_pr_idx);
+                rl_height = _wind_file_get_height(file, cursor->right_lat_idx, cursor->left_lon_idx, cursor->left_pr_idx);
+                rr_height = _wind_file_get_height(file, cursor->right_lat_idx, cursor->right_lon_idx, cursor->left_pr_idx);
                 left_height = _bilinear_interpolate(ll_height, lr_height, rl_height, rr_height,
                                 lat_lambda, lon_lambda);
                 // if the leftmost height is too small and we can go lower...
-                if((left_height > height) && (left_pr_idx > 0))
-                        have_valid_pressure_cache = 0;
+                if((left_height > height) && (cursor->left_pr_idx > 0))
+                        cursor->have_valid_pressure = 0;
 
                 // right
-                ll_height = _wind_file_get_height(file, left_lat_idx, left_lon_idx, right_pr_idx);
-                lr_height = _wind_file_get_height(file, left_lat_idx, right_lon_idx, right_pr_idx);
-                rl_height = _wind_file_get_height(file, right_lat_idx, left_lon_idx, right_pr_idx);
-                rr_height = _wind_file_get_height(file, right_lat_idx, right_lon_idx, right_pr_idx);
+                ll_height = _wind_file_get_height(file, cursor->left_lat_idx, cursor->left_lon_idx, cursor->right_pr_idx);
+                lr_height = _wind_file_get_height(file, cursor->left_lat_idx, cursor->right_lon_idx, cursor->right_pr_idx);
+                rl_height = _wind_file_get_height(file, cursor->right_lat_idx, cursor->left_lon_idx, cursor->right_pr_idx);
+                rr_height = _wind_file_get_height(file, cursor->right_lat_idx, cursor->right_lon_idx, cursor->right_pr_idx);
                 right_height = _bilinear_interpolate(ll_height, lr_height, rl_height, rr_height,
                                 lat_lambda, lon_lambda);
                 // if the rightmost height is too small and we can go higher...
-                if((right_height < height) && (right_pr_idx < file->axes[0]->n_values-1))
-                        have_valid_pressure_cache = 0;
+                if((right_height < height) && (cursor->right_pr_idx < file->axes[0]->n_values-1))
+                        cursor->have_valid_pressure = 0;
         }
         
         // if our height cache is out of whack, find a better cell.
-        if(!have_valid_pressure_cache)
+        if(!cursor->have_valid_pressure)
         {
                 // search along all heights to find what pressure level we're at
-                left_pr_idx = right_pr_idx = file->axes[0]->n_values;
+                cursor->left_pr_idx = cursor->right_pr_idx = file->axes[0]->n_values;
                 left_height = right_height = -1.f;
                 for(i=0; i<file->axes[0]->n_values; ++i)
                 {
                         // get heights for each corner of our lat/lon cell.
                         float ll_height = _wind_file_get_height(file, 
-                                        left_lat_idx, left_lon_idx, i);
+                                        cursor->left_lat_idx, cursor->left_lon_idx, i);
                         float lr_height = _wind_file_get_height(file, 
-                                        left_lat_idx, right_lon_idx, i);
+                                        cursor->left_lat_idx, cursor->right_lon_idx, i);
                         float rl_height = _wind_file_get_height(file, 
-                                        right_lat_idx, left_lon_idx, i);
+                                        cursor->right_lat_idx, cursor->left_lon_idx, i);
                         float rr_height = _wind_file_get_height(file,
-                                        right_lat_idx, right_lon_idx, i);
+                                        cursor->right_lat_idx, cursor->right_lon_idx, i);
 
                         // interpolate within our cell.
                         float interp_height = _bilinear_interpolate(
@@ -619,65 +573,141 @@ wind_file_get_wind(wind_file_t* file, float lat, float lon, float height,
 
                         if((interp_height <= height) && 
                            ((interp_height >= left_height) || 
-                            (left_pr_idx == file->axes[0]->n_values)))
+                            (cursor->left_pr_idx == file->axes[0]->n_values)))
                         {
-                                left_pr_idx = i;
+                                cursor->left_pr_idx = i;
                                 left_height = interp_height;
                         }
 
                         if((interp_height >= height) && 
                            ((interp_height <= right_height) ||
-                            (right_pr_idx == file->axes[0]->n_values)))
+                            (cursor->right_pr_idx == file->axes[0]->n_values)))
                         {
-                                right_pr_idx = i;
+                                cursor->right_pr_idx = i;
                                 right_height = interp_height;
                         }
                 }
 
-                if(left_pr_idx == file->axes[0]->n_values)
+                if(cursor->left_pr_idx == file->axes[0]->n_values)
                 {
-                        left_pr_idx = right_pr_idx;
+                        cursor->left_pr_idx = cursor->right_pr_idx;
                         if(verbosity > 0)
                                 fprintf(stderr, "WARN: Moved to %.2fm, below height where we "
                                                 "have data. "
                                                 "Assuming we're at %.fmb or approx. %.2fm.\n",
                                                 height,
-                                                file->axes[0]->values[left_pr_idx],
+                                                file->axes[0]->values[cursor->left_pr_idx],
                                                 _wind_file_get_height(file,
-                                                        left_lat_idx, left_lon_idx, left_pr_idx));
+                                                        cursor->left_lat_idx, cursor->left_lon_idx, cursor->left_pr_idx));
                 }
 
-                if(right_pr_idx == file->axes[0]->n_values)
+                if(cursor->right_pr_idx == file->axes[0]->n_values)
                 {
-                        right_pr_idx = left_pr_idx;
+                        cursor->right_pr_idx = cursor->left_pr_idx;
                         if(verbosity > 0)
                                 fprintf(stderr, "WARN: Moved to %.2fm, above height where we "
                                                 "have data. "
                                                 "Assuming we're at %.fmb or approx. %.2fm.\n",
                                                 height,
-                                                file->axes[0]->values[right_pr_idx],
+                                                file->axes[0]->values[cursor->right_pr_idx],
                                                 _wind_file_get_height(file,
-                                                        left_lat_idx, left_lon_idx, right_pr_idx));
+                                                        cursor->left_lat_idx, cursor->left_lon_idx, cursor->right_pr_idx));
                 }
 
-                if((left_pr_idx == file->axes[0]->n_values) ||
-                   (right_pr_idx == file->axes[0]->n_values))
+                if((cursor->left_pr_idx == file->axes[0]->n_values) ||
+                   (cursor->right_pr_idx == file->axes[0]->n_values))
                 {
                         fprintf(stderr, "ERROR: Moved to a totally stupid height (%f). "
                                         "Giving up!\n", height);
-                        return;
+                        return 0;
                 }
 
                 if(verbosity > 1)
                         fprintf(stderr, "INFO: Moved to pressure cell (%.fmb, %.fmb)\n", 
-                                        file->axes[0]->values[left_pr_idx],
-                                        file->axes[0]->values[right_pr_idx]);
+                                        file->axes[0]->values[cursor->left_pr_idx],
+                                        file->axes[0]->values[cursor->right_pr_idx]);
 
-                have_valid_pressure_cache = 1;
+                cursor->have_valid_pressure = 1;
         }
 
+        *left_height_out = left_height;
+        *right_height_out = right_height;
+
+        return 1;
+}
+
+void
+wind_file_cursor_get_lambdas(const wind_file_cursor_t* cursor, float lat, float lon,
+                float* lat_lambda, float* lon_lambda, 
+                double* dlat_lambda, double* dlon_lambda)
+{
+        *lat_lambda = *lon_lambda = 0.5f;
+        *dlat_lambda = *dlon_lambda = 0.0;
+
+        // compute the normalised lat/lon co-ordinate within the cell we're in.
+        if(cursor->left_lat_idx != cursor->right_lat_idx) {
+                *lat_lambda = (lat - cursor->left_lat) / (cursor->right_lat - cursor->left_lat);
+                *dlat_lambda = 1.0 / (cursor->right_lat - cursor->left_lat);
+        }
+
+        if(cursor->left_lon_idx != cursor->right_lon_idx) {
+                float width = _longitude_distance(cursor->right_lon, cursor->left_lon);
+
+                *lon_lambda = _longitude_distance(lon, cursor->left_lon) / width;
+                *dlon_lambda = 1.0 / width;
+        }
+
+        // munge the lambdas into the right range. Numerical approximations can nudge them
+        // ~1e-08 either side sometimes. Where they are clamped they do not vary.
+        if((*lat_lambda < 0.f) || (*lat_lambda > 1.f)) {
+                *lat_lambda = (*lat_lambda < 0.f) ? 0.f : 1.f;
+                *dlat_lambda = 0.0;
+        }
+        if((*lon_lambda < 0.f) || (*lon_lambda > 1.f)) {
+                *lon_lambda = (*lon_lambda < 0.f) ? 0.f : 1.f;
+                *dlon_lambda = 0.0;
+        }
+}
+
+void
+wind_file_get_wind(wind_file_t* file, wind_file_cursor_t* cursor,
+                float lat, float lon, float height, 
+                float* windu, float *windv, float *uvar, float *vvar)
+{
+        // if the caller has no cursor of their own, 'cache' the last left and
+        // right lat/longs and heights in a shared one so that we can avoid
+        // searching the axes if necessary
+        static wind_file_cursor_t shared_cursor = { 0 };
+
+        float left_height, right_height;
+        float lat_lambda, lon_lambda, pr_lambda;
+        double dlat_lambda, dlon_lambda;
+
+        assert(file);
+        assert(windu && windv);
+
+        if(!cursor)
+                cursor = &shared_cursor;
+
+        // canonicalise the longitude
+        lon = wind_file_canonicalise_longitude(lon);
+
+        // by default, return nothing in case of error.
+        *windu = *windv = 0.f;
+        *uvar = *vvar = 0.f;
+
+        if(!wind_file_cursor_find_cell(file, cursor, lat, lon))
+                return;
+
+        wind_file_cursor_get_lambdas(cursor, lat, lon, &lat_lambda, &lon_lambda, 
+                        &dlat_lambda, &dlon_lambda);
+
+        if(!wind_file_cursor_find_level(file, cursor, lat_lambda, lon_lambda, height,
+                                &left_height, &right_height))
+                return;
+
         // compute the normalised pressure co-ordinate within the cell we're in.
-        if(left_pr_idx != right_pr_idx)
+        if(cursor->left_pr_idx != cursor->right_pr_idx)
                 pr_lambda = (height - left_height) / (right_height - left_height);
         else
                 pr_lambda = 0.5f;
@@ -714,13 +744,13 @@ wind_file_get_wind(wind_file_t* file, float lat, float lon, float height,
 
                 // let's get the wind u and v for the lower lat/lon cell
                 _wind_file_get_wind_raw(file, 
-                                left_lat_idx, left_lon_idx, left_pr_idx, &llu, &llv);
+                                cursor->left_lat_idx, cursor->left_lon_idx, cursor->left_pr_idx, &llu, &llv);
                 _wind_file_get_wind_raw(file, 
-                                left_lat_idx, right_lon_idx, left_pr_idx, &lru, &lrv);
+                                cursor->left_lat_idx, cursor->right_lon_idx, cursor->left_pr_idx, &lru, &lrv);
                 _wind_file_get_wind_raw(file, 
-                                right_lat_idx, left_lon_idx, left_pr_idx, &rlu, &rlv);
+                                cursor->right_lat_idx, cursor->left_lon_idx, cursor->left_pr_idx, &rlu, &rlv);
                 _wind_file_get_wind_raw(file, 
-                                right_lat_idx, right_lon_idx, left_pr_idx, &rru, &rrv);
+                                cursor->right_lat_idx, cursor->right_lon_idx, cursor->left_pr_idx, &rru, &rrv);
 
                 lowu = _bilinear_interpolate(llu, lru, rlu, rru, lat_lambda, lon_lambda);
                 lowv = _bilinear_interpolate(llv, lrv, rlv, rrv, lat_lambda, lon_lambda);
@@ -739,13 +769,13 @@ wind_file_get_wind(wind_file_t* file, float lat, float lon, float height,
                 
                 // let's get the wind u and v for the upper lat/lon cell
                 _wind_file_get_wind_raw(file, 
-                                left_lat_idx, left_lon_idx, right_pr_idx, &llu, &llv);
+                                cursor->left_lat_idx, cursor->left_lon_idx, cursor->right_pr_idx, &llu, &llv);
                 _wind_file_get_wind_raw(file, 
-                                left_lat_idx, right_lon_idx, right_pr_idx, &lru, &lrv);
+                                cursor->left_lat_idx, cursor->right_lon_idx, cursor->right_pr_idx, &lru, &lrv);
                 _wind_file_get_wind_raw(file, 
-                                right_lat_idx, left_lon_idx, right_pr_idx, &rlu, &rlv);
+                                cursor->right_lat_idx, cursor->left_lon_idx, cursor->right_pr_idx, &rlu, &rlv);
                 _wind_file_get_wind_raw(file, 
-                                right_lat_idx, right_lon_idx, right_pr_idx, &rru, &rrv);
+                                cursor->right_lat_idx, cursor->right_lon_idx, cursor->right_pr_idx, &rru, &rrv);
 
                 highu = _bilinear_interpolate(llu, lru, rlu, rru, lat_lambda, lon_lambda);
                 highv = _bilinear_interpolate(llv, lrv, rlv, rrv, lat_lambda, lon_lambda);
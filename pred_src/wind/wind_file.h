@@ -23,13 +23,38 @@ typedef struct wind_file_s        wind_file_t;
 // An opaque type representing a cache entry.
 typedef struct wind_file_entry_s  wind_file_entry_t;
 
+// The position of a search within a wind file's grid. Consecutive lookups
+// for the same particle tend to land in the same cell so keeping one of these
+// per particle lets us avoid searching the axes on every call. The fields are
+// private, initialise it with wind_file_cursor_init().
+typedef struct wind_file_cursor_s wind_file_cursor_t;
+struct wind_file_cursor_s
+{
+        int                     have_valid_latlon;
+        int                     have_valid_pressure;
+
+        unsigned int            left_lat_idx, right_lat_idx;
+        unsigned int            left_lon_idx, right_lon_idx;
+        unsigned int            left_pr_idx, right_pr_idx;
+
+        float                   left_lat, right_lat;
+        float                   left_lon, right_lon;
+};
+
 //                      Open 'file' and parse contents. Return NULL on failure.
 wind_file_t            *wind_file_new          (const char         *file);
 
 //                      Free resources associated with 'file'.
 void                    wind_file_free         (wind_file_t        *file);
 
+//                      Reset 'cursor' so that the next lookup searches the axes.
+void                    wind_file_cursor_init  (wind_file_cursor_t *cursor);
+
+//                      Interpolate the wind at a point. 'cursor' caches the grid cell
+//                      between calls. If it is NULL, a single cursor shared by all
+//                      callers is used which is not safe to do from multiple threads.
 void                    wind_file_get_wind     (wind_file_t        *file, 
+                                                wind_file_cursor_t *cursor,
                                                 float               lat,
                                                 float               lon,
                                                 float               height, 
@@ -38,6 +63,39 @@ void                    wind_file_get_wind     (wind_file_t        *file,
                                                 float              *windusq,
                                                 float              *windvsq);
 
+// The number of particles wind_file_get_wind_batch() interpolates at once,
+// one AVX2 register of floats. Larger batches are interpolated a packet of
+// this size at a time.
+#define WIND_FILE_BATCH_SIZE 8
+
+//                      Choose the fastest batched interpolation routine this CPU can
+//                      run. Call this once at startup before any worker threads are
+//                      started. Returns the name of the instruction set chosen.
+const char*             wind_file_batch_init   (void);
+
+//                      Use the batched interpolation routine for the instruction set
+//                      'isa', "AVX2", "SSE2" or "scalar", in place of the one chosen by
+//                      wind_file_batch_init(). Returns zero, leaving the routine as it
+//                      was, if this CPU cannot run it. For testing.
+int                     wind_file_batch_use    (const char         *isa);
+
+//                      As wind_file_get_wind() for n particles at once. The i-th
+//                      particle is at (lat[i], lon[i], height[i]) and uses the
+//                      non-NULL cursor cursors[i]. The results are written to the i-th
+//                      element of each output array. Results are identical to calling
+//                      wind_file_get_wind() for each particle in turn.
+void                    wind_file_get_wind_batch
+                                               (wind_file_t        *file, 
+                                                wind_file_cursor_t *const *cursors,
+                                                unsigned int        n,
+                                                const float        *lat,
+                                                const float        *lon,
+                                                const float        *height, 
+                                                float              *windu,
+                                                float              *windv,
+                                                float              *uvar,
+                                                float              *vvar);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -0,0 +1,793 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// Written by Rich Wareham <rjw57@cam.ac.uk>
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+// Interpolating the wind for a packet of particles at once.
+//
+// Finding the grid cell each particle is in is branchy and is left to the
+// scalar cursor code in wind_file.c. Everything else, i.e. the normalised
+// co-ordinates within each cell, the gathers from the data array and the
+// blends, is done for all the particles in the packet together with SIMD
+// instructions if we have them.
+//
+// Each routine below performs exactly the same sequence of floating point
+// operations as wind_file_get_wind() so the results are bit-for-bit
+// identical whichever instruction set is used.
+
+#include "wind_file.h"
+#include "wind_file_private.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#  define HAVE_X86_SIMD 1
+#  include <immintrin.h>
+#endif
+
+#define PACKET_SIZE WIND_FILE_BATCH_SIZE
+
+// A packet of particles laid out as structure-of-arrays so that each field
+// can be loaded straight into a vector register. Offsets index floats in the
+// wind file's data array.
+typedef struct packet_s packet_t;
+struct packet_s
+{
+        int32_t         ok[PACKET_SIZE];
+
+        float           lat[PACKET_SIZE], lon[PACKET_SIZE], height[PACKET_SIZE];
+        float           left_lat[PACKET_SIZE], right_lat[PACKET_SIZE];
+        float           left_lon[PACKET_SIZE], right_lon[PACKET_SIZE];
+
+        //              These are all-ones where the left and right index of the
+        //              cell are the same and zero elsewhere.
+        int32_t         lat_same[PACKET_SIZE], lon_same[PACKET_SIZE], pr_same[PACKET_SIZE];
+
+        //              Offsets of the cell corners in the lowest pressure level...
+        int32_t         ll[PACKET_SIZE], lr[PACKET_SIZE], rl[PACKET_SIZE], rr[PACKET_SIZE];
+
+        //              ...and of the pressure levels either side of each particle.
+        int32_t         left_level[PACKET_SIZE], right_level[PACKET_SIZE];
+
+        //              All-ones where the cursor's pressure levels can be checked and
+        //              where the left (right) level can move down (up) respectively.
+        int32_t         have_level[PACKET_SIZE];
+        int32_t         can_go_lower[PACKET_SIZE], can_go_higher[PACKET_SIZE];
+
+        //              Outputs of the first pass.
+        float           lat_lambda[PACKET_SIZE], lon_lambda[PACKET_SIZE];
+        float           left_height[PACKET_SIZE], right_height[PACKET_SIZE];
+        int32_t         level_invalid[PACKET_SIZE];
+} __attribute__((aligned(32)));
+
+// The two passes over a packet. The first computes the normalised lat/lon
+// co-ordinates and checks that each cursor's pressure levels still straddle
+// the particle. The second does the actual interpolation.
+typedef void (*lambda_pass_t) (const wind_file_t *file, packet_t *p);
+typedef void (*interp_pass_t) (const wind_file_t *file, packet_t *p,
+                float *windu, float *windv, float *uvar, float *vvar);
+
+// ----------------------------------------------------------------------------
+// Plain C. This is the reference for the vectorised versions.
+
+static float
+_lerp(float a, float b, float lambda)
+{
+        return a * (1.f - lambda) + b * lambda;
+}
+
+static float
+_bilinear_interpolate(float ll, float lr, float rl, float rr, float lambda1, float lambda2)
+{
+        float il = _lerp(ll, rl, lambda1);
+        float ir = _lerp(lr, rr, lambda1);
+        return _lerp(il,ir,lambda2);
+}
+
+static float
+_longitude_distance(float lon_a, float lon_b)
+{
+        float d1 = fabsf(lon_a - lon_b);
+        float d2 = 360.f - d1;
+        return (d1 < d2) ? d1 : d2;
+}
+
+static float
+_clamp_lambda(float lambda)
+{
+        lambda = (lambda < 0.f) ? 0.f : lambda;
+        lambda = (lambda > 1.f) ? 1.f : lambda;
+        return lambda;
+}
+
+static void
+_lambda_pass_scalar(const wind_file_t *file, packet_t *p)
+{
+        const float* data = file->data;
+        unsigned int i;
+
+        for(i=0; i<PACKET_SIZE; ++i)
+        {
+                float lat_lambda, lon_lambda, left_height, right_height;
+
+                if(!p->lat_same[i])
+                        lat_lambda = (p->lat[i] - p->left_lat[i])
+                                / (p->right_lat[i] - p->left_lat[i]);
+                else
+                        lat_lambda = 0.5f;
+
+                if(!p->lon_same[i])
+                        lon_lambda = _longitude_distance(p->lon[i], p->left_lon[i])
+                                / _longitude_distance(p->right_lon[i], p->left_lon[i]);
+                else
+                        lon_lambda = 0.5f;
+
+                lat_lambda = _clamp_lambda(lat_lambda);
+                lon_lambda = _clamp_lambda(lon_lambda);
+
+                left_height = _bilinear_interpolate(
+                                data[p->ll[i] + p->left_level[i]],
+                                data[p->lr[i] + p->left_level[i]],
+                                data[p->rl[i] + p->left_level[i]],
+                                data[p->rr[i] + p->left_level[i]],
+                                lat_lambda, lon_lambda);
+                right_height = _bilinear_interpolate(
+                                data[p->ll[i] + p->right_level[i]],
+                                data[p->lr[i] + p->right_level[i]],
+                                data[p->rl[i] + p->right_level[i]],
+                                data[p->rr[i] + p->right_level[i]],
+                                lat_lambda, lon_lambda);
+
+                p->lat_lambda[i] = lat_lambda;
+                p->lon_lambda[i] = lon_lambda;
+                p->left_height[i] = left_height;
+                p->right_height[i] = right_height;
+                p->level_invalid[i] = !p->have_level[i]
+                        || ((left_height > p->height[i]) && p->can_go_lower[i])
+                        || ((right_height < p->height[i]) && p->can_go_higher[i]);
+        }
+}
+
+static void
+_interp_pass_scalar(const wind_file_t *file, packet_t *p,
+                float *windu, float *windv, float *uvar, float *vvar)
+{
+        const float* data = file->data;
+        unsigned int i;
+
+        for(i=0; i<PACKET_SIZE; ++i)
+        {
+                const int32_t corners[4] = { p->ll[i], p->lr[i], p->rl[i], p->rr[i] };
+                float u[2][4], v[2][4];
+                float lowu, lowv, highu, highv;
+                float umean, vmean, usqmean, vsqmean;
+                float pr_lambda;
+                int level, c;
+
+                if(!p->pr_same[i])
+                        pr_lambda = (p->height[i] - p->left_height[i])
+                                / (p->right_height[i] - p->left_height[i]);
+                else
+                        pr_lambda = 0.5f;
+                pr_lambda = _clamp_lambda(pr_lambda);
+
+                for(level=0; level<2; ++level)
+                {
+                        int32_t level_offset = level ? p->right_level[i] : p->left_level[i];
+                        for(c=0; c<4; ++c)
+                        {
+                                u[level][c] = data[corners[c] + level_offset + 1];
+                                v[level][c] = data[corners[c] + level_offset + 2];
+                        }
+                }
+
+                lowu = _bilinear_interpolate(u[0][0], u[0][1], u[0][2], u[0][3],
+                                p->lat_lambda[i], p->lon_lambda[i]);
+                lowv = _bilinear_interpolate(v[0][0], v[0][1], v[0][2], v[0][3],
+                                p->lat_lambda[i], p->lon_lambda[i]);
+                highu = _bilinear_interpolate(u[1][0], u[1][1], u[1][2], u[1][3],
+                                p->lat_lambda[i], p->lon_lambda[i]);
+                highv = _bilinear_interpolate(v[1][0], v[1][1], v[1][2], v[1][3],
+                                p->lat_lambda[i], p->lon_lambda[i]);
+
+                umean = u[0][0] + u[0][1] + u[0][2] + u[0][3];
+                vmean = v[0][0] + v[0][1] + v[0][2] + v[0][3];
+                usqmean = u[0][0]*u[0][0] + u[0][1]*u[0][1] + u[0][2]*u[0][2] + u[0][3]*u[0][3];
+                vsqmean = v[0][0]*v[0][0] + v[0][1]*v[0][1] + v[0][2]*v[0][2] + v[0][3]*v[0][3];
+                umean += u[1][0] + u[1][1] + u[1][2] + u[1][3];
+                vmean += v[1][0] + v[1][1] + v[1][2] + v[1][3];
+                usqmean += u[1][0]*u[1][0] + u[1][1]*u[1][1] + u[1][2]*u[1][2] + u[1][3]*u[1][3];
+                vsqmean += v[1][0]*v[1][0] + v[1][1]*v[1][1] + v[1][2]*v[1][2] + v[1][3]*v[1][3];
+
+                windu[i] = _lerp(lowu, highu, pr_lambda);
+                windv[i] = _lerp(lowv, highv, pr_lambda);
+
+                umean *= 0.125f; usqmean *= 0.125f;
+                vmean *= 0.125f; vsqmean *= 0.125f;
+
+                uvar[i] = usqmean - umean * umean;
+                vvar[i] = vsqmean - vmean * vmean;
+        }
+}
+
+#ifdef HAVE_X86_SIMD
+
+// ----------------------------------------------------------------------------
+// SSE2. There is no gather instruction so loads from the data array are
+// scalar but everything else works on four particles at a time.
+
+#define SSE2 __attribute__((target("sse2")))
+
+static SSE2 __m128
+_sse2_blend(__m128 a, __m128 b, __m128 mask)
+{
+        return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+
+static SSE2 __m128
+_sse2_lerp(__m128 a, __m128 b, __m128 lambda)
+{
+        const __m128 one = _mm_set1_ps(1.f);
+        return _mm_add_ps(_mm_mul_ps(a, _mm_sub_ps(one, lambda)), _mm_mul_ps(b, lambda));
+}
+
+static SSE2 __m128
+_sse2_bilinear(__m128 ll, __m128 lr, __m128 rl, __m128 rr, __m128 lambda1, __m128 lambda2)
+{
+        __m128 il = _sse2_lerp(ll, rl, lambda1);
+        __m128 ir = _sse2_lerp(lr, rr, lambda1);
+        return _sse2_lerp(il, ir, lambda2);
+}
+
+static SSE2 __m128
+_sse2_clamp_lambda(__m128 lambda)
+{
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.f);
+        lambda = _sse2_blend(lambda, zero, _mm_cmplt_ps(lambda, zero));
+        lambda = _sse2_blend(lambda, one, _mm_cmpgt_ps(lambda, one));
+        return lambda;
+}
+
+static SSE2 __m128
+_sse2_longitude_distance(__m128 lon_a, __m128 lon_b)
+{
+        const __m128 sign = _mm_set1_ps(-0.f);
+        __m128 d1 = _mm_andnot_ps(sign, _mm_sub_ps(lon_a, lon_b));
+        __m128 d2 = _mm_sub_ps(_mm_set1_ps(360.f), d1);
+        return _sse2_blend(d2, d1, _mm_cmplt_ps(d1, d2));
+}
+
+static SSE2 __m128
+_sse2_gather(const float* data, const int32_t* idx_a, const int32_t* idx_b, int32_t extra)
+{
+        return _mm_set_ps(data[idx_a[3] + idx_b[3] + extra], data[idx_a[2] + idx_b[2] + extra],
+                          data[idx_a[1] + idx_b[1] + extra], data[idx_a[0] + idx_b[0] + extra]);
+}
+
+static SSE2 __m128
+_sse2_mask(const int32_t* mask)
+{
+        return _mm_castsi128_ps(_mm_load_si128((const __m128i*) mask));
+}
+
+static SSE2 void
+_lambda_pass_sse2(const wind_file_t *file, packet_t *p)
+{
+        const float* data = file->data;
+        const __m128 half = _mm_set1_ps(0.5f);
+        unsigned int i;
+
+        for(i=0; i<PACKET_SIZE; i+=4)
+        {
+                __m128 lat_lambda, lon_lambda, left_height, right_height, height, invalid;
+
+                lat_lambda = _mm_div_ps(
+                                _mm_sub_ps(_mm_load_ps(p->lat + i), _mm_load_ps(p->left_lat + i)),
+                                _mm_sub_ps(_mm_load_ps(p->right_lat + i), _mm_load_ps(p->left_lat + i)));
+                lat_lambda = _sse2_blend(lat_lambda, half, _sse2_mask(p->lat_same + i));
+
+                lon_lambda = _mm_div_ps(
+                                _sse2_longitude_distance(_mm_load_ps(p->lon + i),
+                                        _mm_load_ps(p->left_lon + i)),
+                                _sse2_longitude_distance(_mm_load_ps(p->right_lon + i),
+                                        _mm_load_ps(p->left_lon + i)));
+                lon_lambda = _sse2_blend(lon_lambda, half, _sse2_mask(p->lon_same + i));
+
+                lat_lambda = _sse2_clamp_lambda(lat_lambda);
+                lon_lambda = _sse2_clamp_lambda(lon_lambda);
+
+                left_height = _sse2_bilinear(
+                                _sse2_gather(data, p->ll + i, p->left_level + i, 0),
+                                _sse2_gather(data, p->lr + i, p->left_level + i, 0),
+                                _sse2_gather(data, p->rl + i, p->left_level + i, 0),
+                                _sse2_gather(data, p->rr + i, p->left_level + i, 0),
+                                lat_lambda, lon_lambda);
+                right_height = _sse2_bilinear(
+                                _sse2_gather(data, p->ll + i, p->right_level + i, 0),
+                                _sse2_gather(data, p->lr + i, p->right_level + i, 0),
+                                _sse2_gather(data, p->rl + i, p->right_level + i, 0),
+                                _sse2_gather(data, p->rr + i, p->right_level + i, 0),
+                                lat_lambda, lon_lambda);
+
+                height = _mm_load_ps(p->height + i);
+                invalid = _mm_andnot_ps(_sse2_mask(p->have_level + i),
+                                _mm_castsi128_ps(_mm_set1_epi32(-1)));
+                invalid = _mm_or_ps(invalid, _mm_and_ps(_mm_cmpgt_ps(left_height, height),
+                                        _sse2_mask(p->can_go_lower + i)));
+                invalid = _mm_or_ps(invalid, _mm_and_ps(_mm_cmplt_ps(right_height, height),
+                                        _sse2_mask(p->can_go_higher + i)));
+
+                _mm_store_ps(p->lat_lambda + i, lat_lambda);
+                _mm_store_ps(p->lon_lambda + i, lon_lambda);
+                _mm_store_ps(p->left_height + i, left_height);
+                _mm_store_ps(p->right_height + i, right_height);
+                _mm_store_si128((__m128i*) (p->level_invalid + i), _mm_castps_si128(invalid));
+        }
+}
+
+static SSE2 void
+_interp_pass_sse2(const wind_file_t *file, packet_t *p,
+                float *windu, float *windv, float *uvar, float *vvar)
+{
+        const float* data = file->data;
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 eighth = _mm_set1_ps(0.125f);
+        unsigned int i;
+
+        for(i=0; i<PACKET_SIZE; i+=4)
+        {
+                __m128 lat_lambda = _mm_load_ps(p->lat_lambda + i);
+                __m128 lon_lambda = _mm_load_ps(p->lon_lambda + i);
+                __m128 left_height = _mm_load_ps(p->left_height + i);
+                __m128 pr_lambda;
+                __m128 u[2][4], v[2][4], wind[2][2];
+                __m128 umean, vmean, usqmean, vsqmean;
+                int level;
+
+                pr_lambda = _mm_div_ps(
+                                _mm_sub_ps(_mm_load_ps(p->height + i), left_height),
+                                _mm_sub_ps(_mm_load_ps(p->right_height + i), left_height));
+                pr_lambda = _sse2_blend(pr_lambda, half, _sse2_mask(p->pr_same + i));
+                pr_lambda = _sse2_clamp_lambda(pr_lambda);
+
+                for(level=0; level<2; ++level)
+                {
+                        const int32_t* level_offset = level ? p->right_level + i : p->left_level + i;
+
+                        u[level][0] = _sse2_gather(data, p->ll + i, level_offset, 1);
+                        u[level][1] = _sse2_gather(data, p->lr + i, level_offset, 1);
+                        u[level][2] = _sse2_gather(data, p->rl + i, level_offset, 1);
+                        u[level][3] = _sse2_gather(data, p->rr + i, level_offset, 1);
+                        v[level][0] = _sse2_gather(data, p->ll + i, level_offset, 2);
+                        v[level][1] = _sse2_gather(data, p->lr + i, level_offset, 2);
+                        v[level][2] = _sse2_gather(data, p->rl + i, level_offset, 2);
+                        v[level][3] = _sse2_gather(data, p->rr + i, level_offset, 2);
+
+                        wind[level][0] = _sse2_bilinear(u[level][0], u[level][1], u[level][2],
+                                        u[level][3], lat_lambda, lon_lambda);
+                        wind[level][1] = _sse2_bilinear(v[level][0], v[level][1], v[level][2],
+                                        v[level][3], lat_lambda, lon_lambda);
+                }
+
+                umean = _mm_add_ps(_mm_add_ps(_mm_add_ps(u[0][0], u[0][1]), u[0][2]), u[0][3]);
+                vmean = _mm_add_ps(_mm_add_ps(_mm_add_ps(v[0][0], v[0][1]), v[0][2]), v[0][3]);
+                usqmean = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(u[0][0], u[0][0]), _mm_mul_ps(u[0][1], u[0][1])),
+                                _mm_mul_ps(u[0][2], u[0][2])), _mm_mul_ps(u[0][3], u[0][3]));
+                vsqmean = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(v[0][0], v[0][0]), _mm_mul_ps(v[0][1], v[0][1])),
+                                _mm_mul_ps(v[0][2], v[0][2])), _mm_mul_ps(v[0][3], v[0][3]));
+                umean = _mm_add_ps(umean,
+                                _mm_add_ps(_mm_add_ps(_mm_add_ps(u[1][0], u[1][1]), u[1][2]), u[1][3]));
+                vmean = _mm_add_ps(vmean,
+                                _mm_add_ps(_mm_add_ps(_mm_add_ps(v[1][0], v[1][1]), v[1][2]), v[1][3]));
+                usqmean = _mm_add_ps(usqmean, _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(u[1][0], u[1][0]), _mm_mul_ps(u[1][1], u[1][1])),
+                                _mm_mul_ps(u[1][2], u[1][2])), _mm_mul_ps(u[1][3], u[1][3])));
+                vsqmean = _mm_add_ps(vsqmean, _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(v[1][0], v[1][0]), _mm_mul_ps(v[1][1], v[1][1])),
+                                _mm_mul_ps(v[1][2], v[1][2])), _mm_mul_ps(v[1][3], v[1][3])));
+
+                _mm_storeu_ps(windu + i, _sse2_lerp(wind[0][0], wind[1][0], pr_lambda));
+                _mm_storeu_ps(windv + i, _sse2_lerp(wind[0][1], wind[1][1], pr_lambda));
+
+                umean = _mm_mul_ps(umean, eighth); usqmean = _mm_mul_ps(usqmean, eighth);
+                vmean = _mm_mul_ps(vmean, eighth); vsqmean = _mm_mul_ps(vsqmean, eighth);
+
+                _mm_storeu_ps(uvar + i, _mm_sub_ps(usqmean, _mm_mul_ps(umean, umean)));
+                _mm_storeu_ps(vvar + i, _mm_sub_ps(vsqmean, _mm_mul_ps(vmean, vmean)));
+        }
+}
+
+// ----------------------------------------------------------------------------
+// AVX2. The whole packet fits in one register and loads from the data array
+// use the hardware gather.
+
+#define AVX2 __attribute__((target("avx2")))
+
+static AVX2 __m256
+_avx2_lerp(__m256 a, __m256 b, __m256 lambda)
+{
+        const __m256 one = _mm256_set1_ps(1.f);
+        return _mm256_add_ps(_mm256_mul_ps(a, _mm256_sub_ps(one, lambda)),
+                        _mm256_mul_ps(b, lambda));
+}
+
+static AVX2 __m256
+_avx2_bilinear(__m256 ll, __m256 lr, __m256 rl, __m256 rr, __m256 lambda1, __m256 lambda2)
+{
+        __m256 il = _avx2_lerp(ll, rl, lambda1);
+        __m256 ir = _avx2_lerp(lr, rr, lambda1);
+        return _avx2_lerp(il, ir, lambda2);
+}
+
+static AVX2 __m256
+_avx2_clamp_lambda(__m256 lambda)
+{
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.f);
+        lambda = _mm256_blendv_ps(lambda, zero, _mm256_cmp_ps(lambda, zero, _CMP_LT_OQ));
+        lambda = _mm256_blendv_ps(lambda, one, _mm256_cmp_ps(lambda, one, _CMP_GT_OQ));
+        return lambda;
+}
+
+static AVX2 __m256
+_avx2_longitude_distance(__m256 lon_a, __m256 lon_b)
+{
+        const __m256 sign = _mm256_set1_ps(-0.f);
+        __m256 d1 = _mm256_andnot_ps(sign, _mm256_sub_ps(lon_a, lon_b));
+        __m256 d2 = _mm256_sub_ps(_mm256_set1_ps(360.f), d1);
+        return _mm256_blendv_ps(d2, d1, _mm256_cmp_ps(d1, d2, _CMP_LT_OQ));
+}
+
+static AVX2 __m256i
+_avx2_load_epi32(const int32_t* values)
+{
+        return _mm256_load_si256((const __m256i*) values);
+}
+
+static AVX2 __m256
+_avx2_mask(const int32_t* mask)
+{
+        return _mm256_castsi256_ps(_avx2_load_epi32(mask));
+}
+
+static AVX2 void
+_lambda_pass_avx2(const wind_file_t *file, packet_t *p)
+{
+        const float* data = file->data;
+        const __m256 half = _mm256_set1_ps(0.5f);
+        __m256 lat_lambda, lon_lambda, left_height, right_height, height, invalid;
+        __m256i left_level = _avx2_load_epi32(p->left_level);
+        __m256i right_level = _avx2_load_epi32(p->right_level);
+        __m256i ll = _avx2_load_epi32(p->ll), lr = _avx2_load_epi32(p->lr);
+        __m256i rl = _avx2_load_epi32(p->rl), rr = _avx2_load_epi32(p->rr);
+
+        lat_lambda = _mm256_div_ps(
+                        _mm256_sub_ps(_mm256_load_ps(p->lat), _mm256_load_ps(p->left_lat)),
+                        _mm256_sub_ps(_mm256_load_ps(p->right_lat), _mm256_load_ps(p->left_lat)));
+        lat_lambda = _mm256_blendv_ps(lat_lambda, half, _avx2_mask(p->lat_same));
+
+        lon_lambda = _mm256_div_ps(
+                        _avx2_longitude_distance(_mm256_load_ps(p->lon),
+                                _mm256_load_ps(p->left_lon)),
+                        _avx2_longitude_distance(_mm256_load_ps(p->right_lon),
+                                _mm256_load_ps(p->left_lon)));
+        lon_lambda = _mm256_blendv_ps(lon_lambda, half, _avx2_mask(p->lon_same));
+
+        lat_lambda = _avx2_clamp_lambda(lat_lambda);
+        lon_lambda = _avx2_clamp_lambda(lon_lambda);
+
+        left_height = _avx2_bilinear(
+                        _mm256_i32gather_ps(data, _mm256_add_epi32(ll, left_level), 4),
+                        _mm256_i32gather_ps(data, _mm256_add_epi32(lr, left_level), 4),
+                        _mm256_i32gather_ps(data, _mm256_add_epi32(rl, left_level), 4),
+                        _mm256_i32gather_ps(data, _mm256_add_epi32(rr, left_level), 4),
+                        lat_lambda, lon_lambda);
+        right_height = _avx2_bilinear(
+                        _mm256_i32gather_ps(data, _mm256_add_epi32(ll, right_level), 4),
+                        _mm256_i32gather_ps(data, _mm256_add_epi32(lr, right_level), 4),
+                        _mm256_i32gather_ps(data, _mm256_add_epi32(rl, right_level), 4),
+                        _mm256_i32gather_ps(data, _mm256_add_epi32(rr, right_level), 4),
+                        lat_lambda, lon_lambda);
+
+        height = _mm256_load_ps(p->height);
+        invalid = _mm256_andnot_ps(_avx2_mask(p->have_level),
+                        _mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+        invalid = _mm256_or_ps(invalid, _mm256_and_ps(
+                                _mm256_cmp_ps(left_height, height, _CMP_GT_OQ),
+                                _avx2_mask(p->can_go_lower)));
+        invalid = _mm256_or_ps(invalid, _mm256_and_ps(
+                                _mm256_cmp_ps(right_height, height, _CMP_LT_OQ),
+                                _avx2_mask(p->can_go_higher)));
+
+        _mm256_store_ps(p->lat_lambda, lat_lambda);
+        _mm256_store_ps(p->lon_lambda, lon_lambda);
+        _mm256_store_ps(p->left_height, left_height);
+        _mm256_store_ps(p->right_height, right_height);
+        _mm256_store_si256((__m256i*) p->level_invalid, _mm256_castps_si256(invalid));
+}
+
+static AVX2 void
+_interp_pass_avx2(const wind_file_t *file, packet_t *p,
+                float *windu, float *windv, float *uvar, float *vvar)
+{
+        const float* data = file->data;
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 eighth = _mm256_set1_ps(0.125f);
+        const __m256i u_offset = _mm256_set1_epi32(1);
+        const __m256i v_offset = _mm256_set1_epi32(2);
+        __m256 lat_lambda = _mm256_load_ps(p->lat_lambda);
+        __m256 lon_lambda = _mm256_load_ps(p->lon_lambda);
+        __m256 left_height = _mm256_load_ps(p->left_height);
+        __m256 pr_lambda;
+        __m256 u[2][4], v[2][4], wind[2][2];
+        __m256 umean, vmean, usqmean, vsqmean;
+        __m256i corners[4];
+        int level, c;
+
+        corners[0] = _avx2_load_epi32(p->ll);
+        corners[1] = _avx2_load_epi32(p->lr);
+        corners[2] = _avx2_load_epi32(p->rl);
+        corners[3] = _avx2_load_epi32(p->rr);
+
+        pr_lambda = _mm256_div_ps(
+                        _mm256_sub_ps(_mm256_load_ps(p->height), left_height),
+                        _mm256_sub_ps(_mm256_load_ps(p->right_height), left_height));
+        pr_lambda = _mm256_blendv_ps(pr_lambda, half, _avx2_mask(p->pr_same));
+        pr_lambda = _avx2_clamp_lambda(pr_lambda);
+
+        for(level=0; level<2; ++level)
+        {
+                __m256i level_offset = _avx2_load_epi32(level ? p->right_level : p->left_level);
+
+                for(c=0; c<4; ++c)
+                {
+                        __m256i record = _mm256_add_epi32(corners[c], level_offset);
+                        u[level][c] = _mm256_i32gather_ps(data,
+                                        _mm256_add_epi32(record, u_offset), 4);
+                        v[level][c] = _mm256_i32gather_ps(data,
+                                        _mm256_add_epi32(record, v_offset), 4);
+                }
+
+                wind[level][0] = _avx2_bilinear(u[level][0], u[level][1], u[level][2],
+                                u[level][3], lat_lambda, lon_lambda);
+                wind[level][1] = _avx2_bilinear(v[level][0], v[level][1], v[level][2],
+                                v[level][3], lat_lambda, lon_lambda);
+        }
+
+        umean = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(u[0][0], u[0][1]), u[0][2]), u[0][3]);
+        vmean = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(v[0][0], v[0][1]), v[0][2]), v[0][3]);
+        usqmean = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(u[0][0], u[0][0]), _mm256_mul_ps(u[0][1], u[0][1])),
+                        _mm256_mul_ps(u[0][2], u[0][2])), _mm256_mul_ps(u[0][3], u[0][3]));
+        vsqmean = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(v[0][0], v[0][0]), _mm256_mul_ps(v[0][1], v[0][1])),
+                        _mm256_mul_ps(v[0][2], v[0][2])), _mm256_mul_ps(v[0][3], v[0][3]));
+        umean = _mm256_add_ps(umean, _mm256_add_ps(_mm256_add_ps(
+                                _mm256_add_ps(u[1][0], u[1][1]), u[1][2]), u[1][3]));
+        vmean = _mm256_add_ps(vmean, _mm256_add_ps(_mm256_add_ps(
+                                _mm256_add_ps(v[1][0], v[1][1]), v[1][2]), v[1][3]));
+        usqmean = _mm256_add_ps(usqmean, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(u[1][0], u[1][0]), _mm256_mul_ps(u[1][1], u[1][1])),
+                        _mm256_mul_ps(u[1][2], u[1][2])), _mm256_mul_ps(u[1][3], u[1][3])));
+        vsqmean = _mm256_add_ps(vsqmean, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(v[1][0], v[1][0]), _mm256_mul_ps(v[1][1], v[1][1])),
+                        _mm256_mul_ps(v[1][2], v[1][2])), _mm256_mul_ps(v[1][3], v[1][3])));
+
+        _mm256_storeu_ps(windu, _avx2_lerp(wind[0][0], wind[1][0], pr_lambda));
+        _mm256_storeu_ps(windv, _avx2_lerp(wind[0][1], wind[1][1], pr_lambda));
+
+        umean = _mm256_mul_ps(umean, eighth); usqmean = _mm256_mul_ps(usqmean, eighth);
+        vmean = _mm256_mul_ps(vmean, eighth); vsqmean = _mm256_mul_ps(vsqmean, eighth);
+
+        _mm256_storeu_ps(uvar, _mm256_sub_ps(usqmean, _mm256_mul_ps(umean, umean)));
+        _mm256_storeu_ps(vvar, _mm256_sub_ps(vsqmean, _mm256_mul_ps(vmean, vmean)));
+}
+
+#endif // HAVE_X86_SIMD
+
+// ----------------------------------------------------------------------------
+
+static const char*      _isa_name = "scalar";
+static lambda_pass_t    _lambda_pass = _lambda_pass_scalar;
+static interp_pass_t    _interp_pass = _interp_pass_scalar;
+
+int
+wind_file_batch_use(const char *isa)
+{
+        if(!strcmp(isa, "scalar")) {
+                _isa_name = "scalar";
+                _lambda_pass = _lambda_pass_scalar;
+                _interp_pass = _interp_pass_scalar;
+                return 1;
+        }
+
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+
+        if(!strcmp(isa, "AVX2") && __builtin_cpu_supports("avx2")) {
+                _isa_name = "AVX2";
+                _lambda_pass = _lambda_pass_avx2;
+                _interp_pass = _interp_pass_avx2;
+                return 1;
+        }
+
+        if(!strcmp(isa, "SSE2") && __builtin_cpu_supports("sse2")) {
+                _isa_name = "SSE2";
+                _lambda_pass = _lambda_pass_sse2;
+                _interp_pass = _interp_pass_sse2;
+                return 1;
+        }
+#endif // HAVE_X86_SIMD
+
+        return 0;
+}
+
+const char*
+wind_file_batch_init(void)
+{
+        if(!wind_file_batch_use("AVX2") && !wind_file_batch_use("SSE2"))
+                wind_file_batch_use("scalar");
+
+        return _isa_name;
+}
+
+// Fill in the fields of 'p' which come straight from the cursor for particle
+// i. The cursor must refer to a valid lat/lon cell.
+static void
+_packet_load_cell(const wind_file_t *file, packet_t *p, unsigned int i,
+                const wind_file_cursor_t *cursor)
+{
+        const int32_t stride = file->n_components;
+        const int32_t row_stride = stride * file->axes[2]->n_values;
+
+        p->left_lat[i] = cursor->left_lat;
+        p->right_lat[i] = cursor->right_lat;
+        p->left_lon[i] = cursor->left_lon;
+        p->right_lon[i] = cursor->right_lon;
+
+        p->lat_same[i] = (cursor->left_lat_idx == cursor->right_lat_idx) ? -1 : 0;
+        p->lon_same[i] = (cursor->left_lon_idx == cursor->right_lon_idx) ? -1 : 0;
+
+        p->ll[i] = stride * cursor->left_lon_idx + row_stride * cursor->left_lat_idx;
+        p->lr[i] = stride * cursor->right_lon_idx + row_stride * cursor->left_lat_idx;
+        p->rl[i] = stride * cursor->left_lon_idx + row_stride * cursor->right_lat_idx;
+        p->rr[i] = stride * cursor->right_lon_idx + row_stride * cursor->right_lat_idx;
+}
+
+// Fill in the fields of 'p' which describe the pressure levels the cursor
+// for particle i currently refers to.
+static void
+_packet_load_levels(const wind_file_t *file, packet_t *p, unsigned int i,
+                const wind_file_cursor_t *cursor)
+{
+        const int32_t level_stride = file->n_components *
+                file->axes[2]->n_values * file->axes[1]->n_values;
+
+        p->have_level[i] = cursor->have_valid_pressure ? -1 : 0;
+        if(!cursor->have_valid_pressure) {
+                // The indices are meaningless, make sure we don't read off the
+                // end of the data when we check them.
+                p->left_level[i] = p->right_level[i] = 0;
+                p->can_go_lower[i] = p->can_go_higher[i] = p->pr_same[i] = 0;
+                return;
+        }
+
+        p->left_level[i] = level_stride * cursor->left_pr_idx;
+        p->right_level[i] = level_stride * cursor->right_pr_idx;
+        p->can_go_lower[i] = (cursor->left_pr_idx > 0) ? -1 : 0;
+        p->can_go_higher[i] =
+                (cursor->right_pr_idx < file->axes[0]->n_values-1) ? -1 : 0;
+        p->pr_same[i] = (cursor->left_pr_idx == cursor->right_pr_idx) ? -1 : 0;
+}
+
+// Interpolate the wind for at most PACKET_SIZE particles.
+static void
+_get_wind_packet(wind_file_t *file, wind_file_cursor_t *const *cursors, unsigned int n,
+                const float *lat, const float *lon, const float *height,
+                float *windu, float *windv, float *uvar, float *vvar)
+{
+        packet_t p;
+        float out[4][PACKET_SIZE];
+        unsigned int i;
+
+        assert(n <= PACKET_SIZE);
+
+        // Find the lat/lon cell for each particle. Unused or failed lanes
+        // point at the first record so they are safe to load from.
+        for(i=0; i<PACKET_SIZE; ++i)
+        {
+                p.ok[i] = 0;
+                if(i < n) {
+                        p.lat[i] = lat[i];
+                        p.lon[i] = wind_file_canonicalise_longitude(lon[i]);
+                        p.height[i] = height[i];
+                        p.ok[i] = wind_file_cursor_find_cell(file, cursors[i], p.lat[i], p.lon[i]);
+                }
+
+                if(p.ok[i]) {
+                        _packet_load_cell(file, &p, i, cursors[i]);
+                        _packet_load_levels(file, &p, i, cursors[i]);
+                } else {
+                        p.lat[i] = p.lon[i] = p.height[i] = 0.f;
+                        p.left_lat[i] = p.left_lon[i] = 0.f;
+                        p.right_lat[i] = p.right_lon[i] = 1.f;
+                        p.lat_same[i] = p.lon_same[i] = p.pr_same[i] = 0;
+                        p.ll[i] = p.lr[i] = p.rl[i] = p.rr[i] = 0;
+                        p.left_level[i] = p.right_level[i] = 0;
+                        p.have_level[i] = -1;
+                        p.can_go_lower[i] = p.can_go_higher[i] = 0;
+                }
+        }
+
+        _lambda_pass(file, &p);
+
+        // Any particle which has left its pressure levels needs a search.
+        for(i=0; i<n; ++i)
+        {
+                if(!p.ok[i] || !p.level_invalid[i])
+                        continue;
+
+                cursors[i]->have_valid_pressure = 0;
+                p.ok[i] = wind_file_cursor_find_level(file, cursors[i],
+                                p.lat_lambda[i], p.lon_lambda[i], p.height[i],
+                                &(p.left_height[i]), &(p.right_height[i]));
+
+                if(p.ok[i]) {
+                        _packet_load_levels(file, &p, i, cursors[i]);
+                } else {
+                        p.left_level[i] = p.right_level[i] = 0;
+                        p.left_height[i] = 0.f;
+                        p.right_height[i] = 1.f;
+                }
+        }
+
+        _interp_pass(file, &p, out[0], out[1], out[2], out[3]);
+
+        for(i=0; i<n; ++i)
+        {
+                // by default, return nothing in case of error.
+                if(!p.ok[i]) {
+                        windu[i] = windv[i] = uvar[i] = vvar[i] = 0.f;
+                        continue;
+                }
+
+                windu[i] = out[0][i];
+                windv[i] = out[1][i];
+                uvar[i] = out[2][i];
+                vvar[i] = out[3][i];
+        }
+}
+
+void
+wind_file_get_wind_batch(wind_file_t *file, wind_file_cursor_t *const *cursors, unsigned int n,
+                const float *lat, const float *lon, const float *height,
+                float *windu, float *windv, float *uvar, float *vvar)
+{
+        unsigned int i;
+
+        assert(file && cursors);
+
+        for(i=0; i<n; i+=PACKET_SIZE)
+        {
+                unsigned int packet_n = (n - i < PACKET_SIZE) ? n - i : PACKET_SIZE;
+                _get_wind_packet(file, cursors + i, packet_n, lat + i, lon + i, height + i,
+                                windu + i, windv + i, uvar + i, vvar + i);
+        }
+}
+
+// Data for God's own editor.
+// vim:sw=8:ts=8:et:cindent
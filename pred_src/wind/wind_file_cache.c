@@ -26,6 +26,8 @@
 #include <string.h>
 #include <math.h>
 
+#include <glib.h>
+
 #include "../util/getline.h"
 
 extern int verbosity;
@@ -37,6 +39,7 @@ struct wind_file_cache_entry_s
         float                   lat, lon;               // Window centre.
         float                   latrad, lonrad;         // Window radius.
         wind_file_t            *loaded_file;            // Initially NULL.
+        GMutex                  load_lock;              // Guards loaded_file.
 };
 
 struct wind_file_cache_s
@@ -219,6 +222,7 @@ wind_file_cache_new(const char *directory)
 
                 // initially, no file is loaded.
                 self->entries[i]->loaded_file = NULL;
+                g_mutex_init(&(self->entries[i]->load_lock));
 
                 // finished with this entry
                 free(dir_entries[i]);
@@ -243,6 +247,8 @@ wind_file_cache_free(wind_file_cache_t *cache)
                 for(i=0; i<cache->n_entries; ++i)
                 {
                         free(cache->entries[i]->filepath);
+                        wind_file_free(cache->entries[i]->loaded_file);
+                        g_mutex_clear(&(cache->entries[i]->load_lock));
                         free(cache->entries[i]);
                         cache->entries[i] = NULL;
                 }
@@ -338,19 +344,144 @@ wind_file_t*
 wind_file_cache_entry_file(wind_file_cache_entry_t *entry)
 {
         const char* filepath;
+        wind_file_t* file;
 
         if(!entry)
                 return NULL;
 
-        if(entry->loaded_file)
-                return entry->loaded_file;
+        // Several ensemble workers may ask for the same file at once. Only
+        // one of them should load it.
+        g_mutex_lock(&(entry->load_lock));
 
-        filepath = wind_file_cache_entry_file_path(entry);
-        if(!filepath)
-                return NULL;
+        if(!entry->loaded_file)
+        {
+                filepath = wind_file_cache_entry_file_path(entry);
+                if(filepath)
+                        entry->loaded_file = wind_file_new(filepath);
+        }
+        file = entry->loaded_file;
+
+        g_mutex_unlock(&(entry->load_lock));
+
+        return file;
+}
+
+unsigned long
+wind_file_cache_next_timestamp(wind_file_cache_t *cache, unsigned long timestamp)
+{
+        unsigned long next = 0;
+        unsigned int i;
+
+        assert(cache);
+
+        for(i=0; i<cache->n_entries; ++i)
+        {
+                unsigned long entry_timestamp = cache->entries[i]->timestamp;
+
+                if((entry_timestamp > timestamp) && (!next || (entry_timestamp < next)))
+                        next = entry_timestamp;
+        }
+
+        return next;
+}
+
+// Return non-zero if the window of entry a covers all of that of entry b.
+static int
+_window_covers(const wind_file_cache_entry_t* a, const wind_file_cache_entry_t* b)
+{
+        if(fabs(a->lat - b->lat) + b->latrad > a->latrad)
+                return 0;
+
+        if(_lon_dist(a->lon, b->lon) + b->lonrad > a->lonrad)
+                return 0;
+
+        return 1;
+}
+
+void
+wind_file_cache_release_before(wind_file_cache_t *cache, unsigned long timestamp)
+{
+        unsigned int i, j;
+
+        assert(cache);
+
+        for(i=0; i<cache->n_entries; ++i)
+        {
+                wind_file_cache_entry_t* entry = cache->entries[i];
+
+                if(!entry->loaded_file)
+                        continue;
+
+                // wind_file_cache_find_entry() prefers the latest earlier
+                // entry containing a point so a later one covering all of
+                // this entry's window supersedes it.
+                for(j=0; j<cache->n_entries; ++j)
+                {
+                        wind_file_cache_entry_t* later = cache->entries[j];
+
+                        if((later->timestamp > entry->timestamp) &&
+                           (later->timestamp <= timestamp) &&
+                           _window_covers(later, entry))
+                                break;
+                }
+
+                if(j == cache->n_entries)
+                        continue;
+
+                if(verbosity > 0)
+                        fprintf(stderr, "INFO: Releasing wind data from '%s'.\n", 
+                                        entry->filepath);
+
+                wind_file_free(entry->loaded_file);
+                entry->loaded_file = NULL;
+        }
+}
+
+// Fold size bytes at data into the 64 bit FNV-1a hash.
+static unsigned long long
+_hash(unsigned long long hash, const void* data, size_t size)
+{
+        const unsigned char* bytes = (const unsigned char*)data;
+        size_t i;
+
+        for(i=0; i<size; ++i)
+                hash = (hash ^ bytes[i]) * 1099511628211ULL;
+
+        return hash;
+}
+
+unsigned long long
+wind_file_cache_get_key(wind_file_cache_t *cache)
+{
+        unsigned long long hash = 14695981039346656037ULL;
+        unsigned int i;
+
+        assert(cache);
+
+        for(i=0; i<cache->n_entries; ++i)
+        {
+                const wind_file_cache_entry_t* entry = cache->entries[i];
+                const char* name = strrchr(entry->filepath, '/');
+                long long size = -1, mtime = 0;
+                struct stat info;
+
+                if(stat(entry->filepath, &info) == 0) {
+                        size = info.st_size;
+                        mtime = info.st_mtime;
+                }
+
+                name = name ? name + 1 : entry->filepath;
+                hash = _hash(hash, name, strlen(name) + 1);
+                hash = _hash(hash, &entry->timestamp, sizeof(entry->timestamp));
+                hash = _hash(hash, &entry->lat, sizeof(entry->lat));
+                hash = _hash(hash, &entry->latrad, sizeof(entry->latrad));
+                hash = _hash(hash, &entry->lon, sizeof(entry->lon));
+                hash = _hash(hash, &entry->lonrad, sizeof(entry->lonrad));
+                hash = _hash(hash, &size, sizeof(size));
+                hash = _hash(hash, &mtime, sizeof(mtime));
+        }
 
-        entry->loaded_file = wind_file_new(filepath);
-        return entry->loaded_file;
+        return hash;
 }
 
 // Data for God's own editor.
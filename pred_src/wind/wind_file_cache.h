@@ -65,10 +65,34 @@ unsigned int            wind_file_cache_entry_timestamp
                                                (wind_file_cache_entry_t  *entry);
 
 //                      Return the file for of the specified cache entry loading it if 
-//                      necessary.
+//                      necessary. This may be called from multiple threads.
 wind_file_t*            wind_file_cache_entry_file
                                                (wind_file_cache_entry_t  *entry);
 
+//                      Return the earliest timestamp of any entry which is later than
+//                      'timestamp' or 0 if there is none. The wind changes direction
+//                      in time at these.
+unsigned long           wind_file_cache_next_timestamp
+                                               (wind_file_cache_t        *cache,
+                                                unsigned long             timestamp);
+
+//                      Free the loaded files of entries which will never be found for
+//                      a time at or after 'timestamp' since a later entry covering the
+//                      same window is no later than it. Such files are loaded again if
+//                      they are asked for. This must not be called while other threads
+//                      are using the cache.
+void                    wind_file_cache_release_before
+                                               (wind_file_cache_t        *cache,
+                                                unsigned long             timestamp);
+
+//                      Return a key which identifies the wind data in the cache: a hash
+//                      of the name, timestamp and window of each file and of its size and
+//                      modification time. Anything built from the wind data can be
+//                      checked against it. Copying the data without keeping the
+//                      modification times changes the key.
+unsigned long long      wind_file_cache_get_key
+                                               (wind_file_cache_t        *cache);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -0,0 +1,103 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+// Interpolating the wind at a point whose co-ordinates are dual numbers.
+//
+// The cell, the pressure levels and the normalised co-ordinates within the
+// cell are found by the scalar cursor code in wind_file.c, so the value of
+// the result is the wind wind_file_get_wind() interpolates there, to within
+// the rounding of its single precision arithmetic. Only the blends are done
+// here, in dual numbers.
+
+#include "wind_file_dual.h"
+#include "wind_file_private.h"
+
+#include <assert.h>
+
+// The values of the given component at the four corners of the cursor's
+// cell at the given pressure level blended with the dual weights lambda1
+// across latitude and lambda2 across longitude.
+static dual_t
+_bilinear_interpolate_dual(wind_file_t* file, const wind_file_cursor_t* cursor,
+                unsigned int pressure_idx, unsigned int component, 
+                dual_t lambda1, dual_t lambda2)
+{
+        float ll = wind_file_get_record(file, cursor->left_lat_idx, 
+                        cursor->left_lon_idx, pressure_idx)[component];
+        float lr = wind_file_get_record(file, cursor->left_lat_idx, 
+                        cursor->right_lon_idx, pressure_idx)[component];
+        float rl = wind_file_get_record(file, cursor->right_lat_idx, 
+                        cursor->left_lon_idx, pressure_idx)[component];
+        float rr = wind_file_get_record(file, cursor->right_lat_idx, 
+                        cursor->right_lon_idx, pressure_idx)[component];
+        dual_t il = dual_lerp(dual_constant(ll), dual_constant(rl), lambda1);
+        dual_t ir = dual_lerp(dual_constant(lr), dual_constant(rr), lambda1);
+
+        return dual_lerp(il, ir, lambda2);
+}
+
+void
+wind_file_get_wind_dual(wind_file_t* file, wind_file_cursor_t* cursor,
+                const dual_t* lat, const dual_t* lon, const dual_t* height, 
+                dual_t* windu, dual_t* windv)
+{
+        float canonical_lon, lat_value, lon_value, left_height, right_height;
+        double dlat_lambda, dlon_lambda;
+        dual_t lat_lambda, lon_lambda, pr_lambda;
+        unsigned int k;
+
+        assert(file && cursor);
+        assert(windu && windv);
+
+        canonical_lon = wind_file_canonicalise_longitude(lon->x);
+
+        *windu = *windv = dual_constant(0.0);
+
+        if(!wind_file_cursor_find_cell(file, cursor, lat->x, canonical_lon))
+                return;
+
+        wind_file_cursor_get_lambdas(cursor, lat->x, canonical_lon, 
+                        &lat_value, &lon_value, &dlat_lambda, &dlon_lambda);
+        lat_lambda = dual_chain(*lat, lat_value, dlat_lambda);
+        lon_lambda = dual_chain(*lon, lon_value, dlon_lambda);
+
+        if(!wind_file_cursor_find_level(file, cursor, lat_value, lon_value, height->x,
+                                &left_height, &right_height))
+                return;
+
+        // The heights of the pressure levels vary over the cell so the
+        // normalised pressure co-ordinate depends on the position as well as
+        // the height. Where it is clamped it does not vary.
+        pr_lambda = dual_constant(0.5);
+        if(cursor->left_pr_idx != cursor->right_pr_idx) {
+                dual_t left = _bilinear_interpolate_dual(file, cursor, 
+                                cursor->left_pr_idx, 0, lat_lambda, lon_lambda);
+                dual_t right = _bilinear_interpolate_dual(file, cursor, 
+                                cursor->right_pr_idx, 0, lat_lambda, lon_lambda);
+
+                pr_lambda = dual_div(dual_sub(*height, left), dual_sub(right, left));
+        }
+
+        if((pr_lambda.x < 0.0) || (pr_lambda.x > 1.0))
+                pr_lambda = dual_constant((pr_lambda.x < 0.0) ? 0.0 : 1.0);
+
+        // The u and v components follow the height in each record.
+        for(k=1; k<=2; ++k) {
+                dual_t low = _bilinear_interpolate_dual(file, cursor, 
+                                cursor->left_pr_idx, k, lat_lambda, lon_lambda);
+                dual_t high = _bilinear_interpolate_dual(file, cursor, 
+                                cursor->right_pr_idx, k, lat_lambda, lon_lambda);
+
+                *((k == 1) ? windu : windv) = dual_lerp(low, high, pr_lambda);
+        }
+}
+
+// Data for God's own editor.
+// vim:sw=8:ts=8:et:cindent
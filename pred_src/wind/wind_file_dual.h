@@ -0,0 +1,40 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+#ifndef __WIND_FILE_DUAL_H__
+#define __WIND_FILE_DUAL_H__
+
+#include "wind_file.h"
+#include "../util/dual.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+//                      As wind_file_get_wind() without the variances for a point whose
+//                      co-ordinates are dual numbers. The wind is differentiated with
+//                      respect to whatever the co-ordinates are. 'cursor' must not be
+//                      NULL.
+void                    wind_file_get_wind_dual(wind_file_t        *file, 
+                                                wind_file_cursor_t *cursor,
+                                                const dual_t       *lat,
+                                                const dual_t       *lon,
+                                                const dual_t       *height, 
+                                                dual_t             *windu,
+                                                dual_t             *windv);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // __WIND_FILE_DUAL_H__
+
+// Data for God's own editor.
+// vim:sw=8:ts=8:et:cindent
@@ -0,0 +1,98 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// Written by Rich Wareham <rjw57@cam.ac.uk>
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY 
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+#ifndef __WIND_FILE_PRIVATE_H__
+#define __WIND_FILE_PRIVATE_H__
+
+// The innards of wind_file_t shared between the scalar and batched
+// interpolation code. Nothing outside of the wind directory should include
+// this.
+
+#include "wind_file.h"
+
+typedef struct wind_file_axis_s wind_file_axis_t;
+struct wind_file_axis_s 
+{
+        unsigned int            n_values;
+
+        //                      in actual fact, enough space is allocated for all values.
+        float                   values[1];
+};
+
+struct wind_file_s
+{
+        //                      This is from the file header.
+        float                   lat, latrad;
+        float                   lon, lonrad;
+        unsigned long           timestamp;
+
+        //                      This describes the axes.
+        unsigned int            n_axes;
+        wind_file_axis_t      **axes;
+
+        unsigned int            n_components;
+
+        //                      A pointer to the actual data.
+        float                  *data;
+};
+
+//                      Canonicalise a longitude into the range (0, 360].
+float                   wind_file_canonicalise_longitude
+                                               (float               lon);
+
+//                      Return a pointer to the n_components values of the specified record.
+float*                  wind_file_get_record   (wind_file_t        *file,
+                                                unsigned int        lat_idx,
+                                                unsigned int        lon_idx,
+                                                unsigned int        pressure_idx);
+
+//                      Make sure 'cursor' refers to the lat/lon cell containing the
+//                      (canonical) longitude 'lon' and latitude 'lat', searching the axes
+//                      only if the point has left the cell. Returns non-zero on success.
+int                     wind_file_cursor_find_cell
+                                               (wind_file_t        *file,
+                                                wind_file_cursor_t *cursor,
+                                                float               lat,
+                                                float               lon);
+
+//                      Find the normalised position (lat_lambda, lon_lambda), each
+//                      between 0 and 1, of the (canonical) longitude 'lon' and latitude
+//                      'lat' within the cursor's lat/lon cell and the derivatives of each
+//                      with respect to the latitude and longitude. They are 0.5 for a cell
+//                      of zero size and clamped to the cell, and then do not vary.
+void                    wind_file_cursor_get_lambdas
+                                               (const wind_file_cursor_t *cursor,
+                                                float               lat,
+                                                float               lon,
+                                                float              *lat_lambda,
+                                                float              *lon_lambda,
+                                                double             *dlat_lambda,
+                                                double             *dlon_lambda);
+
+//                      Make sure 'cursor' refers to the pressure levels straddling
+//                      'height' at the normalised position (lat_lambda, lon_lambda)
+//                      within its lat/lon cell. The interpolated heights of the two
+//                      levels are stored in *left_height and *right_height. Returns
+//                      non-zero on success.
+int                     wind_file_cursor_find_level
+                                               (wind_file_t        *file,
+                                                wind_file_cursor_t *cursor,
+                                                float               lat_lambda,
+                                                float               lon_lambda,
+                                                float               height,
+                                                float              *left_height,
+                                                float              *right_height);
+
+#endif // __WIND_FILE_PRIVATE_H__
+
+// Data for God's own editor.
+// vim:sw=8:ts=8:et:cindent
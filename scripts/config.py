@@ -7,6 +7,7 @@ CUSF_PYTHON_PATH = '/societies/cuspaceflight/python-packages/'
 HOURLY_PREDICTIONS = os.path.join(CUSF_HOME, 'public_html/hourly-predictions')
 LAND_PRED_APP = os.path.join(CUSF_HOME, 'git/cusf-landing-prediction/pred_src/pred')
 LAND_PRED_DATA = os.path.join(CUSF_HOME, 'landing-prediction-data/gfs/')
+LAND_PRED_SURFACE = os.path.join(CUSF_HOME, 'landing-prediction-data/surface.bin')
 
 # vim:sw=4:ts=4:et:autoindent
 
@@ -12,6 +12,10 @@ fi
 # The get data script itself
 GETDATA=${ROOT}/git/cusf-landing-prediction/pydap/get_wind_data.py
 
+# The predictor, which builds the response surface the web predictor answers
+# from.
+PRED=${ROOT}/git/cusf-landing-prediction/pred_src/pred
+
 # Where to run the script
 WORKINGDIR=${ROOT}/landing-prediction-data/
 
@@ -48,3 +52,49 @@ ${GETDATA} --lat=52 --lon=0 --latdelta=10 --londelta=10 -v -f 180 2>${LOGFILE}
 # Delete any data that hasn't been changed for 3 days. This stops us filling
 # the CUSF quota with old atmosphere data.
 find ${GFSDIR} -mtime 3 -name 'gfs*' | xargs rm -f
+
+# Rebuild the response surface for the wind data as it now is. A surface is
+# keyed to the wind data it was flown in and the predictor ignores one built
+# for other data, so without this every web prediction would be flown in
+# full. The surface covers the next twelve hours of launches from Cambridge.
+# It is built aside and moved into place so that the predictor never reads
+# half of one.
+SURFACE=${WORKINGDIR}/surface.bin
+SURFACEINI=${WORKINGDIR}/surface.ini
+cat > ${SURFACEINI} <<EOF
+[launch-site]
+    latitude        = 52.2135
+    longitude       = 0.0964
+    altitude        = 0
+
+[launch-time]
+    year            = `date -u +%Y`
+    month           = `date -u +%-m`
+    day             = `date -u +%-d`
+    hour            = `date -u +%-H`
+    minute          = 0
+    second          = 0
+
+[atmosphere]
+    wind-error      = 0
+
+[altitude-model]
+    ascent-rate     = 3
+    descent-rate    = 5
+    burst-altitude  = 30000
+
+[surface]
+    ascent-rate     = 2:6:1
+    burst-altitude  = 20000:35000:2500
+    descent-rate    = 3:7:1
+    launch-time     = 0:43200:1800
+    filename        = ${SURFACE}.new
+EOF
+
+if [ -x ${PRED} ] && ${PRED} -i ${GFSDIR} ${SURFACEINI} >/dev/null 2>>${LOGFILE}; then
+	mv ${SURFACE}.new ${SURFACE}
+else
+	echo "$0: Could not build the response surface, see ${LOGFILE}."
+	rm -f ${SURFACE}.new ${SURFACE}
+fi
+rm -f ${SURFACEINI}
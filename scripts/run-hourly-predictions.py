@@ -8,7 +8,7 @@ import config, site
 # Add our local packages to the path
 site.addsitedir(config.CUSF_PYTHON_PATH)
 
-import logging, glob, os, time, datetime, uuid, subprocess, demjson
+import logging, glob, os, time, datetime, calendar, uuid, subprocess, demjson
 import shutil, traceback
 
 logging.basicConfig(level = logging.INFO)
@@ -47,111 +47,163 @@ def relpath(target, base=os.curdir):
     rel_list = [os.pardir] * (len(base_list)-i) + target_list[i:]
     return os.path.join(*rel_list)
 
-def last_line_of(filename):
-    file = open(filename, 'r')
-    last_line = ''
-    for line in file:
-        last_line = line
-    return last_line.strip()
+def time_dict(when):
+    return {
+            'year': when.year,
+            'month': when.month,
+            'day': when.day,
+            'hour': when.hour,
+            'minute': when.minute,
+            'second': when.second,
+        }
 
-def run_prediction(prediction_time, predictions_dir, scenario_template):
-    # Create a UUID for the prediction
-    pred_uuid = uuid.uuid4()
+def scenario_to_ini(scenario):
+    scenarioINI = []
+    for cattitle, catcontents in scenario.iteritems():
+        scenarioINI.append('[%s]' % cattitle)
+        for key, value in catcontents.iteritems():
+            scenarioINI.append('%s = %s' % (key, value))
+    return '\n'.join(scenarioINI) + '\n'
+
+def manifest_entry(prediction_time, track):
+    """
+    Return the manifest entry of a prediction launched at prediction_time whose
+    track is the list of lines track. The last line of the track is the landing.
+    """
+
+    last_output = track[-1]
+    logging.info('Final line of output for %s: %s' % (prediction_time.ctime(), last_output))
 
-    # Create a directory for the predicition result.
+    (final_timestamp, latitude, longitude, alt) = map(lambda x: float(x), last_output.split(','))
+    final_timestamp = int(final_timestamp)
+
+    logging.info('Parsed as ts=%s, lat=%s, lon=%s, alt=%s' %
+        (final_timestamp, latitude, longitude, alt))
+    final_time = datetime.datetime.utcfromtimestamp(final_timestamp)
+
+    return {
+        'landing-location': {
+            'latitude': latitude,
+            'longitude': longitude,
+            'altitude': alt,
+        },
+        'landing-time': time_dict(final_time),
+        'launch-time': time_dict(prediction_time),
+    }
+
+def run_prediction(prediction_time, predictions_dir, scenario_template, record):
+    """
+    Run a prediction for a launch at prediction_time on its own and pass its
+    uuid and manifest entry to record.
+    """
+
+    # Create a UUID and directory for the prediction result.
+    pred_uuid = uuid.uuid4()
     pred_root = os.path.join(predictions_dir, str(pred_uuid))
     os.mkdir(pred_root)
 
     scenario = demjson.decode(scenario_template)
-    scenario['launch-time'] = {
-            'year': prediction_time.year,
-            'month': prediction_time.month,
-            'day': prediction_time.day,
-            'hour': prediction_time.hour,
-            'minute': prediction_time.minute,
-            'second': prediction_time.second,
-        }
+    scenario['launch-time'] = time_dict(prediction_time)
 
     logging.debug('Using scenario:')
     logging.debug(scenario)
 
-    # Convert the scenario to an INI
-    scenarioINI = []
-    for cattitle, catcontents in scenario.iteritems():
-        scenarioINI.append('[%s]' % cattitle)
-        for key, value in catcontents.iteritems():
-            scenarioINI.append('%s = %s' % (key, value))
-    scenarioINI = '\n'.join(scenarioINI)
+    scenario_filename = os.path.join(pred_root, 'scenario.ini')
+    open(scenario_filename, 'w').write(scenario_to_ini(scenario))
+    open(os.path.join(pred_root, 'scenario.json'), 'w').write(demjson.encode(scenario))
 
-    logging.debug('Scenario INI:')
-    logging.debug(scenarioINI)
+    output_filename = os.path.join(pred_root, 'output.csv')
+    output_file = open(output_filename, 'w')
+    logging_file = open(os.path.join(pred_root, 'log.txt'), 'w')
+    pred_process = subprocess.Popen( \
+        (config.LAND_PRED_APP, '-v', '-i', config.LAND_PRED_DATA, scenario_filename),
+        stdout=output_file, stderr=logging_file)
+    pred_process.wait()
+    output_file.close()
+    logging_file.close()
+    if pred_process.returncode:
+        raise RuntimeError('Prediction process %s returned error code: %s.' % (pred_uuid, pred_process.returncode))
 
-    # Write scenario
-    scenario_filename = os.path.join(pred_root, 'scenario.ini')
-    scenario_file = open(scenario_filename, 'w')
-    scenario_file.write(scenarioINI + '\n')
-    scenario_file.close()
+    track = [line.strip() for line in open(output_filename, 'r') if line.strip()]
+    record(str(pred_uuid), manifest_entry(prediction_time, track))
+
+def run_predictions(first_time, last_time, interval, predictions_dir, scenario_template, record):
+    """
+    Run predictions for launches every interval seconds from first_time to last_time
+    inclusive. They are all flown by one run of the prediction application
+    which writes a table of where each landed and their tracks. Each is then
+    written to its own directory as if it had been run on its own, sharing
+    the run's log, and its uuid and manifest entry passed to record as soon
+    as it is. A launch which did not land is skipped.
+    """
+
+    scenario = demjson.decode(scenario_template)
 
-    scenario_json_filename = os.path.join(pred_root, 'scenario.json')
-    scenario_json_file = open(scenario_json_filename, 'w')
-    scenario_json_file.write(demjson.encode(scenario))
-    scenario_json_file.close()
+    logging.debug('Using scenario:')
+    logging.debug(scenario)
+
+    window_root = os.path.join(predictions_dir, 'window')
+    os.mkdir(window_root)
+
+    scenario_filename = os.path.join(window_root, 'scenario.ini')
+    open(scenario_filename, 'w').write(scenario_to_ini(scenario))
 
     # Where is the prediction app?
     pred_app = config.LAND_PRED_APP
 
     logging.info('Launching prediction application...')
 
-    # Try to wire everything up
-    output_filename = os.path.join(pred_root, 'output.csv')
-    output_file = open(output_filename, 'w')
-    logging_filename = os.path.join(pred_root, 'log.txt')
+    first_stamp = calendar.timegm(first_time.utctimetuple())
+    last_stamp = calendar.timegm(last_time.utctimetuple())
+
+    table_filename = os.path.join(window_root, 'table.csv')
+    table_file = open(table_filename, 'w')
+    tracks_filename = os.path.join(window_root, 'tracks.csv')
+    logging_filename = os.path.join(window_root, 'log.txt')
     logging_file = open(logging_filename, 'w')
     pred_process = subprocess.Popen( \
-        (pred_app, '-v', '-i', config.LAND_PRED_DATA, scenario_filename),
-        stdout=output_file, stderr=logging_file)
+        (pred_app, '-v', '-i', config.LAND_PRED_DATA,
+         '-t', str(first_stamp), '-w', '%i:%i' % (last_stamp, interval),
+         '-T', tracks_filename, scenario_filename),
+        stdout=table_file, stderr=logging_file)
     pred_process.wait()
-    if pred_process.returncode:
-        raise RuntimeError('Prediction process %s returned error code: %s.' % (pred_uuid, pred_process.returncode))
-    output_file.close()
+    table_file.close()
     logging_file.close()
+    if pred_process.returncode:
+        raise RuntimeError('Prediction process returned error code: %s.' % pred_process.returncode)
 
-    # Find the last line of the output
-    last_output = last_line_of(output_filename)
-    logging.info('Final line of output: %s' % last_output)
+    # Split the tracks by launch
+    tracks = { }
+    for line in open(tracks_filename, 'r'):
+        (index, entry) = line.strip().split(',', 1)
+        tracks.setdefault(int(index), []).append(entry)
 
-    (final_timestamp, latitude, longitude, alt) = map(lambda x: float(x), last_output.split(','))
-    final_timestamp = int(final_timestamp)
+    for line in open(table_filename, 'r'):
+        fields = line.strip().split(',')
+        index = int(fields[0])
+        prediction_time = first_time + datetime.timedelta(seconds = float(fields[5]))
 
-    logging.info('Parsed as ts=%s, lat=%s, lon=%s, alt=%s' %
-        (final_timestamp, latitude, longitude, alt))
-    final_time = datetime.datetime.utcfromtimestamp(final_timestamp)
+        # A launch some of whose members left the wind data has no landing.
+        if int(fields[7]) < int(fields[6]) or index not in tracks:
+            logging.warning('The launch at %s did not land.' % prediction_time.ctime())
+            continue
 
-    manifest_entry = {
-        'landing-location': {
-            'latitude': latitude,
-            'longitude': longitude,
-            'altitude': alt,
-        },
-        'landing-time': {
-            'year': final_time.year,
-            'month': final_time.month,
-            'day': final_time.day,
-            'hour': final_time.hour,
-            'minute': final_time.minute,
-            'second': final_time.second,
-        },
-        'launch-time': {
-            'year': prediction_time.year,
-            'month': prediction_time.month,
-            'day': prediction_time.day,
-            'hour': prediction_time.hour,
-            'minute': prediction_time.minute,
-            'second': prediction_time.second,
-        },
-    }
+        try:
+            # Create a UUID and directory for the prediction result.
+            pred_uuid = uuid.uuid4()
+            pred_root = os.path.join(predictions_dir, str(pred_uuid))
+            os.mkdir(pred_root)
 
-    return (str(pred_uuid), manifest_entry)
+            scenario['launch-time'] = time_dict(prediction_time)
+
+            open(os.path.join(pred_root, 'scenario.ini'), 'w').write(scenario_to_ini(scenario))
+            open(os.path.join(pred_root, 'scenario.json'), 'w').write(demjson.encode(scenario))
+            open(os.path.join(pred_root, 'output.csv'), 'w').write('\n'.join(tracks[index]) + '\n')
+            os.symlink(relpath(logging_filename, pred_root), os.path.join(pred_root, 'log.txt'))
+
+            record(str(pred_uuid), manifest_entry(prediction_time, tracks[index]))
+        except Exception:
+            traceback.print_exc()
 
 def next_non_comment_line(file):
     line = file.readline()
@@ -200,24 +252,42 @@ def main():
     manifest['scenario-template'] = demjson.decode(scenario_template)
     manifest['predictions'] = { }
 
-    while predict_time < end_time:
-        if predict_time >= start_time:
-            try:
-                logging.info('Run prediction for %s.' % predict_time.ctime())
-                (uuid, entry) = run_prediction(predict_time, pred_root, scenario_template)
-
-                # Record in manifest
-                manifest['predictions'][uuid] = entry
-                open(manifest_filename, 'w').write(demjson.encode(manifest))
-
-                logging.info('Prediction finished. Sleeping to save CPU...')
-                
-                # Sleep so we don't use massive amounts of CPU
-                # time.sleep(2)
-            except Exception:
-                traceback.print_exc()
-
+    # Predict for every hour boundary from now until the end of the data
+    if predict_time < start_time:
         predict_time += one_hour
+    last_time = predict_time
+    while last_time + one_hour < end_time:
+        last_time += one_hour
+
+    if predict_time >= end_time:
+        logging.info('No data to predict with.')
+        return
+
+    # Record each prediction in the manifest as soon as it is made.
+    predicted = set()
+    def record(uuid, entry):
+        manifest['predictions'][uuid] = entry
+        open(manifest_filename, 'w').write(demjson.encode(manifest))
+        predicted.add(calendar.timegm(datetime.datetime(**entry['launch-time']).utctimetuple()))
+
+    try:
+        logging.info('Run predictions from %s to %s.' % (predict_time.ctime(), last_time.ctime()))
+        run_predictions(predict_time, last_time, 3600, pred_root, scenario_template, record)
+        logging.info('Predictions finished.')
+    except Exception:
+        traceback.print_exc()
+
+        # Fly every hour the window did not predict on its own so that one
+        # bad launch does not lose the rest.
+        logging.info('Window failed, running each hour on its own.')
+        while predict_time <= last_time:
+            if calendar.timegm(predict_time.utctimetuple()) not in predicted:
+                try:
+                    logging.info('Run prediction for %s.' % predict_time.ctime())
+                    run_prediction(predict_time, pred_root, scenario_template, record)
+                except Exception:
+                    traceback.print_exc()
+            predict_time += one_hour
 
 if(__name__ == '__main__'):
     main()
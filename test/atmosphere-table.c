@@ -0,0 +1,68 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY 
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+// Check the generated density table against the atmosphere model.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "atmosphere.h"
+
+#define TEST_STEP 0.25f                 // m
+#define MAX_RELATIVE_ERROR 1e-5
+
+int main(int argc, const char *argv[])
+{
+    float altitude[64], density[64];
+    double max_error = 0.0, worst_altitude = 0.0;
+    unsigned int i, n = 0;
+    float z;
+
+    for(z = 0.f; z <= ATMOSPHERE_TABLE_TOP; z += TEST_STEP)
+    {
+        altitude[n++] = z;
+        if((n < 64) && (z + TEST_STEP <= ATMOSPHERE_TABLE_TOP))
+            continue;
+
+        // check the batch and scalar accessors agree too
+        atmosphere_get_density_batch(n, altitude, density);
+
+        for(i=0; i<n; ++i)
+        {
+            double exact = atmosphere_get_density_exact(altitude[i]);
+            double error = fabs(density[i] - exact) / exact;
+
+            if(density[i] != atmosphere_get_density(altitude[i])) {
+                fprintf(stderr, "ERROR: batch and scalar density differ at %fm.\n",
+                        altitude[i]);
+                return 1;
+            }
+
+            if(error > max_error) {
+                max_error = error;
+                worst_altitude = altitude[i];
+            }
+        }
+        n = 0;
+    }
+
+    printf("density table: largest relative error %.2e at %.0fm.\n", 
+           max_error, worst_altitude);
+
+    if(max_error > MAX_RELATIVE_ERROR) {
+        fprintf(stderr, "ERROR: density table differs from the atmosphere model.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+// vim:sw=4:ts=4:et:cindent
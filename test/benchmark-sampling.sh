@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Compare how quickly the mean landing point of random and sobol ensembles
+# converges with the number of members. For each size the ensemble is run
+# with several seeds and the spread (RMS distance from their average) of the
+# mean landing points is printed. Sobol ensembles should need several times
+# fewer members for the same spread.
+#
+# Usage: benchmark-sampling.sh [seeds] [wind error (m/s)]
+
+PRED=../pred_src/pred
+SEEDS=${1:-8}
+WIND_ERROR=${2:-2}
+
+# Print the mean landing latitude and longitude of the last $2 members in
+# file $1.
+mean_landing() {
+	tail -n $2 $1 | \
+		awk -F, '{ lat += $2; lng += $3 } END { printf("%.8f %.8f\n", lat / NR, lng / NR) }'
+}
+
+echo "Spread of the ensemble mean landing over $SEEDS seeds."
+
+for sampling in random sobol; do
+	members=8
+	while [ $members -le 256 ]; do
+		seed=1
+		while [ $seed -le $SEEDS ]; do
+			$PRED -i gfs -n $members -s $seed -e $WIND_ERROR -S $sampling \
+				scenario-2.ini > benchmark-sampling.csv 2> /dev/null || exit 1
+			mean_landing benchmark-sampling.csv $members
+			seed=`expr $seed + 1`
+		done | awk -v sampling=$sampling -v members=$members '{
+			lat[NR] = $1; lng[NR] = $2; mlat += $1; mlng += $2
+		} END {
+			mlat /= NR; mlng /= NR;
+			for(i=1; i<=NR; ++i) {
+				dlat = (lat[i] - mlat) * 111198.92345;
+				dlng = (lng[i] - mlng) * 111198.92345 * cos(mlat * 0.0174532925);
+				ss += dlat * dlat + dlng * dlng;
+			}
+			printf("%6s %4i members: %8.1fm\n", sampling, members, sqrt(ss / NR));
+		}'
+		members=`expr $members \* 2`
+	done
+done
+
+rm -f benchmark-sampling.csv
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Time an ensemble prediction using 1 to N worker threads and check that
+# every thread count gives exactly the same output.
+#
+# Usage: benchmark-threads.sh [max threads] [members]
+
+PRED=../pred_src/pred
+MAX_THREADS=${1:-`getconf _NPROCESSORS_ONLN`}
+MEMBERS=${2:-256}
+
+echo "Ensemble of $MEMBERS members, 1 to $MAX_THREADS threads."
+
+threads=1
+while [ $threads -le $MAX_THREADS ]; do
+	start=`date +%s.%N`
+	$PRED -v -i gfs -n $MEMBERS -s 1 -j $threads scenario-2.ini \
+		> benchmark-$threads.csv 2> benchmark-$threads.log || exit 1
+	end=`date +%s.%N`
+
+	rate=`sed -n 's/^INFO: Advanced.*(\([0-9]*\) per second).*/\1/p' benchmark-$threads.log`
+	echo "$threads $start $end $rate" | \
+		awk '{ printf("%3i threads: %8.3fs %12i member timesteps/s\n", $1, $3 - $2, $4) }'
+
+	if ! cmp -s benchmark-1.csv benchmark-$threads.csv; then
+		echo "ERROR: output with $threads threads differs from 1 thread."
+		exit 1
+	fi
+
+	threads=`expr $threads + 1`
+done
+
+rm -f benchmark-*.csv benchmark-*.log
@@ -0,0 +1,76 @@
+#!/bin/sh
+#
+# Check the landings looked up in the descent map of scenario-11.ini against
+# descents flown from each burst in descent-bursts.csv, that bursts off the
+# map are flown, that bursts next to invalid burst points are flown and that
+# a map flown in other wind data is refused.
+#
+# Usage: check-descent-map.sh [max distance (m)] [max time difference (s)]
+
+PRED=../pred_src/pred
+MAX_DISTANCE=${1:-300}
+MAX_TIME=${2:-15}
+
+$PRED -i gfs -j 1 scenario-11.ini > /dev/null || exit 1
+$PRED -i gfs -Q descent-map-1.bin < descent-bursts.csv > descent-lookup.csv || exit 1
+
+grep -v '^#' descent-bursts.csv | while IFS=, read timestamp lat lng alt; do
+	printf "[launch-site]\nlatitude = %s\nlongitude = %s\naltitude = %s\n" \
+		$lat $lng $alt > descent.ini
+	printf "[altitude-model]\ndescent-rate = 5\n" >> descent.ini
+	$PRED -i gfs -d -n 1 -s 0 -t $timestamp descent.ini | tail -n 1 || exit 1
+done > descent-flown.csv
+
+# Check the landings in $1 against the flown ones. The i-th character of $2
+# is 1 if the i-th burst should have been looked up and 0 if flown.
+check() {
+	cat $1 descent-flown.csv | \
+		awk -F, -v max=$MAX_DISTANCE -v max_time=$MAX_TIME -v expected=$2 '
+		NF == 5 { n++; lat[n] = $2; lng[n] = $3; t[n] = $4; looked_up[n] = $5 }
+		NF == 4 { m++; 
+			dn = ($2 - lat[m]) * 111198.92345;
+			de = ($3 - lng[m]) * 111198.92345 * cos($2 * 0.0174532925);
+			d = sqrt(dn * dn + de * de);
+			dt = $1 - t[m];
+			dt = (dt < 0) ? -dt : dt;
+			printf("burst %i: %s %.0fm and %is from the flown landing.\n", 
+				m, looked_up[m] ? "looked up" : "flown", d, dt);
+			if((d > max) || (dt > max_time)) {
+				printf("ERROR: burst %i landed too far from the flown landing.\n", m);
+				exit 1;
+			}
+			if(looked_up[m] != substr(expected, m, 1)) {
+				printf("ERROR: burst %i should have been %s.\n", m, 
+					looked_up[m] ? "flown" : "looked up");
+				exit 1;
+			}
+		}
+		END { if((n != 6) || (m != 6)) { print "ERROR: missing landings."; exit 1 } }'
+}
+
+check descent-lookup.csv 111100 || exit 1
+
+# Mark the burst points of the first time of the map as invalid, as if their
+# descents had left the wind data. The second and fourth bursts are before the
+# second time so must now be flown. The header is 96 bytes.
+set -- `od -A n -t u4 -j 12 -N 20 descent-map-1.bin`
+N_ALTITUDES=$4
+N_VALUES=$(($1 * $2 * $3 * $4))
+head -c $((96 + 4 * N_ALTITUDES)) descent-map-1.bin > descent-invalid.bin
+printf '\000\000\300\177%.0s' `seq $N_VALUES` >> descent-invalid.bin
+tail -c +$((96 + 4 * (N_ALTITUDES + N_VALUES) + 1)) descent-map-1.bin >> descent-invalid.bin
+
+$PRED -i gfs -Q descent-invalid.bin < descent-bursts.csv > descent-lookup.csv || exit 1
+check descent-lookup.csv 101000 || exit 1
+
+# A map flown in other wind data is refused. The wind key is the last 8 bytes
+# of the header.
+head -c 88 descent-map-1.bin > descent-invalid.bin
+printf 'otherkey' >> descent-invalid.bin
+tail -c +97 descent-map-1.bin >> descent-invalid.bin
+if $PRED -i gfs -Q descent-invalid.bin < descent-bursts.csv > /dev/null 2>&1; then
+	echo "ERROR: a descent map with another wind key was read."
+	exit 1
+fi
+
+rm -f descent-lookup.csv descent-flown.csv descent.ini descent-invalid.bin
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# Check that a progressive prediction of scenario-2.ini writes a coarse track
+# which lands near the full prediction, followed by a blank line and then
+# exactly the full prediction in ensemble-1.csv, and that a coarse prediction
+# which runs out of time writes no track.
+#
+# Usage: check-progressive.sh [max distance (m)]
+
+PRED=../pred_src/pred
+MAX_DISTANCE=${1:-2000}
+
+$PRED -i gfs -n 32 -s 42 -j 3 -P 10 scenario-2.ini > progressive.csv || exit 1
+
+sed -e '1,/^$/d' progressive.csv | cmp -s - ensemble-1.csv || {
+	echo "ERROR: the full prediction differs from ensemble-1.csv."
+	exit 1
+}
+
+# The coarse landing is the last line before the blank line and the most
+# likely full landing the first line after the track, at altitude zero.
+sed -e '/^$/q' progressive.csv | grep -v '^$' | tail -n 1 | \
+	cat - ensemble-1.csv | awk -F, -v max=$MAX_DISTANCE '
+	NR == 1 { lat = $2; lng = $3; alt = $4 }
+	NR > 1 && $4 == 0 && !found {
+		found = 1;
+		dn = ($2 - lat) * 111198.92345;
+		de = ($3 - lng) * 111198.92345 * cos($2 * 0.0174532925);
+		d = sqrt(dn * dn + de * de);
+		printf("progressive: coarse landing %.0fm from the full prediction.\n", d);
+		if(alt != 0 || d > max) {
+			printf("ERROR: the coarse prediction did not land near the full one.\n");
+			exit 1;
+		}
+	}
+	END { if(!found) exit 1 }' || exit 1
+
+# A budget of a microsecond runs out in the first block.
+$PRED -i gfs -n 32 -s 42 -j 3 -P 0.000001 scenario-2.ini > progressive.csv 2> /dev/null || exit 1
+printf "\n" | cat - ensemble-1.csv | cmp -s - progressive.csv || {
+	echo "ERROR: a coarse prediction which ran out of time wrote a track."
+	exit 1
+}
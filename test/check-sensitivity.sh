@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# Check the derivatives of the landing found with dual numbers against
+# central differences of the unperturbed landing with each of the ascent
+# rate, burst altitude and descent rate of scenario-2.ini nudged either way.
+# The landing only moves when the landing time crosses a whole timestep so
+# the nudges must be large enough to cross many.
+#
+# Usage: check-sensitivity.sh [max relative error]
+
+PRED=../pred_src/pred
+MAX_ERROR=${1:-0.1}
+
+# Write the sensitivity of scenario-2.ini with key set to value to file $3.
+sensitivity() {
+	sed -e "s/^\( *$1 *=\) *[0-9.]*/\1 $2/" scenario-2.ini > sensitivity.ini
+	$PRED -i gfs -n 1 -J $3 sensitivity.ini > /dev/null || exit 1
+}
+
+sensitivity ascent-rate 3 sensitivity.csv
+
+for nudge in ascent-rate:3:0.02 burst-altitude:30000:200 descent-rate:5:0.05; do
+	key=${nudge%%:*}
+	value=`echo $nudge | cut -d: -f2`
+	step=${nudge##*:}
+
+	sensitivity $key `awk "BEGIN { print $value + $step }"` sensitivity-above.csv
+	sensitivity $key `awk "BEGIN { print $value - $step }"` sensitivity-below.csv
+
+	cat sensitivity.csv sensitivity-above.csv sensitivity-below.csv | \
+		awk -F, -v key=$key -v step=$step -v max=$MAX_ERROR '
+		$1 == key && !found { found = 1; d[1] = $2; d[2] = $3; d[3] = $4 }
+		$1 == "landing" { n++; lat[n] = $2; lng[n] = $3; t[n] = $4 }
+		END {
+			fd[1] = (lat[2] - lat[3]) * 111198.92345 / (2 * step);
+			fd[2] = (lng[2] - lng[3]) * 111198.92345 * cos(lat[1] * 0.0174532925) / (2 * step);
+			fd[3] = (t[2] - t[3]) / (2 * step);
+			scale = sqrt(fd[1] * fd[1] + fd[2] * fd[2]);
+			for(i=1; i<=3; ++i) {
+				e = d[i] - fd[i];
+				e = (e < 0) ? -e : e;
+				if(i < 3) {
+					e /= scale;
+				} else {
+					e /= (fd[i] < 0) ? -fd[i] : fd[i];
+				}
+				if(e > max) {
+					printf("ERROR: %s derivative %i is %g, differences give %g.\n", 
+						key, i, d[i], fd[i]);
+					exit 1;
+				}
+			}
+			printf("%s: north %.1f east %.1f time %.1f per unit, differences %.1f %.1f %.1f.\n", 
+				key, d[1], d[2], d[3], fd[1], fd[2], fd[3]);
+		}' || exit 1
+done
+
+rm -f sensitivity*.csv sensitivity.ini
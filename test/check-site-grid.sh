@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# Check the landing from one cell of the site grid of scenario-8.ini against
+# a separate run of a single launch from the centre of the cell. Both fly the
+# same member in the same wind, so they must be the same.
+#
+# Usage: check-site-grid.sh [cell]
+
+PRED=../pred_src/pred
+CELL=${1:-17}
+
+$PRED -i gfs -j 1 scenario-8.ini > site-grid.csv || exit 1
+
+# The centre of the cell, from the shape of the grid in the raster's header,
+# as site_grid_get_site() finds it.
+SITE=`(od -A n -t u4 -j 16 -N 4 site-grid-1.bin; od -A n -t f8 -j 24 -N 32 site-grid-1.bin) | \
+	tr -s ' \n' '  ' | awk -v cell=$CELL '{
+		printf("%.17g %.17g\n", $2 + (int(cell / $1) + 0.5) * $4, 
+			$3 + (cell % $1 + 0.5) * $5);
+	}'`
+set -- $SITE
+
+# Write scenario-8.ini launched from the site without its grid, as a sweep of
+# one point so that its line is that of the grid's table.
+sed -e "s/^\( *latitude *=\) *[-0-9.]*/\1 $1/" \
+	-e "s/^\( *longitude *=\) *[-0-9.]*/\1 $2/" \
+	-e '/^\[site-grid\]/,$d' scenario-8.ini > site-separate.ini
+printf "[sweep]\n    float-time      = 0\n" >> site-separate.ini
+
+$PRED -i gfs -j 1 site-separate.ini > site-separate.csv || exit 1
+
+sed -n "$((CELL + 1))p" site-grid.csv | cut -d, -f2- > site-grid-cell.csv
+cut -d, -f2- site-separate.csv | cmp -s - site-grid-cell.csv
+if [ $? -ne 0 ]; then
+	echo "ERROR: cell $CELL of the site grid differs from a separate run from $1, $2:"
+	cat site-grid-cell.csv site-separate.csv
+	exit 1
+fi
+
+rm -f site-grid.csv site-separate.ini site-separate.csv site-grid-cell.csv
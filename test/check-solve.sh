@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Check that the solver finds a launch for scenario-9.ini, and for the same
+# search varying the launch time, whose landing it reports within the
+# scenario's tolerance of the target.
+#
+# Usage: check-solve.sh
+
+PRED=../pred_src/pred
+TOLERANCE=`sed -n 's/^ *tolerance *= *\([0-9.]*\).*/\1/p' scenario-9.ini`
+
+check() {
+	$PRED -i gfs -j 1 $1 2> solve-log.txt > /dev/null || exit 1
+	grep 'Solved for the launch' solve-log.txt | \
+		sed -e 's/.*landing \([0-9]*\)m from the target.*/\1/' | \
+		awk -v name=$1 -v tolerance=$TOLERANCE '
+		{ printf("%s: landed %sm from the target.\n", name, $1) }
+		$1 > tolerance {
+			printf("ERROR: %s missed the target by more than %sm.\n", name, tolerance);
+			exit 1;
+		}
+		END { if(NR != 1) { printf("ERROR: %s was not solved.\n", name); exit 1 } }' || exit 1
+}
+
+check scenario-9.ini
+
+# Varying the launch time, to land where the flight launched two hours
+# later lands. The target is only given to about 10m.
+sed -e 's/^\[solve\]/[solve]\n    vary            = time/' \
+	-e 's/^\( *latitude *=\) *52.45 /\1 52.7496 /' \
+	-e 's/^\( *longitude *=\) *2.3 /\1 2.60544 /' \
+	-e 's/^\( *tolerance *=\) *[0-9.]* /\1 20 /' scenario-9.ini > solve-time.ini
+TOLERANCE=20
+check solve-time.ini
+
+rm -f solve-log.txt solve-time.ini
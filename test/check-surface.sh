@@ -0,0 +1,119 @@
+#!/bin/sh
+#
+# Check the landings looked up in the response surface of scenario-12.ini
+# against the same flights flown as a one point sweep from the surface's
+# launch time, so that they draw the same wind perturbations as the surface.
+# Each must be within the estimated error of the flown landing. A flight
+# launched on its own draws its perturbations from its own launch and so
+# differs further by the spread of the ensemble. A flight outside the
+# surface, whose estimated error is too large or which needs an invalid point
+# must be flown in full, as must every flight given a surface flown in other
+# wind data.
+
+PRED=../pred_src/pred
+
+$PRED -i gfs -j 1 scenario-12.ini > /dev/null || exit 1
+
+# Write scenario-12.ini without its surface and with the ascent rate, burst
+# altitude, descent rate and launch hour, minute and second given to
+# surface-query.ini, and as a one point sweep launched the given number of
+# seconds after the surface's launch time to surface-sweep.ini.
+query() {
+	sed -e "s/^\( *ascent-rate *=\) *[0-9.]*/\1 $1/" \
+		-e "s/^\( *burst-altitude *=\) *[0-9.]*/\1 $2/" \
+		-e "s/^\( *descent-rate *=\) *[0-9.]*/\1 $3/" \
+		-e '/^\[surface\]/,$d' scenario-12.ini > surface-sweep.ini
+	sed -e "s/^\( *hour *=\) *[0-9]*/\1 $4/" \
+		-e "s/^\( *minute *=\) *[0-9]*/\1 $5/" \
+		-e "s/^\( *second *=\) *[0-9]*/\1 $6/" surface-sweep.ini > surface-query.ini
+	printf "[sweep]\n    launch-time     = %s\n" $7 >> surface-sweep.ini
+}
+
+# Returns zero if the flight in surface-query.ini is flown in full with the
+# given options.
+flown() {
+	$PRED -i gfs -n 1 "$@" surface-query.ini > surface-lookup.csv 2> /dev/null || exit 1
+	[ `wc -l < surface-lookup.csv` -gt 2 ]
+}
+
+for flight in 3:30000:5:16:50:31:1800 2.5:27000:4.5:16:50:0:1769 \
+	3.7:31500:5.8:17:45:10:5079 2.2:32000:4.1:18:0:0:5969; do
+	query `echo $flight | tr : ' '`
+
+	$PRED -i gfs -n 1 -A surface-1.bin surface-query.ini > surface-lookup.csv \
+		2> surface-log.txt || exit 1
+	$PRED -i gfs -n 1 surface-sweep.ini 2> /dev/null > surface-flown.csv || exit 1
+
+	grep 'response surface' surface-log.txt | sed -e 's/.*error \([0-9]*\)m.*/\1/' | \
+		cat - surface-lookup.csv surface-flown.csv | \
+		awk -F, -v flight=$flight '
+		NR == 1 { error = $1 }
+		NR == 3 { lat = $2; lng = $3 }
+		NR == 4 {
+			dn = ($9 - lat) * 111198.92345;
+			de = ($10 - lng) * 111198.92345 * cos($9 * 0.0174532925);
+			d = sqrt(dn * dn + de * de);
+			printf("%s: looked up %.0fm from the flown landing, estimated %.0fm.\n", 
+				flight, d, error);
+			if(sprintf("%.0f", d) + 0 > error) {
+				printf("ERROR: %s landed further away than estimated.\n", flight);
+				exit 1;
+			}
+		}
+		END { if(NR != 4) { printf("ERROR: %s was not looked up.\n", flight); exit 1 } }' || exit 1
+done
+
+# The last flight's estimated error is more than 100m.
+if ! flown -A surface-1.bin -E 100; then
+	echo "ERROR: a flight whose estimated error was too large was not flown."
+	exit 1
+fi
+
+# An error bound that is not a number is refused.
+for bound in "" 100m; do
+	if $PRED -i gfs -n 1 -A surface-1.bin -E "$bound" surface-query.ini > /dev/null 2>&1; then
+		echo "ERROR: the error bound '$bound' was accepted."
+		exit 1
+	fi
+done
+
+# An ascent rate outside the surface.
+query 5 30000 5 16 20 31 0
+if ! flown -A surface-1.bin; then
+	echo "ERROR: a flight outside the surface was not flown."
+	exit 1
+fi
+
+# Mark the point of the first flight invalid, as if a member had left the
+# wind data. The header is 88 bytes, followed by the 16 values of the
+# parameters, and each point is 7 values with the valid flag last.
+query 3 30000 5 16 50 31 1800
+OFFSET=$((88 + 16 * 4 + 96 * 7 * 4 + 6 * 4))
+head -c $OFFSET surface-1.bin > surface-invalid.bin
+printf '\000\000\000\000' >> surface-invalid.bin
+tail -c +$((OFFSET + 5)) surface-1.bin >> surface-invalid.bin
+if ! flown -A surface-invalid.bin; then
+	echo "ERROR: a flight needing an invalid point of the surface was not flown."
+	exit 1
+fi
+
+# A surface flown in other wind data is ignored with a warning and the flight
+# flown in full, as is one which cannot be read. The wind key is the last 8
+# bytes of the header.
+head -c 80 surface-1.bin > surface-invalid.bin
+printf 'otherkey' >> surface-invalid.bin
+tail -c +89 surface-1.bin >> surface-invalid.bin
+for stale in surface-invalid.bin surface-missing.bin; do
+	if ! flown -A $stale; then
+		echo "ERROR: a flight was not flown in full with the stale surface $stale."
+		exit 1
+	fi
+	if ! $PRED -i gfs -n 1 -A $stale surface-query.ini 2>&1 > /dev/null | \
+		grep -q "^WARN: $stale: flights will be flown in full"; then
+		echo "ERROR: the stale surface $stale was not warned of."
+		exit 1
+	fi
+done
+
+rm -f surface-query.ini surface-sweep.ini surface-lookup.csv surface-flown.csv \
+	surface-log.txt surface-invalid.bin
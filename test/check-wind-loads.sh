@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Check that modes which run the model many times over the same wind data,
+# the live prediction from the fixes in live-fixes.csv, the solver of
+# scenario-9.ini and the descent map of scenario-11.ini, load each wind data
+# file once rather than releasing and loading it again for every run.
+
+PRED=../pred_src/pred
+
+# Fails if any wind data file is loaded more than once in the log on standard
+# input of the mode named $1.
+loaded_once() {
+	grep 'Loading wind data from' | sort | uniq -c | \
+		awk -v mode="$1" '
+		{ n++ }
+		$1 > 1 { 
+			sub(/\.$/, "", $NF);
+			printf("ERROR: %s loaded %s %i times.\n", mode, $NF, $1);
+			failed = 1;
+		}
+		END { 
+			if(n == 0) { printf("ERROR: %s loaded no wind data.\n", mode); exit 1 }
+			exit failed
+		}'
+}
+
+$PRED -v -i gfs -j 1 -l scenario-10.ini < live-fixes.csv 2>&1 > /dev/null | \
+	loaded_once "the live prediction" || exit 1
+$PRED -v -i gfs -e 1 -j 1 scenario-9.ini 2>&1 > /dev/null | \
+	loaded_once "the solver" || exit 1
+$PRED -v -i gfs -j 1 scenario-11.ini 2>&1 > /dev/null | \
+	loaded_once "the descent map" || exit 1
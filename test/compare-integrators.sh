@@ -0,0 +1,63 @@
+#!/bin/sh
+#
+# Check that the Runge-Kutta integrators land an ensemble within a given
+# distance of where the 1 second Euler reference lands it for a normal flight
+# and a long float. The landing point of each member is perturbed at random so
+# compare the mean over the ensemble. Then check the unperturbed flight, which
+# every sigma point of an unscented run with no uncertainties flies, lands
+# within a much smaller distance of the reference, which a wrong stage or
+# step size controller would not.
+#
+# Usage: compare-integrators.sh [max distance (m)] [members] [max unperturbed distance (m)]
+
+PRED=../pred_src/pred
+MAX_DISTANCE=${1:-500}
+MEMBERS=${2:-64}
+MAX_UNPERTURBED=${3:-30}
+
+# Print the mean landing latitude and longitude of the ensemble in file $1.
+mean_landing() {
+	tail -n $MEMBERS $1 | \
+		awk -F, '{ lat += $2; lng += $3 } END { printf("%.6f %.6f\n", lat / NR, lng / NR) }'
+}
+
+# Check that the landing of method $2 is within $4 m of the Euler reference.
+# $1 is "reference latitude, longitude, latitude, longitude" and $3 names the
+# flight.
+compare() {
+	echo "$1" | awk -v method=$2 -v scenario="$3" -v max=$4 '{
+		dlat = ($3 - $1) * 111198.92345;
+		dlng = ($4 - $2) * 111198.92345 * cos($1 * 0.0174532925);
+		d = sqrt(dlat * dlat + dlng * dlng);
+		printf("%s: %s lands %.0fm from euler.\n", scenario, method, d);
+		if(d > max) {
+			printf("ERROR: %s landing is more than %.0fm from euler.\n", method, max);
+			exit 1;
+		}
+	}'
+}
+
+for scenario in scenario-2.ini scenario-3.ini; do
+	$PRED -i gfs -n $MEMBERS -s 42 -m euler $scenario > integrator-euler.csv || exit 1
+	reference=`mean_landing integrator-euler.csv`
+
+	for method in rk4 rk45; do
+		$PRED -i gfs -n $MEMBERS -s 42 -m $method $scenario > integrator-$method.csv || exit 1
+		landing=`mean_landing integrator-$method.csv`
+
+		compare "$reference $landing" $method "$scenario" $MAX_DISTANCE || exit 1
+	done
+
+	$PRED -i gfs -S unscented -m euler $scenario > integrator-euler.csv || exit 1
+	reference=`tail -n 1 integrator-euler.csv | awk -F, '{ print $2, $3 }'`
+
+	for method in rk4 rk45; do
+		$PRED -i gfs -S unscented -m $method $scenario > integrator-$method.csv || exit 1
+		landing=`tail -n 1 integrator-$method.csv | awk -F, '{ print $2, $3 }'`
+
+		compare "$reference $landing" $method "$scenario (unperturbed)" \
+			$MAX_UNPERTURBED || exit 1
+	done
+done
+
+rm -f integrator-*.csv
@@ -0,0 +1,180 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY 
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+// Check the tabulated descent of the altitude model against stepping the
+// terminal velocity of the atmosphere model with a small timestep.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "altitude.h"
+
+#define REFERENCE_STEP 0.01     // s
+#define MAX_ALT_ERROR 1.0       // m
+#define MAX_LANDING_ERROR 1.0   // s
+
+// Step the descent of model with 4th order Runge-Kutta from alt at time t
+// until it lands, comparing with the table every second. Returns non-zero if
+// the errors are within bounds.
+static int
+_check_descent(const char* name, const altitude_model_t* model, 
+               altitude_state_t* state, double t, double alt)
+{
+    double max_error = 0.0, landing_error;
+    int n = 0;
+
+    while(alt > 0.0)
+    {
+        double k1, k2, k3, k4, h = REFERENCE_STEP;
+
+        k1 = altitude_model_get_vertical_speed(model, state, t, alt);
+        k2 = altitude_model_get_vertical_speed(model, state, t, alt + 0.5*h*k1);
+        k3 = altitude_model_get_vertical_speed(model, state, t, alt + 0.5*h*k2);
+        k4 = altitude_model_get_vertical_speed(model, state, t, alt + h*k3);
+        alt += (h / 6.0) * (k1 + 2.0*k2 + 2.0*k3 + k4);
+        t += h;
+
+        if((++n % (int)(1.0 / REFERENCE_STEP)) == 0 && (alt > 0.0)) {
+            float table_alt;
+
+            altitude_model_get_altitude(model, state, t, &table_alt);
+            if(fabs(table_alt - alt) > max_error)
+                max_error = fabs(table_alt - alt);
+        }
+    }
+
+    landing_error = fabs(altitude_model_get_landing_time(model, state) - t);
+
+    printf("%s: largest altitude error %.3fm, landing time error %.3fs.\n",
+           name, max_error, landing_error);
+
+    return (max_error <= MAX_ALT_ERROR) && (landing_error <= MAX_LANDING_ERROR);
+}
+
+// Advance particles with differing parameters together and check each agrees
+// with looking its altitude up on its own. Returns non-zero if they agree.
+static int
+_check_batch(const altitude_model_t* model)
+{
+    altitude_state_t states[ALTITUDE_BATCH_SIZE + 3];
+    altitude_state_t* state_ptrs[ALTITUDE_BATCH_SIZE + 3];
+    float alt[ALTITUDE_BATCH_SIZE + 3];
+    int flying[ALTITUDE_BATCH_SIZE + 3];
+    unsigned int i, n = ALTITUDE_BATCH_SIZE + 3, n_wrong = 0;
+    double t;
+
+    for(i=0; i<n; ++i) {
+        altitude_params_t params;
+
+        altitude_model_get_params(model, &params);
+        params.burst_altitude *= 0.8f + 0.025f * i;
+        params.ascent_rate *= 0.9f + 0.01f * i;
+        params.drag_coeff *= 0.9f + 0.01f * i;
+        altitude_model_start(model, &states[i], 100.f, &params);
+        state_ptrs[i] = &states[i];
+    }
+
+    for(t=0.0; t<20000.0; t+=37.5) {
+        altitude_model_advance(model, n, state_ptrs, t, alt, flying);
+
+        for(i=0; i<n; ++i) {
+            float single_alt;
+            int single_flying;
+
+            single_flying = altitude_model_get_altitude(model, &states[i], t, &single_alt);
+            if((single_flying != flying[i]) || (single_alt != alt[i]))
+                ++n_wrong;
+        }
+    }
+
+    printf("batch: %u disagreements with single particle lookups.\n", n_wrong);
+
+    return n_wrong == 0;
+}
+
+// Follow a profile which ascends as the analytic model does and then floats
+// for FLOAT_TIME, looking it up at times in no particular order. Returns
+// non-zero if it agrees with the analytic model floating for as long.
+#define FLOAT_TIME 3600.0
+
+static int
+_check_profile(const char* filename)
+{
+    altitude_model_t *model, *profile;
+    altitude_state_t state, profile_state;
+    double t, landing_error, max_error = 0.0;
+    unsigned int i;
+
+    profile = altitude_model_new_from_file(filename, 5.f * 1.1045f);
+    if(!profile)
+        return 0;
+
+    model = altitude_model_new(DESCENT_MODE_NORMAL, 30000.f, 3.f, 5.f * 1.1045f, FLOAT_TIME);
+    altitude_model_start(model, &state, 0.f, NULL);
+    altitude_model_start(profile, &profile_state, 0.f, NULL);
+
+    for(i=0; i<1000; ++i) {
+        float alt, profile_alt;
+
+        // Wander back and forth through the flight.
+        t = fmod(i * 7919.37, altitude_model_get_landing_time(profile, &profile_state));
+
+        altitude_model_get_altitude(profile, &profile_state, t, &profile_alt);
+        altitude_model_get_altitude(model, &state, t, &alt);
+
+        if(fabs(profile_alt - alt) > max_error)
+            max_error = fabs(profile_alt - alt);
+    }
+
+    landing_error = fabs(altitude_model_get_landing_time(profile, &profile_state) - 
+                         altitude_model_get_landing_time(model, &state));
+
+    printf("profile: largest altitude error %.3fm, landing time error %.3fs.\n",
+           max_error, landing_error);
+
+    altitude_model_free(model);
+    altitude_model_free(profile);
+
+    return (max_error <= MAX_ALT_ERROR) && (landing_error <= MAX_LANDING_ERROR);
+}
+
+int main(int argc, const char *argv[])
+{
+    altitude_model_t* model;
+    altitude_state_t state;
+    int ok = 1;
+
+    // A normal flight bursting at 30km descending at 5m/s at sea level.
+    model = altitude_model_new(DESCENT_MODE_NORMAL, 30000.f, 5.f, 5.f * 1.1045f, 0.f);
+    altitude_model_start(model, &state, 100.f, NULL);
+    ok &= _check_descent("ascent and descent", model, &state,
+                         altitude_model_get_burst_time(model, &state), 
+                         100.0 + altitude_model_get_burst_time(model, &state) * 5.0);
+    ok &= _check_batch(model);
+    altitude_model_free(model);
+
+    // A fast descent from the top of the stratosphere.
+    model = altitude_model_new(DESCENT_MODE_DESCENDING, 0.f, 0.f, 20.f * 1.1045f, 0.f);
+    altitude_model_start(model, &state, 45000.f, NULL);
+    ok &= _check_descent("descent", model, &state, 0.0, 45000.0);
+    altitude_model_free(model);
+
+    ok &= _check_profile("float-profile.csv");
+
+    if(!ok) {
+        fprintf(stderr, "ERROR: tabulated descent differs from the atmosphere model.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+// vim:sw=4:ts=4:et:cindent
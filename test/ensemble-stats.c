@@ -0,0 +1,131 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+
+// Check that moments accumulated in parts and merged agree with those found
+// by the two-pass formula and that altitude percentiles are found to within a
+// bin.
+
+#include <stdio.h>
+#include <math.h>
+
+#include "ensemble_stats.h"
+
+#define N_POINTS 100000
+#define N_PARTS 7
+#define MAX_ERROR 1e-9
+
+// A spread of positions around Cambridge at around 20km.
+static void
+_point(unsigned int i, double* x)
+{
+    x[0] = 52.2 + 0.05 * sin(i * 0.7) * cos(i * 0.013);
+    x[1] = 0.1 + 0.08 * cos(i * 1.3) * sin(i * 0.029) + 0.3 * (x[0] - 52.2);
+    x[2] = 20000.0 + 5000.0 * sin(i * 0.0031);
+}
+
+// Returns non-zero if moments merged from parts match the two-pass mean and
+// covariance.
+static int
+_check_moments(void)
+{
+    ensemble_moments_t merged, parts[N_PARTS];
+    double mean[3] = { 0.0, 0.0, 0.0 }, cov[3][3], x[3], max_error = 0.0;
+    unsigned int i, j, k;
+
+    for(i=0; i<N_PARTS; ++i)
+        ensemble_moments_reset(&(parts[i]));
+
+    for(i=0; i<N_POINTS; ++i) {
+        _point(i, x);
+        for(j=0; j<3; ++j)
+            mean[j] += x[j] / N_POINTS;
+        ensemble_moments_add(&(parts[(i * N_PARTS) / N_POINTS]), x);
+    }
+
+    for(j=0; j<3; ++j)
+        for(k=0; k<3; ++k)
+            cov[j][k] = 0.0;
+
+    for(i=0; i<N_POINTS; ++i) {
+        _point(i, x);
+        for(j=0; j<3; ++j)
+            for(k=0; k<3; ++k)
+                cov[j][k] += (x[j] - mean[j]) * (x[k] - mean[k]) / N_POINTS;
+    }
+
+    ensemble_moments_reset(&merged);
+    for(i=0; i<N_PARTS; ++i)
+        ensemble_moments_merge(&merged, &(parts[i]));
+
+    // Compare relative to the spread of each coordinate.
+    for(j=0; j<3; ++j) {
+        double error = fabs(merged.mean[j] - mean[j]) / sqrt(cov[j][j]);
+
+        if(error > max_error)
+            max_error = error;
+
+        for(k=0; k<3; ++k) {
+            error = fabs(ensemble_moments_covariance(&merged, j, k) - cov[j][k]) / 
+                sqrt(cov[j][j] * cov[k][k]);
+            if(error > max_error)
+                max_error = error;
+        }
+    }
+
+    printf("moments: %.0f points in %i parts, largest relative error %.2e.\n",
+           merged.n, N_PARTS, max_error);
+
+    return (merged.n == N_POINTS) && (max_error <= MAX_ERROR);
+}
+
+// Returns non-zero if the percentiles of altitudes spread evenly over 10km to
+// 30km are right to within a bin.
+static int
+_check_percentiles(void)
+{
+    altitude_histogram_t histogram;
+    double p[3] = { 0.05, 0.5, 0.95 };
+    unsigned int i;
+    int ok = 1;
+
+    altitude_histogram_reset(&histogram);
+    for(i=0; i<N_POINTS; ++i)
+        altitude_histogram_add(&histogram, 10000.0 + (20000.0 * i) / N_POINTS);
+
+    for(i=0; i<3; ++i) {
+        float alt = altitude_histogram_percentile(&histogram, p[i]);
+        float expected = 10000.0 + 20000.0 * p[i];
+
+        printf("percentiles: %.0f%% below %.1fm, expected %.1fm.\n", 
+               100.0 * p[i], alt, expected);
+        if(fabs(alt - expected) > ALTITUDE_HISTOGRAM_BIN)
+            ok = 0;
+    }
+
+    return ok;
+}
+
+int main(int argc, const char *argv[])
+{
+    int ok = 1;
+
+    ok &= _check_moments();
+    ok &= _check_percentiles();
+
+    if(!ok) {
+        fprintf(stderr, "ERROR: ensemble statistics check failed.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+// vim:sw=4:ts=4:et:cindent
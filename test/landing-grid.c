@@ -0,0 +1,152 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+// Check that landing grids accumulated in parts and merged agree with one
+// accumulated in one go, that the probabilities sum to one and that the
+// binary file can be read back.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "landing_grid.h"
+
+#define N_LANDINGS 10000
+#define N_PARTS 3
+#define MAX_ERROR 1e-9
+
+// A spread of landings around Cambridge.
+static void
+_landing(unsigned int i, float* lat, float* lng)
+{
+    *lat = 52.2f + 0.05f * sinf(i * 0.7f) * cosf(i * 0.013f);
+    *lng = 0.1f + 0.08f * cosf(i * 1.3f) * sinf(i * 0.029f);
+}
+
+// Returns non-zero if the grid built in parts matches the one built in one go
+// and the probabilities sum to one.
+static int
+_check_merge(const char* name, float bandwidth)
+{
+    landing_grid_t *whole, *merged, *parts[N_PARTS];
+    unsigned int i, j, n_lat, n_lng;
+    double max_error = 0.0, sum = 0.0;
+
+    whole = landing_grid_new(52.15f, 0.02f, 52.25f, 0.18f, 250.f, bandwidth);
+    merged = landing_grid_new_like(whole);
+    for(i=0; i<N_PARTS; ++i)
+        parts[i] = landing_grid_new_like(whole);
+
+    for(i=0; i<N_LANDINGS; ++i) {
+        float lat, lng;
+
+        _landing(i, &lat, &lng);
+        landing_grid_add(whole, lat, lng, 1.0);
+        landing_grid_add(parts[(i * N_PARTS) / N_LANDINGS], lat, lng, 1.0);
+    }
+
+    for(i=0; i<N_PARTS; ++i) {
+        landing_grid_merge(merged, parts[i]);
+        landing_grid_free(parts[i]);
+    }
+
+    landing_grid_get_size(whole, &n_lat, &n_lng);
+    for(i=0; i<n_lat; ++i) {
+        for(j=0; j<n_lng; ++j) {
+            double p = landing_grid_get_probability(whole, i, j);
+
+            sum += p;
+            if(fabs(p - landing_grid_get_probability(merged, i, j)) > max_error)
+                max_error = fabs(p - landing_grid_get_probability(merged, i, j));
+        }
+    }
+
+    printf("%s: %ux%u cells, probabilities sum to %.9f, largest merge error %.2e.\n",
+           name, n_lat, n_lng, sum, max_error);
+
+    landing_grid_free(whole);
+    landing_grid_free(merged);
+
+    return (max_error <= MAX_ERROR) && (fabs(sum - 1.0) <= MAX_ERROR);
+}
+
+// Returns non-zero if a grid written in the binary format can be read back.
+static int
+_check_binary(const char* filename)
+{
+    landing_grid_t* grid;
+    landing_grid_header_t header;
+    unsigned int i, n_lat, n_lng, n_values;
+    float* values;
+    double sum = 0.0;
+    FILE* file;
+    int ok;
+
+    grid = landing_grid_new(52.15f, 0.02f, 52.25f, 0.18f, 500.f, 0.f);
+    for(i=0; i<N_LANDINGS; ++i) {
+        float lat, lng;
+
+        _landing(i, &lat, &lng);
+        landing_grid_add(grid, lat, lng, 1.0);
+    }
+    landing_grid_get_size(grid, &n_lat, &n_lng);
+
+    if(!landing_grid_write(grid, filename)) {
+        landing_grid_free(grid);
+        return 0;
+    }
+    landing_grid_free(grid);
+
+    file = fopen(filename, "rb");
+    if(!file || (fread(&header, sizeof(header), 1, file) != 1)) {
+        fprintf(stderr, "ERROR: %s: could not read landing grid header\n", filename);
+        if(file)
+            fclose(file);
+        return 0;
+    }
+
+    n_values = header.n_lat * header.n_lng;
+    values = (float*)malloc(sizeof(float) * n_values);
+    ok = (fread(values, sizeof(float), n_values, file) == n_values);
+    fclose(file);
+
+    for(i=0; ok && (i<n_values); ++i)
+        sum += values[i];
+    free(values);
+
+    ok = ok && !memcmp(header.magic, LANDING_GRID_MAGIC, sizeof(header.magic)) &&
+        (header.version == LANDING_GRID_VERSION) &&
+        (header.n_lat == n_lat) && (header.n_lng == n_lng) &&
+        (fabs(sum - 1.0) <= 1e-5);
+
+    printf("binary: read back %ux%u cells summing to %.6f.\n",
+           header.n_lat, header.n_lng, sum);
+
+    return ok;
+}
+
+int main(int argc, const char *argv[])
+{
+    int ok = 1;
+
+    ok &= _check_merge("histogram", 0.f);
+    ok &= _check_merge("kernel", 600.f);
+    ok &= _check_binary("landing-grid.bin");
+
+    if(!ok) {
+        fprintf(stderr, "ERROR: landing grid check failed.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+// vim:sw=4:ts=4:et:cindent
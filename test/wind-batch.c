@@ -0,0 +1,146 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+// Check that the batched wind interpolation gives bit-for-bit the same
+// results as wind_file_get_wind() with every instruction set this CPU can
+// run. The thread and packet invariance of the predictor depends on it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wind/wind_file.h"
+
+#define WIND_FILE "gfs/gfs_1257951600_52_0.0_5_5.dat"
+#define N_PARTICLES 64
+#define N_STEPS 200
+
+int verbosity = 0;
+
+static const char* _isas[] = { "scalar", "SSE2", "AVX2" };
+
+// A small generator so that every run checks the same points.
+static float
+_uniform(unsigned long* state)
+{
+    *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+    return (float)((*state >> 40) & 0xffffff) / (float)0x1000000;
+}
+
+// Move each particle a little way, as if it were flying, occasionally
+// jumping somewhere new, sometimes off the tile.
+static void
+_move(unsigned long* state, float* lat, float* lng, float* alt)
+{
+    unsigned int i;
+
+    for(i=0; i<N_PARTICLES; ++i)
+    {
+        if((_uniform(state) < 0.02f) || (alt[i] <= 0.f)) {
+            lat[i] = 46.f + 12.f * _uniform(state);
+            lng[i] = -6.f + 12.f * _uniform(state);
+            alt[i] = 35000.f * _uniform(state);
+        } else {
+            lat[i] += 0.05f * (_uniform(state) - 0.5f);
+            lng[i] += 0.05f * (_uniform(state) - 0.5f);
+            alt[i] += 400.f * (_uniform(state) - 0.3f);
+        }
+    }
+}
+
+// Returns non-zero if the batches of packet_size particles with the
+// instruction set isa match the scalar interpolation.
+static int
+_check_batch(wind_file_t* file, const char* isa, unsigned int packet_size)
+{
+    wind_file_cursor_t scalar_cursors[N_PARTICLES], batch_cursors[N_PARTICLES];
+    wind_file_cursor_t* cursors[N_PARTICLES];
+    float lat[N_PARTICLES], lng[N_PARTICLES], alt[N_PARTICLES];
+    float u[N_PARTICLES], v[N_PARTICLES], uvar[N_PARTICLES], vvar[N_PARTICLES];
+    unsigned long state = 42;
+    unsigned int i, step, n_mismatches = 0, n_calls = 0;
+
+    for(i=0; i<N_PARTICLES; ++i)
+    {
+        wind_file_cursor_init(&scalar_cursors[i]);
+        wind_file_cursor_init(&batch_cursors[i]);
+        cursors[i] = &batch_cursors[i];
+        alt[i] = 0.f;
+    }
+
+    for(step=0; step<N_STEPS; ++step)
+    {
+        _move(&state, lat, lng, alt);
+
+        for(i=0; i<N_PARTICLES; i+=packet_size)
+        {
+            unsigned int n = (N_PARTICLES - i < packet_size) ? N_PARTICLES - i : packet_size;
+
+            wind_file_get_wind_batch(file, &cursors[i], n, &lat[i], &lng[i], &alt[i],
+                                     &u[i], &v[i], &uvar[i], &vvar[i]);
+            ++n_calls;
+        }
+
+        for(i=0; i<N_PARTICLES; ++i)
+        {
+            float su, sv, suvar, svvar;
+
+            wind_file_get_wind(file, &scalar_cursors[i], lat[i], lng[i], alt[i],
+                               &su, &sv, &suvar, &svvar);
+
+            if(memcmp(&su, &u[i], sizeof(float)) || memcmp(&sv, &v[i], sizeof(float)) ||
+               memcmp(&suvar, &uvar[i], sizeof(float)) ||
+               memcmp(&svvar, &vvar[i], sizeof(float)))
+                ++n_mismatches;
+        }
+    }
+
+    printf("%s: %u calls of %u particles, %u of %u results differ from the scalar "
+           "interpolation.\n", isa, n_calls, packet_size, n_mismatches,
+           N_STEPS * N_PARTICLES);
+
+    return n_mismatches == 0;
+}
+
+int main(int argc, const char *argv[])
+{
+    wind_file_t* file;
+    unsigned int i;
+    int ok = 1;
+
+    file = wind_file_new(WIND_FILE);
+    if(!file) {
+        fprintf(stderr, "ERROR: %s: could not load wind data.\n", WIND_FILE);
+        return 1;
+    }
+
+    for(i=0; i<sizeof(_isas)/sizeof(_isas[0]); ++i)
+    {
+        if(!wind_file_batch_use(_isas[i])) {
+            printf("%s: not supported by this CPU, skipped.\n", _isas[i]);
+            continue;
+        }
+
+        ok &= _check_batch(file, _isas[i], WIND_FILE_BATCH_SIZE);
+        ok &= _check_batch(file, _isas[i], 3);
+        ok &= _check_batch(file, _isas[i], N_PARTICLES);
+    }
+
+    wind_file_free(file);
+
+    if(!ok) {
+        fprintf(stderr, "ERROR: wind batch check failed.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+// vim:sw=4:ts=4:et:cindent
@@ -0,0 +1,94 @@
+// --------------------------------------------------------------
+// CU Spaceflight Landing Prediction
+// Copyright (c) CU Spaceflight 2009, All Right Reserved
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+// KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+// --------------------------------------------------------------
+
+// Check that the value of the wind interpolated in dual numbers is the wind
+// wind_file_get_wind() interpolates at the same point, to within the
+// rounding of its single precision arithmetic. The sensitivity of a landing
+// is only that of the predicted landing if it is.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "wind/wind_file.h"
+#include "wind/wind_file_dual.h"
+
+#define WIND_FILE "gfs/gfs_1257951600_52_0.0_5_5.dat"
+#define N_POINTS 20000
+
+// The largest difference (m/s) allowed between the two.
+#define MAX_DIFFERENCE 1e-4
+
+int verbosity = 0;
+
+// A small generator so that every run checks the same points.
+static float
+_uniform(unsigned long* state)
+{
+    *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+    return (float)((*state >> 40) & 0xffffff) / (float)0x1000000;
+}
+
+int main(int argc, const char *argv[])
+{
+    wind_file_t* file;
+    wind_file_cursor_t cursor, dual_cursor;
+    unsigned long state = 42;
+    double max_difference = 0.0;
+    unsigned int i, n_bad = 0;
+
+    file = wind_file_new(WIND_FILE);
+    if(!file) {
+        fprintf(stderr, "ERROR: %s: could not load wind data.\n", WIND_FILE);
+        return 1;
+    }
+
+    wind_file_cursor_init(&cursor);
+    wind_file_cursor_init(&dual_cursor);
+
+    for(i=0; i<N_POINTS; ++i)
+    {
+        float lat = 46.f + 12.f * _uniform(&state);
+        float lng = -6.f + 12.f * _uniform(&state);
+        float alt = 35000.f * _uniform(&state);
+        dual_t dual_lat = dual_variable(lat, 0);
+        dual_t dual_lng = dual_variable(lng, 1);
+        dual_t dual_alt = dual_variable(alt, 2);
+        float u, v, uvar, vvar;
+        dual_t dual_u, dual_v;
+        double difference;
+
+        wind_file_get_wind(file, &cursor, lat, lng, alt, &u, &v, &uvar, &vvar);
+        wind_file_get_wind_dual(file, &dual_cursor, &dual_lat, &dual_lng, &dual_alt, 
+                                &dual_u, &dual_v);
+
+        difference = fabs(dual_u.x - u);
+        if(fabs(dual_v.x - v) > difference)
+            difference = fabs(dual_v.x - v);
+        if(!(difference <= MAX_DIFFERENCE))
+            ++n_bad;
+        if(difference > max_difference)
+            max_difference = difference;
+    }
+
+    wind_file_free(file);
+
+    printf("%u of %u dual winds differ from the float wind by more than %gm/s, "
+           "at most %gm/s.\n", n_bad, N_POINTS, MAX_DIFFERENCE, max_difference);
+
+    if(n_bad > 0) {
+        fprintf(stderr, "ERROR: wind dual check failed.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+// vim:sw=4:ts=4:et:cindent
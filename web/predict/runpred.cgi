@@ -42,9 +42,16 @@ def main():
     form = cgi.FieldStorage()
     ini = form_to_ini(form)
 
+    # Answer from the response surface, and only run the full prediction if
+    # it cannot. The data cronjob rebuilds the surface after each download;
+    # pred warns of and ignores one built for other wind data.
+    args = [config.LAND_PRED_APP, '-v', '-i', config.LAND_PRED_DATA]
+    surface = getattr(config, 'LAND_PRED_SURFACE', None)
+    if surface and os.path.exists(surface):
+        args.extend(('-A', surface))
+
     # Try to wire everything up
-    pred_process = subprocess.Popen( \
-        (config.LAND_PRED_APP, '-v', '-i', config.LAND_PRED_DATA),
+    pred_process = subprocess.Popen(args,
         stdout=subprocess.PIPE, stderr=subprocess.PIPE, stdin=subprocess.PIPE)
     (output, log) = pred_process.communicate(ini)
 